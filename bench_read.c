@@ -0,0 +1,518 @@
+// Multiscale Electrophysiology Format (MEF) version 3.0
+// Copyright 2022, Mayo Foundation, Rochester MN. All rights reserved.
+
+// Usage and modification of this source code is governed by the Apache 2.0 license.
+// You may not use this file except in compliance with this License.
+// A copy of the Apache 2.0 License may be obtained at http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under this License is distributed on an "as is" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either expressed or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Thanks to all who acknowledge the Mayo Systems Electrophysiology Laboratory, Rochester, MN
+// in academic publications of their work facilitated by this software.
+
+// Read throughput benchmark.  Writes a synthetic MEF 3.0 channel (sampling rate, block size, number of segments, gaps
+// and encryption set on the command line), then times read_mef_ts_data_by_time() and read_mef_ts_data_by_samp() over a
+// set of scenarios.  Results are written one JSON object per line, to bench_output.txt unless -out is given.  With
+// -verify, every block written is also decoded both with meflib's RED_decode() and with the reader's own decoder,
+// which must agree exactly, and the output of every read is compared with the samples the channel was written with;
+// the program exits with status 1 if any block or read differs.
+//
+// The channel is written by synthetic_channel.c.  Build with it, meflib.c and mefrec.c, for example:
+//     cc -O2 bench_read.c synthetic_channel.c read_mef_ts_data.c meflib.c mefrec.c -lpthread -lm -o bench_read
+//
+// Options (defaults in brackets):
+//     -dir <path>         where the channel is written [mef_bench]
+//     -rate <Hz>          sampling frequency [1000]
+//     -block <samples>    samples per block [1000]
+//     -segments <n>       number of segments [4]
+//     -seconds <s>        recording length of each segment [600]
+//     -gap_every <n>      insert a gap after every n blocks, 0 for none [0]
+//     -gap_ms <ms>        length of each gap [500]
+//     -encrypt            encrypt blocks with a level 1 password
+//     -software_aes       decrypt with meflib's AES only, not AES-NI
+//     -meflib_decode      decode every block with meflib's RED_decode(), not the reader's own decoder
+//     -reads <n>          reads per small-window scenario [1000]
+//     -threads <n>        threads for the multi-threaded scenarios, 0 for one per processor [0]
+//     -out <path>         results file [bench_output.txt]
+//     -keep               reuse an existing channel in -dir instead of writing a new one
+//     -verify             check every block written decodes the same with both decoders, and every read's output
+//                         against the written samples (a kept channel must have been written with the same options,
+//                         and its blocks aren't checked); timings then include the checks
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "synthetic_channel.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <time.h>
+#else
+#include <windows.h>
+#endif
+
+extern MEF_GLOBALS *MEF_globals;
+
+#define BENCH_CHANNEL_NAME  "bench"
+
+typedef struct {
+    si1     dir[MEF_FULL_FILE_NAME_BYTES];
+    sf8     rate;
+    si4     block_samples;
+    si4     segments;
+    sf8     seconds;
+    si4     gap_every;
+    sf8     gap_ms;
+    si4     encrypt;
+    si4     software_aes;
+    si4     meflib_decode;
+    si4     reads;
+    si4     threads;
+    si1     out[MEF_FULL_FILE_NAME_BYTES];
+    si4     keep;
+    si4     verify;
+} BENCH_CONFIG;
+
+// one timed scenario: latencies of each read, and totals
+typedef struct {
+    sf8     *latency;       // seconds
+    si4     n_reads;
+    si8     samples;
+    sf8     seconds;
+    si4     mismatches;     // reads whose output differed from the written samples (-verify)
+} BENCH_RESULT;
+
+/**************************  Timing  ****************************/
+
+static sf8 bench_now(void)
+{
+#ifndef _WIN32
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (sf8) ts.tv_sec + ((sf8) ts.tv_nsec * 1e-9);
+#else
+    LARGE_INTEGER count, frequency;
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (sf8) count.QuadPart / (sf8) frequency.QuadPart;
+#endif
+}
+
+static si4 compare_sf8(const void *a, const void *b)
+{
+    sf8 x, y;
+
+    x = *((sf8 *) a);
+    y = *((sf8 *) b);
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static sf8 percentile(sf8 *sorted, si4 n, sf8 p)
+{
+    si4 i;
+
+    if (n <= 0)
+        return 0.0;
+    i = (si4) ((p * (n - 1)) + 0.5);
+    return sorted[i];
+}
+
+/**************************  Synthetic channel  ****************************/
+
+// the channel the options describe, written by synthetic_channel.c
+static void bench_synthetic_channel(BENCH_CONFIG *config, SYNTHETIC_CHANNEL *synth)
+{
+    initialize_synthetic_channel(synth);
+    MEF_strncpy(synth->dir, config->dir, MEF_FULL_FILE_NAME_BYTES);
+    MEF_strncpy(synth->name, BENCH_CHANNEL_NAME, MEF_BASE_FILE_NAME_BYTES);
+    synth->rate = config->rate;
+    synth->block_samples = config->block_samples;
+    synth->seconds = config->seconds;
+    synth->gap_every = config->gap_every;
+    synth->gap_ms = config->gap_ms;
+    synth->encrypt = config->encrypt;
+}
+
+/**************************  Scenarios  ****************************/
+
+// a window of a read: by time (start and end times) or by sample
+typedef struct {
+    si8     start;
+    si8     end;
+} BENCH_WINDOW;
+
+static void run_reads(CHANNEL *channel, BENCH_WINDOW *windows, si4 n_windows, si4 by_time, si4 *buffer, SYNTHETIC_TRUTH *truth, BENCH_RESULT *result)
+{
+    sf8 t0, t1, start;
+    si4 i, n;
+
+    result->latency = (sf8 *) malloc(sizeof(sf8) * (size_t) n_windows);
+    result->n_reads = n_windows;
+    result->samples = 0;
+    result->mismatches = 0;
+
+    start = bench_now();
+    for (i = 0; i < n_windows; i++)
+    {
+        t0 = bench_now();
+        if (by_time)
+            n = read_mef_ts_data_by_time(NULL, NULL, windows[i].start, windows[i].end, buffer, channel);
+        else
+            n = read_mef_ts_data_by_samp(NULL, NULL, windows[i].start, windows[i].end, buffer, channel);
+        t1 = bench_now();
+        result->latency[i] = t1 - t0;
+        if (n > 0)
+            result->samples += n;
+        if ((truth != NULL) && !check_synthetic_read(truth, windows[i].start, windows[i].end, by_time, buffer, n))
+            result->mismatches++;
+    }
+    result->seconds = bench_now() - start;
+}
+
+static void report(FILE *out, BENCH_CONFIG *config, si1 *scenario, si1 *mode, si4 threads, BENCH_RESULT *result)
+{
+    qsort(result->latency, (size_t) result->n_reads, sizeof(sf8), compare_sf8);
+
+    fprintf(out, "{\"scenario\":\"%s\",\"mode\":\"%s\",\"threads\":%d,\"io_mode\":%d,\"rate\":%.3f,\"block_samples\":%d,"
+            "\"segments\":%d,\"gap_every\":%d,\"encrypted\":%d,\"hardware_aes\":%d,\"module_decode\":%d,\"reads\":%d,\"samples\":%lld,\"seconds\":%.6f,"
+            "\"samples_per_sec\":%.1f,\"latency_us_p50\":%.1f,\"latency_us_p99\":%.1f,\"latency_us_max\":%.1f",
+            scenario, mode, threads, get_read_mef_ts_data_io_mode(), config->rate, config->block_samples, config->segments,
+            config->gap_every, config->encrypt, !config->software_aes, !config->meflib_decode, result->n_reads, (long long) result->samples, result->seconds,
+            (result->seconds > 0.0) ? ((sf8) result->samples / result->seconds) : 0.0,
+            percentile(result->latency, result->n_reads, 0.5) * 1e6, percentile(result->latency, result->n_reads, 0.99) * 1e6,
+            percentile(result->latency, result->n_reads, 1.0) * 1e6);
+    if (config->verify)
+        fprintf(out, ",\"mismatches\":%d", result->mismatches);
+    fprintf(out, "}\n");
+    fflush(out);
+
+    free (result->latency);
+    result->latency = NULL;
+}
+
+// converts sample windows to the equivalent time windows
+static void windows_to_times(CHANNEL *channel, BENCH_WINDOW *windows, BENCH_WINDOW *time_windows, si4 n)
+{
+    si4 i;
+
+    for (i = 0; i < n; i++)
+    {
+        time_windows[i].start = uutc_for_sample_c(windows[i].start, channel);
+        time_windows[i].end = uutc_for_sample_c(windows[i].end, channel);
+    }
+}
+
+// runs a set of sample windows, and the same windows by time; returns the number of reads that failed verification
+static si4 run_scenario(FILE *out, BENCH_CONFIG *config, CHANNEL *channel, si1 *scenario, BENCH_WINDOW *windows, si4 n, si4 threads, si4 *buffer,
+                        SYNTHETIC_TRUTH *truth)
+{
+    BENCH_WINDOW *time_windows;
+    BENCH_RESULT result;
+    si4 mismatches;
+
+    set_read_mef_ts_data_num_threads(threads);
+
+    run_reads(channel, windows, n, 0, buffer, truth, &result);
+    mismatches = result.mismatches;
+    report(out, config, scenario, "by_samp", threads, &result);
+
+    time_windows = (BENCH_WINDOW *) malloc(sizeof(BENCH_WINDOW) * (size_t) n);
+    windows_to_times(channel, windows, time_windows, n);
+    run_reads(channel, time_windows, n, 1, buffer, truth, &result);
+    mismatches += result.mismatches;
+    report(out, config, scenario, "by_time", threads, &result);
+    free (time_windows);
+
+    set_read_mef_ts_data_num_threads(1);
+
+    return mismatches;
+}
+
+// concurrent readers: each thread has its own CHANNEL, and reads its share of the windows
+typedef struct {
+    CHANNEL         *channel;
+    BENCH_WINDOW    *windows;
+    si4             n_windows;
+    si4             *buffer;
+    SYNTHETIC_TRUTH     *truth;
+    BENCH_RESULT    result;
+} BENCH_THREAD;
+
+#ifndef _WIN32
+static void *bench_thread(void *arg)
+#else
+static DWORD WINAPI bench_thread(LPVOID arg)
+#endif
+{
+    BENCH_THREAD *thread;
+
+    thread = (BENCH_THREAD *) arg;
+    run_reads(thread->channel, thread->windows, thread->n_windows, 1, thread->buffer, thread->truth, &thread->result);
+
+    return 0;
+}
+
+// returns the number of reads that failed verification
+static si4 run_concurrent(FILE *out, BENCH_CONFIG *config, si1 *channel_path, BENCH_WINDOW *time_windows, si4 n, si4 n_threads, si4 max_window,
+                          SYNTHETIC_TRUTH *truth)
+{
+    BENCH_THREAD *threads;
+    BENCH_RESULT result;
+    sf8 start;
+    si4 t, i, k;
+#ifndef _WIN32
+    pthread_t *handles;
+
+    handles = (pthread_t *) malloc(sizeof(pthread_t) * (size_t) n_threads);
+#else
+    HANDLE *handles;
+
+    handles = (HANDLE *) malloc(sizeof(HANDLE) * (size_t) n_threads);
+#endif
+    threads = (BENCH_THREAD *) calloc((size_t) n_threads, sizeof(BENCH_THREAD));
+    for (t = 0; t < n_threads; t++)
+    {
+        threads[t].channel = read_MEF_channel(NULL, channel_path, TIME_SERIES_CHANNEL_TYPE, config->encrypt ? SYNTHETIC_PASSWORD : NULL, NULL, MEF_FALSE, MEF_FALSE);
+        threads[t].windows = time_windows + ((n / n_threads) * t);
+        threads[t].n_windows = (t == n_threads - 1) ? (n - ((n / n_threads) * t)) : (n / n_threads);
+        threads[t].buffer = (si4 *) malloc(sizeof(si4) * (size_t) (max_window + 1));
+        threads[t].truth = truth;
+    }
+
+    start = bench_now();
+    for (t = 0; t < n_threads; t++)
+#ifndef _WIN32
+        pthread_create(&handles[t], NULL, bench_thread, &threads[t]);
+    for (t = 0; t < n_threads; t++)
+        pthread_join(handles[t], NULL);
+#else
+        handles[t] = CreateThread(NULL, 0, bench_thread, &threads[t], 0, NULL);
+    WaitForMultipleObjects((DWORD) n_threads, handles, TRUE, INFINITE);
+    for (t = 0; t < n_threads; t++)
+        CloseHandle(handles[t]);
+#endif
+
+    // combined latencies, over the wall clock time of all threads
+    result.latency = (sf8 *) malloc(sizeof(sf8) * (size_t) n);
+    result.n_reads = 0;
+    result.samples = 0;
+    result.mismatches = 0;
+    result.seconds = bench_now() - start;
+    for (t = 0, k = 0; t < n_threads; t++)
+    {
+        for (i = 0; i < threads[t].result.n_reads; i++)
+            result.latency[k++] = threads[t].result.latency[i];
+        result.n_reads += threads[t].result.n_reads;
+        result.samples += threads[t].result.samples;
+        result.mismatches += threads[t].result.mismatches;
+        free (threads[t].result.latency);
+        free (threads[t].buffer);
+        release_channel_reader_state(threads[t].channel);
+        free_channel(threads[t].channel, MEF_TRUE);
+    }
+    n = result.mismatches;
+    report(out, config, "random_small_concurrent", "by_time", n_threads, &result);
+
+    free (threads);
+    free (handles);
+
+    return n;
+}
+
+/**************************  Main  ****************************/
+
+static void usage(void)
+{
+    printf("usage: bench_read [-dir path] [-rate Hz] [-block samples] [-segments n] [-seconds s] [-gap_every n] [-gap_ms ms]\n"
+           "                  [-encrypt] [-software_aes] [-meflib_decode] [-reads n] [-threads n] [-out path] [-keep] [-verify]\n");
+}
+
+int main(int argc, char **argv)
+{
+    BENCH_CONFIG config;
+    SYNTHETIC_CHANNEL synth;
+    SYNTHETIC_TRUTH truth;
+    CHANNEL *channel;
+    BENCH_WINDOW *windows, *time_windows;
+    FILE *out;
+    si1 channel_path[MEF_FULL_FILE_NAME_BYTES];
+    si4 *buffer;
+    si4 i, n, threads, window, max_window, mismatches, decode_mismatches;
+    si8 total_samples, segment_samples, boundary;
+    ui8 random_state;
+
+    memset(&config, 0, sizeof(config));
+    MEF_strncpy(config.dir, "mef_bench", MEF_FULL_FILE_NAME_BYTES);
+    MEF_strncpy(config.out, "bench_output.txt", MEF_FULL_FILE_NAME_BYTES);
+    config.rate = 1000.0;
+    config.block_samples = 1000;
+    config.segments = 4;
+    config.seconds = 600.0;
+    config.gap_ms = 500.0;
+    config.reads = 1000;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-encrypt"))
+            config.encrypt = 1;
+        else if (!strcmp(argv[i], "-software_aes"))
+            config.software_aes = 1;
+        else if (!strcmp(argv[i], "-meflib_decode"))
+            config.meflib_decode = 1;
+        else if (!strcmp(argv[i], "-keep"))
+            config.keep = 1;
+        else if (!strcmp(argv[i], "-verify"))
+            config.verify = 1;
+        else if (i + 1 >= argc)
+        {
+            usage();
+            return 1;
+        }
+        else if (!strcmp(argv[i], "-dir"))
+            MEF_strncpy(config.dir, argv[++i], MEF_FULL_FILE_NAME_BYTES);
+        else if (!strcmp(argv[i], "-out"))
+            MEF_strncpy(config.out, argv[++i], MEF_FULL_FILE_NAME_BYTES);
+        else if (!strcmp(argv[i], "-rate"))
+            config.rate = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-block"))
+            config.block_samples = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-segments"))
+            config.segments = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-seconds"))
+            config.seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-gap_every"))
+            config.gap_every = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-gap_ms"))
+            config.gap_ms = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-reads"))
+            config.reads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-threads"))
+            config.threads = atoi(argv[++i]);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if ((config.rate <= 0.0) || (config.block_samples <= 0) || (config.segments <= 0) || (config.seconds <= 0.0) || (config.reads <= 0))
+    {
+        usage();
+        return 1;
+    }
+    threads = (config.threads > 0) ? config.threads : get_number_of_processors();
+    decode_mismatches = 0;
+
+    if (!config.keep)
+    {
+        printf("Writing synthetic channel to %s...\n", config.dir);
+        bench_synthetic_channel(&config, &synth);
+        if (!write_synthetic_channel(&synth, config.segments, config.verify ? &decode_mismatches : NULL))
+            return 1;
+    }
+
+    (void) initialize_meflib();
+    MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
+    set_read_mef_ts_data_hardware_aes(!config.software_aes);
+    set_read_mef_ts_data_red_decode(!config.meflib_decode);
+    bench_synthetic_channel(&config, &synth);
+    synthetic_channel_path(&synth, channel_path);
+    channel = read_MEF_channel(NULL, channel_path, TIME_SERIES_CHANNEL_TYPE, config.encrypt ? SYNTHETIC_PASSWORD : NULL, NULL, MEF_FALSE, MEF_FALSE);
+    if ((channel == NULL) || (channel->channel_type != TIME_SERIES_CHANNEL_TYPE))
+    {
+        printf("Could not read channel %s\n", channel_path);
+        return 1;
+    }
+
+    memset(&truth, 0, sizeof(truth));
+    if (config.verify && !build_synthetic_truth(&synth, config.segments, &truth))
+    {
+        printf("Could not allocate the expected samples\n");
+        return 1;
+    }
+
+    out = fopen(config.out, "w");
+    if (out == NULL)
+    {
+        printf("Could not open %s\n", config.out);
+        return 1;
+    }
+
+    total_samples = channel->metadata.time_series_section_2->number_of_samples;
+    segment_samples = channel->segments[0].metadata_fps->metadata.time_series_section_2->number_of_samples;
+
+    // output buffer: the whole channel, plus room for gaps when reading it by time
+    buffer = (si4 *) malloc(sizeof(si4) * (size_t) ((((channel->latest_end_time - channel->earliest_start_time) / 1e6) * config.rate) + total_samples + 1));
+    windows = (BENCH_WINDOW *) malloc(sizeof(BENCH_WINDOW) * (size_t) config.reads);
+    random_state = 42;
+    mismatches = 0;
+
+    // single block: windows inside one block
+    for (i = 0; i < config.reads; i++)
+    {
+        windows[i].start = ((si8) (synthetic_random(&random_state) % (ui4) (total_samples / config.block_samples)) * config.block_samples) + (config.block_samples / 4);
+        windows[i].end = windows[i].start + (config.block_samples / 2);
+    }
+    mismatches += run_scenario(out, &config, channel, "single_block", windows, config.reads, 1, buffer, config.verify ? &truth : NULL);
+
+    // segment spanning: ten blocks either side of a segment boundary
+    if (config.segments > 1)
+    {
+        n = (config.reads < 100) ? config.reads : 100;
+        for (i = 0; i < n; i++)
+        {
+            boundary = segment_samples * (1 + (i % (config.segments - 1)));
+            windows[i].start = boundary - (10 * (si8) config.block_samples);
+            windows[i].end = boundary + (10 * (si8) config.block_samples);
+        }
+        mismatches += run_scenario(out, &config, channel, "segment_spanning", windows, n, 1, buffer, config.verify ? &truth : NULL);
+    }
+
+    // random small windows: one second at random
+    window = (si4) config.rate;
+    for (i = 0; i < config.reads; i++)
+    {
+        windows[i].start = (si8) (((sf8) synthetic_random(&random_state) / 4294967296.0) * (sf8) (total_samples - window));
+        windows[i].end = windows[i].start + window;
+    }
+    mismatches += run_scenario(out, &config, channel, "random_small", windows, config.reads, 1, buffer, config.verify ? &truth : NULL);
+
+    // concurrent random small windows, one reader thread per CHANNEL
+    time_windows = (BENCH_WINDOW *) malloc(sizeof(BENCH_WINDOW) * (size_t) config.reads);
+    windows_to_times(channel, windows, time_windows, config.reads);
+    max_window = (si4) (window * 2);
+    mismatches += run_concurrent(out, &config, channel_path, time_windows, config.reads, threads, max_window, config.verify ? &truth : NULL);
+    free (time_windows);
+
+    // full channel scan, serial and with parallel decoding
+    n = 3;
+    for (i = 0; i < n; i++)
+    {
+        windows[i].start = 0;
+        windows[i].end = total_samples;
+    }
+    mismatches += run_scenario(out, &config, channel, "full_scan", windows, n, 1, buffer, config.verify ? &truth : NULL);
+    mismatches += run_scenario(out, &config, channel, "full_scan_threaded", windows, n, threads, buffer, config.verify ? &truth : NULL);
+
+    fclose(out);
+    printf("Results written to %s\n", config.out);
+    if (config.verify)
+    {
+        if (!config.keep)
+            printf("%d blocks decoded differently from RED_decode()\n", decode_mismatches);
+        printf("%d reads did not match the written samples\n", mismatches);
+    }
+
+    free (windows);
+    free (buffer);
+    free_synthetic_truth(&truth);
+    release_channel_reader_state(channel);
+    free_channel(channel, MEF_TRUE);
+
+    return ((mismatches > 0) || (decode_mismatches > 0)) ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+// Multiscale Electrophysiology Format (MEF) version 3.0
+// Copyright 2022, Mayo Foundation, Rochester MN. All rights reserved.
+
+// Usage and modification of this source code is governed by the Apache 2.0 license.
+// You may not use this file except in compliance with this License.
+// A copy of the Apache 2.0 License may be obtained at http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under this License is distributed on an "as is" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either expressed or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Thanks to all who acknowledge the Mayo Systems Electrophysiology Laboratory, Rochester, MN
+// in academic publications of their work facilitated by this software.
+
+// Writes the index sidecar (<channel name>.ridx) of each channel given, so that open_lazy_mef_channel() can open it
+// without reading its segment headers.  Channels whose sidecar is still fresh are skipped unless -force is given.
+// With -pyramid the min/max/mean pyramid sidecar (<channel name>.rpyr) is written as well, decoding only data appended
+// since it was last written.
+//
+// Build with meflib.c and mefrec.c, for example:
+//     cc -O2 build_index.c read_mef_ts_data.c meflib.c mefrec.c -lpthread -lm -o build_index
+//
+// Usage:
+//     build_index [-password <password>] [-force] [-pyramid] <channel.timd> ...
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "read_mef_ts_data.h"
+
+int main(int argc, char **argv)
+{
+    si1 *password;
+    si4 force, pyramid, i, n_channels, n_written, n_failed;
+
+    password = NULL;
+    force = pyramid = 0;
+    n_channels = n_written = n_failed = 0;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-password") == 0) && (i + 1 < argc))
+        {
+            password = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "-force") == 0)
+        {
+            force = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "-pyramid") == 0)
+        {
+            pyramid = 1;
+            continue;
+        }
+
+        n_channels++;
+        if (pyramid)
+        {
+            if (write_mef_channel_pyramid(argv[i], password))
+            {
+                fprintf(stdout, "%s: pyramid written\n", argv[i]);
+            }
+            else
+            {
+                fprintf(stderr, "%s: could not write pyramid\n", argv[i]);
+                n_failed++;
+            }
+        }
+        if (!force && mef_channel_index_sidecar_is_fresh(argv[i]))
+        {
+            fprintf(stdout, "%s: index is up to date\n", argv[i]);
+            continue;
+        }
+        if (write_mef_channel_index_sidecar(argv[i], password))
+        {
+            fprintf(stdout, "%s: index written\n", argv[i]);
+            n_written++;
+        }
+        else
+        {
+            fprintf(stderr, "%s: could not write index\n", argv[i]);
+            n_failed++;
+        }
+    }
+
+    if (n_channels == 0)
+    {
+        fprintf(stderr, "usage: %s [-password <password>] [-force] [-pyramid] <channel.timd> ...\n", argv[0]);
+        return 1;
+    }
+
+    return (n_failed > 0) ? 1 : 0;
+}
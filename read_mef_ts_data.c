@@ -23,9 +23,377 @@
 
 #include "read_mef_ts_data.h"
 
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <dirent.h>
+#else
+#include <windows.h>
+#endif
+
+#include <math.h>
+#ifndef M_PI
+#define M_PI    3.14159265358979323846
+#endif
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define READER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 // global
 extern MEF_GLOBALS	*MEF_globals;
 
+// number of threads used to decode the blocks of a single read, see set_read_mef_ts_data_num_threads()
+static si4 read_mef_ts_data_num_threads = 1;
+
+// how compressed data is brought in, see set_read_mef_ts_data_io_mode()
+static si4 read_mef_ts_data_io_mode = READ_IO_FREAD;
+static si4 read_mef_ts_data_access_pattern = READ_ACCESS_NORMAL;
+
+// a decode worker thread is only started for at least this many blocks
+#define DECODE_MIN_BLOCKS_PER_THREAD    16
+
+// minimal thread wrappers, so the worker pools below build on both pthreads and win32
+#ifndef _WIN32
+typedef pthread_t   READER_THREAD;
+#define READER_THREAD_RETURN    void *
+#define READER_THREAD_RETURN_VALUE  NULL
+#else
+typedef HANDLE      READER_THREAD;
+#define READER_THREAD_RETURN    DWORD WINAPI
+#define READER_THREAD_RETURN_VALUE  0
+#endif
+
+static si4 reader_thread_create(READER_THREAD *thread, READER_THREAD_RETURN (*start_routine)(void *), void *arg)
+{
+#ifndef _WIN32
+    return (pthread_create(thread, NULL, start_routine, arg) == 0);
+#else
+    *thread = CreateThread(NULL, 0, start_routine, arg, 0, NULL);
+    return (*thread != NULL);
+#endif
+}
+
+#ifndef _WIN32
+typedef pthread_mutex_t READER_MUTEX;
+#define READER_MUTEX_INITIALIZER    PTHREAD_MUTEX_INITIALIZER
+#define reader_mutex_init(m)        pthread_mutex_init((m), NULL)
+#define reader_mutex_lock(m)        pthread_mutex_lock(m)
+#define reader_mutex_unlock(m)      pthread_mutex_unlock(m)
+#define reader_mutex_destroy(m)     pthread_mutex_destroy(m)
+#else
+typedef SRWLOCK     READER_MUTEX;
+#define READER_MUTEX_INITIALIZER    SRWLOCK_INIT
+#define reader_mutex_init(m)        InitializeSRWLock(m)
+#define reader_mutex_lock(m)        AcquireSRWLockExclusive(m)
+#define reader_mutex_unlock(m)      ReleaseSRWLockExclusive(m)
+#define reader_mutex_destroy(m)
+#endif
+
+// loads and stores of flags that are set once and then read by many threads without a lock
+#ifndef _WIN32
+#define reader_atomic_load(p)       __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define reader_atomic_store(p, v)   __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define reader_atomic_load_byte(p)  __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define reader_atomic_or_byte(p, v) __atomic_fetch_or((p), (ui1) (v), __ATOMIC_RELEASE)
+#else
+#include <intrin.h>
+#define reader_atomic_load(p)       InterlockedCompareExchange((volatile LONG *) (p), 0, 0)
+#define reader_atomic_store(p, v)   InterlockedExchange((volatile LONG *) (p), (v))
+#define reader_atomic_load_byte(p)  ((ui1) _InterlockedCompareExchange8((volatile char *) (p), 0, 0))
+#define reader_atomic_or_byte(p, v) _InterlockedOr8((volatile char *) (p), (char) (v))
+#endif
+
+#ifndef _WIN32
+typedef pthread_cond_t  READER_COND;
+#define reader_cond_init(c)         pthread_cond_init((c), NULL)
+#define reader_cond_wait(c, m)      pthread_cond_wait((c), (m))
+#define reader_cond_broadcast(c)    pthread_cond_broadcast(c)
+#define reader_cond_destroy(c)      pthread_cond_destroy(c)
+#else
+typedef CONDITION_VARIABLE  READER_COND;
+#define reader_cond_init(c)         InitializeConditionVariable(c)
+#define reader_cond_wait(c, m)      SleepConditionVariableSRW((c), (m), INFINITE, 0)
+#define reader_cond_broadcast(c)    WakeAllConditionVariable(c)
+#define reader_cond_destroy(c)
+#endif
+
+// read_MEF_channel() and free_channel() touch MEF_globals, so channels opened by worker threads are opened one at a time
+static READER_MUTEX meflib_mutex = READER_MUTEX_INITIALIZER;
+
+static void reader_thread_join(READER_THREAD thread)
+{
+#ifndef _WIN32
+    pthread_join(thread, NULL);
+#else
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#endif
+}
+
+// shared state of a multi-channel read; workers take channels one at a time
+typedef struct {
+    si1     **channel_paths;
+    si1     *password;
+    CHANNEL **channels;
+    si4     n_channels;
+    si8     start_time;
+    si8     end_time;
+    si4     *decomp_data;
+    si8     samples_per_channel;
+    si4     layout;
+    si4     *samples_returned;
+    si4     decode_threads;
+    si4     next_channel;
+    si4     channels_read;
+    READER_MUTEX    mutex;
+} MULTI_CHANNEL_READ;
+
+// contiguous compressed data holding whole RED blocks: a read buffer, or part of a mapped .tdat file
+typedef struct {
+    ui1     *data;
+    ui8     bytes;
+} COMPRESSED_SPAN;
+
+// a read-only mapping of a segment's .tdat file
+typedef struct {
+    ui1     *data;
+    ui8     bytes;
+#ifdef _WIN32
+    HANDLE  file_handle;
+    HANDLE  mapping_handle;
+#endif
+} SEGMENT_MAP;
+
+// everything this module caches for one channel, looked up by CHANNEL pointer
+typedef struct READER_CHANNEL_STATE READER_CHANNEL_STATE;
+struct READER_CHANNEL_STATE {
+    CHANNEL                 *channel;
+    CHANNEL_BLOCK_INDEX     *block_index;
+    CONTINUOUS_RANGES       *continuous_ranges; // built from block_index, on first use
+    SEGMENT_MAP             *segment_maps;      // number_of_segment_maps entries, mapped on first use
+    si8                     number_of_segment_maps;
+    ui1                     *verified_blocks;   // bitmap of blocks whose CRC has been checked (READ_CRC_ONCE)
+    si8                     number_of_verified_bits;
+    READER_CHANNEL_STATE    *next;
+};
+
+static READER_CHANNEL_STATE *reader_channel_states = NULL;
+static READER_MUTEX reader_channel_states_mutex = READER_MUTEX_INITIALIZER;
+
+// A channel's READ_CRC_ONCE bitmap, looked up once for a read (or a decode worker's run of jobs) rather than once per
+// block.  Bits are tested and set atomically, so workers share the bitmap without a lock.  Start with channel NULL.
+typedef struct {
+    CHANNEL *channel;
+    ui1     *bits;
+    si8     n_bits;
+} VERIFIED_BLOCKS;
+
+// CRC and decode work counted while statistics are being kept, added to READ_MEF_TS_STATS when a stage ends.  Each
+// decode worker keeps its own, so threads never share one.
+typedef struct {
+    si8     blocks_decoded;
+    si8     blocks_crc_checked;
+    sf8     crc_seconds;
+    sf8     decode_seconds;
+} DECODE_TIMES;
+
+// a contiguous run of jobs handed to one decode worker
+typedef struct {
+    DECODE_BLOCK_JOB    *jobs;
+    si8     first_job;
+    si8     end_job;
+    ui4     max_samps;
+    si4     copy_blocks;
+    si8     failed_job;
+    RED_PROCESSING_STRUCT   *rps;       // supplied by the caller, or NULL to allocate one
+    ui1     *block_copy;                // likewise, when copy_blocks is set
+    si4     timed;                      // count the work done in times
+    DECODE_TIMES    times;
+} DECODE_WORKER;
+
+// buffers kept between reads of one channel
+struct READ_MEF_TS_CONTEXT {
+    CHANNEL     *channel;
+    ui4         max_samps;              // rps, block_samples and block_copy are sized for blocks of up to max_samps samples
+    RED_PROCESSING_STRUCT   *rps;
+    si4         *block_samples;         // one decoded block
+    ui1         *block_copy;            // one compressed block
+    ui1         *compressed_data;
+    ui8         compressed_data_bytes;
+    COMPRESSED_SPAN     *spans;
+    si4         number_of_spans;
+    DECODE_BLOCK_JOB    *jobs;
+    si8         number_of_jobs;
+};
+
+// Index sidecar file layout: this header, then the arrays it gives the offsets of, each starting on an 8 byte boundary.
+// A reader on a machine of the other byte order sees a wrong version, and ignores the file.
+#define INDEX_SIDECAR_MAGIC     "MEFRIDX"
+typedef struct {
+    si1     magic[8];
+    ui4     version;
+    ui4     header_bytes;
+    si8     file_bytes;
+    si8     number_of_segments;
+    si8     number_of_blocks;
+    si8     number_of_ranges;
+    si8     number_of_samples;
+    sf8     sampling_frequency;
+    si8     earliest_start_time;            // as read_MEF_channel() sets them
+    si8     latest_end_time;
+    ui4     block_samples;
+    si4     regular;
+    si8     segments_offset;                // INDEX_SIDECAR_SEGMENT[number_of_segments]
+    si8     indices_offset;                 // TIME_SERIES_INDEX[number_of_blocks], every segment's in turn
+    si8     block_arrays_offset[5];         // CHANNEL_BLOCK_INDEX start_sample, start_time, file_offset, segment, discontinuity
+    si8     segment_arrays_offset[5];       // segment_first_block, segment_start_time, _end_time, _start_sample, _end_sample
+    si8     range_arrays_offset[5];         // CONTINUOUS_RANGES start_time, end_time, start_sample, end_sample, time_before
+} INDEX_SIDECAR_HEADER;
+
+typedef struct {
+    si1     name[MEF_SEGMENT_NAME_BYTES];   // the .segd directory
+    si8     start_time;                     // .tdat universal header times, as stored
+    si8     end_time;
+    si8     start_sample;
+    si8     number_of_samples;
+    si8     number_of_blocks;
+    si8     maximum_block_bytes;
+    ui4     maximum_block_samples;
+    ui4     reserved;
+    si8     data_file_length;
+    si8     first_block;
+} INDEX_SIDECAR_SEGMENT;
+
+// one segment of a lazy channel
+typedef struct {
+    si1     path[MEF_FULL_FILE_NAME_BYTES];     // the .segd directory
+    si1     loaded;
+    si1     from_sidecar;                       // filled in from the index sidecar rather than by meflib
+    si8     last_used;                          // value of use_count when the segment was last in the range CHANNEL
+} LAZY_SEGMENT;
+
+// A lazy channel.  channel is the range CHANNEL handed out: segments [range_first, range_end) of segments, with the
+// whole channel's bounds.  Segment 0 stays loaded, for the password data and channel metadata.
+struct LAZY_MEF_CHANNEL {
+    CHANNEL     channel;
+    TIME_SERIES_METADATA_SECTION_2  section_2;  // channel's section 2, with the whole channel's sample count
+    SEGMENT     *segments;
+    LAZY_SEGMENT        *lazy_segments;
+    LAZY_SEGMENT_BOUNDS *bounds;
+    si8         number_of_segments;
+    si8         range_first;
+    si8         range_end;
+    si8         loaded_segments;
+    si8         use_count;
+    SEGMENT_MAP sidecar;                // mapped index sidecar, if there is a fresh one
+    INDEX_SIDECAR_HEADER    *sidecar_header;
+    CHANNEL_BLOCK_INDEX     sidecar_index;
+    CONTINUOUS_RANGES       sidecar_ranges;
+};
+
+// Pyramid sidecar file layout: this header, then the arrays it gives the offsets of, each starting on an 8 byte boundary.
+#define PYRAMID_MAGIC           "MEFRPYR"
+typedef struct {
+    si1     magic[8];
+    ui4     version;
+    ui4     header_bytes;
+    si8     file_bytes;
+    si8     number_of_samples;
+    si8     number_of_ranges;
+    sf8     sampling_frequency;
+    ui4     base_bin_samples;
+    ui4     number_of_levels;
+    si8     range_arrays_offset[4];                             // CONTINUOUS_RANGES start_time, end_time, start_sample, end_sample
+    si8     level_bins_offset[MEF_PYRAMID_MAX_LEVELS];          // PYRAMID_BIN[] of each level, every range's bins in turn
+    si8     level_first_bin_offset[MEF_PYRAMID_MAX_LEVELS];     // si8[number_of_ranges + 1]: first bin of each range in a level
+} PYRAMID_HEADER;
+
+// A bin of a pyramid level: base_bin_samples << level samples of one continuous range (the last bin of a range may hold
+// fewer).  A bin of NaN samples only has a count of 0.
+typedef struct {
+    sf8     mean;
+    si4     minimum;
+    si4     maximum;
+    ui4     count;          // valid samples
+    ui4     reserved;
+} PYRAMID_BIN;
+
+// an open (mapped) pyramid sidecar
+struct MEF_PYRAMID {
+    SEGMENT_MAP     map;
+    PYRAMID_HEADER  *header;
+    si8             *range_start_time;
+    si8             *range_end_time;
+    si8             *range_start_sample;
+    si8             *range_end_sample;
+    PYRAMID_BIN     *bins[MEF_PYRAMID_MAX_LEVELS];
+    si8             *first_bin[MEF_PYRAMID_MAX_LEVELS];
+};
+
+// internal helpers, defined further down
+static ui1 *next_block_ptr(COMPRESSED_SPAN *spans, si4 n_spans, si4 *span, ui1 *cdp);
+static void free_segment_maps(READER_CHANNEL_STATE *state);
+static si4 block_cache_enabled(void);
+static si8 output_offset_for_time(si8 block_time, si8 start_time, sf8 sampling_frequency);
+static si4 map_segment(SEGMENT_MAP *map, si1 *file_name);
+static void unmap_segment(SEGMENT_MAP *map);
+static si4 open_index_sidecar(si1 *channel_path, si1 **segment_names, si8 n_segments, SEGMENT_MAP *map);
+static si4 file_modified_and_size(si1 *file_name, si8 *modified, si8 *bytes);
+static void check_block_index_regular(CHANNEL_BLOCK_INDEX *index, si8 first_block);
+static si4 grow_array(void **array, size_t bytes);
+static si4 extend_channel_block_index(CHANNEL_BLOCK_INDEX *index, CHANNEL *channel);
+static si4 extend_continuous_ranges(CONTINUOUS_RANGES *ranges, CHANNEL *channel, CHANNEL_BLOCK_INDEX *index, si8 first_block);
+static si4 read_mef_ts_data_core(si1 *channel_path, si1 *password, si8 start_value, si8 end_value, si4 times_specified, si4 *decomp_data, CHANNEL *channel_passed_in, si4 sample_limit, READ_MEF_TS_DATA_OPTIONS *options);
+static sf8 reader_clock(void);
+static sf8 end_read_stage(READ_MEF_TS_STATS *stats, si4 stage, sf8 start);
+static void add_decode_times(READ_MEF_TS_STATS *stats, DECODE_TIMES *times);
+static void add_worker_times(DECODE_TIMES *total, DECODE_TIMES *times);
+static si4 channel_block_crc(CHANNEL *channel, si8 block, ui1* block_hdr_ptr, ui4 max_samps, ui1* total_data_ptr, ui8 total_data_bytes,
+                             VERIFIED_BLOCKS *verified, si4 *computed);
+static si4 check_and_decode_block(CHANNEL *channel, si8 block, RED_PROCESSING_STRUCT *rps, ui1 *block_ptr, ui4 max_samps, ui1 *total_data_ptr,
+                                  ui8 total_data_bytes, si4 *output, ui1 *block_copy, VERIFIED_BLOCKS *verified, DECODE_TIMES *times);
+static si8 decode_block_jobs_timed(DECODE_BLOCK_JOB *jobs, si8 n_jobs, ui4 max_samps, si4 copy_blocks, si4 n_threads,
+                                   RED_PROCESSING_STRUCT *rps, ui1 *block_copy, DECODE_TIMES *times);
+static ui1 *map_channel_segment(CHANNEL *channel, si4 segment, ui8 *bytes, si4 *mapped);
+static si4 locate_read_blocks(CHANNEL_BLOCK_INDEX *index, si4 times_specified, si8 start_time, si8 end_time, si8 start_samp, si8 end_samp,
+                              si4 *start_segment, si4 *end_segment, ui8 *start_idx, ui8 *end_idx);
+static si4 reserve_read_mef_ts_context(READ_MEF_TS_CONTEXT *context, ui4 max_samps, ui8 compressed_bytes, si4 n_spans, si8 n_blocks);
+static void release_read_buffers(READ_MEF_TS_CONTEXT *context, ui1 *compressed_data_buffer, COMPRESSED_SPAN *spans, ui1 *block_copy,
+                                 si4 *temp_data_buf, DECODE_BLOCK_JOB *jobs, RED_PROCESSING_STRUCT *rps);
+static void copy_block_clipped(si4 *decomp_data, si8 num_samps, si8 offset, si4 *samples, si8 number_of_samples);
+static READER_CHANNEL_STATE *find_reader_channel_state(CHANNEL *channel, si4 create);
+static si4 block_crc_tables_ready(void);
+static CHANNEL *read_channel_with_cached_password(si1 *channel_path, si1 *password);
+static void release_read_channel_password(CHANNEL *channel);
+static PASSWORD_DATA *channel_password_data(CHANNEL *channel);
+static si4 decode_block_hardware_aes(RED_PROCESSING_STRUCT *rps);
+static void decode_red_block(RED_PROCESSING_STRUCT *rps);
+static RED_PROCESSING_STRUCT *allocate_channel_decode_rps(CHANNEL *channel, ui4 max_samps);
+static void place_output_samples(void *output, si4 output_format, si8 position, si4 *samples, si8 n, sf8 factor);
+static void fill_output_nan(void *output, si4 output_format, si8 position, si8 n);
+static void convert_output_in_place(void *output, si4 output_format, si8 n, sf8 factor);
+static si4 read_blocks_pipelined(CHANNEL *channel, CHANNEL_BLOCK_INDEX *index, si8 first_block, si8 num_blocks, si4 times_specified,
+                                 si8 start_time, si8 end_time, si8 start_samp, si4 *decomp_data, si4 num_samps, si4 n_threads);
+static si4 read_blocks_through_cache(CHANNEL *channel, CHANNEL_BLOCK_INDEX *index, si8 first_block, si8 num_blocks, si4 times_specified,
+                                     si8 start_time, si8 end_time, si8 start_samp, si4 *decomp_data, si4 num_samps, si4 n_threads, si4 io_mode);
+
+// frees a channel that was read inside one of the read functions, along with anything cached for it
+static void free_read_channel(CHANNEL *channel)
+{
+    release_channel_reader_state(channel);
+    release_read_channel_password(channel);
+    free_channel(channel, MEF_TRUE);
+}
+
 // user specifies a time range
 si4 read_mef_ts_data_by_time(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, si4 *decomp_data, CHANNEL *channel_passed_in)
 {
@@ -44,6 +412,43 @@ si4 read_mef_ts_data_by_samp(si1 *channel_path, si1 *password, si8 start_samp, s
     return read_mef_ts_data(channel_path, password, start_samp, end_samp, 0, decomp_data, channel_passed_in, -1);
 }
 
+// sets the number of threads used to decode the blocks of a single read.
+// 1 (the default) decodes serially, 0 uses one thread per online processor.
+void set_read_mef_ts_data_num_threads(si4 num_threads)
+{
+    if (num_threads <= 0)
+        num_threads = get_number_of_processors();
+    
+    read_mef_ts_data_num_threads = num_threads;
+}
+
+si4 get_read_mef_ts_data_num_threads(void)
+{
+    return read_mef_ts_data_num_threads;
+}
+
+// Sets how compressed data is brought in.  READ_IO_FREAD (the default) reads each requested range into a buffer,
+// READ_IO_MMAP maps the segment .tdat files and decodes from the mapping, READ_IO_PIPELINED reads the range in chunks on
+// a separate thread while the chunks already read are decoded.
+void set_read_mef_ts_data_io_mode(si4 io_mode)
+{
+    if ((io_mode != READ_IO_FREAD) && (io_mode != READ_IO_MMAP) && (io_mode != READ_IO_PIPELINED))
+        io_mode = READ_IO_FREAD;
+    
+    read_mef_ts_data_io_mode = io_mode;
+}
+
+si4 get_read_mef_ts_data_io_mode(void)
+{
+    return read_mef_ts_data_io_mode;
+}
+
+// Sets the access pattern hint given to the OS for mapped segment files (READ_IO_MMAP only).
+void set_read_mef_ts_data_access_pattern(si4 access_pattern)
+{
+    read_mef_ts_data_access_pattern = access_pattern;
+}
+
 // returns a CHANNEL struct given a channel path and password
 CHANNEL *get_channel_struct(si1 *channel_path, si1 *password)
 {
@@ -79,81 +484,46 @@ sf8 get_channel_units_conversion_factor(CHANNEL *channel)
 si4 find_start_and_end_times_of_continuous_ranges(si1 *channel_path, si1 *password, si8 **start_continuous_input, si8 **end_continuous_input, CHANNEL *channel_passed_in)
 {
     CHANNEL    *channel;
-    CONTINUOUS_RANGE_NODE *head;
-    CONTINUOUS_RANGE_NODE *current;
-    CONTINUOUS_RANGE_NODE *node_temp;
-    si4 node_counter;
-    ui4 n_segments;
-    si4 i, j;
-    si8 block_start_time;
+    CONTINUOUS_RANGES *ranges;
+    si4 node_counter, read_channel;
     
     si8 *start_continuous;
     si8 *end_continuous;
     
-    start_continuous = *start_continuous_input;
-    end_continuous = *end_continuous_input;
-    
     if (channel_passed_in == NULL)
     {
+        read_channel = 1;
+        
         // set up mef 3 library
         (void) initialize_meflib();
         MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
         
-        channel = read_MEF_channel(NULL, channel_path, TIME_SERIES_CHANNEL_TYPE, password, NULL, MEF_FALSE, MEF_FALSE);
+        channel = read_channel_with_cached_password(channel_path, password);
         
+        if (channel == NULL)
+            return 0;
         if (channel->channel_type != TIME_SERIES_CHANNEL_TYPE) {
             printf("Not a time series channel, exiting...");
+            free_read_channel(channel);
             return 0;
         }
     }
     else
     {
+        read_channel = 0;
         channel = channel_passed_in;
     }
-
-    head = current = NULL;
-    node_counter = 0;
     
-    n_segments = channel->number_of_segments;
-    //fprintf(stderr, "segments: %d\n", n_segments);
-    
-    // iterate over segments
-    for (i=0;i<n_segments;i++)
+    // the ranges are built once per channel, and copied out here
+    ranges = get_channel_continuous_ranges(channel);
+    if (ranges == NULL)
     {
-        // iterate over blocks within segments
-        for (j = 0; j < channel->segments[i].metadata_fps->metadata.time_series_section_2->number_of_blocks; j++)
-        {
-            block_start_time = channel->segments[i].time_series_indices_fps->time_series_indices[j].start_time;
-            remove_recording_time_offset( &block_start_time);
-            
-            // check to see if block is start of a new continuous region.
-            // First block of recording is by definition marked as discontinuous - but check to just make sure.
-            if ((channel->segments[i].time_series_indices_fps->time_series_indices[j].RED_block_flags & RED_DISCONTINUITY_MASK) ||
-                ((i == 0) && (j == 0)))
-            {
-                if (head == NULL)
-                {
-                    head = current = (struct CONTINUOUS_RANGE_NODE*)malloc(sizeof(struct CONTINUOUS_RANGE_NODE));
-                    current->next = NULL;
-                }
-                else
-                {
-                    node_temp = (struct CONTINUOUS_RANGE_NODE*)malloc(sizeof(struct CONTINUOUS_RANGE_NODE));
-                    current->next = node_temp;
-                    current = current->next;
-                    current->next = NULL;
-                }
-                
-                // set start time of range.  This won't be changed later.
-                current->start_time = block_start_time;
-                
-                node_counter++;
-            }
-            
-            // calculate block end time, and set this to be the range end time (although it might be overridden later blocks)
-            current->end_time = block_start_time + ((channel->segments[i].time_series_indices_fps->time_series_indices[j].number_of_samples / channel->metadata.time_series_section_2->sampling_frequency) * 1e6);
-        }
+        printf("Could not index channel, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        return 0;
     }
+    node_counter = (si4) ranges->number_of_ranges;
     
     // allocate output arrays
     start_continuous = (si8*) malloc(sizeof(si8) * node_counter);
@@ -164,45 +534,64 @@ si4 find_start_and_end_times_of_continuous_ranges(si1 *channel_path, si1 *passwo
     *end_continuous_input = end_continuous;
     
     // set data of output arrays
-    current = head;
-    for (i=0;i<node_counter;i++)
-    {
-        start_continuous[i] = current->start_time;
-        end_continuous[i] = current->end_time;
-        current = current->next;
-    }
+    memcpy(start_continuous, ranges->start_time, sizeof(si8) * (size_t) node_counter);
+    memcpy(end_continuous, ranges->end_time, sizeof(si8) * (size_t) node_counter);
     
-    // clean up linked list
-    while (head != NULL)
-    {
-        //fprintf(stderr, "start %ld end %ld\n", head->start_time, head->end_time);
-        node_temp = head->next;
-        free (head);
-        head = node_temp;
-    }
+    if (read_channel == 1)
+        free_read_channel(channel);
     
     return node_counter;
 }
 
 // this function should not be called directly by user, but rather by a function specified above
 si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_value, si4 times_specified, si4 *decomp_data, CHANNEL *channel_passed_in, si4 sample_limit)
+{
+    return read_mef_ts_data_with_options(channel_path, password, start_value, end_value, times_specified, decomp_data, channel_passed_in, sample_limit, NULL);
+}
+
+void initialize_read_mef_ts_data_options(READ_MEF_TS_DATA_OPTIONS *options)
+{
+    options->num_threads = 0;
+    options->free_decomp_data_on_error = MEF_TRUE;
+    options->io_mode = READ_IO_DEFAULT;
+    options->use_block_cache = MEF_TRUE;
+    options->context = NULL;
+    options->stats = NULL;
+    options->output_format = READ_OUTPUT_SI4;
+}
+
+// same as read_mef_ts_data(), with per-call options.  Passing NULL for options gives the defaults.
+si4 read_mef_ts_data_with_options(si1 *channel_path, si1 *password, si8 start_value, si8 end_value, si4 times_specified, si4 *decomp_data, CHANNEL *channel_passed_in, si4 sample_limit, READ_MEF_TS_DATA_OPTIONS *options)
+{
+    si4 num_samps;
+    sf8 start;
+    
+    if ((options == NULL) || (options->stats == NULL))
+        return read_mef_ts_data_core(channel_path, password, start_value, end_value, times_specified, decomp_data, channel_passed_in, sample_limit, options);
+    
+    start = reader_clock();
+    num_samps = read_mef_ts_data_core(channel_path, password, start_value, end_value, times_specified, decomp_data, channel_passed_in, sample_limit, options);
+    options->stats->reads++;
+    end_read_stage(options->stats, READ_STAGE_READ, start);
+    
+    return num_samps;
+}
+
+static si4 read_mef_ts_data_core(si1 *channel_path, si1 *password, si8 start_value, si8 end_value, si4 times_specified, si4 *decomp_data, CHANNEL *channel_passed_in, si4 sample_limit, READ_MEF_TS_DATA_OPTIONS *options)
 {
     // Specified by user
     si8     start_time, end_time;
     si8     start_samp, end_samp;
     
     // Method specific variables
-    si4     i, j;
-    ui4 n_segments;
+    si4     i;
     CHANNEL    *channel;
     si4 start_segment, end_segment;
     si8  total_samps;//, samp_counter_base;
     ui8  total_data_bytes;
     ui8 start_idx, end_idx, num_blocks;
+    si8 first_block;
     ui1 *compressed_data_buffer, *cdp;
-    si8  segment_start_sample, segment_end_sample;
-    si8  segment_start_time, segment_end_time;
-    si8  block_start_time;
     si4 num_block_in_segment;
     FILE *fp;
     ui8 n_read, bytes_to_read;
@@ -214,6 +603,42 @@ si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_
     si4 offset_into_output_buffer;
     si8 block_start_time_offset;
     si4 read_channel;
+    DECODE_BLOCK_JOB *jobs;
+    si8 n_jobs, failed_job;
+    RED_BLOCK_HEADER *block_header;
+    READ_MEF_TS_DATA_OPTIONS default_options;
+    si4 n_threads;
+    CHANNEL_BLOCK_INDEX *index;
+    COMPRESSED_SPAN *spans;
+    si4 n_spans, span, io_mode;
+    ui1 *seg_map, *block_copy;
+    ui8 seg_map_bytes;
+    si8 span_start, span_end;
+    READ_MEF_TS_CONTEXT *context;
+    READ_MEF_TS_STATS *stats;
+    DECODE_TIMES decode_times, *times;
+    VERIFIED_BLOCKS verified;
+    sf8 stage_start;
+    si4 mapped;
+    si8 range_samps;
+    sf8 factor;
+    
+    if (options == NULL)
+    {
+        initialize_read_mef_ts_data_options(&default_options);
+        options = &default_options;
+    }
+    n_threads = (options->num_threads > 0) ? options->num_threads : read_mef_ts_data_num_threads;
+    io_mode = (options->io_mode != READ_IO_DEFAULT) ? options->io_mode : read_mef_ts_data_io_mode;
+    stats = options->stats;
+    stage_start = 0.0;
+    times = NULL;
+    if (stats != NULL)
+    {
+        stage_start = reader_clock();
+        memset(&decode_times, 0, sizeof(DECODE_TIMES));
+        times = &decode_times;
+    }
     
     // check if no buffer is passed in
     if (decomp_data == NULL)
@@ -230,10 +655,13 @@ si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_
         (void) initialize_meflib();
         MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
         
-        channel = read_MEF_channel(NULL, channel_path, TIME_SERIES_CHANNEL_TYPE, password, NULL, MEF_FALSE, MEF_FALSE);
+        channel = read_channel_with_cached_password(channel_path, password);
         
+        if (channel == NULL)
+            return 0;
         if (channel->channel_type != TIME_SERIES_CHANNEL_TYPE) {
             printf("Not a time series channel, exiting...");
+            free_read_channel(channel);
             return 0;
         }
     }
@@ -242,9 +670,14 @@ si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_
         read_channel = 0;
         channel = channel_passed_in;
     }
+    factor = channel->metadata.time_series_section_2->units_conversion_factor;
+    if ((stats != NULL) && (read_channel == 1))
+        stage_start = end_read_stage(stats, READ_STAGE_OPEN, stage_start);
     
     // interpret parameters based on whether times or samples are being specified
     
+    start_time = end_time = 0;
+    start_samp = end_samp = 0;
     if (times_specified)
     {
         start_time = start_value;
@@ -268,22 +701,14 @@ si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_
     {
         printf("Start time later than end time, exiting...");
         if (read_channel == 1)
-        {
-            if (channel->number_of_segments > 0)
-                channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-            free_channel(channel, MEF_TRUE);
-        }
+            free_read_channel(channel);
         return 0;
     }
     if (!times_specified && start_samp >= end_samp)
     {
         printf("Start sample larger than end sample, exiting...");
         if (read_channel == 1)
-        {
-            if (channel->number_of_segments > 0)
-                channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-            free_channel(channel, MEF_TRUE);
-        }
+            free_read_channel(channel);
         return 0;
     }
     
@@ -293,11 +718,7 @@ si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_
             ((start_time > channel->latest_end_time) & (end_time > channel->latest_end_time))){
             printf("Start and stop times are out of file.");
             if (read_channel == 1)
-            {
-                if (channel->number_of_segments > 0)
-                    channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-                free_channel(channel, MEF_TRUE);
-            }
+                free_read_channel(channel);
 			return 0;
         }
         if (end_time > channel->latest_end_time)
@@ -310,11 +731,7 @@ si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_
             ((start_samp > channel->metadata.time_series_section_2->number_of_samples) & (end_samp > channel->metadata.time_series_section_2->number_of_samples))){
             printf("Start and stop samples are out of file. Returning None");
             if (read_channel == 1)
-            {
-                if (channel->number_of_segments > 0)
-                    channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-                free_channel(channel, MEF_TRUE);
-            }
+                free_read_channel(channel);
             return 0;
         }
         if (end_samp > channel->metadata.time_series_section_2->number_of_samples){
@@ -327,26 +744,45 @@ si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_
         }
     }
     // Determine the number of samples
-    num_samps = 0;
+    range_samps = 0;
     if (times_specified)
-        num_samps = (si4)(((end_time - start_time) / 1000000.0) * channel->metadata.time_series_section_2->sampling_frequency);
+        range_samps = (si8)(((end_time - start_time) / 1000000.0) * channel->metadata.time_series_section_2->sampling_frequency);
     else
-        num_samps = end_samp - start_samp;
+        range_samps = end_samp - start_samp;
     
     // enforce limit, so we don't overrun buffers.  This is important in some cases when specifying by time - as we don't always know
     // how many samples are in a time range, due to frequency drift and other potential issues.
     if (sample_limit > 0)
     {
-        if (num_samps > sample_limit)
-            num_samps = sample_limit;
+        if (range_samps > sample_limit)
+            range_samps = sample_limit;
+    }
+    
+    // the count is returned as an si4
+    if (range_samps > 0x7FFFFFFF)
+    {
+        printf("Range holds too many samples for one read, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        return 0;
     }
+    num_samps = (si4) range_samps;
     
     //fprintf(stderr, "Num_samps = %d\n", num_samps);
     
     // Iterate through segments, looking for data that matches our criteria
-    n_segments = channel->number_of_segments;
     start_segment = end_segment = -1;
     
+    // all searches below use the channel's flattened block index
+    index = get_channel_block_index(channel);
+    if (index == NULL)
+    {
+        printf("Could not index channel, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        return 0;
+    }
+    
     // fill in whatever data we don't know
     if (times_specified) {
         start_samp = sample_for_uutc_c(start_time, channel);
@@ -359,76 +795,13 @@ si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_
     //fprintf(stderr, "start_time = %ld\n", start_time);
     //fprintf(stderr, "end_time = %ld\n", end_time);
     
-    // Find start and stop segments by uutc time
-    // find start segment by finding first segment whose ending is past the start time.
-    // then find stop segment by using the previous segment of the (first segment whose start is past the end time)
-    for (i = 0; i < n_segments; ++i) {
-        if (times_specified){
-            segment_start_time = channel->segments[i].time_series_data_fps->universal_header->start_time;
-            segment_end_time   = channel->segments[i].time_series_data_fps->universal_header->end_time;
-            remove_recording_time_offset( &segment_start_time);
-            remove_recording_time_offset( &segment_end_time);
-            
-            //fprintf(stderr, "considering segment: %d\n", i);
-            //fprintf(stderr, "segment_start_time: %ld\n", segment_start_time);
-            //fprintf(stderr, "segment_end_time: %ld\n", segment_end_time);
-            
-            if ((segment_end_time >= start_time) && (start_segment == -1)) {
-                start_segment = i;
-                end_segment = i;
-                //fprintf(stderr, "Found\n");
-            }
-            if ((end_segment != -1) && (segment_start_time <= end_time))
-            {
-                //fprintf(stderr, "Found2\n");
-                end_segment = i;
-            }
-            
-        }else{
-            segment_start_sample = channel->segments[i].metadata_fps->metadata.time_series_section_2->start_sample;
-            segment_end_sample   = channel->segments[i].metadata_fps->metadata.time_series_section_2->start_sample +
-            channel->segments[i].metadata_fps->metadata.time_series_section_2->number_of_samples;
-            
-            if ((start_samp >= segment_start_sample) && (start_samp <= segment_end_sample))
-                start_segment = i;
-            if ((end_samp >= segment_start_sample) && (end_samp <= segment_end_sample))
-                end_segment = i;
-            
-        }
-    }
-    
-    //fprintf(stderr, "start_segment = %d\n", start_segment);
-    //fprintf(stderr, "end_segment = %d\n", end_segment);
-    
-    // find start block in start segment
-    start_idx = end_idx = 0;
-    //samp_counter_base = channel->segments[start_segment].metadata_fps->metadata.time_series_section_2->start_sample;
-    for (j = 1; j < channel->segments[start_segment].metadata_fps->metadata.time_series_section_2->number_of_blocks; j++) {
-        
-        block_start_time = channel->segments[start_segment].time_series_indices_fps->time_series_indices[j].start_time;
-        remove_recording_time_offset( &block_start_time);
-        
-        if (block_start_time > start_time) {
-            start_idx = j - 1;
-            break;
-        }
-        // starting point is in last block in segment
-        start_idx = j;
-    }
-    
-    // find stop block in stop segment
-    //samp_counter_base = channel->segments[end_segment].metadata_fps->metadata.time_series_section_2->start_sample;
-    for (j = 1; j < channel->segments[end_segment].metadata_fps->metadata.time_series_section_2->number_of_blocks; j++) {
-        
-        block_start_time = channel->segments[end_segment].time_series_indices_fps->time_series_indices[j].start_time;
-        remove_recording_time_offset( &block_start_time);
-        
-        if (block_start_time > end_time) {
-            end_idx = j - 1;
-            break;
-        }
-        // ending point is in last block in segment
-        end_idx = j;
+    // find the first and last blocks of the read
+    if (!locate_read_blocks(index, times_specified, start_time, end_time, start_samp, end_samp, &start_segment, &end_segment, &start_idx, &end_idx))
+    {
+        printf("No segment contains the requested range, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        return 0;
     }
     
     // find total_samps and total_data_bytes, so we can allocate buffers
@@ -465,11 +838,7 @@ si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_
         if (channel->segments[start_segment].time_series_indices_fps->time_series_indices[start_idx].file_offset < 1024){
             printf("Invalid index file offset, exiting...");
             if (read_channel == 1)
-            {
-                if (channel->number_of_segments > 0)
-                    channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-                free_channel(channel, MEF_TRUE);
-            }
+                free_read_channel(channel);
             return 0;
         }
         
@@ -484,11 +853,7 @@ si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_
             if (channel->segments[i].time_series_indices_fps->time_series_indices[0].file_offset < 1024){
                 printf("Invalid index file offset, exiting...");
                 if (read_channel == 1)
-                {
-                    if (channel->number_of_segments > 0)
-                        channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-                    free_channel(channel, MEF_TRUE);
-                }
+                    free_read_channel(channel);
                 return 0;
             }
         }
@@ -514,209 +879,351 @@ si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_
         if (channel->segments[end_segment].time_series_indices_fps->time_series_indices[end_idx].file_offset < 1024){
             printf("Invalid index file offset, exiting...");
             if (read_channel == 1)
-            {
-                if (channel->number_of_segments > 0)
-                    channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-                free_channel(channel, MEF_TRUE);
-            }
+                free_read_channel(channel);
             return 0;
         }
     }
     
-    // allocate buffers
-    compressed_data_buffer = (ui1 *) malloc((size_t) total_data_bytes);
-    cdp = compressed_data_buffer;
+    // channel block number of the first block read
+    first_block = index->segment_first_block[start_segment] + (si8) start_idx;
+    if (stats != NULL)
+    {
+        stats->segments_touched += end_segment - start_segment + 1;
+        stage_start = end_read_stage(stats, READ_STAGE_INDEX, stage_start);
+    }
     
     // fill buffer with NAN's if specifiying by time.  No need to do this if specifying by sample.
     if (times_specified)
         memset_int(decomp_data, RED_NAN, num_samps);
-
-    // read in RED data
-    // normal case - everything is in one segment
-    if (start_segment == end_segment) {
-        if (channel->segments[start_segment].time_series_data_fps->fp == NULL)
-            channel->segments[start_segment].time_series_data_fps->fp = fopen(channel->segments[start_segment].time_series_data_fps->full_file_name, "rb");
-        fp = channel->segments[start_segment].time_series_data_fps->fp;
-#ifndef _WIN32
-        fseek(fp, channel->segments[start_segment].time_series_indices_fps->time_series_indices[start_idx].file_offset, SEEK_SET);
-#else
-        _fseeki64(fp, channel->segments[start_segment].time_series_indices_fps->time_series_indices[start_idx].file_offset, SEEK_SET);
-#endif
-        n_read = fread(cdp, sizeof(si1), (size_t) total_data_bytes, fp);
-        if (read_channel == 1)
-            fclose(fp);
-        if (n_read != total_data_bytes){
-            printf("Error reading file, exiting...");
+    
+    // with the block cache enabled, blocks of a passed in channel come from the cache, and only missing ones are read
+    if ((read_channel == 0) && options->use_block_cache && block_cache_enabled())
+    {
+        if (!read_blocks_through_cache(channel, index, first_block, (si8) num_blocks,
+                                       times_specified, start_time, end_time, start_samp, decomp_data, num_samps, n_threads, io_mode))
+        {
+            if (options->free_decomp_data_on_error)
+                free (decomp_data);
+            return 0;
+        }
+        if (stats != NULL)
+            end_read_stage(stats, READ_STAGE_DECODE, stage_start);
+        convert_output_in_place(decomp_data, options->output_format, num_samps, factor);
+        return num_samps;
+    }
+    
+    // pipelined reads overlap reading the compressed data with decoding it
+    if (io_mode == READ_IO_PIPELINED)
+    {
+        if (!read_blocks_pipelined(channel, index, first_block, (si8) num_blocks,
+                                   times_specified, start_time, end_time, start_samp, decomp_data, num_samps, n_threads))
+        {
             if (read_channel == 1)
-            {
-                if (channel->number_of_segments > 0)
-                    channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-                free_channel(channel, MEF_TRUE);
-            }
-            free (compressed_data_buffer);
-            free (decomp_data);
+                free_read_channel(channel);
+            if (options->free_decomp_data_on_error)
+                free (decomp_data);
             return 0;
         }
+        if (read_channel == 1)
+            free_read_channel(channel);
+        if (stats != NULL)
+            end_read_stage(stats, READ_STAGE_DECODE, stage_start);
+        convert_output_in_place(decomp_data, options->output_format, num_samps, factor);
+        return num_samps;
     }
-    // spans across segments
-    else {
-        // start with first segment
-        if (channel->segments[start_segment].time_series_data_fps->fp == NULL)
-            channel->segments[start_segment].time_series_data_fps->fp = fopen(channel->segments[start_segment].time_series_data_fps->full_file_name, "rb");
-        fp = channel->segments[start_segment].time_series_data_fps->fp;
-#ifndef _WIN32
-        fseek(fp, channel->segments[start_segment].time_series_indices_fps->time_series_indices[start_idx].file_offset, SEEK_SET);
-#else
-        _fseeki64(fp, channel->segments[start_segment].time_series_indices_fps->time_series_indices[start_idx].file_offset, SEEK_SET);
-#endif
-        bytes_to_read = channel->segments[start_segment].time_series_data_fps->file_length -
-        channel->segments[start_segment].time_series_indices_fps->time_series_indices[start_idx].file_offset;
-        n_read = fread(cdp, sizeof(si1), (size_t) bytes_to_read, fp);
+    
+    // A reader context passed in for this channel supplies all of the buffers below, so a read that fits in what it
+    // already holds allocates nothing.  If the context can't be grown, the buffers are allocated for this read instead.
+    max_samps = channel->metadata.time_series_section_2->maximum_block_samples;
+    context = NULL;
+    if ((options->context != NULL) && (options->context->channel == channel))
+    {
+        if (reserve_read_mef_ts_context(options->context, max_samps, (io_mode == READ_IO_MMAP) ? 0 : total_data_bytes,
+                                        end_segment - start_segment + 1, (si8) num_blocks))
+            context = options->context;
+    }
+    compressed_data_buffer = block_copy = NULL;
+    temp_data_buf = NULL;
+    jobs = NULL;
+    rps = NULL;
+    
+    // the compressed data is either read into one buffer (one span), or used in place from the mapped segment files
+    // (one span per segment, only the pages of the requested blocks are touched)
+    if (context != NULL)
+        spans = context->spans;
+    else
+        spans = (COMPRESSED_SPAN *) malloc(sizeof(COMPRESSED_SPAN) * (size_t) (end_segment - start_segment + 1));
+    if (spans == NULL)
+    {
+        printf("Error allocating memory, exiting...");
         if (read_channel == 1)
-            fclose(fp);
-        if (n_read != bytes_to_read){
-            printf("Error reading file, exiting...");
-            if (read_channel == 1)
-            {
-                if (channel->number_of_segments > 0)
-                    channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-                free_channel(channel, MEF_TRUE);
-            }
-            free (compressed_data_buffer);
+            free_read_channel(channel);
+        release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+        if (options->free_decomp_data_on_error)
             free (decomp_data);
+        return 0;
+    }
+    n_spans = 0;
+    
+    if (io_mode == READ_IO_MMAP) {
+        for (i = start_segment; i <= end_segment; i++) {
+            seg_map = map_channel_segment(channel, i, &seg_map_bytes, &mapped);
+            if ((stats != NULL) && mapped)
+                stats->files_opened++;
+            if (seg_map == NULL){
+                printf("Error mapping file, exiting...");
+                if (read_channel == 1)
+                    free_read_channel(channel);
+                release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+                if (options->free_decomp_data_on_error)
+                    free (decomp_data);
+                return 0;
+            }
+            span_start = (i == start_segment) ? channel->segments[i].time_series_indices_fps->time_series_indices[start_idx].file_offset :
+                                                channel->segments[i].time_series_indices_fps->time_series_indices[0].file_offset;
+            if ((i == end_segment) && (end_idx < (ui8) (channel->segments[i].metadata_fps->metadata.time_series_section_2->number_of_blocks - 1)))
+                span_end = channel->segments[i].time_series_indices_fps->time_series_indices[end_idx+1].file_offset;
+            else
+                span_end = channel->segments[i].time_series_data_fps->file_length;
+            if ((span_start < 0) || (span_end > (si8) seg_map_bytes) || (span_end < span_start)){
+                printf("Invalid index file offset, exiting...");
+                if (read_channel == 1)
+                    free_read_channel(channel);
+                release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+                if (options->free_decomp_data_on_error)
+                    free (decomp_data);
+                return 0;
+            }
+            spans[n_spans].data = seg_map + span_start;
+            spans[n_spans].bytes = (ui8) (span_end - span_start);
+            advise_segment_map(spans[n_spans].data, spans[n_spans].bytes);
+            n_spans++;
+        }
+        cdp = spans[0].data;
+    }
+    else {
+        // read in RED data
+        if (stats != NULL)
+        {
+            for (i = start_segment; i <= end_segment; i++)
+                if (channel->segments[i].time_series_data_fps->fp == NULL)
+                    stats->files_opened++;
+        }
+        
+        // allocate buffers
+        if (context != NULL)
+            compressed_data_buffer = context->compressed_data;
+        else
+            compressed_data_buffer = (ui1 *) malloc((size_t) total_data_bytes);
+        if (compressed_data_buffer == NULL)
+        {
+            printf("Error allocating memory, exiting...");
+            if (read_channel == 1)
+                free_read_channel(channel);
+            release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+            if (options->free_decomp_data_on_error)
+                free (decomp_data);
             return 0;
         }
-        cdp += bytes_to_read;
+        cdp = compressed_data_buffer;
+        spans[0].data = compressed_data_buffer;
+        spans[0].bytes = total_data_bytes;
+        n_spans = 1;
         
-        // this loop will only run if there are segments in between the start and stop segments
-        for (i = (start_segment + 1); i <= (end_segment - 1); i++) {
-            if (channel->segments[i].time_series_data_fps->fp == NULL)
-                channel->segments[i].time_series_data_fps->fp = fopen(channel->segments[i].time_series_data_fps->full_file_name, "rb");
-            fp = channel->segments[i].time_series_data_fps->fp;
+        // normal case - everything is in one segment
+        if (start_segment == end_segment) {
+            if (channel->segments[start_segment].time_series_data_fps->fp == NULL)
+                channel->segments[start_segment].time_series_data_fps->fp = fopen(channel->segments[start_segment].time_series_data_fps->full_file_name, "rb");
+            fp = channel->segments[start_segment].time_series_data_fps->fp;
 #ifndef _WIN32
-            fseek(fp, UNIVERSAL_HEADER_BYTES, SEEK_SET);
+            fseek(fp, channel->segments[start_segment].time_series_indices_fps->time_series_indices[start_idx].file_offset, SEEK_SET);
 #else
-            _fseeki64(fp, UNIVERSAL_HEADER_BYTES, SEEK_SET);
+            _fseeki64(fp, channel->segments[start_segment].time_series_indices_fps->time_series_indices[start_idx].file_offset, SEEK_SET);
 #endif
-            bytes_to_read = channel->segments[i].time_series_data_fps->file_length -
-            channel->segments[i].time_series_indices_fps->time_series_indices[0].file_offset;
-            n_read = fread(cdp, sizeof(si1), (size_t) bytes_to_read, fp);
+            n_read = fread(cdp, sizeof(si1), (size_t) total_data_bytes, fp);
             if (read_channel == 1)
                 fclose(fp);
-            if (n_read != bytes_to_read){
+            if (n_read != total_data_bytes){
                 printf("Error reading file, exiting...");
                 if (read_channel == 1)
-                {
-                    if (channel->number_of_segments > 0)
-                        channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-                    free_channel(channel, MEF_TRUE);
-                }
-                free (compressed_data_buffer);
-                free (decomp_data);
+                    free_read_channel(channel);
+                release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+                if (options->free_decomp_data_on_error)
+                    free (decomp_data);
                 return 0;
             }
-            cdp += bytes_to_read;
         }
-        
-        // then last segment
-        num_block_in_segment = channel->segments[end_segment].metadata_fps->metadata.time_series_section_2->number_of_blocks;
-        if (end_idx < (ui8) (channel->segments[end_segment].metadata_fps->metadata.time_series_section_2->number_of_blocks - 1)) {
-            if (channel->segments[end_segment].time_series_data_fps->fp == NULL)
-                channel->segments[end_segment].time_series_data_fps->fp = fopen(channel->segments[end_segment].time_series_data_fps->full_file_name, "rb");
-            fp = channel->segments[end_segment].time_series_data_fps->fp;
+        // spans across segments
+        else {
+            // start with first segment
+            if (channel->segments[start_segment].time_series_data_fps->fp == NULL)
+                channel->segments[start_segment].time_series_data_fps->fp = fopen(channel->segments[start_segment].time_series_data_fps->full_file_name, "rb");
+            fp = channel->segments[start_segment].time_series_data_fps->fp;
 #ifndef _WIN32
-            fseek(fp, UNIVERSAL_HEADER_BYTES, SEEK_SET);
+            fseek(fp, channel->segments[start_segment].time_series_indices_fps->time_series_indices[start_idx].file_offset, SEEK_SET);
 #else
-            _fseeki64(fp, UNIVERSAL_HEADER_BYTES, SEEK_SET);
+            _fseeki64(fp, channel->segments[start_segment].time_series_indices_fps->time_series_indices[start_idx].file_offset, SEEK_SET);
 #endif
-            bytes_to_read = channel->segments[end_segment].time_series_indices_fps->time_series_indices[end_idx+1].file_offset -
-            channel->segments[end_segment].time_series_indices_fps->time_series_indices[0].file_offset;
+            bytes_to_read = channel->segments[start_segment].time_series_data_fps->file_length -
+            channel->segments[start_segment].time_series_indices_fps->time_series_indices[start_idx].file_offset;
             n_read = fread(cdp, sizeof(si1), (size_t) bytes_to_read, fp);
             if (read_channel == 1)
                 fclose(fp);
             if (n_read != bytes_to_read){
                 printf("Error reading file, exiting...");
                 if (read_channel == 1)
-                {
-                    if (channel->number_of_segments > 0)
-                        channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-                    free_channel(channel, MEF_TRUE);
-                }
-                free (compressed_data_buffer);
-                free (decomp_data);
+                    free_read_channel(channel);
+                release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+                if (options->free_decomp_data_on_error)
+                    free (decomp_data);
                 return 0;
             }
             cdp += bytes_to_read;
-        }
-        else {
-            // case where end_idx is last block in segment
-            if (channel->segments[end_segment].time_series_data_fps->fp == NULL)
-                channel->segments[end_segment].time_series_data_fps->fp = fopen(channel->segments[end_segment].time_series_data_fps->full_file_name, "rb");
-            fp = channel->segments[end_segment].time_series_data_fps->fp;
+            
+            // this loop will only run if there are segments in between the start and stop segments
+            for (i = (start_segment + 1); i <= (end_segment - 1); i++) {
+                if (channel->segments[i].time_series_data_fps->fp == NULL)
+                    channel->segments[i].time_series_data_fps->fp = fopen(channel->segments[i].time_series_data_fps->full_file_name, "rb");
+                fp = channel->segments[i].time_series_data_fps->fp;
 #ifndef _WIN32
-            fseek(fp, UNIVERSAL_HEADER_BYTES, SEEK_SET);
+                fseek(fp, UNIVERSAL_HEADER_BYTES, SEEK_SET);
 #else
-            _fseeki64(fp, UNIVERSAL_HEADER_BYTES, SEEK_SET);
+                _fseeki64(fp, UNIVERSAL_HEADER_BYTES, SEEK_SET);
 #endif
-            bytes_to_read = channel->segments[end_segment].time_series_data_fps->file_length -
-            channel->segments[end_segment].time_series_indices_fps->time_series_indices[0].file_offset;
-            n_read = fread(cdp, sizeof(si1), (size_t) bytes_to_read, fp);
-            if (read_channel == 1)
-                fclose(fp);
-            if (n_read != bytes_to_read){
-                printf("Error reading file, exiting...");
+                bytes_to_read = channel->segments[i].time_series_data_fps->file_length -
+                channel->segments[i].time_series_indices_fps->time_series_indices[0].file_offset;
+                n_read = fread(cdp, sizeof(si1), (size_t) bytes_to_read, fp);
                 if (read_channel == 1)
-                {
-                    if (channel->number_of_segments > 0)
-                        channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-                    free_channel(channel, MEF_TRUE);
+                    fclose(fp);
+                if (n_read != bytes_to_read){
+                    printf("Error reading file, exiting...");
+                    if (read_channel == 1)
+                        free_read_channel(channel);
+                    release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+                    if (options->free_decomp_data_on_error)
+                        free (decomp_data);
+                    return 0;
                 }
-                free (compressed_data_buffer);
-                free (decomp_data);
-                return 0;
+                cdp += bytes_to_read;
+            }
+            
+            // then last segment
+            num_block_in_segment = channel->segments[end_segment].metadata_fps->metadata.time_series_section_2->number_of_blocks;
+            if (end_idx < (ui8) (channel->segments[end_segment].metadata_fps->metadata.time_series_section_2->number_of_blocks - 1)) {
+                if (channel->segments[end_segment].time_series_data_fps->fp == NULL)
+                    channel->segments[end_segment].time_series_data_fps->fp = fopen(channel->segments[end_segment].time_series_data_fps->full_file_name, "rb");
+                fp = channel->segments[end_segment].time_series_data_fps->fp;
+#ifndef _WIN32
+                fseek(fp, UNIVERSAL_HEADER_BYTES, SEEK_SET);
+#else
+                _fseeki64(fp, UNIVERSAL_HEADER_BYTES, SEEK_SET);
+#endif
+                bytes_to_read = channel->segments[end_segment].time_series_indices_fps->time_series_indices[end_idx+1].file_offset -
+                channel->segments[end_segment].time_series_indices_fps->time_series_indices[0].file_offset;
+                n_read = fread(cdp, sizeof(si1), (size_t) bytes_to_read, fp);
+                if (read_channel == 1)
+                    fclose(fp);
+                if (n_read != bytes_to_read){
+                    printf("Error reading file, exiting...");
+                    if (read_channel == 1)
+                        free_read_channel(channel);
+                    release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+                    if (options->free_decomp_data_on_error)
+                        free (decomp_data);
+                    return 0;
+                }
+                cdp += bytes_to_read;
+            }
+            else {
+                // case where end_idx is last block in segment
+                if (channel->segments[end_segment].time_series_data_fps->fp == NULL)
+                    channel->segments[end_segment].time_series_data_fps->fp = fopen(channel->segments[end_segment].time_series_data_fps->full_file_name, "rb");
+                fp = channel->segments[end_segment].time_series_data_fps->fp;
+#ifndef _WIN32
+                fseek(fp, UNIVERSAL_HEADER_BYTES, SEEK_SET);
+#else
+                _fseeki64(fp, UNIVERSAL_HEADER_BYTES, SEEK_SET);
+#endif
+                bytes_to_read = channel->segments[end_segment].time_series_data_fps->file_length -
+                channel->segments[end_segment].time_series_indices_fps->time_series_indices[0].file_offset;
+                n_read = fread(cdp, sizeof(si1), (size_t) bytes_to_read, fp);
+                if (read_channel == 1)
+                    fclose(fp);
+                if (n_read != bytes_to_read){
+                    printf("Error reading file, exiting...");
+                    if (read_channel == 1)
+                        free_read_channel(channel);
+                    release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+                    if (options->free_decomp_data_on_error)
+                        free (decomp_data);
+                    return 0;
+                }
+                cdp += bytes_to_read;
             }
-            cdp += bytes_to_read;
         }
     }
     
+    if (stats != NULL)
+    {
+        for (i = 0; i < n_spans; i++)
+            stats->bytes_read += spans[i].bytes;
+        stage_start = end_read_stage(stats, READ_STAGE_IO, stage_start);
+    }
+    
     // set up RED processing struct
-    cdp = compressed_data_buffer;
-    max_samps = channel->metadata.time_series_section_2->maximum_block_samples;
+    cdp = spans[0].data;
+    span = 0;
     
     // create RED processing struct
-    rps = (RED_PROCESSING_STRUCT *) calloc((size_t) 1, sizeof(RED_PROCESSING_STRUCT));
-    rps->compression.mode = RED_DECOMPRESSION;
+    rps = (context != NULL) ? context->rps : allocate_decode_rps(max_samps);
+    if (rps == NULL)
+    {
+        printf("Error allocating memory, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+        if (options->free_decomp_data_on_error)
+            free (decomp_data);
+        return 0;
+    }
+    rps->password_data = channel_password_data(channel);
+    verified.channel = NULL;
     //rps->directives.return_block_extrema = MEF_TRUE;
     rps->decompressed_ptr = rps->decompressed_data = decomp_data;
-    rps->difference_buffer = (si1 *) e_calloc((size_t) RED_MAX_DIFFERENCE_BYTES(max_samps) + 1, sizeof(ui1), __FUNCTION__, __LINE__, USE_GLOBAL_BEHAVIOR);
     
     // offset_to_start_samp = start_samp - channel->segments[start_segment].time_series_indices_fps->time_series_indices[start_idx].start_sample;
     
     sample_counter = 0;
     
-    cdp = compressed_data_buffer;
+    // Mapped blocks are copied to a block sized buffer before decoding, as decoding works in place.  (The copy is of
+    // one block, and stays in cache.)  CRCs are checked on the mapped data.
+    if (io_mode == READ_IO_MMAP)
+        block_copy = (context != NULL) ? context->block_copy : (ui1 *) malloc((size_t) RED_MAX_COMPRESSED_BYTES(max_samps, 1));
     
-    // TBD use real max block length
-    temp_data_buf = (int *) malloc(33000 * 4);
-    rps->decompressed_ptr = rps->decompressed_data = temp_data_buf;
-    rps->compressed_data = cdp;
-    rps->block_header = (RED_BLOCK_HEADER *) rps->compressed_data;
-    if (!check_block_crc((ui1*)(rps->block_header), max_samps, compressed_data_buffer, total_data_bytes))
+    // first and last blocks are decoded here, then clipped into the output; the buffer holds max_samps samples, which
+    // check_block_bounds() (run on every block before it is decoded, under any CRC policy) ensures is enough
+    temp_data_buf = (context != NULL) ? context->block_samples : (si4 *) malloc(sizeof(si4) * ((size_t) max_samps + 1));
+    if ((temp_data_buf == NULL) || ((io_mode == READ_IO_MMAP) && (block_copy == NULL)))
+    {
+        printf("Error allocating memory, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+        if (options->free_decomp_data_on_error)
+            free (decomp_data);
+        return 0;
+    }
+    if (!check_and_decode_block(channel, first_block, rps, cdp, max_samps, spans[span].data, spans[span].bytes, temp_data_buf, block_copy, &verified, times))
     {
         printf("RED block %lu has 0 bytes, or CRC failed, data likely corrupt...", start_idx);
         if (read_channel == 1)
-        {
-            if (channel->number_of_segments > 0)
-                channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-            free_channel(channel, MEF_TRUE);
-        }
-        free (compressed_data_buffer);
-        free (decomp_data);
-        free (temp_data_buf);
+            free_read_channel(channel);
+        release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+        if (options->free_decomp_data_on_error)
+            free (decomp_data);
         return 0;
     }
-    RED_decode(rps);
-    cdp += rps->block_header->block_bytes;
+    cdp = next_block_ptr(spans, n_spans, &span, cdp);
     
     
         if (times_specified)
@@ -733,90 +1240,106 @@ si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_
                                                channel->segments[start_segment].time_series_indices_fps->time_series_indices[start_idx].start_sample) - start_samp;
         
 
-    // copy requested samples from first block to output buffer
-    // TBD this loop could be optimized
-    for (i=0;i<rps->block_header->number_of_samples;i++)
+    // copy requested samples from first block to output buffer, and move past them
+    copy_block_clipped(decomp_data, num_samps, offset_into_output_buffer, temp_data_buf, rps->block_header->number_of_samples);
+    if (offset_into_output_buffer < num_samps)
     {
-        if (offset_into_output_buffer < 0)
-        {
-            offset_into_output_buffer++;
-            continue;
-        }
-        
-        if ((ui4) offset_into_output_buffer >= num_samps)
-            break;
-        
-        *(decomp_data + offset_into_output_buffer) = temp_data_buf[i];
-        
-        offset_into_output_buffer++;
+        if (offset_into_output_buffer + (si8) rps->block_header->number_of_samples < num_samps)
+            offset_into_output_buffer += rps->block_header->number_of_samples;
+        else
+            offset_into_output_buffer = num_samps;
     }
     
     // decode bytes to samples
+    // First walk the middle blocks to work out where each one lands in the output buffer (this only needs the block
+    // headers), then decode them, split across worker threads if more than one is configured.
     sample_counter = offset_into_output_buffer;
-    for (i=1;i<num_blocks-1;i++) {
-        rps->compressed_data = cdp;
-        rps->block_header = (RED_BLOCK_HEADER *) rps->compressed_data;
+    if (context != NULL)
+        jobs = context->jobs;
+    else
+        jobs = (DECODE_BLOCK_JOB *) malloc(sizeof(DECODE_BLOCK_JOB) * (size_t) ((num_blocks > 2) ? (num_blocks - 2) : 1));
+    if (jobs == NULL)
+    {
+        printf("Error allocating memory, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+        if (options->free_decomp_data_on_error)
+            free (decomp_data);
+        return 0;
+    }
+    n_jobs = 0;
+    for (i=1;i<(si8) num_blocks-1;i++) {
+        block_header = (RED_BLOCK_HEADER *) cdp;
         // check that block fits fully within output array
         // this should be true, but it's possible a stray block exists out-of-order, or with a bad timestamp
         
         // we need to manually remove offset, since we are using the time value of the block bevore decoding the block
         // (normally the offset is removed during the decoding process)
         
-        if ((rps->block_header->block_bytes == 0) || !check_block_crc((ui1*)(rps->block_header), max_samps, compressed_data_buffer, total_data_bytes)){
+        if (!check_block_bounds(cdp, max_samps, spans[span].data, spans[span].bytes) || (block_header->block_bytes == 0)){
             printf("RED block %lu has 0 bytes, or CRC failed, data likely corrupt...", start_idx+i);
             if (read_channel == 1)
-            {
-                if (channel->number_of_segments > 0)
-                    channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-                free_channel(channel, MEF_TRUE);
-            }
-            free (compressed_data_buffer);
-            free (decomp_data);
-            free (temp_data_buf);
+                free_read_channel(channel);
+            release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+            if (options->free_decomp_data_on_error)
+                free (decomp_data);
             return 0;
         }
         
         if (times_specified){
             
-            block_start_time_offset = rps->block_header->start_time;
+            block_start_time_offset = block_header->start_time;
             remove_recording_time_offset( &block_start_time_offset );
             
+            // A skipped block is never stepped over, so every remaining middle block is skipped too, and the
+            // skipped block is the one decoded as the "last" block below.
             if (block_start_time_offset < start_time)
-                continue;
-            if (block_start_time_offset + ((rps->block_header->number_of_samples / channel->metadata.time_series_section_2->sampling_frequency) * 1e6) >= end_time)
-                continue;
-            rps->decompressed_ptr = rps->decompressed_data = decomp_data + (int)((((block_start_time_offset - start_time) / 1000000.0) * channel->metadata.time_series_section_2->sampling_frequency) + 0.5);
+                break;
+            if (block_start_time_offset + ((block_header->number_of_samples / channel->metadata.time_series_section_2->sampling_frequency) * 1e6) >= end_time)
+                break;
+            jobs[n_jobs].output_ptr = decomp_data + (int)((((block_start_time_offset - start_time) / 1000000.0) * channel->metadata.time_series_section_2->sampling_frequency) + 0.5);
             
         }else{
-            rps->decompressed_ptr = rps->decompressed_data = decomp_data + sample_counter;
+            jobs[n_jobs].output_ptr = decomp_data + sample_counter;
         }
         
-        RED_decode(rps);
-        cdp += rps->block_header->block_bytes;
-        sample_counter += rps->block_header->number_of_samples;
+        jobs[n_jobs].block_ptr = cdp;
+        jobs[n_jobs].bytes_available = spans[span].bytes - (ui8) (cdp - spans[span].data);
+        jobs[n_jobs].number_of_samples = block_header->number_of_samples;
+        jobs[n_jobs].channel = channel;
+        jobs[n_jobs].block = first_block + 1 + n_jobs;
+        n_jobs++;
+        cdp = next_block_ptr(spans, n_spans, &span, cdp);
+        sample_counter += block_header->number_of_samples;
+    }
+    i = (si4) ((num_blocks > 1) ? (num_blocks - 1) : 1);
+    
+    failed_job = decode_block_jobs_timed(jobs, n_jobs, max_samps, (block_copy != NULL), n_threads, rps, block_copy, times);
+    if (failed_job >= 0)
+    {
+        printf("RED block %lu has 0 bytes, or CRC failed, data likely corrupt...", start_idx + 1 + failed_job);
+        if (read_channel == 1)
+            free_read_channel(channel);
+        release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+        if (options->free_decomp_data_on_error)
+            free (decomp_data);
+        return 0;
     }
     
     if (num_blocks > 1)
     {
-        // decode last block to temp array
-        rps->compressed_data = cdp;
-        rps->block_header = (RED_BLOCK_HEADER *) rps->compressed_data;
-        rps->decompressed_ptr = rps->decompressed_data = temp_data_buf;
-        if (!check_block_crc((ui1*)(rps->block_header), max_samps, compressed_data_buffer, total_data_bytes))
+        // decode last block to temp array (the block after the middle blocks decoded)
+        if (!check_and_decode_block(channel, first_block + 1 + n_jobs, rps, cdp, max_samps, spans[span].data, spans[span].bytes, temp_data_buf, block_copy, &verified, times))
         {
             printf("RED block %lu has 0 bytes, or CRC failed, data likely corrupt...", start_idx+i);
             if (read_channel == 1)
-            {
-                if (channel->number_of_segments > 0)
-                    channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-                free_channel(channel, MEF_TRUE);
-            }
-            free (compressed_data_buffer);
-            free (decomp_data);
-            free (temp_data_buf);
+                free_read_channel(channel);
+            release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
+            if (options->free_decomp_data_on_error)
+                free (decomp_data);
             return 0;
         }
-        RED_decode(rps);
    
  		if (times_specified)
         {
@@ -831,160 +1354,8084 @@ si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_
             offset_into_output_buffer = sample_counter;
         
         // copy requested samples from last block to output buffer
-        // TBD this loop could be optimized
-        for (i=0;i<rps->block_header->number_of_samples;i++)
-        {
-            if (offset_into_output_buffer < 0)
-            {
-                offset_into_output_buffer++;
-                continue;
-            }
-            
-            if ((ui4) offset_into_output_buffer >= num_samps)
-                break;
-            
-            *(decomp_data + offset_into_output_buffer) = temp_data_buf[i];
-            
-            offset_into_output_buffer++;
-        }
+        copy_block_clipped(decomp_data, num_samps, offset_into_output_buffer, temp_data_buf, rps->block_header->number_of_samples);
+    }
+    
+    if (stats != NULL)
+    {
+        add_decode_times(stats, times);
+        end_read_stage(stats, READ_STAGE_DECODE, stage_start);
     }
     
     // copy requested samples from last block to output buffer
     // we're done with the compressed data, get rid of it
-    free (temp_data_buf);
-    free (compressed_data_buffer);
-    free (rps->difference_buffer);
-    free (rps);
+    release_read_buffers(context, compressed_data_buffer, spans, block_copy, temp_data_buf, jobs, rps);
     
     if (read_channel == 1)
-    {
-        if (channel->number_of_segments > 0)
-            channel->segments[0].metadata_fps->directives.free_password_data = MEF_TRUE;
-        free_channel(channel, MEF_TRUE);
-    }
+        free_read_channel(channel);
     
+    convert_output_in_place(decomp_data, options->output_format, num_samps, factor);
     
     return num_samps;
 }
 
-/**************************  Other helper functions  ****************************/
+/**************************  Read planning  ****************************/
 
-si8 sample_for_uutc_c(si8 uutc, CHANNEL *channel)
+// Finds the segments and blocks (within their segments) holding the first and last samples of a read.  Returns 0 if no
+// segment contains the range.
+static si4 locate_read_blocks(CHANNEL_BLOCK_INDEX *index, si4 times_specified, si8 start_time, si8 end_time, si8 start_samp, si8 end_samp,
+                              si4 *start_segment, si4 *end_segment, ui8 *start_idx, ui8 *end_idx)
 {
-    ui8 i, j, sample;
-    sf8 native_samp_freq;
-    ui8 prev_sample_number;
-    si8 prev_time, seg_start_sample;
-    si8 next_sample_number;
-    
-    native_samp_freq = channel->metadata.time_series_section_2->sampling_frequency;
-    prev_sample_number = channel->segments[0].metadata_fps->metadata.time_series_section_2->start_sample;
-    prev_time = channel->segments[0].time_series_indices_fps->time_series_indices[0].start_time;
+    si8 seg_first_block, seg_end_block;
     
-    for (j = 0; j < (ui8) channel->number_of_segments; j++)
-    {
-        seg_start_sample = channel->segments[j].metadata_fps->metadata.time_series_section_2->start_sample;
-        
-        // initialize next_sample_number to end of current segment, in case we're on the last segment and we
-        // go all the way to the end of the segment.
-        // Otherwise this value will get overridden later on
-        next_sample_number = seg_start_sample + channel->segments[j].metadata_fps->metadata.time_series_section_2->number_of_samples;
-        
-        for (i = 0; i < (ui8) channel->segments[j].metadata_fps->metadata.time_series_section_2->number_of_blocks; ++i) {
-            if (channel->segments[j].time_series_indices_fps->time_series_indices[i].start_time > uutc)
-            {
-                next_sample_number = channel->segments[j].time_series_indices_fps->time_series_indices[i].start_sample + seg_start_sample;
-                goto done;
-            }
-            prev_sample_number = channel->segments[j].time_series_indices_fps->time_series_indices[i].start_sample + seg_start_sample;
-            prev_time = channel->segments[j].time_series_indices_fps->time_series_indices[i].start_time;
+    // Find start and stop segments by uutc time
+    // find start segment by finding first segment whose ending is past the start time.
+    // then find stop segment by using the previous segment of the (first segment whose start is past the end time)
+    *start_segment = *end_segment = -1;
+    if (times_specified){
+        *start_segment = block_index_first_segment_ending_at_or_after(index, start_time);
+        if (*start_segment >= 0)
+        {
+            *end_segment = block_index_last_segment_starting_at_or_before(index, end_time);
+            if (*end_segment < *start_segment)
+                *end_segment = *start_segment;
         }
+    }else{
+        *start_segment = block_index_segment_for_sample(index, start_samp);
+        *end_segment = block_index_segment_for_sample(index, end_samp);
     }
     
-done:
+    if ((*start_segment < 0) || (*end_segment < 0))
+        return 0;
+    
+    // find start block in start segment: the last block starting at or before start time (block 0 if none)
+    seg_first_block = index->segment_first_block[*start_segment];
+    seg_end_block = index->segment_first_block[*start_segment + 1];
+    *start_idx = *end_idx = 0;
+    if (seg_end_block - seg_first_block > 1)
+        *start_idx = (ui8) (block_index_first_after_time(index, seg_first_block + 1, seg_end_block, start_time, MEF_TRUE) - 1 - seg_first_block);
     
-    sample = prev_sample_number + (ui8) (((((sf8) (uutc - prev_time)) / 1000000.0) * native_samp_freq) + 0.5);
-    if (sample > next_sample_number)
-        sample = next_sample_number;  // prevent it from going too far
+    // find stop block in stop segment
+    seg_first_block = index->segment_first_block[*end_segment];
+    seg_end_block = index->segment_first_block[*end_segment + 1];
+    if (seg_end_block - seg_first_block > 1)
+        *end_idx = (ui8) (block_index_first_after_time(index, seg_first_block + 1, seg_end_block, end_time, MEF_TRUE) - 1 - seg_first_block);
     
-    return(sample);
+    return 1;
 }
 
-si8 uutc_for_sample_c(si8 sample, CHANNEL *channel)
+// user specifies a time range
+si4 plan_mef_ts_read_by_time(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, READ_MEF_TS_PLAN *plan, CHANNEL *channel_passed_in)
 {
-    ui8 i, j, uutc;
-    sf8 native_samp_freq;
-    ui8 prev_sample_number; 
-    si8 prev_time, seg_start_sample;
-
+    return plan_mef_ts_read(channel_path, password, start_time, end_time, 1, plan, channel_passed_in);
+}
 
-    native_samp_freq = channel->metadata.time_series_section_2->sampling_frequency;
-    prev_sample_number = channel->segments[0].metadata_fps->metadata.time_series_section_2->start_sample;
-    prev_time = channel->segments[0].time_series_indices_fps->time_series_indices[0].start_time;
+// user specifies a range of samples
+si4 plan_mef_ts_read_by_samp(si1 *channel_path, si1 *password, si8 start_samp, si8 end_samp, READ_MEF_TS_PLAN *plan, CHANNEL *channel_passed_in)
+{
+    return plan_mef_ts_read(channel_path, password, start_samp, end_samp, 0, plan, channel_passed_in);
+}
 
-    for (j = 0; j < (ui8) channel->number_of_segments; j++)
+// Works out, from the block index alone, what read_mef_ts_data() would return and read for the same range.  Returns 1,
+// or 0 (with plan zeroed) where the read would fail.
+si4 plan_mef_ts_read(si1 *channel_path, si1 *password, si8 start_value, si8 end_value, si4 times_specified, READ_MEF_TS_PLAN *plan, CHANNEL *channel_passed_in)
+{
+    CHANNEL *channel;
+    CHANNEL_BLOCK_INDEX *index;
+    si8 start_time, end_time, start_samp, end_samp, number_of_samples;
+    si8 block, seg_first_block, seg_last_block, block_time;
+    si4 start_segment, end_segment, segment, read_channel;
+    ui8 start_idx, end_idx;
+    
+    if (plan == NULL)
+        return 0;
+    memset(plan, 0, sizeof(READ_MEF_TS_PLAN));
+    
+    if (channel_passed_in == NULL)
     {
-        seg_start_sample = channel->segments[j].metadata_fps->metadata.time_series_section_2->start_sample;
-        for (i = 0; i < (ui8) channel->segments[j].metadata_fps->metadata.time_series_section_2->number_of_blocks; ++i){
-            if (channel->segments[j].time_series_indices_fps->time_series_indices[i].start_sample + seg_start_sample > sample)
-                goto done;
-            prev_sample_number = channel->segments[j].time_series_indices_fps->time_series_indices[i].start_sample + seg_start_sample;
-            prev_time = channel->segments[j].time_series_indices_fps->time_series_indices[i].start_time;
+        read_channel = 1;
+        
+        // set up mef 3 library
+        (void) initialize_meflib();
+        MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
+        
+        channel = read_channel_with_cached_password(channel_path, password);
+        
+        if (channel == NULL)
+            return 0;
+        if (channel->channel_type != TIME_SERIES_CHANNEL_TYPE) {
+            printf("Not a time series channel, exiting...");
+            free_read_channel(channel);
+            return 0;
         }
     }
-
-    done:
-        uutc = prev_time + (ui8) ((((sf8) (sample - prev_sample_number) / native_samp_freq) * 1000000.0) + 0.5);
+    else
+    {
+        read_channel = 0;
+        channel = channel_passed_in;
+    }
     
-    return(uutc);
+    // same range checks and adjustments as read_mef_ts_data()
+    start_time = end_time = start_samp = end_samp = 0;
+    if (times_specified)
+    {
+        start_time = start_value;
+        end_time = end_value;
+        if ((start_time >= end_time) ||
+            ((start_time < channel->earliest_start_time) && (end_time < channel->earliest_start_time)) ||
+            ((start_time > channel->latest_end_time) && (end_time > channel->latest_end_time)))
+        {
+            printf("Invalid time range, exiting...");
+            if (read_channel == 1)
+                free_read_channel(channel);
+            return 0;
+        }
+        number_of_samples = (si8) (((end_time - start_time) / 1000000.0) * channel->metadata.time_series_section_2->sampling_frequency);
+    }
+    else
+    {
+        start_samp = start_value;
+        end_samp = end_value;
+        if ((start_samp >= end_samp) || ((start_samp < 0) && (end_samp < 0)) ||
+            ((start_samp > channel->metadata.time_series_section_2->number_of_samples) && (end_samp > channel->metadata.time_series_section_2->number_of_samples)))
+        {
+            printf("Invalid sample range, exiting...");
+            if (read_channel == 1)
+                free_read_channel(channel);
+            return 0;
+        }
+        if (end_samp > channel->metadata.time_series_section_2->number_of_samples)
+            end_samp = channel->metadata.time_series_section_2->number_of_samples;
+        if (start_samp < 0)
+            start_samp = 0;
+        number_of_samples = end_samp - start_samp;
+    }
+    
+    index = get_channel_block_index(channel);
+    if (index == NULL)
+    {
+        printf("Could not index channel, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        return 0;
+    }
+    
+    if (times_specified) {
+        start_samp = sample_for_uutc_c(start_time, channel);
+        end_samp = sample_for_uutc_c(end_time, channel);
+    }else{
+        start_time = uutc_for_sample_c(start_samp, channel);
+        end_time = uutc_for_sample_c(end_samp, channel);
+    }
+    
+    if (!locate_read_blocks(index, times_specified, start_time, end_time, start_samp, end_samp, &start_segment, &end_segment, &start_idx, &end_idx))
+    {
+        printf("No segment contains the requested range, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        return 0;
+    }
+    
+    plan->number_of_samples = number_of_samples;
+    plan->number_of_recorded_samples = end_samp - start_samp;
+    plan->first_block = index->segment_first_block[start_segment] + (si8) start_idx;
+    plan->last_block = index->segment_first_block[end_segment] + (si8) end_idx;
+    plan->number_of_blocks = plan->last_block - plan->first_block + 1;
+    plan->number_of_segments = end_segment - start_segment + 1;
+    
+    // compressed data read from each segment: from the first block read in it, to the end of the last
+    for (segment = start_segment; segment <= end_segment; segment++)
+    {
+        seg_first_block = (segment == start_segment) ? plan->first_block : index->segment_first_block[segment];
+        seg_last_block = (segment == end_segment) ? plan->last_block : index->segment_first_block[segment + 1] - 1;
+        plan->compressed_bytes += (ui8) (block_index_block_end_offset(index, channel, seg_last_block) - index->file_offset[seg_first_block]);
+    }
+    
+    // Gaps: a discontinuity between the blocks read, or (by time) the range extending past the recording, or into the
+    // gap following the last block read.
+    for (block = plan->first_block + 1; (block <= plan->last_block) && !plan->has_gaps; block++)
+        if (index->discontinuity[block])
+            plan->has_gaps = MEF_TRUE;
+    if (times_specified && !plan->has_gaps)
+    {
+        if ((start_time < channel->earliest_start_time) || (end_time > channel->latest_end_time))
+            plan->has_gaps = MEF_TRUE;
+        else if ((plan->last_block + 1 < index->number_of_blocks) && index->discontinuity[plan->last_block + 1])
+        {
+            block_time = index->start_time[plan->last_block];
+            remove_recording_time_offset(&block_time);
+            if (block_time + (si8) ((((index->start_sample[plan->last_block + 1] - index->start_sample[plan->last_block]) /
+                                      channel->metadata.time_series_section_2->sampling_frequency) * 1e6) + 0.5) < end_time)
+                plan->has_gaps = MEF_TRUE;
+        }
+    }
+    
+    if (read_channel == 1)
+        free_read_channel(channel);
+    
+    return 1;
 }
 
-void memset_int(si4 *ptr, si4 value, size_t num)
+/**************************  Reader contexts  ****************************/
+
+READ_MEF_TS_CONTEXT *create_read_mef_ts_context(CHANNEL *channel)
 {
-    si4 *temp_ptr;
-    int i;
+    READ_MEF_TS_CONTEXT *context;
+    si8 largest_block;
     
-    if (num < 1)
-        return;
+    if ((channel == NULL) || (channel->channel_type != TIME_SERIES_CHANNEL_TYPE))
+    {
+        printf("Not a time series channel, exiting...");
+        return NULL;
+    }
     
-    temp_ptr = ptr;
-    for (i=0;i<num;i++)
+    context = (READ_MEF_TS_CONTEXT *) calloc((size_t) 1, sizeof(READ_MEF_TS_CONTEXT));
+    if (context == NULL)
+        return NULL;
+    context->channel = channel;
+    
+    // start with room for the channel's largest block, and its segments
+    largest_block = channel->metadata.time_series_section_2->maximum_block_bytes;
+    if (largest_block <= 0)
+        largest_block = RED_MAX_COMPRESSED_BYTES(channel->metadata.time_series_section_2->maximum_block_samples, 1);
+    if (!reserve_read_mef_ts_context(context, channel->metadata.time_series_section_2->maximum_block_samples, (ui8) largest_block,
+                                     (si4) channel->number_of_segments, 1))
     {
-        memcpy(temp_ptr, &value, sizeof(si4));
-        temp_ptr++;
+        free_read_mef_ts_context(context);
+        return NULL;
     }
+    
+    return context;
 }
 
-si4 check_block_crc(ui1* block_hdr_ptr, ui4 max_samps, ui1* total_data_ptr, ui8 total_data_bytes)
+void free_read_mef_ts_context(READ_MEF_TS_CONTEXT *context)
 {
-    ui8 offset_into_data, remaining_buf_size;
-    si1 CRC_valid;
-    RED_BLOCK_HEADER* block_header;
+    if (context == NULL)
+        return;
     
-    offset_into_data = block_hdr_ptr - total_data_ptr;
-    remaining_buf_size = total_data_bytes - offset_into_data;
+    free_decode_rps(context->rps);
+    free (context->block_samples);
+    free (context->block_copy);
+    free (context->compressed_data);
+    free (context->spans);
+    free (context->jobs);
+    free (context);
+}
+
+// Grows the context's buffers, if needed, for a read of n_blocks blocks in n_spans segments, with compressed_bytes of
+// compressed data read into memory.  Returns 0 if it couldn't; buffers already held are kept.
+static si4 reserve_read_mef_ts_context(READ_MEF_TS_CONTEXT *context, ui4 max_samps, ui8 compressed_bytes, si4 n_spans, si8 n_blocks)
+{
+    RED_PROCESSING_STRUCT *rps;
+    si4 *block_samples;
+    ui1 *block_copy, *compressed_data;
+    COMPRESSED_SPAN *spans;
+    DECODE_BLOCK_JOB *jobs;
     
-    // check if remaining buffer at least contains the RED block header
-    if (remaining_buf_size < RED_BLOCK_HEADER_BYTES)
-        return 0;
+    // block sized buffers (max_samps samples, see check_block_bounds()), replaced if the channel's largest block has grown
+    if ((context->rps == NULL) || (max_samps > context->max_samps))
+    {
+        rps = allocate_decode_rps(max_samps);
+        block_samples = (si4 *) malloc(sizeof(si4) * ((size_t) max_samps + 1));
+        block_copy = (ui1 *) malloc((size_t) RED_MAX_COMPRESSED_BYTES(max_samps, 1));
+        if ((rps == NULL) || (rps->difference_buffer == NULL) || (block_samples == NULL) || (block_copy == NULL))
+        {
+            free_decode_rps(rps);
+            free (block_samples);
+            free (block_copy);
+            return 0;
+        }
+        free_decode_rps(context->rps);
+        free (context->block_samples);
+        free (context->block_copy);
+        context->rps = rps;
+        context->block_samples = block_samples;
+        context->block_copy = block_copy;
+        context->max_samps = max_samps;
+    }
     
-    block_header = (RED_BLOCK_HEADER*) block_hdr_ptr;
+    if (compressed_bytes > context->compressed_data_bytes)
+    {
+        compressed_data = (ui1 *) realloc(context->compressed_data, (size_t) compressed_bytes);
+        if (compressed_data == NULL)
+            return 0;
+        context->compressed_data = compressed_data;
+        context->compressed_data_bytes = compressed_bytes;
+    }
     
-    // check if entire block, based on size specified in header, can possibly fit in the remaining buffer
-    if (block_header->block_bytes > remaining_buf_size)
+    if (n_spans > context->number_of_spans)
+    {
+        spans = (COMPRESSED_SPAN *) realloc(context->spans, sizeof(COMPRESSED_SPAN) * (size_t) n_spans);
+        if (spans == NULL)
+            return 0;
+        context->spans = spans;
+        context->number_of_spans = n_spans;
+    }
+    
+    if (n_blocks > context->number_of_jobs)
+    {
+        jobs = (DECODE_BLOCK_JOB *) realloc(context->jobs, sizeof(DECODE_BLOCK_JOB) * (size_t) n_blocks);
+        if (jobs == NULL)
+            return 0;
+        context->jobs = jobs;
+        context->number_of_jobs = n_blocks;
+    }
+    
+    return 1;
+}
+
+// frees the buffers of a read, unless they belong to a context
+static void release_read_buffers(READ_MEF_TS_CONTEXT *context, ui1 *compressed_data_buffer, COMPRESSED_SPAN *spans, ui1 *block_copy,
+                                 si4 *temp_data_buf, DECODE_BLOCK_JOB *jobs, RED_PROCESSING_STRUCT *rps)
+{
+    if (context != NULL)
+        return;
+    
+    free (compressed_data_buffer);
+    free (spans);
+    free (block_copy);
+    free (temp_data_buf);
+    free (jobs);
+    free_decode_rps(rps);
+}
+
+/**************************  Lazy channels  ****************************/
+
+static si4 compare_segment_names(const void *a, const void *b)
+{
+    return strcmp(*((si1 **) a), *((si1 **) b));
+}
+
+// Lists the .segd directories of a channel, in segment order.  Returns the number found, or -1 on error or if there are
+// none; *names (allocated in one block, free it with free()) holds the directory names, and is NULL when -1 is returned.
+static si8 list_channel_segments(si1 *channel_path, si1 ***names)
+{
+    si1 **list, **grown, *name;
+    si8 n, n_allocated, len;
+    size_t name_bytes;
+    si4 failed;
+#ifndef _WIN32
+    DIR *dir;
+    struct dirent *entry;
+#else
+    si1 pattern[MEF_FULL_FILE_NAME_BYTES];
+    WIN32_FIND_DATAA find_data;
+    HANDLE find_handle;
+#endif
+    
+    *names = NULL;
+    n = 0;
+    failed = 0;
+    n_allocated = 64;
+    list = (si1 **) malloc(sizeof(si1 *) * (size_t) n_allocated);
+    if (list == NULL)
+        return -1;
+    
+#ifndef _WIN32
+    dir = opendir(channel_path);
+    if (dir == NULL)
+    {
+        free (list);
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL)
+    {
+        name = entry->d_name;
+#else
+    MEF_snprintf(pattern, MEF_FULL_FILE_NAME_BYTES, "%s\\*.%s", channel_path, SEGMENT_DIRECTORY_TYPE_STRING);
+    find_handle = FindFirstFileA(pattern, &find_data);
+    if (find_handle == INVALID_HANDLE_VALUE)
+    {
+        free (list);
+        return -1;
+    }
+    do
+    {
+        name = find_data.cFileName;
+#endif
+        len = (si8) strlen(name);
+        if ((len <= 5) || (name[len - 5] != '.') || strcmp(name + len - 4, SEGMENT_DIRECTORY_TYPE_STRING))
+            continue;
+        if (n == n_allocated)
+        {
+            grown = (si1 **) realloc(list, sizeof(si1 *) * (size_t) (n_allocated * 2));
+            if (grown == NULL)
+            {
+                failed = 1;
+                break;
+            }
+            list = grown;
+            n_allocated *= 2;
+        }
+        list[n] = (si1 *) malloc((size_t) len + 1);
+        if (list[n] == NULL)
+        {
+            failed = 1;
+            break;
+        }
+        strcpy(list[n], name);
+        n++;
+#ifndef _WIN32
+    }
+    closedir(dir);
+#else
+    } while (FindNextFileA(find_handle, &find_data));
+    FindClose(find_handle);
+#endif
+    
+    // repack the names behind the pointers, so the caller frees one block
+    name_bytes = 0;
+    for (len = 0; len < n; len++)
+        name_bytes += strlen(list[len]) + 1;
+    if (!failed && (n > 0))
+        *names = (si1 **) malloc((sizeof(si1 *) * (size_t) n) + name_bytes + 1);
+    if (*names == NULL)
+    {
+        for (len = 0; len < n; len++)
+            free (list[len]);
+        free (list);
+        return -1;
+    }
+    
+    // segment names end in a zero padded segment number, so name order is segment order
+    qsort(list, (size_t) n, sizeof(si1 *), compare_segment_names);
+    
+    name = (si1 *) (*names + n);
+    for (len = 0; len < n; len++)
+    {
+        strcpy(name, list[len]);
+        (*names)[len] = name;
+        name += strlen(list[len]) + 1;
+        free (list[len]);
+    }
+    free (list);
+    
+    return n;
+}
+
+// reads the first bytes of a segment file into buffer (which must be si8 aligned), returns 0 on error
+static si4 read_segment_file_bytes(si1 *segment_path, si1 *segment_name, si1 *type_string, si8 offset, void *buffer, size_t bytes)
+{
+    si1 file_name[MEF_FULL_FILE_NAME_BYTES];
+    FILE *fp;
+    size_t n_read;
+    
+    MEF_snprintf(file_name, MEF_FULL_FILE_NAME_BYTES, "%s/%s.%s", segment_path, segment_name, type_string);
+    fp = fopen(file_name, "rb");
+    if (fp == NULL)
         return 0;
+    n_read = 0;
+    if (fseek(fp, (long) offset, SEEK_SET) == 0)
+        n_read = fread(buffer, 1, bytes, fp);
+    fclose(fp);
     
-    // check if size specified in header is absurdly large
-    if (block_header->block_bytes > RED_MAX_COMPRESSED_BYTES(max_samps, 1))
+    return (n_read == bytes);
+}
+
+// Bounds of a segment from the universal header of its .tdat file (times), and from its .tidx file (the number of
+// blocks from the header, the number of samples from the last entry), without decrypting or reading anything else.
+// Times have the recording time offset removed; the start sample is left for the caller.  Returns 0 on error.
+static si4 read_lazy_segment_bounds(si1 *segment_path, LAZY_SEGMENT_BOUNDS *bounds)
+{
+    si1 segment_name[MEF_SEGMENT_NAME_BYTES], *dot, *slash;
+    si8 header[UNIVERSAL_HEADER_BYTES / sizeof(si8)];
+    TIME_SERIES_INDEX last_index;
+    UNIVERSAL_HEADER *universal_header;
+    
+    // segment files are named after the segment directory
+    slash = strrchr(segment_path, '/');
+#ifdef _WIN32
+    if (strrchr(segment_path, '\\') > slash)
+        slash = strrchr(segment_path, '\\');
+#endif
+    MEF_strncpy(segment_name, (slash == NULL) ? segment_path : slash + 1, MEF_SEGMENT_NAME_BYTES);
+    dot = strrchr(segment_name, '.');
+    if (dot != NULL)
+        *dot = 0;
+    
+    universal_header = (UNIVERSAL_HEADER *) header;
+    if (!read_segment_file_bytes(segment_path, segment_name, TIME_SERIES_DATA_FILE_TYPE_STRING, 0, header, UNIVERSAL_HEADER_BYTES))
         return 0;
+    bounds->start_time = universal_header->start_time;
+    bounds->end_time = universal_header->end_time;
+    remove_recording_time_offset( &bounds->start_time);
+    remove_recording_time_offset( &bounds->end_time);
     
-    // at this point we know we have enough data to actually run the CRC calculation, so do it
-    CRC_valid = CRC_validate((ui1*) block_header + CRC_BYTES, block_header->block_bytes - CRC_BYTES, block_header->block_CRC);
+    if (!read_segment_file_bytes(segment_path, segment_name, TIME_SERIES_INDICES_FILE_TYPE_STRING, 0, header, UNIVERSAL_HEADER_BYTES))
+        return 0;
+    bounds->number_of_blocks = universal_header->number_of_entries;
+    bounds->end_sample = 0;
+    if (bounds->number_of_blocks > 0)
+    {
+        if (!read_segment_file_bytes(segment_path, segment_name, TIME_SERIES_INDICES_FILE_TYPE_STRING,
+                                     UNIVERSAL_HEADER_BYTES + ((bounds->number_of_blocks - 1) * TIME_SERIES_INDEX_BYTES), &last_index, TIME_SERIES_INDEX_BYTES))
+            return 0;
+        bounds->end_sample = last_index.start_sample + (si8) last_index.number_of_samples;
+    }
     
-    // return output of CRC heck
-    if (CRC_valid == MEF_TRUE)
+    return 1;
+}
+
+// Fills in a segment from the index sidecar: the metadata the reader uses, and the time series indices in place in the
+// mapping.  Reads no files.
+static si4 load_sidecar_segment(LAZY_MEF_CHANNEL *lazy, si8 segment)
+{
+    INDEX_SIDECAR_SEGMENT *record;
+    TIME_SERIES_METADATA_SECTION_2 *section_2;
+    SEGMENT *seg;
+    
+    record = (INDEX_SIDECAR_SEGMENT *) (lazy->sidecar.data + lazy->sidecar_header->segments_offset) + segment;
+    seg = &lazy->segments[segment];
+    seg->channel_type = TIME_SERIES_CHANNEL_TYPE;
+    seg->metadata_fps = (FILE_PROCESSING_STRUCT *) calloc((size_t) 1, sizeof(FILE_PROCESSING_STRUCT));
+    seg->time_series_data_fps = (FILE_PROCESSING_STRUCT *) calloc((size_t) 1, sizeof(FILE_PROCESSING_STRUCT));
+    seg->time_series_indices_fps = (FILE_PROCESSING_STRUCT *) calloc((size_t) 1, sizeof(FILE_PROCESSING_STRUCT));
+    section_2 = (TIME_SERIES_METADATA_SECTION_2 *) malloc(sizeof(TIME_SERIES_METADATA_SECTION_2));
+    if ((seg->metadata_fps == NULL) || (seg->time_series_data_fps == NULL) || (seg->time_series_indices_fps == NULL) || (section_2 == NULL))
+    {
+        printf("Error allocating memory, exiting...");
+        free (section_2);
+        free (seg->metadata_fps);
+        free (seg->time_series_data_fps);
+        free (seg->time_series_indices_fps);
+        memset(seg, 0, sizeof(SEGMENT));
+        return 0;
+    }
+    seg->metadata_fps->universal_header = (UNIVERSAL_HEADER *) calloc((size_t) 1, sizeof(UNIVERSAL_HEADER));
+    seg->time_series_data_fps->universal_header = (UNIVERSAL_HEADER *) calloc((size_t) 1, sizeof(UNIVERSAL_HEADER));
+    if ((seg->metadata_fps->universal_header == NULL) || (seg->time_series_data_fps->universal_header == NULL))
+    {
+        printf("Error allocating memory, exiting...");
+        free (seg->metadata_fps->universal_header);
+        free (seg->time_series_data_fps->universal_header);
+        free (section_2);
+        free (seg->metadata_fps);
+        free (seg->time_series_data_fps);
+        free (seg->time_series_indices_fps);
+        memset(seg, 0, sizeof(SEGMENT));
+        return 0;
+    }
+    
+    *section_2 = *lazy->segments[0].metadata_fps->metadata.time_series_section_2;
+    section_2->start_sample = record->start_sample;
+    section_2->number_of_samples = record->number_of_samples;
+    section_2->number_of_blocks = record->number_of_blocks;
+    section_2->maximum_block_samples = record->maximum_block_samples;
+    section_2->maximum_block_bytes = record->maximum_block_bytes;
+    seg->metadata_fps->metadata = lazy->segments[0].metadata_fps->metadata;
+    seg->metadata_fps->metadata.time_series_section_2 = section_2;
+    seg->metadata_fps->universal_header->start_time = seg->time_series_data_fps->universal_header->start_time = record->start_time;
+    seg->metadata_fps->universal_header->end_time = seg->time_series_data_fps->universal_header->end_time = record->end_time;
+    seg->metadata_fps->universal_header->number_of_entries = seg->time_series_data_fps->universal_header->number_of_entries = record->number_of_blocks;
+    
+    MEF_snprintf(seg->time_series_data_fps->full_file_name, MEF_FULL_FILE_NAME_BYTES, "%s/%.*s.%s", lazy->lazy_segments[segment].path,
+                 (si4) (strlen(record->name) - 5), record->name, TIME_SERIES_DATA_FILE_TYPE_STRING);
+    seg->time_series_data_fps->file_length = record->data_file_length;
+    seg->time_series_indices_fps->time_series_indices = (TIME_SERIES_INDEX *) (lazy->sidecar.data + lazy->sidecar_header->indices_offset) + record->first_block;
+    MEF_strncpy(seg->name, record->name, MEF_SEGMENT_NAME_BYTES);
+    seg->name[strlen(seg->name) - 5] = 0;
+    MEF_strncpy(seg->path, lazy->lazy_segments[segment].path, MEF_FULL_FILE_NAME_BYTES);
+    MEF_strncpy(seg->channel_name, lazy->segments[0].channel_name, MEF_BASE_FILE_NAME_BYTES);
+    MEF_strncpy(seg->session_name, lazy->segments[0].session_name, MEF_BASE_FILE_NAME_BYTES);
+    
+    lazy->lazy_segments[segment].loaded = MEF_TRUE;
+    lazy->lazy_segments[segment].from_sidecar = MEF_TRUE;
+    lazy->loaded_segments++;
+    
+    return 1;
+}
+
+// reads a segment's metadata and index files, returns 0 on error
+static si4 load_lazy_segment(LAZY_MEF_CHANNEL *lazy, si8 segment, si1 *password)
+{
+    PASSWORD_DATA *password_data;
+    SEGMENT *loaded;
+    
+    if (lazy->lazy_segments[segment].loaded)
         return 1;
+    
+    if ((lazy->sidecar_header != NULL) && (segment > 0))
+        return load_sidecar_segment(lazy, segment);
+    
+    password_data = (segment == 0) ? NULL : lazy->segments[0].metadata_fps->password_data;
+    reader_mutex_lock(&meflib_mutex);
+    loaded = read_MEF_segment(&lazy->segments[segment], lazy->lazy_segments[segment].path, TIME_SERIES_CHANNEL_TYPE, password, password_data, MEF_FALSE, MEF_FALSE);
+    reader_mutex_unlock(&meflib_mutex);
+    if (loaded == NULL)
+        return 0;
+    
+    lazy->lazy_segments[segment].loaded = MEF_TRUE;
+    lazy->loaded_segments++;
+    
+    return 1;
+}
+
+static void unload_lazy_segment(LAZY_MEF_CHANNEL *lazy, si8 segment)
+{
+    SEGMENT *seg;
+    
+    if (!lazy->lazy_segments[segment].loaded)
+        return;
+    
+    seg = &lazy->segments[segment];
+    if (seg->time_series_data_fps->fp != NULL)
+    {
+        fclose(seg->time_series_data_fps->fp);
+        seg->time_series_data_fps->fp = NULL;
+    }
+    if (lazy->lazy_segments[segment].from_sidecar)
+    {
+        free (seg->metadata_fps->metadata.time_series_section_2);
+        free (seg->metadata_fps->universal_header);
+        free (seg->time_series_data_fps->universal_header);
+        free (seg->metadata_fps);
+        free (seg->time_series_data_fps);
+        free (seg->time_series_indices_fps);
+    }
+    else
+    {
+        if (segment == 0)
+            seg->metadata_fps->directives.free_password_data = MEF_TRUE;
+        reader_mutex_lock(&meflib_mutex);
+        free_segment(seg, MEF_FALSE);
+        reader_mutex_unlock(&meflib_mutex);
+    }
+    memset(seg, 0, sizeof(SEGMENT));
+    
+    lazy->lazy_segments[segment].loaded = MEF_FALSE;
+    lazy->lazy_segments[segment].from_sidecar = MEF_FALSE;
+    lazy->loaded_segments--;
+}
+
+// segment bounds from the index sidecar, as read_lazy_segment_bounds() reads them from the segment files
+static void sidecar_segment_bounds(LAZY_MEF_CHANNEL *lazy, si8 segment, LAZY_SEGMENT_BOUNDS *bounds)
+{
+    INDEX_SIDECAR_SEGMENT *record;
+    
+    record = (INDEX_SIDECAR_SEGMENT *) (lazy->sidecar.data + lazy->sidecar_header->segments_offset) + segment;
+    bounds->start_time = record->start_time;
+    bounds->end_time = record->end_time;
+    remove_recording_time_offset( &bounds->start_time);
+    remove_recording_time_offset( &bounds->end_time);
+    bounds->number_of_blocks = record->number_of_blocks;
+    bounds->end_sample = record->number_of_samples;
+}
+
+// points the lazy channel's whole channel block index and continuous ranges into the sidecar mapping
+static void use_sidecar_index(LAZY_MEF_CHANNEL *lazy)
+{
+    INDEX_SIDECAR_HEADER *header;
+    CHANNEL_BLOCK_INDEX *index;
+    CONTINUOUS_RANGES *ranges;
+    ui1 *data;
+    
+    header = lazy->sidecar_header;
+    data = lazy->sidecar.data;
+    index = &lazy->sidecar_index;
+    index->number_of_blocks = header->number_of_blocks;
+    index->number_of_segments = (si4) header->number_of_segments;
+    index->start_sample = (si8 *) (data + header->block_arrays_offset[0]);
+    index->start_time = (si8 *) (data + header->block_arrays_offset[1]);
+    index->file_offset = (si8 *) (data + header->block_arrays_offset[2]);
+    index->segment = (si4 *) (data + header->block_arrays_offset[3]);
+    index->discontinuity = (ui1 *) (data + header->block_arrays_offset[4]);
+    index->segment_first_block = (si8 *) (data + header->segment_arrays_offset[0]);
+    index->segment_start_time = (si8 *) (data + header->segment_arrays_offset[1]);
+    index->segment_end_time = (si8 *) (data + header->segment_arrays_offset[2]);
+    index->segment_start_sample = (si8 *) (data + header->segment_arrays_offset[3]);
+    index->segment_end_sample = (si8 *) (data + header->segment_arrays_offset[4]);
+    index->end_sample = header->number_of_samples;
+    index->regular = (si1) header->regular;
+    index->block_samples = header->block_samples;
+    index->sampling_frequency = header->sampling_frequency;
+    index->channel_number_of_segments = header->number_of_segments;
+    index->channel_number_of_samples = header->number_of_samples;
+    
+    ranges = &lazy->sidecar_ranges;
+    ranges->number_of_ranges = header->number_of_ranges;
+    ranges->start_time = (si8 *) (data + header->range_arrays_offset[0]);
+    ranges->end_time = (si8 *) (data + header->range_arrays_offset[1]);
+    ranges->start_sample = (si8 *) (data + header->range_arrays_offset[2]);
+    ranges->end_sample = (si8 *) (data + header->range_arrays_offset[3]);
+    ranges->time_before = (si8 *) (data + header->range_arrays_offset[4]);
+}
+
+// Opens a channel reading only each segment's bounds (and segment 0 in full).  Returns NULL on error.
+LAZY_MEF_CHANNEL *open_lazy_mef_channel(si1 *channel_path, si1 *password)
+{
+    LAZY_MEF_CHANNEL *lazy;
+    si1 **names, path[MEF_FULL_FILE_NAME_BYTES], name[MEF_BASE_FILE_NAME_BYTES], extension[8];
+    si8 n_segments, i, start_sample;
+    
+    // set up mef 3 library
+    (void) initialize_meflib();
+    MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
+    
+    names = NULL;
+    n_segments = list_channel_segments(channel_path, &names);
+    if (n_segments <= 0)
+    {
+        printf("No segments found in %s, exiting...", channel_path);
+        free (names);
+        return NULL;
+    }
+    
+    lazy = (LAZY_MEF_CHANNEL *) calloc((size_t) 1, sizeof(LAZY_MEF_CHANNEL));
+    if (lazy != NULL)
+    {
+        lazy->segments = (SEGMENT *) calloc((size_t) n_segments, sizeof(SEGMENT));
+        lazy->lazy_segments = (LAZY_SEGMENT *) calloc((size_t) n_segments, sizeof(LAZY_SEGMENT));
+        lazy->bounds = (LAZY_SEGMENT_BOUNDS *) calloc((size_t) n_segments, sizeof(LAZY_SEGMENT_BOUNDS));
+    }
+    if ((lazy == NULL) || (lazy->segments == NULL) || (lazy->lazy_segments == NULL) || (lazy->bounds == NULL))
+    {
+        printf("Error allocating memory, exiting...");
+        close_lazy_mef_channel(lazy);
+        free (names);
+        return NULL;
+    }
+    lazy->number_of_segments = n_segments;
+    for (i = 0; i < n_segments; i++)
+        MEF_snprintf(lazy->lazy_segments[i].path, MEF_FULL_FILE_NAME_BYTES, "%s/%s", channel_path, names[i]);
+    if (open_index_sidecar(channel_path, names, n_segments, &lazy->sidecar))
+        lazy->sidecar_header = (INDEX_SIDECAR_HEADER *) lazy->sidecar.data;
+    free (names);
+    
+    // segment 0 sets up the recording time offset, and supplies the password data and channel metadata
+    if (!load_lazy_segment(lazy, 0, password))
+    {
+        printf("Error reading segment %s, exiting...", lazy->lazy_segments[0].path);
+        close_lazy_mef_channel(lazy);
+        return NULL;
+    }
+    
+    // the channel's times are as read_MEF_channel() sets them: the earliest start and latest end of its segments, with
+    // the recording time offset removed
+    start_sample = 0;
+    for (i = 0; i < n_segments; i++)
+    {
+        if (lazy->sidecar_header != NULL)
+            sidecar_segment_bounds(lazy, i, &lazy->bounds[i]);
+        else if (!read_lazy_segment_bounds(lazy->lazy_segments[i].path, &lazy->bounds[i]))
+        {
+            printf("Error reading headers of segment %s, exiting...", lazy->lazy_segments[i].path);
+            close_lazy_mef_channel(lazy);
+            return NULL;
+        }
+        lazy->bounds[i].start_sample = start_sample;
+        lazy->bounds[i].end_sample += start_sample;
+        start_sample = lazy->bounds[i].end_sample;
+        if ((i == 0) || (lazy->bounds[i].start_time < lazy->channel.earliest_start_time))
+            lazy->channel.earliest_start_time = lazy->bounds[i].start_time;
+        if ((i == 0) || (lazy->bounds[i].end_time > lazy->channel.latest_end_time))
+            lazy->channel.latest_end_time = lazy->bounds[i].end_time;
+    }
+    
+    if (lazy->sidecar_header != NULL)
+        use_sidecar_index(lazy);
+    
+    // the range CHANNEL: channel level fields as read_MEF_channel() sets them, no segments yet
+    lazy->section_2 = *lazy->segments[0].metadata_fps->metadata.time_series_section_2;
+    lazy->section_2.number_of_samples = start_sample;
+    lazy->channel.channel_type = TIME_SERIES_CHANNEL_TYPE;
+    lazy->channel.metadata = lazy->segments[0].metadata_fps->metadata;
+    lazy->channel.metadata.time_series_section_2 = &lazy->section_2;
+    lazy->channel.segments = lazy->segments;
+    lazy->channel.number_of_segments = 0;
+    extract_path_parts(channel_path, path, name, extension);
+    MEF_strncpy(lazy->channel.path, channel_path, MEF_FULL_FILE_NAME_BYTES);
+    MEF_strncpy(lazy->channel.name, name, MEF_BASE_FILE_NAME_BYTES);
+    MEF_strncpy(lazy->channel.extension, extension, 8);
+    MEF_strncpy(lazy->channel.session_name, lazy->segments[0].session_name, MEF_BASE_FILE_NAME_BYTES);
+    memcpy(lazy->channel.level_UUID, lazy->segments[0].level_UUID, sizeof(lazy->channel.level_UUID));
+    
+    return lazy;
+}
+
+void close_lazy_mef_channel(LAZY_MEF_CHANNEL *lazy)
+{
+    si8 i;
+    
+    if (lazy == NULL)
+        return;
+    
+    release_channel_reader_state(&lazy->channel);
+    for (i = lazy->number_of_segments - 1; i >= 0; i--)
+        unload_lazy_segment(lazy, i);
+    unmap_segment(&lazy->sidecar);
+    free (lazy->segments);
+    free (lazy->lazy_segments);
+    free (lazy->bounds);
+    free (lazy);
+}
+
+// returns the number of segments, and their bounds (owned by the lazy channel)
+si8 get_lazy_mef_channel_bounds(LAZY_MEF_CHANNEL *lazy, LAZY_SEGMENT_BOUNDS **bounds)
+{
+    if (lazy == NULL)
+        return 0;
+    
+    if (bounds != NULL)
+        *bounds = lazy->bounds;
+    
+    return lazy->number_of_segments;
+}
+
+// The whole channel's block index and continuous ranges, in place in the index sidecar, or NULL if the channel was opened
+// without one.  Block and segment numbers are the channel's, not those of a range CHANNEL.
+CHANNEL_BLOCK_INDEX *get_lazy_mef_channel_block_index(LAZY_MEF_CHANNEL *lazy)
+{
+    if ((lazy == NULL) || (lazy->sidecar_header == NULL))
+        return NULL;
+    
+    return &lazy->sidecar_index;
+}
+
+CONTINUOUS_RANGES *get_lazy_mef_channel_continuous_ranges(LAZY_MEF_CHANNEL *lazy)
+{
+    if ((lazy == NULL) || (lazy->sidecar_header == NULL))
+        return NULL;
+    
+    return &lazy->sidecar_ranges;
+}
+
+// Returns a CHANNEL holding the segments a read of the range touches, loading any not yet loaded, or NULL on error.
+// Reads of the range through it return exactly what reads of the fully opened channel would.  If the current range
+// CHANNEL already holds those segments it is returned as is; otherwise everything cached for it is released first.
+CHANNEL *get_lazy_mef_channel_range(LAZY_MEF_CHANNEL *lazy, si8 start_value, si8 end_value, si4 times_specified)
+{
+    LAZY_SEGMENT_BOUNDS *bounds;
+    si8 first, last, lo, hi, mid, i;
+    ui4 max_block_samples;
+    si8 max_block_bytes;
+    
+    if (lazy == NULL)
+        return NULL;
+    bounds = lazy->bounds;
+    
+    if (times_specified)
+    {
+        // first segment ending at or after the start time, and the one before it if the start falls in the gap
+        // between them (times in a gap are placed relative to the preceding block)
+        lo = 0;
+        hi = lazy->number_of_segments;
+        while (lo < hi)
+        {
+            mid = lo + ((hi - lo) >> 1);
+            if (bounds[mid].end_time < start_value)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        first = (lo < lazy->number_of_segments) ? lo : lazy->number_of_segments - 1;
+        if ((first > 0) && (start_value < bounds[first].start_time))
+            first--;
+        
+        // last segment starting at or before the end time
+        lo = 0;
+        hi = lazy->number_of_segments;
+        while (lo < hi)
+        {
+            mid = lo + ((hi - lo) >> 1);
+            if (bounds[mid].start_time <= end_value)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        last = lo - 1;
+    }
     else
+    {
+        // segments holding the first and last samples (or the segment starting at the sample one past the end)
+        for (i = 0; i < 2; i++)
+        {
+            lo = 0;
+            hi = lazy->number_of_segments;
+            while (lo < hi)
+            {
+                mid = lo + ((hi - lo) >> 1);
+                if (bounds[mid].start_sample <= ((i == 0) ? start_value : end_value))
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if (i == 0)
+                first = (lo > 0) ? lo - 1 : 0;
+            else
+                last = lo - 1;
+        }
+    }
+    if (last < first)
+        last = first;
+    
+    lazy->use_count++;
+    if ((first < lazy->range_first) || (last >= lazy->range_end))
+    {
+        // a different run of segments: nothing cached for the old one applies (segment and block numbers are
+        // relative to the range)
+        release_channel_reader_state(&lazy->channel);
+        lazy->channel.number_of_segments = 0;
+        lazy->range_first = lazy->range_end = 0;
+        
+        max_block_samples = 0;
+        max_block_bytes = 0;
+        for (i = first; i <= last; i++)
+        {
+            if (!load_lazy_segment(lazy, i, NULL))
+            {
+                printf("Error reading segment %s, exiting...", lazy->lazy_segments[i].path);
+                return NULL;
+            }
+            if (lazy->segments[i].metadata_fps->metadata.time_series_section_2->maximum_block_samples > max_block_samples)
+                max_block_samples = lazy->segments[i].metadata_fps->metadata.time_series_section_2->maximum_block_samples;
+            if (lazy->segments[i].metadata_fps->metadata.time_series_section_2->maximum_block_bytes > max_block_bytes)
+                max_block_bytes = lazy->segments[i].metadata_fps->metadata.time_series_section_2->maximum_block_bytes;
+        }
+        lazy->section_2.maximum_block_samples = max_block_samples;
+        lazy->section_2.maximum_block_bytes = max_block_bytes;
+        lazy->channel.segments = lazy->segments + first;
+        lazy->channel.number_of_segments = last - first + 1;
+        lazy->range_first = first;
+        lazy->range_end = last + 1;
+    }
+    for (i = lazy->range_first; i < lazy->range_end; i++)
+        lazy->lazy_segments[i].last_used = lazy->use_count;
+    
+    return &lazy->channel;
+}
+
+si4 read_lazy_mef_ts_data_by_time(LAZY_MEF_CHANNEL *lazy, si8 start_time, si8 end_time, si4 *decomp_data)
+{
+    CHANNEL *channel;
+    
+    channel = get_lazy_mef_channel_range(lazy, start_time, end_time, 1);
+    if (channel == NULL)
+        return 0;
+    
+    return read_mef_ts_data(NULL, NULL, start_time, end_time, 1, decomp_data, channel, -1);
+}
+
+si4 read_lazy_mef_ts_data_by_samp(LAZY_MEF_CHANNEL *lazy, si8 start_samp, si8 end_samp, si4 *decomp_data)
+{
+    CHANNEL *channel;
+    
+    channel = get_lazy_mef_channel_range(lazy, start_samp, end_samp, 0);
+    if (channel == NULL)
+        return 0;
+    
+    return read_mef_ts_data(NULL, NULL, start_samp, end_samp, 0, decomp_data, channel, -1);
+}
+
+static si4 compare_lazy_segment_use(const void *a, const void *b)
+{
+    si8 use_a, use_b;
+    
+    use_a = (*((LAZY_SEGMENT **) a))->last_used;
+    use_b = (*((LAZY_SEGMENT **) b))->last_used;
+    
+    return (use_a > use_b) - (use_a < use_b);
+}
+
+// Unloads least recently used segments until at most max_loaded_segments are loaded.  Segment 0, and the segments of
+// the current range CHANNEL, are never unloaded.  Returns the number of segments still loaded.
+si8 evict_lazy_mef_channel_segments(LAZY_MEF_CHANNEL *lazy, si8 max_loaded_segments)
+{
+    LAZY_SEGMENT **candidates;
+    si8 n_candidates, i;
+    
+    if (lazy == NULL)
+        return 0;
+    if (lazy->loaded_segments <= max_loaded_segments)
+        return lazy->loaded_segments;
+    
+    candidates = (LAZY_SEGMENT **) malloc(sizeof(LAZY_SEGMENT *) * (size_t) lazy->loaded_segments);
+    n_candidates = 0;
+    for (i = 1; i < lazy->number_of_segments; i++)
+    {
+        if (lazy->lazy_segments[i].loaded && ((i < lazy->range_first) || (i >= lazy->range_end)))
+            candidates[n_candidates++] = &lazy->lazy_segments[i];
+    }
+    qsort(candidates, (size_t) n_candidates, sizeof(LAZY_SEGMENT *), compare_lazy_segment_use);
+    
+    for (i = 0; (i < n_candidates) && (lazy->loaded_segments > max_loaded_segments); i++)
+        unload_lazy_segment(lazy, candidates[i] - lazy->lazy_segments);
+    free (candidates);
+    
+    return lazy->loaded_segments;
+}
+
+/**************************  Index sidecar  ****************************/
+
+// <channel_path>/<channel name>.<extension>
+static void channel_sidecar_file_name(si1 *channel_path, si1 *extension, si1 *file_name)
+{
+    si1 name[MEF_BASE_FILE_NAME_BYTES], *start, *dot;
+    size_t len;
+    
+    len = strlen(channel_path);
+    while ((len > 1) && ((channel_path[len - 1] == '/') || (channel_path[len - 1] == '\\')))
+        len--;
+    start = channel_path + len;
+    while ((start > channel_path) && (start[-1] != '/') && (start[-1] != '\\'))
+        start--;
+    if ((size_t) (channel_path + len - start) >= MEF_BASE_FILE_NAME_BYTES)
+        len = (size_t) (start - channel_path) + MEF_BASE_FILE_NAME_BYTES - 1;
+    memcpy(name, start, (size_t) (channel_path + len - start));
+    name[channel_path + len - start] = 0;
+    dot = strrchr(name, '.');
+    if (dot != NULL)
+        *dot = 0;
+    
+    MEF_snprintf(file_name, MEF_FULL_FILE_NAME_BYTES, "%.*s/%s.%s", (si4) len, channel_path, name, extension);
+}
+
+// modification time (in the platform's units) and size of a file, returns 0 if it can't be read
+static si4 file_modified_and_size(si1 *file_name, si8 *modified, si8 *bytes)
+{
+#ifndef _WIN32
+    struct stat sb;
+    
+    if (stat(file_name, &sb) != 0)
+        return 0;
+    *modified = (si8) sb.st_mtime;
+    *bytes = (si8) sb.st_size;
+#else
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    
+    if (!GetFileAttributesExA(file_name, GetFileExInfoStandard, &attributes))
         return 0;
+    *modified = ((si8) attributes.ftLastWriteTime.dwHighDateTime << 32) | (si8) attributes.ftLastWriteTime.dwLowDateTime;
+    *bytes = ((si8) attributes.nFileSizeHigh << 32) | (si8) attributes.nFileSizeLow;
+#endif
+    
+    return 1;
+}
+
+// Maps a channel's index sidecar, if it is valid for this version and fresh: written for the same segments, not older
+// than any of their files, and with the data and index files still their recorded sizes.  Returns 0 otherwise.
+static si4 open_index_sidecar(si1 *channel_path, si1 **segment_names, si8 n_segments, SEGMENT_MAP *map)
+{
+    si1 file_name[MEF_FULL_FILE_NAME_BYTES], segment_name[MEF_SEGMENT_NAME_BYTES];
+    static const si8 block_element_bytes[5] = { sizeof(si8), sizeof(si8), sizeof(si8), sizeof(si4), sizeof(ui1) };
+    INDEX_SIDECAR_HEADER *header;
+    INDEX_SIDECAR_SEGMENT *record;
+    si8 sidecar_modified, modified, bytes, offset, n_blocks, n_ranges, i, j;
+    si1 *type_strings[3];
+    si4 fresh;
+    
+    channel_sidecar_file_name(channel_path, MEF_INDEX_SIDECAR_EXTENSION, file_name);
+    if (!file_modified_and_size(file_name, &sidecar_modified, &bytes))
+        return 0;
+    memset(map, 0, sizeof(SEGMENT_MAP));
+    if (!map_segment(map, file_name))
+        return 0;
+    
+    header = (INDEX_SIDECAR_HEADER *) map->data;
+    fresh = (map->bytes >= sizeof(INDEX_SIDECAR_HEADER)) && (memcmp(header->magic, INDEX_SIDECAR_MAGIC, sizeof(INDEX_SIDECAR_MAGIC)) == 0) &&
+            (header->version == MEF_INDEX_SIDECAR_VERSION) && (header->header_bytes == sizeof(INDEX_SIDECAR_HEADER)) &&
+            (header->file_bytes == (si8) map->bytes) && (header->number_of_segments == n_segments) &&
+            (header->number_of_blocks >= 0) && (header->number_of_blocks < header->file_bytes) &&
+            (header->number_of_ranges >= 0) && (header->number_of_ranges < header->file_bytes);
+    n_blocks = fresh ? header->number_of_blocks : 0;
+    n_ranges = fresh ? header->number_of_ranges : 0;
+    
+    // every array lies within the file, the block, segment and range arrays after the indices
+    if (fresh && ((header->segments_offset < (si8) sizeof(INDEX_SIDECAR_HEADER)) ||
+                  (header->indices_offset < header->segments_offset + (n_segments * (si8) sizeof(INDEX_SIDECAR_SEGMENT))) ||
+                  (header->indices_offset + (n_blocks * (si8) TIME_SERIES_INDEX_BYTES) > header->file_bytes)))
+        fresh = 0;
+    for (i = 0; fresh && (i < 15); i++)
+    {
+        if (i < 5)
+        {
+            offset = header->block_arrays_offset[i];
+            bytes = n_blocks * block_element_bytes[i];
+        }
+        else if (i < 10)
+        {
+            offset = header->segment_arrays_offset[i - 5];
+            bytes = ((i == 5) ? n_segments + 1 : n_segments) * (si8) sizeof(si8);
+        }
+        else
+        {
+            offset = header->range_arrays_offset[i - 10];
+            bytes = ((i == 14) ? n_ranges + 1 : n_ranges) * (si8) sizeof(si8);
+        }
+        if ((offset < header->indices_offset) || (offset + bytes > header->file_bytes))
+            fresh = 0;
+    }
+    
+    type_strings[0] = TIME_SERIES_METADATA_FILE_TYPE_STRING;
+    type_strings[1] = TIME_SERIES_INDICES_FILE_TYPE_STRING;
+    type_strings[2] = TIME_SERIES_DATA_FILE_TYPE_STRING;
+    record = (INDEX_SIDECAR_SEGMENT *) (map->data + (fresh ? header->segments_offset : 0));
+    for (i = 0; fresh && (i < n_segments); i++)
+    {
+        if ((memchr(record[i].name, 0, MEF_SEGMENT_NAME_BYTES) == NULL) || (strcmp(record[i].name, segment_names[i]) != 0) ||
+            (record[i].first_block < 0) || (record[i].number_of_blocks < 0) || (record[i].first_block > n_blocks - record[i].number_of_blocks))
+        {
+            fresh = 0;
+            break;
+        }
+        MEF_strncpy(segment_name, segment_names[i], MEF_SEGMENT_NAME_BYTES);
+        segment_name[strlen(segment_name) - 5] = 0;
+        for (j = 0; fresh && (j < 3); j++)
+        {
+            MEF_snprintf(file_name, MEF_FULL_FILE_NAME_BYTES, "%s/%s/%s.%s", channel_path, segment_names[i], segment_name, type_strings[j]);
+            if (!file_modified_and_size(file_name, &modified, &bytes) || (modified > sidecar_modified))
+                fresh = 0;
+            else if ((j == 1) && (bytes != UNIVERSAL_HEADER_BYTES + (record[i].number_of_blocks * TIME_SERIES_INDEX_BYTES)))
+                fresh = 0;
+            else if ((j == 2) && (bytes != record[i].data_file_length))
+                fresh = 0;
+        }
+    }
+    
+    if (!fresh)
+        unmap_segment(map);
+    
+    return fresh;
+}
+
+// returns nonzero if the channel has an index sidecar that open_lazy_mef_channel() would use
+si4 mef_channel_index_sidecar_is_fresh(si1 *channel_path)
+{
+    SEGMENT_MAP map;
+    si1 **names;
+    si8 n_segments;
+    si4 fresh;
+    
+    names = NULL;
+    n_segments = list_channel_segments(channel_path, &names);
+    fresh = (n_segments > 0) && open_index_sidecar(channel_path, names, n_segments, &map);
+    if (fresh)
+        unmap_segment(&map);
+    free (names);
+    
+    return fresh;
+}
+
+// writes bytes of data, then zeros up to the next 8 byte boundary
+static si4 write_sidecar_array(FILE *fp, void *data, size_t bytes)
+{
+    static const ui1 zeros[8] = {0};
+    size_t pad;
+    
+    pad = (8 - (bytes & 7)) & 7;
+    if ((bytes > 0) && (fwrite(data, 1, bytes, fp) != bytes))
+        return 0;
+    if ((pad > 0) && (fwrite(zeros, 1, pad, fp) != pad))
+        return 0;
+    
+    return 1;
+}
+
+static si8 sidecar_array_bytes(size_t bytes)
+{
+    return (si8) ((bytes + 7) & ~((size_t) 7));
+}
+
+// Reads a channel in full and writes its index sidecar (replacing any existing one only once the new one is
+// complete).  Returns 1, or 0 on error.
+si4 write_mef_channel_index_sidecar(si1 *channel_path, si1 *password)
+{
+    CHANNEL *channel;
+    CHANNEL_BLOCK_INDEX *index;
+    CONTINUOUS_RANGES *ranges;
+    INDEX_SIDECAR_HEADER header;
+    INDEX_SIDECAR_SEGMENT record;
+    TIME_SERIES_METADATA_SECTION_2 *seg_md;
+    si1 file_name[MEF_FULL_FILE_NAME_BYTES], temp_file_name[MEF_FULL_FILE_NAME_BYTES], *dir_end, *dir_start;
+    si8 n_blocks, n_segments, n_ranges, offset, i;
+    FILE *fp;
+    si4 ok;
+    
+    // set up mef 3 library
+    (void) initialize_meflib();
+    MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
+    
+    channel = read_channel_with_cached_password(channel_path, password);
+    if (channel == NULL)
+        return 0;
+    if (channel->channel_type != TIME_SERIES_CHANNEL_TYPE) {
+        printf("Not a time series channel, exiting...");
+        free_read_channel(channel);
+        return 0;
+    }
+    
+    index = build_channel_block_index(channel);
+    ranges = (index != NULL) ? build_continuous_ranges(channel, index) : NULL;
+    if (ranges == NULL)
+    {
+        printf("Could not index channel, exiting...");
+        free_channel_block_index(index);
+        free_read_channel(channel);
+        return 0;
+    }
+    n_blocks = index->number_of_blocks;
+    n_segments = index->number_of_segments;
+    n_ranges = ranges->number_of_ranges;
+    
+    memset(&header, 0, sizeof(INDEX_SIDECAR_HEADER));
+    memcpy(header.magic, INDEX_SIDECAR_MAGIC, sizeof(INDEX_SIDECAR_MAGIC));
+    header.version = MEF_INDEX_SIDECAR_VERSION;
+    header.header_bytes = sizeof(INDEX_SIDECAR_HEADER);
+    header.number_of_segments = n_segments;
+    header.number_of_blocks = n_blocks;
+    header.number_of_ranges = n_ranges;
+    header.number_of_samples = index->end_sample;
+    header.sampling_frequency = index->sampling_frequency;
+    header.earliest_start_time = channel->earliest_start_time;
+    header.latest_end_time = channel->latest_end_time;
+    header.block_samples = index->block_samples;
+    header.regular = index->regular;
+    
+    offset = sidecar_array_bytes(sizeof(INDEX_SIDECAR_HEADER));
+    header.segments_offset = offset;
+    offset += sidecar_array_bytes(sizeof(INDEX_SIDECAR_SEGMENT) * (size_t) n_segments);
+    header.indices_offset = offset;
+    offset += sidecar_array_bytes(sizeof(TIME_SERIES_INDEX) * (size_t) n_blocks);
+    header.block_arrays_offset[0] = offset;
+    offset += sidecar_array_bytes(sizeof(si8) * (size_t) n_blocks);
+    header.block_arrays_offset[1] = offset;
+    offset += sidecar_array_bytes(sizeof(si8) * (size_t) n_blocks);
+    header.block_arrays_offset[2] = offset;
+    offset += sidecar_array_bytes(sizeof(si8) * (size_t) n_blocks);
+    header.block_arrays_offset[3] = offset;
+    offset += sidecar_array_bytes(sizeof(si4) * (size_t) n_blocks);
+    header.block_arrays_offset[4] = offset;
+    offset += sidecar_array_bytes(sizeof(ui1) * (size_t) n_blocks);
+    header.segment_arrays_offset[0] = offset;
+    offset += sidecar_array_bytes(sizeof(si8) * (size_t) (n_segments + 1));
+    for (i = 1; i < 5; i++)
+    {
+        header.segment_arrays_offset[i] = offset;
+        offset += sidecar_array_bytes(sizeof(si8) * (size_t) n_segments);
+    }
+    for (i = 0; i < 5; i++)
+    {
+        header.range_arrays_offset[i] = offset;
+        offset += sidecar_array_bytes(sizeof(si8) * (size_t) ((i == 4) ? n_ranges + 1 : n_ranges));
+    }
+    header.file_bytes = offset;
+    
+    // written under a temporary name, and renamed into place when complete
+    channel_sidecar_file_name(channel_path, MEF_INDEX_SIDECAR_EXTENSION, file_name);
+    MEF_snprintf(temp_file_name, MEF_FULL_FILE_NAME_BYTES, "%s.tmp", file_name);
+    fp = fopen(temp_file_name, "wb");
+    if (fp == NULL)
+    {
+        printf("Could not create %s, exiting...", temp_file_name);
+        free_continuous_ranges(ranges);
+        free_channel_block_index(index);
+        free_read_channel(channel);
+        return 0;
+    }
+    
+    ok = write_sidecar_array(fp, &header, sizeof(INDEX_SIDECAR_HEADER));
+    for (i = 0; ok && (i < n_segments); i++)
+    {
+        seg_md = channel->segments[i].metadata_fps->metadata.time_series_section_2;
+        memset(&record, 0, sizeof(INDEX_SIDECAR_SEGMENT));
+        
+        // the segment directory is the one holding the data file
+        dir_end = strrchr(channel->segments[i].time_series_data_fps->full_file_name, '/');
+        if ((dir_end == NULL) || (strrchr(channel->segments[i].time_series_data_fps->full_file_name, '\\') > dir_end))
+            dir_end = strrchr(channel->segments[i].time_series_data_fps->full_file_name, '\\');
+        for (dir_start = dir_end; (dir_start != NULL) && (dir_start > channel->segments[i].time_series_data_fps->full_file_name) &&
+                                  (dir_start[-1] != '/') && (dir_start[-1] != '\\'); dir_start--)
+            ;
+        if ((dir_start == NULL) || (dir_end - dir_start >= MEF_SEGMENT_NAME_BYTES))
+        {
+            ok = 0;
+            break;
+        }
+        memcpy(record.name, dir_start, (size_t) (dir_end - dir_start));
+        
+        record.start_time = channel->segments[i].time_series_data_fps->universal_header->start_time;
+        record.end_time = channel->segments[i].time_series_data_fps->universal_header->end_time;
+        record.start_sample = seg_md->start_sample;
+        record.number_of_samples = seg_md->number_of_samples;
+        record.number_of_blocks = seg_md->number_of_blocks;
+        record.maximum_block_bytes = seg_md->maximum_block_bytes;
+        record.maximum_block_samples = seg_md->maximum_block_samples;
+        record.data_file_length = channel->segments[i].time_series_data_fps->file_length;
+        record.first_block = index->segment_first_block[i];
+        ok = (fwrite(&record, sizeof(INDEX_SIDECAR_SEGMENT), 1, fp) == 1);
+    }
+    for (i = 0; ok && (i < n_segments); i++)
+        ok = (fwrite(channel->segments[i].time_series_indices_fps->time_series_indices, sizeof(TIME_SERIES_INDEX),
+                     (size_t) (index->segment_first_block[i + 1] - index->segment_first_block[i]), fp) ==
+              (size_t) (index->segment_first_block[i + 1] - index->segment_first_block[i]));
+    ok = ok && write_sidecar_array(fp, index->start_sample, sizeof(si8) * (size_t) n_blocks);
+    ok = ok && write_sidecar_array(fp, index->start_time, sizeof(si8) * (size_t) n_blocks);
+    ok = ok && write_sidecar_array(fp, index->file_offset, sizeof(si8) * (size_t) n_blocks);
+    ok = ok && write_sidecar_array(fp, index->segment, sizeof(si4) * (size_t) n_blocks);
+    ok = ok && write_sidecar_array(fp, index->discontinuity, sizeof(ui1) * (size_t) n_blocks);
+    ok = ok && write_sidecar_array(fp, index->segment_first_block, sizeof(si8) * (size_t) (n_segments + 1));
+    ok = ok && write_sidecar_array(fp, index->segment_start_time, sizeof(si8) * (size_t) n_segments);
+    ok = ok && write_sidecar_array(fp, index->segment_end_time, sizeof(si8) * (size_t) n_segments);
+    ok = ok && write_sidecar_array(fp, index->segment_start_sample, sizeof(si8) * (size_t) n_segments);
+    ok = ok && write_sidecar_array(fp, index->segment_end_sample, sizeof(si8) * (size_t) n_segments);
+    ok = ok && write_sidecar_array(fp, ranges->start_time, sizeof(si8) * (size_t) n_ranges);
+    ok = ok && write_sidecar_array(fp, ranges->end_time, sizeof(si8) * (size_t) n_ranges);
+    ok = ok && write_sidecar_array(fp, ranges->start_sample, sizeof(si8) * (size_t) n_ranges);
+    ok = ok && write_sidecar_array(fp, ranges->end_sample, sizeof(si8) * (size_t) n_ranges);
+    ok = ok && write_sidecar_array(fp, ranges->time_before, sizeof(si8) * (size_t) (n_ranges + 1));
+    if (fclose(fp) != 0)
+        ok = 0;
+    
+    free_continuous_ranges(ranges);
+    free_channel_block_index(index);
+    free_read_channel(channel);
+    
+    if (ok)
+    {
+#ifdef _WIN32
+        remove(file_name);
+#endif
+        ok = (rename(temp_file_name, file_name) == 0);
+    }
+    if (!ok)
+    {
+        printf("Error writing %s, exiting...", file_name);
+        remove(temp_file_name);
+    }
+    
+    return ok;
+}
+
+/**************************  Tail following  ****************************/
+
+// Brings a segment up to date with its .tidx file: index entries written since the segment was read are appended (up
+// to the last whose block is wholly in the .tdat file), and the segment's metadata and end time updated to match.
+// Returns the number of samples appended, -1 on error.
+static si8 refresh_segment_tail(SEGMENT *segment, sf8 sampling_frequency)
+{
+    FILE_PROCESSING_STRUCT *fps;
+    TIME_SERIES_METADATA_SECTION_2 *seg_md;
+    TIME_SERIES_INDEX *tsi;
+    si1 index_file_name[MEF_FULL_FILE_NAME_BYTES], *dot;
+    si8 modified, data_bytes, index_bytes, old_blocks, n_blocks, k, old_samples, end_time, header_end_time;
+    ui1 *raw_data;
+    FILE *fp;
+    
+    seg_md = segment->metadata_fps->metadata.time_series_section_2;
+    fps = segment->time_series_indices_fps;
+    old_blocks = seg_md->number_of_blocks;
+    old_samples = seg_md->number_of_samples;
+    
+    // the index file is named as the data file is
+    MEF_strncpy(index_file_name, segment->time_series_data_fps->full_file_name, MEF_FULL_FILE_NAME_BYTES);
+    dot = strrchr(index_file_name, '.');
+    if (dot == NULL)
+        return -1;
+    MEF_strncpy(dot + 1, TIME_SERIES_INDICES_FILE_TYPE_STRING, TYPE_BYTES);
+    
+    if (!file_modified_and_size(segment->time_series_data_fps->full_file_name, &modified, &data_bytes) ||
+        !file_modified_and_size(index_file_name, &modified, &index_bytes))
+        return -1;
+    n_blocks = (index_bytes - UNIVERSAL_HEADER_BYTES) / TIME_SERIES_INDEX_BYTES;
+    if (n_blocks <= old_blocks)
+        return 0;
+    
+    // the indices are extended where meflib read them, behind the file's universal header
+    if ((fps->raw_data == NULL) || ((ui1 *) fps->time_series_indices != fps->raw_data + UNIVERSAL_HEADER_BYTES))
+    {
+        printf("Segment indices were not read from their file, can't refresh...");
+        return -1;
+    }
+    raw_data = (ui1 *) realloc(fps->raw_data, (size_t) (UNIVERSAL_HEADER_BYTES + (n_blocks * TIME_SERIES_INDEX_BYTES)));
+    if (raw_data == NULL)
+        return -1;
+    fps->raw_data = raw_data;
+    fps->universal_header = (UNIVERSAL_HEADER *) raw_data;
+    fps->time_series_indices = tsi = (TIME_SERIES_INDEX *) (raw_data + UNIVERSAL_HEADER_BYTES);
+    
+    fp = fopen(index_file_name, "rb");
+    if (fp == NULL)
+        return -1;
+    k = 0;
+#ifndef _WIN32
+    if (fseek(fp, (long) (UNIVERSAL_HEADER_BYTES + (old_blocks * TIME_SERIES_INDEX_BYTES)), SEEK_SET) == 0)
+#else
+    if (_fseeki64(fp, UNIVERSAL_HEADER_BYTES + (old_blocks * TIME_SERIES_INDEX_BYTES), SEEK_SET) == 0)
+#endif
+        k = (si8) fread(tsi + old_blocks, TIME_SERIES_INDEX_BYTES, (size_t) (n_blocks - old_blocks), fp);
+    fclose(fp);
+    
+    // a block is used once all of it has been written
+    n_blocks = old_blocks + k;
+    for (k = old_blocks; k < n_blocks; k++)
+        if ((tsi[k].file_offset < UNIVERSAL_HEADER_BYTES) || (tsi[k].file_offset + (si8) tsi[k].block_bytes > data_bytes))
+            break;
+    n_blocks = k;
+    fps->raw_data_bytes = UNIVERSAL_HEADER_BYTES + (n_blocks * TIME_SERIES_INDEX_BYTES);
+    if (n_blocks == old_blocks)
+        return 0;
+    
+    for (k = old_blocks; k < n_blocks; k++)
+    {
+        if (tsi[k].number_of_samples > seg_md->maximum_block_samples)
+            seg_md->maximum_block_samples = tsi[k].number_of_samples;
+        if ((si8) tsi[k].block_bytes > seg_md->maximum_block_bytes)
+            seg_md->maximum_block_bytes = tsi[k].block_bytes;
+        if (tsi[k].RED_block_flags & RED_DISCONTINUITY_MASK)
+            seg_md->number_of_discontinuities++;
+    }
+    seg_md->number_of_blocks = n_blocks;
+    seg_md->number_of_samples = tsi[n_blocks - 1].start_sample + (si8) tsi[n_blocks - 1].number_of_samples;
+    fps->universal_header->number_of_entries = n_blocks;
+    segment->time_series_data_fps->file_length = data_bytes;
+    
+    // the segment ends where its last block does (unless the writer has already recorded a later end)
+    end_time = tsi[n_blocks - 1].start_time;
+    remove_recording_time_offset( &end_time);
+    end_time += (si8) ((tsi[n_blocks - 1].number_of_samples / sampling_frequency) * 1e6);
+    header_end_time = segment->time_series_data_fps->universal_header->end_time;
+    remove_recording_time_offset( &header_end_time);
+    if (end_time > header_end_time)
+    {
+        apply_recording_time_offset( &end_time);
+        segment->time_series_data_fps->universal_header->end_time = end_time;
+        segment->metadata_fps->universal_header->end_time = end_time;
+        fps->universal_header->end_time = end_time;
+    }
+    
+    return seg_md->number_of_samples - old_samples;
+}
+
+// Brings a CHANNEL (read with read_MEF_channel() or get_channel_struct(), not a lazy channel's) up to date with a
+// recording that is still being written: blocks appended to its last segment, and segments created since, are added,
+// reading only the new index entries and the new segments.  The channel's sample count, block count and end time are
+// updated, and the block index, continuous ranges and mappings this module keeps for it are extended rather than
+// rebuilt, so a refresh costs what was appended.  Blocks whose data is not yet all in the .tdat file, and new segments
+// without blocks, are left for a later refresh.  Don't read the channel while it is being refreshed.
+//
+// returns the number of samples appended, -1 on error
+si8 refresh_mef_channel(CHANNEL *channel, si1 *password)
+{
+    TIME_SERIES_METADATA_SECTION_2 *channel_md, *seg_md;
+    READER_CHANNEL_STATE *state;
+    CHANNEL_BLOCK_INDEX *index;
+    LAZY_SEGMENT_BOUNDS bounds;
+    SEGMENT *segments, *old_segments, *loaded;
+    SEGMENT_MAP *maps;
+    si1 channel_dir[MEF_FULL_FILE_NAME_BYTES], segment_path[MEF_FULL_FILE_NAME_BYTES], **names, *slash;
+    si8 appended, n_names, old_segment_count, old_samples, old_blocks, i, end_time;
+    ui1 *verified;
+    sf8 fs;
+    si4 c;
+    
+    if ((channel == NULL) || (channel->number_of_segments <= 0) || (channel->metadata.time_series_section_2 == NULL))
+        return -1;
+    
+    channel_md = channel->metadata.time_series_section_2;
+    fs = channel_md->sampling_frequency;
+    old_segments = channel->segments;
+    old_segment_count = channel->number_of_segments;
+    old_samples = channel_md->number_of_samples;
+    old_blocks = 0;
+    for (i = 0; i < old_segment_count; i++)
+        old_blocks += channel->segments[i].metadata_fps->metadata.time_series_section_2->number_of_blocks;
+    
+    appended = refresh_segment_tail(&channel->segments[old_segment_count - 1], fs);
+    if (appended < 0)
+        return -1;
+    
+    // the channel directory holds the segment directories, which hold the segment files
+    MEF_strncpy(channel_dir, channel->segments[0].time_series_data_fps->full_file_name, MEF_FULL_FILE_NAME_BYTES);
+    for (c = 0; c < 2; c++)
+    {
+        slash = strrchr(channel_dir, '/');
+#ifdef _WIN32
+        if (strrchr(channel_dir, '\\') > slash)
+            slash = strrchr(channel_dir, '\\');
+#endif
+        if (slash != NULL)
+            *slash = 0;
+    }
+    
+    // new segments, in order, while they are ready to be read
+    n_names = list_channel_segments(channel_dir, &names);
+    if (n_names > old_segment_count)
+    {
+        // the old last segment may have been finished after it was refreshed above
+        appended = refresh_segment_tail(&channel->segments[old_segment_count - 1], fs);
+        if (appended < 0)
+        {
+            free (names);
+            return -1;
+        }
+        
+        for (i = old_segment_count; i < n_names; i++)
+        {
+            MEF_snprintf(segment_path, MEF_FULL_FILE_NAME_BYTES, "%s/%s", channel_dir, names[i]);
+            if (!read_lazy_segment_bounds(segment_path, &bounds) || (bounds.number_of_blocks <= 0))
+                break;
+            
+            segments = (SEGMENT *) realloc(channel->segments, sizeof(SEGMENT) * (size_t) (i + 1));
+            if (segments == NULL)
+                break;
+            channel->segments = segments;
+            memset(&segments[i], 0, sizeof(SEGMENT));
+            reader_mutex_lock(&meflib_mutex);
+            loaded = read_MEF_segment(&segments[i], segment_path, TIME_SERIES_CHANNEL_TYPE, password, segments[0].metadata_fps->password_data, MEF_FALSE, MEF_FALSE);
+            reader_mutex_unlock(&meflib_mutex);
+            if (loaded == NULL)
+                break;
+            channel->number_of_segments = i + 1;
+        }
+    }
+    if (n_names >= 0)
+        free (names);
+    
+    // channel metadata, from the segments
+    channel_md->number_of_samples = 0;
+    channel_md->number_of_blocks = 0;
+    for (i = 0; i < channel->number_of_segments; i++)
+    {
+        seg_md = channel->segments[i].metadata_fps->metadata.time_series_section_2;
+        channel_md->number_of_samples += seg_md->number_of_samples;
+        channel_md->number_of_blocks += seg_md->number_of_blocks;
+        if (i < old_segment_count - 1)
+            continue;
+        if (seg_md->maximum_block_samples > channel_md->maximum_block_samples)
+            channel_md->maximum_block_samples = seg_md->maximum_block_samples;
+        if (seg_md->maximum_block_bytes > channel_md->maximum_block_bytes)
+            channel_md->maximum_block_bytes = seg_md->maximum_block_bytes;
+        end_time = channel->segments[i].time_series_data_fps->universal_header->end_time;
+        remove_recording_time_offset( &end_time);
+        if (end_time > channel->latest_end_time)
+            channel->latest_end_time = end_time;
+    }
+    
+    if (channel_md->number_of_samples == old_samples)
+        return 0;
+    
+    // extend what this module keeps for the channel, dropping what can't be extended (it is rebuilt when next used)
+    reader_mutex_lock(&reader_channel_states_mutex);
+    state = find_reader_channel_state(channel, 0);
+    if (state != NULL)
+    {
+        index = state->block_index;
+        if ((index != NULL) && ((index->segments != old_segments) || (index->channel_number_of_segments != old_segment_count) ||
+                                (index->channel_number_of_samples != old_samples) || !extend_channel_block_index(index, channel)))
+        {
+            free_channel_block_index(state->block_index);
+            state->block_index = index = NULL;
+        }
+        if ((state->continuous_ranges != NULL) && ((index == NULL) || !extend_continuous_ranges(state->continuous_ranges, channel, index, old_blocks)))
+        {
+            free_continuous_ranges(state->continuous_ranges);
+            state->continuous_ranges = NULL;
+        }
+        
+        // the old last segment's mapping is too short now, the new segments are mapped on first use
+        if (state->segment_maps != NULL)
+        {
+            unmap_segment(&state->segment_maps[old_segment_count - 1]);
+            maps = (SEGMENT_MAP *) realloc(state->segment_maps, sizeof(SEGMENT_MAP) * (size_t) channel->number_of_segments);
+            if (maps != NULL)
+            {
+                memset(maps + old_segment_count, 0, sizeof(SEGMENT_MAP) * (size_t) (channel->number_of_segments - old_segment_count));
+                state->segment_maps = maps;
+                state->number_of_segment_maps = channel->number_of_segments;
+            }
+        }
+        
+        if ((state->verified_blocks != NULL) && (channel_md->number_of_blocks > state->number_of_verified_bits))
+        {
+            verified = (ui1 *) realloc(state->verified_blocks, (size_t) ((channel_md->number_of_blocks + 7) >> 3));
+            if (verified != NULL)
+            {
+                memset(verified + ((state->number_of_verified_bits + 7) >> 3), 0,
+                       (size_t) (((channel_md->number_of_blocks + 7) >> 3) - ((state->number_of_verified_bits + 7) >> 3)));
+                state->verified_blocks = verified;
+                state->number_of_verified_bits = channel_md->number_of_blocks;
+            }
+        }
+    }
+    reader_mutex_unlock(&reader_channel_states_mutex);
+    
+    return channel_md->number_of_samples - old_samples;
+}
+
+// Reads the samples of a channel from *next_sample to its end (at most max_samples of them) into decomp_data, and moves
+// *next_sample past them.  Called after each refresh_mef_channel(), with *next_sample starting at 0 (or the channel's
+// sample count, to skip what was recorded before), it returns each sample once, as it is appended.
+//
+// returns the number of samples read (0 if there are no new samples), -1 on error
+si4 read_mef_ts_data_since(CHANNEL *channel, si8 *next_sample, si4 *decomp_data, si4 max_samples)
+{
+    READ_MEF_TS_DATA_OPTIONS options;
+    si8 end_samp;
+    si4 num_samps;
+    
+    if ((channel == NULL) || (next_sample == NULL) || (decomp_data == NULL) || (max_samples <= 0))
+        return -1;
+    
+    end_samp = channel->metadata.time_series_section_2->number_of_samples;
+    if (*next_sample < 0)
+        *next_sample = 0;
+    if (*next_sample >= end_samp)
+        return 0;
+    if (end_samp - *next_sample > max_samples)
+        end_samp = *next_sample + max_samples;
+    
+    initialize_read_mef_ts_data_options(&options);
+    options.free_decomp_data_on_error = MEF_FALSE;
+    num_samps = read_mef_ts_data_with_options(NULL, NULL, *next_sample, end_samp, 0, decomp_data, channel, -1, &options);
+    if (num_samps <= 0)
+        return -1;
+    *next_sample += num_samps;
+    
+    return num_samps;
+}
+
+/**************************  Multi-channel reads  ****************************/
+
+static READER_THREAD_RETURN multi_channel_worker(void *arg)
+{
+    MULTI_CHANNEL_READ *mcr;
+    READ_MEF_TS_DATA_OPTIONS options;
+    CHANNEL *channel;
+    si4 *samp_buf, *out;
+    si4 ch, num_samps, read_channel;
+    si8 i, limit;
+    
+    mcr = (MULTI_CHANNEL_READ *) arg;
+    
+    initialize_read_mef_ts_data_options(&options);
+    options.num_threads = mcr->decode_threads;
+    options.free_decomp_data_on_error = MEF_FALSE;
+    
+    limit = mcr->samples_per_channel;
+    if (limit > 0x7FFFFFFF)
+        limit = 0x7FFFFFFF;
+    
+    // interleaved output is read into a scratch row first, then spread out
+    samp_buf = NULL;
+    if (mcr->layout == SAMPLE_INTERLEAVED_LAYOUT)
+        samp_buf = (si4 *) malloc(sizeof(si4) * (size_t) mcr->samples_per_channel);
+    
+    while (1)
+    {
+        reader_mutex_lock(&mcr->mutex);
+        ch = mcr->next_channel++;
+        reader_mutex_unlock(&mcr->mutex);
+        if (ch >= mcr->n_channels)
+            break;
+        
+        if ((mcr->channels != NULL) && (mcr->channels[ch] != NULL))
+        {
+            read_channel = 0;
+            channel = mcr->channels[ch];
+        }
+        else
+        {
+            read_channel = 1;
+            reader_mutex_lock(&meflib_mutex);
+            channel = read_channel_with_cached_password(mcr->channel_paths[ch], mcr->password);
+            reader_mutex_unlock(&meflib_mutex);
+        }
+        
+        out = (mcr->layout == SAMPLE_INTERLEAVED_LAYOUT) ? samp_buf : mcr->decomp_data + (ch * mcr->samples_per_channel);
+        
+        num_samps = 0;
+        if ((channel != NULL) && (channel->channel_type == TIME_SERIES_CHANNEL_TYPE))
+            num_samps = read_mef_ts_data_with_options(NULL, NULL, mcr->start_time, mcr->end_time, 1, out, channel, (si4) limit, &options);
+        else
+            printf("Channel %d is not a time series channel, skipping...", ch);
+        
+        if (num_samps < 0)
+            num_samps = 0;
+        
+        // anything past the returned samples is NaN, so every row of the output is fully defined
+        memset_int(out + num_samps, RED_NAN, (size_t) (mcr->samples_per_channel - num_samps));
+        
+        if (mcr->layout == SAMPLE_INTERLEAVED_LAYOUT)
+        {
+            for (i = 0; i < mcr->samples_per_channel; i++)
+                mcr->decomp_data[(i * mcr->n_channels) + ch] = samp_buf[i];
+        }
+        
+        if (mcr->samples_returned != NULL)
+            mcr->samples_returned[ch] = num_samps;
+        
+        if (read_channel == 1 && channel != NULL)
+        {
+            release_channel_reader_state(channel);
+            release_read_channel_password(channel);
+            reader_mutex_lock(&meflib_mutex);
+            free_channel(channel, MEF_TRUE);
+            reader_mutex_unlock(&meflib_mutex);
+        }
+        
+        if (num_samps > 0)
+        {
+            reader_mutex_lock(&mcr->mutex);
+            mcr->channels_read++;
+            reader_mutex_unlock(&mcr->mutex);
+        }
+    }
+    
+    free (samp_buf);
+    
+    return READER_THREAD_RETURN_VALUE;
+}
+
+// Reads the same time range from several channels concurrently, into one channels x samples buffer.
+// Channels are given either as paths (channel_paths, password), or as already read CHANNELs (channels_passed_in).
+// If both are given, a NULL entry in channels_passed_in means that channel is read from its path.  Channels given as
+// paths are opened (read_MEF_channel(), which sets meflib globals) and freed one at a time, so only their data reads
+// overlap; for the full speedup on many short reads, pass CHANNELs read beforehand.
+//
+// decomp_data must hold n_channels * samples_per_channel samples.  With CHANNEL_MAJOR_LAYOUT channel c occupies
+// decomp_data[c * samples_per_channel ...], with SAMPLE_INTERLEAVED_LAYOUT sample s of channel c is at
+// decomp_data[s * n_channels + c].  Each channel returns at most samples_per_channel samples, any remaining
+// positions are set to NaN.  If samples_returned is not NULL it receives the per-channel sample counts.
+//
+// returns the number of channels that returned data
+si4 read_mef_channels_data_by_time(si1 **channel_paths, si1 *password, CHANNEL **channels_passed_in, si4 n_channels, si8 start_time, si8 end_time, si4 *decomp_data, si8 samples_per_channel, si4 layout, si4 *samples_returned)
+{
+    MULTI_CHANNEL_READ mcr;
+    READER_THREAD *threads;
+    si4 *thread_started;
+    si4 n_threads, w;
+    
+    if (decomp_data == NULL)
+    {
+        printf("No sample buffer was passed to function, exiting...");
+        return 0;
+    }
+    if ((n_channels <= 0) || (samples_per_channel <= 0))
+        return 0;
+    if ((channel_paths == NULL) && (channels_passed_in == NULL))
+    {
+        printf("No channels were passed to function, exiting...");
+        return 0;
+    }
+    
+    // set up mef 3 library once, before any worker opens a channel
+    if (channel_paths != NULL)
+    {
+        reader_mutex_lock(&meflib_mutex);
+        (void) initialize_meflib();
+        MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
+        reader_mutex_unlock(&meflib_mutex);
+    }
+    
+    mcr.channel_paths = channel_paths;
+    mcr.password = password;
+    mcr.channels = channels_passed_in;
+    mcr.n_channels = n_channels;
+    mcr.start_time = start_time;
+    mcr.end_time = end_time;
+    mcr.decomp_data = decomp_data;
+    mcr.samples_per_channel = samples_per_channel;
+    mcr.layout = layout;
+    mcr.samples_returned = samples_returned;
+    mcr.next_channel = 0;
+    mcr.channels_read = 0;
+    reader_mutex_init(&mcr.mutex);
+    
+    // one channel per thread; when there are more threads than channels, the rest go to decoding within a channel
+    n_threads = read_mef_ts_data_num_threads;
+    mcr.decode_threads = 1;
+    if (n_threads > n_channels)
+    {
+        mcr.decode_threads = n_threads / n_channels;
+        n_threads = n_channels;
+    }
+    
+    threads = (READER_THREAD *) calloc((size_t) n_threads, sizeof(READER_THREAD));
+    thread_started = (si4 *) calloc((size_t) n_threads, sizeof(si4));
+    for (w = 1; w < n_threads; w++)
+        thread_started[w] = reader_thread_create(&threads[w], multi_channel_worker, &mcr);
+    multi_channel_worker(&mcr);
+    for (w = 1; w < n_threads; w++)
+        if (thread_started[w])
+            reader_thread_join(threads[w]);
+    
+    free (thread_started);
+    free (threads);
+    reader_mutex_destroy(&mcr.mutex);
+    
+    return mcr.channels_read;
+}
+
+// Same as read_mef_channels_data_by_time(), for channels of an already read SESSION.  channel_indices selects
+// which of the session's time series channels are read (and their order in the output), NULL reads all of them.
+si4 read_mef_session_data_by_time(SESSION *session, si4 *channel_indices, si4 n_channels, si8 start_time, si8 end_time, si4 *decomp_data, si8 samples_per_channel, si4 layout, si4 *samples_returned)
+{
+    CHANNEL **channels;
+    si4 i, n_read;
+    
+    if (session == NULL)
+        return 0;
+    
+    if (channel_indices == NULL)
+        n_channels = session->number_of_time_series_channels;
+    if (n_channels <= 0)
+        return 0;
+    
+    channels = (CHANNEL **) malloc(sizeof(CHANNEL *) * (size_t) n_channels);
+    for (i = 0; i < n_channels; i++)
+    {
+        if (channel_indices == NULL)
+            channels[i] = &session->time_series_channels[i];
+        else if ((channel_indices[i] >= 0) && (channel_indices[i] < session->number_of_time_series_channels))
+            channels[i] = &session->time_series_channels[channel_indices[i]];
+        else
+        {
+            printf("Invalid channel index %d, exiting...", channel_indices[i]);
+            free (channels);
+            return 0;
+        }
+    }
+    
+    n_read = read_mef_channels_data_by_time(NULL, NULL, channels, n_channels, start_time, end_time, decomp_data, samples_per_channel, layout, samples_returned);
+    
+    free (channels);
+    
+    return n_read;
+}
+
+/**************************  Epoch reads  ****************************/
+
+// Many short windows of one channel (event-locked epochs) are read together.  The blocks a read of each window would
+// decode are found in the block index, the windows' block ranges are merged where they overlap or touch, and each block
+// of the merged ranges is read and decoded once, a chunk of blocks at a time, then copied into every window using it.
+
+#define EPOCH_CHUNK_SAMPLES     (1 << 22)   // decoded samples held at once
+
+typedef struct {
+    si4     *output;                // the epoch's row of decomp_data
+    si8     start_time;
+    si8     end_time;
+    si8     num_samps;
+    si8     first_block;            // channel block numbers of the first and last blocks a read of the window decodes
+    si8     last_block;
+    si1     done;                   // the read's last block has been placed
+} EPOCH_READ;
+
+static si4 compare_epoch_blocks(const void *a, const void *b)
+{
+    const EPOCH_READ *ea, *eb;
+    
+    ea = (const EPOCH_READ *) a;
+    eb = (const EPOCH_READ *) b;
+    if (ea->first_block != eb->first_block)
+        return (ea->first_block < eb->first_block) ? -1 : 1;
+    if (ea->last_block != eb->last_block)
+        return (ea->last_block < eb->last_block) ? -1 : 1;
+    return 0;
+}
+
+// Copies a decoded block into an epoch, placed as read_mef_ts_data() places it.  Blocks after the first are middle
+// blocks until one doesn't fit the window (or the last block is reached); that one is placed as the read's last block,
+// and later blocks are not used.
+static void place_epoch_block(EPOCH_READ *epoch, si8 block, si8 block_time, si4 *samples, si8 number_of_samples, sf8 fs)
+{
+    si8 offset;
+    
+    if (epoch->done)
+        return;
+    
+    if ((block == epoch->first_block) || (block == epoch->last_block) || (block_time < epoch->start_time) ||
+        (block_time + ((number_of_samples / fs) * 1e6) >= epoch->end_time))
+    {
+        offset = output_offset_for_time(block_time, epoch->start_time, fs);
+        if (block != epoch->first_block)
+            epoch->done = 1;
+    }
+    else
+        offset = (si8) ((((block_time - epoch->start_time) / 1000000.0) * fs) + 0.5);
+    
+    copy_block_clipped(epoch->output, epoch->num_samps, offset, samples, number_of_samples);
+}
+
+// Reads n_epochs time windows, [start_times[e], end_times[e]), of one channel into an epochs x samples buffer: epoch e
+// occupies decomp_data[e * samples_per_epoch ...], and holds what read_mef_ts_data_by_time() returns for its window
+// (at most samples_per_epoch samples), followed by NaNs.  Windows may be in any order and may overlap.  A window the
+// channel has no data for returns no samples.  If samples_returned is not NULL it receives the per-epoch sample counts.
+// Uses the set_read_mef_ts_data_num_threads() and set_read_mef_ts_data_io_mode() settings (READ_IO_PIPELINED reads as
+// READ_IO_FREAD does, a run of blocks at a time), not the block cache.
+//
+// returns the number of epochs that returned data, or 0 on error
+si4 read_mef_ts_epochs_by_time(si1 *channel_path, si1 *password, si8 *start_times, si8 *end_times, si4 n_epochs, si4 *decomp_data, si8 samples_per_epoch, si4 *samples_returned, CHANNEL *channel_passed_in)
+{
+    CHANNEL *channel;
+    CHANNEL_BLOCK_INDEX *index;
+    EPOCH_READ *epochs;
+    DECODE_BLOCK_JOB *jobs;
+    RED_BLOCK_HEADER *block_header;
+    si4 *samples;
+    si8 *block_time, *block_samples;
+    ui1 *buffer, *run_data, *block_ptr, *map;
+    si8 e, n_read, limit, num_samps, group, group_end, group_last, chunk_first, chunk_end, chunk_blocks;
+    si8 b, k, run_end, run_offset, n_jobs, failed_job, stride;
+    ui8 run_bytes, buffer_bytes, map_bytes, start_idx, end_idx;
+    si4 read_channel, start_segment, end_segment, segment, io_mode, n_threads, ok;
+    ui4 max_samps;
+    sf8 fs;
+    
+    if (decomp_data == NULL)
+    {
+        printf("No sample buffer was passed to function, exiting...");
+        return 0;
+    }
+    if ((n_epochs <= 0) || (samples_per_epoch <= 0) || (start_times == NULL) || (end_times == NULL))
+        return 0;
+    
+    if (channel_passed_in == NULL)
+    {
+        read_channel = 1;
+        
+        // set up mef 3 library
+        (void) initialize_meflib();
+        MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
+        
+        channel = read_channel_with_cached_password(channel_path, password);
+        
+        if (channel == NULL)
+            return 0;
+        if (channel->channel_type != TIME_SERIES_CHANNEL_TYPE) {
+            printf("Not a time series channel, exiting...");
+            free_read_channel(channel);
+            return 0;
+        }
+    }
+    else
+    {
+        read_channel = 0;
+        channel = channel_passed_in;
+    }
+    
+    index = get_channel_block_index(channel);
+    if (index == NULL)
+    {
+        printf("Could not index channel, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        return 0;
+    }
+    
+    fs = channel->metadata.time_series_section_2->sampling_frequency;
+    max_samps = channel->metadata.time_series_section_2->maximum_block_samples;
+    io_mode = read_mef_ts_data_io_mode;
+    n_threads = read_mef_ts_data_num_threads;
+    limit = samples_per_epoch;
+    if (limit > 0x7FFFFFFF)
+        limit = 0x7FFFFFFF;
+    
+    // every position not filled by a block is NaN, as in a read by time
+    memset_int(decomp_data, RED_NAN, (size_t) (n_epochs * samples_per_epoch));
+    
+    // the blocks each window's read would decode, with the same checks as read_mef_ts_data()
+    epochs = (EPOCH_READ *) calloc((size_t) n_epochs, sizeof(EPOCH_READ));
+    if (epochs == NULL)
+    {
+        printf("Error allocating memory, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        return 0;
+    }
+    n_read = 0;
+    for (e = 0; e < n_epochs; e++)
+    {
+        if (samples_returned != NULL)
+            samples_returned[e] = 0;
+        if (start_times[e] >= end_times[e])
+            continue;
+        if (((start_times[e] < channel->earliest_start_time) && (end_times[e] < channel->earliest_start_time)) ||
+            ((start_times[e] > channel->latest_end_time) && (end_times[e] > channel->latest_end_time)))
+            continue;
+        num_samps = (si4) (((end_times[e] - start_times[e]) / 1000000.0) * fs);
+        if (num_samps > limit)
+            num_samps = limit;
+        if (num_samps <= 0)
+            continue;
+        if (!locate_read_blocks(index, 1, start_times[e], end_times[e], 0, 0, &start_segment, &end_segment, &start_idx, &end_idx))
+            continue;
+        
+        epochs[n_read].output = decomp_data + (e * samples_per_epoch);
+        epochs[n_read].start_time = start_times[e];
+        epochs[n_read].end_time = end_times[e];
+        epochs[n_read].num_samps = num_samps;
+        epochs[n_read].first_block = index->segment_first_block[start_segment] + (si8) start_idx;
+        epochs[n_read].last_block = index->segment_first_block[end_segment] + (si8) end_idx;
+        if (epochs[n_read].last_block < epochs[n_read].first_block)
+            epochs[n_read].last_block = epochs[n_read].first_block;
+        if (samples_returned != NULL)
+            samples_returned[e] = (si4) num_samps;
+        n_read++;
+    }
+    qsort(epochs, (size_t) n_read, sizeof(EPOCH_READ), compare_epoch_blocks);
+    
+    // decoded blocks of a chunk, each at a stride of max_samps + 1 samples
+    stride = (si8) max_samps + 1;
+    chunk_blocks = EPOCH_CHUNK_SAMPLES / stride;
+    if (chunk_blocks < 1)
+        chunk_blocks = 1;
+    samples = (si4 *) malloc(sizeof(si4) * (size_t) (chunk_blocks * stride));
+    block_time = (si8 *) malloc(sizeof(si8) * (size_t) chunk_blocks);
+    block_samples = (si8 *) malloc(sizeof(si8) * (size_t) chunk_blocks);
+    jobs = (DECODE_BLOCK_JOB *) malloc(sizeof(DECODE_BLOCK_JOB) * (size_t) chunk_blocks);
+    buffer = NULL;
+    buffer_bytes = 0;
+    ok = 1;
+    if ((samples == NULL) || (block_time == NULL) || (block_samples == NULL) || (jobs == NULL))
+    {
+        printf("Error allocating memory, exiting...");
+        ok = 0;
+    }
+    
+    // a group is a run of epochs whose block ranges overlap or touch, read as one range of blocks
+    for (group = 0; (group < n_read) && ok; group = group_end)
+    {
+        group_last = epochs[group].last_block;
+        for (group_end = group + 1; (group_end < n_read) && (epochs[group_end].first_block <= group_last + 1); group_end++)
+        {
+            if (epochs[group_end].last_block > group_last)
+                group_last = epochs[group_end].last_block;
+        }
+        
+        for (chunk_first = epochs[group].first_block; (chunk_first <= group_last) && ok; chunk_first = chunk_end)
+        {
+            chunk_end = chunk_first + chunk_blocks;
+            if (chunk_end > group_last + 1)
+                chunk_end = group_last + 1;
+            
+            // read and decode the chunk, one run of consecutive blocks of a segment at a time
+            for (k = chunk_first; (k < chunk_end) && ok; k = run_end)
+            {
+                segment = index->segment[k];
+                for (run_end = k + 1; (run_end < chunk_end) && (index->segment[run_end] == segment); run_end++);
+                run_offset = index->file_offset[k];
+                run_bytes = (ui8) (block_index_block_end_offset(index, channel, run_end - 1) - run_offset);
+                
+                if (io_mode == READ_IO_MMAP)
+                {
+                    map = get_segment_map(channel, segment, &map_bytes);
+                    if ((map == NULL) || (run_offset < 0) || ((ui8) run_offset + run_bytes > map_bytes))
+                    {
+                        printf("Error mapping file, exiting...");
+                        ok = 0;
+                        break;
+                    }
+                    run_data = map + run_offset;
+                    advise_segment_map(run_data, run_bytes);
+                }
+                else
+                {
+                    if (run_bytes > buffer_bytes)
+                    {
+                        free (buffer);
+                        buffer = (ui1 *) malloc((size_t) run_bytes);
+                        buffer_bytes = (buffer != NULL) ? run_bytes : 0;
+                        if (buffer == NULL)
+                        {
+                            printf("Error allocating memory, exiting...");
+                            ok = 0;
+                            break;
+                        }
+                    }
+                    run_data = buffer;
+                    if (!read_segment_data(channel, segment, run_offset, run_bytes, run_data))
+                    {
+                        printf("Error reading file, exiting...");
+                        ok = 0;
+                        break;
+                    }
+                }
+                
+                n_jobs = 0;
+                for (b = k; b < run_end; b++)
+                {
+                    block_ptr = run_data + (index->file_offset[b] - run_offset);
+                    block_header = (RED_BLOCK_HEADER *) block_ptr;
+                    // (CRCs are checked as the blocks are decoded)
+                    if (!check_block_bounds(block_ptr, max_samps, run_data, run_bytes) || (block_header->block_bytes == 0))
+                    {
+                        printf("RED block %ld has 0 bytes, or CRC failed, data likely corrupt...", (long) b);
+                        ok = 0;
+                        break;
+                    }
+                    block_time[b - chunk_first] = block_header->start_time;
+                    remove_recording_time_offset( &block_time[b - chunk_first] );
+                    block_samples[b - chunk_first] = block_header->number_of_samples;
+                    
+                    jobs[n_jobs].block_ptr = block_ptr;
+                    jobs[n_jobs].bytes_available = run_bytes - (ui8) (block_ptr - run_data);
+                    jobs[n_jobs].output_ptr = samples + ((b - chunk_first) * stride);
+                    jobs[n_jobs].number_of_samples = block_header->number_of_samples;
+                    jobs[n_jobs].channel = channel;
+                    jobs[n_jobs].block = b;
+                    n_jobs++;
+                }
+                if (!ok)
+                    break;
+                
+                failed_job = decode_block_jobs(jobs, n_jobs, max_samps, (io_mode == READ_IO_MMAP), n_threads);
+                if (failed_job >= 0)
+                {
+                    printf("RED block %ld has 0 bytes, or CRC failed, data likely corrupt...", (long) (k + failed_job));
+                    ok = 0;
+                }
+            }
+            if (!ok)
+                break;
+            
+            // copy the chunk's blocks into the epochs using them (epochs are in order of their first block)
+            for (e = group; (e < group_end) && (epochs[e].first_block < chunk_end); e++)
+            {
+                b = (epochs[e].first_block > chunk_first) ? epochs[e].first_block : chunk_first;
+                for (; (b <= epochs[e].last_block) && (b < chunk_end); b++)
+                    place_epoch_block(&epochs[e], b, block_time[b - chunk_first], samples + ((b - chunk_first) * stride), block_samples[b - chunk_first], fs);
+            }
+        }
+    }
+    
+    free (buffer);
+    free (jobs);
+    free (block_samples);
+    free (block_time);
+    free (samples);
+    free (epochs);
+    if (read_channel == 1)
+        free_read_channel(channel);
+    
+    if (!ok)
+        return 0;
+    
+    return (si4) n_read;
+}
+
+/**************************  Decoded block cache  ****************************/
+
+// A decoded block, keyed by channel, segment and block number within the segment.  Samples are never changed once an
+// entry is in the cache; entries in use by a read are pinned (ref_count > 0) and not evicted.
+typedef struct BLOCK_CACHE_ENTRY BLOCK_CACHE_ENTRY;
+struct BLOCK_CACHE_ENTRY {
+    CHANNEL     *channel;
+    si4         segment;
+    si8         block;
+    si8         start_time;             // recording time offset removed
+    ui4         number_of_samples;
+    si4         *samples;
+    si4         ref_count;
+    si1         cached;                 // in the hash table and LRU list
+    BLOCK_CACHE_ENTRY   *hash_next;
+    BLOCK_CACHE_ENTRY   *lru_prev;      // toward most recently used
+    BLOCK_CACHE_ENTRY   *lru_next;      // toward least recently used
+};
+
+typedef struct {
+    ui8     max_bytes;                  // 0 when the cache is disabled
+    ui8     bytes_used;
+    si8     number_of_entries;
+    BLOCK_CACHE_ENTRY   **buckets;
+    si8     number_of_buckets;
+    BLOCK_CACHE_ENTRY   *lru_head;
+    BLOCK_CACHE_ENTRY   *lru_tail;
+    ui8     hits;
+    ui8     misses;
+} BLOCK_CACHE;
+
+#define BLOCK_CACHE_INITIAL_BUCKETS     4096
+
+static BLOCK_CACHE block_cache;
+static READER_MUTEX block_cache_mutex = READER_MUTEX_INITIALIZER;
+
+static ui8 block_cache_entry_bytes(BLOCK_CACHE_ENTRY *entry)
+{
+    return sizeof(BLOCK_CACHE_ENTRY) + (sizeof(si4) * (ui8) entry->number_of_samples);
+}
+
+static ui8 block_cache_hash(CHANNEL *channel, si4 segment, si8 block)
+{
+    ui8 h;
+    
+    h = (ui8) (uintptr_t) channel;
+    h = (h ^ (h >> 17)) * 0x9E3779B97F4A7C15ULL;
+    h ^= ((ui8) segment << 40) ^ (ui8) block;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    
+    return h ^ (h >> 31);
+}
+
+static void block_cache_free_entry(BLOCK_CACHE_ENTRY *entry)
+{
+    free (entry->samples);
+    free (entry);
+}
+
+static void block_cache_lru_unlink(BLOCK_CACHE_ENTRY *entry)
+{
+    if (entry->lru_prev != NULL)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        block_cache.lru_head = entry->lru_next;
+    if (entry->lru_next != NULL)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        block_cache.lru_tail = entry->lru_prev;
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void block_cache_lru_push_front(BLOCK_CACHE_ENTRY *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = block_cache.lru_head;
+    if (block_cache.lru_head != NULL)
+        block_cache.lru_head->lru_prev = entry;
+    block_cache.lru_head = entry;
+    if (block_cache.lru_tail == NULL)
+        block_cache.lru_tail = entry;
+}
+
+// takes an entry out of the hash table and LRU list (caller holds block_cache_mutex)
+static void block_cache_remove(BLOCK_CACHE_ENTRY *entry)
+{
+    BLOCK_CACHE_ENTRY **link;
+    
+    link = &block_cache.buckets[block_cache_hash(entry->channel, entry->segment, entry->block) & (ui8) (block_cache.number_of_buckets - 1)];
+    while (*link != entry)
+        link = &(*link)->hash_next;
+    *link = entry->hash_next;
+    block_cache_lru_unlink(entry);
+    entry->cached = 0;
+    block_cache.bytes_used -= block_cache_entry_bytes(entry);
+    block_cache.number_of_entries--;
+}
+
+// evicts least recently used, unpinned entries until the cache is within its size (caller holds block_cache_mutex)
+static void block_cache_evict(void)
+{
+    BLOCK_CACHE_ENTRY *entry, *prev;
+    
+    entry = block_cache.lru_tail;
+    while ((block_cache.bytes_used > block_cache.max_bytes) && (entry != NULL))
+    {
+        prev = entry->lru_prev;
+        if (entry->ref_count == 0)
+        {
+            block_cache_remove(entry);
+            block_cache_free_entry(entry);
+        }
+        entry = prev;
+    }
+}
+
+// doubles the number of hash buckets (caller holds block_cache_mutex)
+static void block_cache_grow(void)
+{
+    BLOCK_CACHE_ENTRY **old_buckets, *entry, *next;
+    si8 old_n, i;
+    ui8 b;
+    
+    old_buckets = block_cache.buckets;
+    old_n = block_cache.number_of_buckets;
+    block_cache.number_of_buckets = (old_n == 0) ? BLOCK_CACHE_INITIAL_BUCKETS : old_n * 2;
+    block_cache.buckets = (BLOCK_CACHE_ENTRY **) calloc((size_t) block_cache.number_of_buckets, sizeof(BLOCK_CACHE_ENTRY *));
+    for (i = 0; i < old_n; i++)
+    {
+        for (entry = old_buckets[i]; entry != NULL; entry = next)
+        {
+            next = entry->hash_next;
+            b = block_cache_hash(entry->channel, entry->segment, entry->block) & (ui8) (block_cache.number_of_buckets - 1);
+            entry->hash_next = block_cache.buckets[b];
+            block_cache.buckets[b] = entry;
+        }
+    }
+    free (old_buckets);
+}
+
+static si4 block_cache_enabled(void)
+{
+    return (block_cache.max_bytes > 0);
+}
+
+// Sets the size in bytes of the decoded block cache.  0 (the default) disables it and frees anything cached.
+// The cache is used by reads of a CHANNEL passed in by the caller, and is shared by all threads.
+void set_read_mef_ts_data_block_cache_size(ui8 max_bytes)
+{
+    reader_mutex_lock(&block_cache_mutex);
+    block_cache.max_bytes = max_bytes;
+    block_cache_evict();
+    if ((max_bytes == 0) && (block_cache.number_of_entries == 0))
+    {
+        free (block_cache.buckets);
+        block_cache.buckets = NULL;
+        block_cache.number_of_buckets = 0;
+    }
+    reader_mutex_unlock(&block_cache_mutex);
+}
+
+// drops the cached blocks of a channel, or of all channels if channel is NULL
+void invalidate_read_mef_ts_data_block_cache(CHANNEL *channel)
+{
+    BLOCK_CACHE_ENTRY *entry, *next;
+    
+    reader_mutex_lock(&block_cache_mutex);
+    for (entry = block_cache.lru_head; entry != NULL; entry = next)
+    {
+        next = entry->lru_next;
+        if ((channel == NULL) || (entry->channel == channel))
+        {
+            block_cache_remove(entry);
+            if (entry->ref_count == 0)
+                block_cache_free_entry(entry);
+        }
+    }
+    reader_mutex_unlock(&block_cache_mutex);
+}
+
+void get_read_mef_ts_data_block_cache_stats(ui8 *hits, ui8 *misses, ui8 *bytes_used, si8 *number_of_blocks)
+{
+    reader_mutex_lock(&block_cache_mutex);
+    if (hits != NULL)
+        *hits = block_cache.hits;
+    if (misses != NULL)
+        *misses = block_cache.misses;
+    if (bytes_used != NULL)
+        *bytes_used = block_cache.bytes_used;
+    if (number_of_blocks != NULL)
+        *number_of_blocks = block_cache.number_of_entries;
+    reader_mutex_unlock(&block_cache_mutex);
+}
+
+void reset_read_mef_ts_data_block_cache_stats(void)
+{
+    reader_mutex_lock(&block_cache_mutex);
+    block_cache.hits = block_cache.misses = 0;
+    reader_mutex_unlock(&block_cache_mutex);
+}
+
+// returns the cached block, pinned, or NULL (caller holds block_cache_mutex)
+static BLOCK_CACHE_ENTRY *block_cache_lookup(CHANNEL *channel, si4 segment, si8 block)
+{
+    BLOCK_CACHE_ENTRY *entry;
+    
+    if (block_cache.number_of_buckets == 0)
+        return NULL;
+    
+    entry = block_cache.buckets[block_cache_hash(channel, segment, block) & (ui8) (block_cache.number_of_buckets - 1)];
+    for (; entry != NULL; entry = entry->hash_next)
+    {
+        if ((entry->channel == channel) && (entry->segment == segment) && (entry->block == block))
+        {
+            entry->ref_count++;
+            block_cache_lru_unlink(entry);
+            block_cache_lru_push_front(entry);
+            return entry;
+        }
+    }
+    
+    return NULL;
+}
+
+// Adds a newly decoded, pinned entry.  If another thread cached the same block meanwhile, the new entry is freed and the
+// existing one returned (pinned) instead.  An entry larger than the whole cache is returned uncached, to be freed when
+// it is released.  (caller holds block_cache_mutex)
+static BLOCK_CACHE_ENTRY *block_cache_insert(BLOCK_CACHE_ENTRY *entry)
+{
+    BLOCK_CACHE_ENTRY *existing;
+    ui8 b;
+    
+    existing = block_cache_lookup(entry->channel, entry->segment, entry->block);
+    if (existing != NULL)
+    {
+        block_cache_free_entry(entry);
+        return existing;
+    }
+    
+    if (block_cache_entry_bytes(entry) > block_cache.max_bytes)
+        return entry;
+    
+    if (block_cache.number_of_entries >= 2 * block_cache.number_of_buckets)
+        block_cache_grow();
+    
+    b = block_cache_hash(entry->channel, entry->segment, entry->block) & (ui8) (block_cache.number_of_buckets - 1);
+    entry->hash_next = block_cache.buckets[b];
+    block_cache.buckets[b] = entry;
+    block_cache_lru_push_front(entry);
+    entry->cached = 1;
+    block_cache.bytes_used += block_cache_entry_bytes(entry);
+    block_cache.number_of_entries++;
+    block_cache_evict();
+    
+    return entry;
+}
+
+// unpins an entry; call block_cache_evict() once done releasing (caller holds block_cache_mutex)
+static void block_cache_release(BLOCK_CACHE_ENTRY *entry)
+{
+    entry->ref_count--;
+    if ((entry->ref_count == 0) && !entry->cached)
+        block_cache_free_entry(entry);  // evicted or invalidated while pinned
+}
+
+// copies the samples of a block that fall within [0, num_samps) of the output, the block's first sample going to offset
+static void copy_block_clipped(si4 *decomp_data, si8 num_samps, si8 offset, si4 *samples, si8 number_of_samples)
+{
+    si8 first, last;
+    
+    first = (offset < 0) ? -offset : 0;
+    last = number_of_samples;
+    if (offset + last > num_samps)
+        last = num_samps - offset;
+    if (last > first)
+        memcpy(decomp_data + offset + first, samples + first, sizeof(si4) * (size_t) (last - first));
+}
+
+// Reads num_blocks blocks starting at first_block (channel block number) into decomp_data, taking decoded blocks from
+// the cache where possible.  Missing blocks are read (in runs of consecutive blocks), decoded into new cache entries, and
+// cached.  Blocks are placed exactly as read_mef_ts_data() places them.  Returns 1 on success, 0 on error.
+static si4 read_blocks_through_cache(CHANNEL *channel, CHANNEL_BLOCK_INDEX *index, si8 first_block, si8 num_blocks, si4 times_specified,
+                                     si8 start_time, si8 end_time, si8 start_samp, si4 *decomp_data, si4 num_samps, si4 n_threads, si4 io_mode)
+{
+    BLOCK_CACHE_ENTRY **entries, *entry;
+    DECODE_BLOCK_JOB *jobs;
+    si8 i, k, run_end, n_jobs, n_misses, failed_job, offset, sample_counter, last_block;
+    si8 seg_block, run_offset, run_bytes_total, buffer_used;
+    ui1 *run_buffer, *run_data, *block_ptr, *map, *is_new;
+    ui8 map_bytes, run_bytes;
+    ui4 max_samps;
+    si4 segment, ok;
+    sf8 fs;
+    RED_BLOCK_HEADER *block_header;
+    
+    max_samps = channel->metadata.time_series_section_2->maximum_block_samples;
+    fs = channel->metadata.time_series_section_2->sampling_frequency;
+    entries = (BLOCK_CACHE_ENTRY **) calloc((size_t) num_blocks, sizeof(BLOCK_CACHE_ENTRY *));
+    is_new = (ui1 *) calloc((size_t) num_blocks, sizeof(ui1));
+    if ((entries == NULL) || (is_new == NULL))
+    {
+        printf("Error allocating memory, exiting...");
+        free (entries);
+        free (is_new);
+        return 0;
+    }
+    
+    // look up every block, pinning the ones found
+    n_misses = 0;
+    reader_mutex_lock(&block_cache_mutex);
+    for (i = 0; i < num_blocks; i++)
+    {
+        k = first_block + i;
+        entries[i] = block_cache_lookup(channel, index->segment[k], k - index->segment_first_block[index->segment[k]]);
+        if (entries[i] == NULL)
+            n_misses++;
+    }
+    block_cache.hits += (ui8) (num_blocks - n_misses);
+    block_cache.misses += (ui8) n_misses;
+    reader_mutex_unlock(&block_cache_mutex);
+    
+    // read and decode the missing blocks
+    ok = 1;
+    run_buffer = NULL;
+    jobs = NULL;
+    n_jobs = 0;
+    if (n_misses > 0)
+    {
+        jobs = (DECODE_BLOCK_JOB *) malloc(sizeof(DECODE_BLOCK_JOB) * (size_t) n_misses);
+        
+        // compressed bytes of all runs, when reading into a buffer
+        run_bytes_total = 0;
+        if (io_mode != READ_IO_MMAP)
+        {
+            for (i = 0; i < num_blocks; i++)
+                if (entries[i] == NULL)
+                    run_bytes_total += block_index_block_end_offset(index, channel, first_block + i) - index->file_offset[first_block + i];
+            run_buffer = (ui1 *) malloc((size_t) run_bytes_total);
+        }
+        if ((jobs == NULL) || ((io_mode != READ_IO_MMAP) && (run_buffer == NULL)))
+        {
+            printf("Error allocating memory, exiting...");
+            ok = 0;
+        }
+        
+        buffer_used = 0;
+        for (i = 0; (i < num_blocks) && ok; i = run_end)
+        {
+            if (entries[i] != NULL)
+            {
+                run_end = i + 1;
+                continue;
+            }
+            
+            // a run is consecutive missing blocks of one segment
+            k = first_block + i;
+            segment = index->segment[k];
+            for (run_end = i + 1; (run_end < num_blocks) && (entries[run_end] == NULL) && (index->segment[first_block + run_end] == segment); run_end++);
+            run_offset = index->file_offset[k];
+            run_bytes = (ui8) (block_index_block_end_offset(index, channel, first_block + run_end - 1) - run_offset);
+            
+            if (io_mode == READ_IO_MMAP)
+            {
+                map = get_segment_map(channel, segment, &map_bytes);
+                if ((map == NULL) || (run_offset < 0) || ((ui8) run_offset + run_bytes > map_bytes))
+                {
+                    printf("Error mapping file, exiting...");
+                    ok = 0;
+                    break;
+                }
+                run_data = map + run_offset;
+                advise_segment_map(run_data, run_bytes);
+            }
+            else
+            {
+                run_data = run_buffer + buffer_used;
+                buffer_used += (si8) run_bytes;
+                if (!read_segment_data(channel, segment, run_offset, run_bytes, run_data))
+                {
+                    printf("Error reading file, exiting...");
+                    ok = 0;
+                    break;
+                }
+            }
+            
+            for (; i < run_end; i++)
+            {
+                k = first_block + i;
+                block_ptr = run_data + (index->file_offset[k] - run_offset);
+                block_header = (RED_BLOCK_HEADER *) block_ptr;
+                // (CRCs are checked as the blocks are decoded)
+                if (!check_block_bounds(block_ptr, max_samps, run_data, run_bytes) || (block_header->block_bytes == 0))
+                {
+                    printf("RED block %ld has 0 bytes, or CRC failed, data likely corrupt...", (long) k);
+                    ok = 0;
+                    break;
+                }
+                
+                seg_block = k - index->segment_first_block[segment];
+                entry = (BLOCK_CACHE_ENTRY *) calloc((size_t) 1, sizeof(BLOCK_CACHE_ENTRY));
+                if (entry != NULL)
+                    entry->samples = (si4 *) malloc(sizeof(si4) * (size_t) (block_header->number_of_samples + 1));
+                if ((entry == NULL) || (entry->samples == NULL))
+                {
+                    printf("Error allocating memory, exiting...");
+                    free (entry);
+                    ok = 0;
+                    break;
+                }
+                entry->channel = channel;
+                entry->segment = segment;
+                entry->block = seg_block;
+                entry->number_of_samples = block_header->number_of_samples;
+                entry->start_time = block_header->start_time;
+                remove_recording_time_offset( &entry->start_time );
+                entry->ref_count = 1;
+                entries[i] = entry;
+                is_new[i] = 1;
+                
+                jobs[n_jobs].block_ptr = block_ptr;
+                jobs[n_jobs].bytes_available = run_bytes - (ui8) (block_ptr - run_data);
+                jobs[n_jobs].output_ptr = entry->samples;
+                jobs[n_jobs].number_of_samples = entry->number_of_samples;
+                jobs[n_jobs].channel = channel;
+                jobs[n_jobs].block = k;
+                n_jobs++;
+            }
+        }
+        
+        if (ok)
+        {
+            failed_job = decode_block_jobs(jobs, n_jobs, max_samps, (io_mode == READ_IO_MMAP), n_threads);
+            if (failed_job >= 0)
+            {
+                printf("RED block has 0 bytes, or CRC failed, data likely corrupt...");
+                ok = 0;
+            }
+        }
+        
+        free (jobs);
+        free (run_buffer);
+        
+        // cache the new blocks (or drop them all on error)
+        reader_mutex_lock(&block_cache_mutex);
+        for (i = 0; i < num_blocks; i++)
+        {
+            if (ok && is_new[i])
+                entries[i] = block_cache_insert(entries[i]);
+        }
+        reader_mutex_unlock(&block_cache_mutex);
+    }
+    
+    if (ok)
+    {
+        // first block
+        if (times_specified)
+            offset = output_offset_for_time(entries[0]->start_time, start_time, fs);
+        else
+            offset = index->start_sample[first_block] - start_samp;
+        copy_block_clipped(decomp_data, num_samps, offset, entries[0]->samples, entries[0]->number_of_samples);
+        if (offset < num_samps)
+            sample_counter = (offset + entries[0]->number_of_samples < num_samps) ? offset + entries[0]->number_of_samples : num_samps;
+        else
+            sample_counter = offset;
+        
+        // middle blocks; when reading by time, the first block that doesn't fit the range is used as the last block
+        last_block = num_blocks - 1;
+        for (i = 1; i < num_blocks - 1; i++)
+        {
+            entry = entries[i];
+            if (times_specified)
+            {
+                if ((entry->start_time < start_time) ||
+                    (entry->start_time + ((entry->number_of_samples / fs) * 1e6) >= end_time))
+                {
+                    last_block = i;
+                    break;
+                }
+                offset = (si8) ((((entry->start_time - start_time) / 1000000.0) * fs) + 0.5);
+            }
+            else
+                offset = sample_counter;
+            copy_block_clipped(decomp_data, num_samps, offset, entry->samples, entry->number_of_samples);
+            sample_counter += entry->number_of_samples;
+        }
+        
+        // last block
+        if (num_blocks > 1)
+        {
+            entry = entries[last_block];
+            if (times_specified)
+                offset = output_offset_for_time(entry->start_time, start_time, fs);
+            else
+                offset = sample_counter;
+            copy_block_clipped(decomp_data, num_samps, offset, entry->samples, entry->number_of_samples);
+        }
+    }
+    
+    // unpin, freeing anything that never made it into the cache, then bring the cache back within its size (the
+    // blocks of this read could not be evicted while pinned)
+    reader_mutex_lock(&block_cache_mutex);
+    for (i = 0; i < num_blocks; i++)
+    {
+        if (entries[i] == NULL)
+            continue;
+        block_cache_release(entries[i]);
+    }
+    block_cache_evict();
+    reader_mutex_unlock(&block_cache_mutex);
+    free (entries);
+    free (is_new);
+    
+    return ok;
+}
+
+/**************************  Pipelined reads  ****************************/
+
+// With READ_IO_PIPELINED, a reader thread reads the blocks of a read, a chunk of consecutive blocks at a time, into a
+// small ring of buffers, while the calling thread (with any decode workers) decodes the chunks already read.  Before
+// waiting for a free buffer the reader asks the OS to start reading its next chunk, so the disk stays busy while the
+// buffers are full.
+
+#define PIPELINE_SLOTS          4
+#define PIPELINE_CHUNK_BYTES    (1 << 20)
+
+#define PIPELINE_SLOT_EMPTY     0
+#define PIPELINE_SLOT_FULL      1
+#define PIPELINE_SLOT_FAILED    2
+
+typedef struct {
+    ui1     *data;
+    ui8     capacity;
+    ui8     bytes;
+    si8     first_block;            // blocks [first_block, end_block) of the read
+    si8     end_block;
+    si4     state;
+} PIPELINE_SLOT;
+
+typedef struct {
+    CHANNEL             *channel;
+    CHANNEL_BLOCK_INDEX *index;
+    si8     first_block;            // channel block number of the read's first block
+    si8     num_blocks;
+    PIPELINE_SLOT   slots[PIPELINE_SLOTS];
+    si4     stop;                   // set by the consumer to end reading early
+    READER_MUTEX    mutex;
+    READER_COND     changed;
+} READ_PIPELINE;
+
+static READER_THREAD_RETURN pipeline_reader(void *arg)
+{
+    READ_PIPELINE *pipeline;
+    CHANNEL_BLOCK_INDEX *index;
+    PIPELINE_SLOT *slot;
+    si8 block, end_block, k, offset;
+    ui8 bytes;
+    si4 n_slot, segment, ok, stop;
+    
+    pipeline = (READ_PIPELINE *) arg;
+    index = pipeline->index;
+    
+    n_slot = 0;
+    for (block = 0; block < pipeline->num_blocks; block = end_block)
+    {
+        // a chunk is consecutive blocks of one segment, at least one block and otherwise up to PIPELINE_CHUNK_BYTES
+        k = pipeline->first_block + block;
+        segment = index->segment[k];
+        offset = index->file_offset[k];
+        for (end_block = block + 1; end_block < pipeline->num_blocks; end_block++)
+        {
+            if (index->segment[pipeline->first_block + end_block] != segment)
+                break;
+            if (block_index_block_end_offset(index, pipeline->channel, pipeline->first_block + end_block) - offset > PIPELINE_CHUNK_BYTES)
+                break;
+        }
+        bytes = (ui8) (block_index_block_end_offset(index, pipeline->channel, pipeline->first_block + end_block - 1) - offset);
+        
+        advise_segment_data(pipeline->channel, segment, offset, bytes);
+        
+        // wait for the next slot to be free
+        slot = &pipeline->slots[n_slot];
+        reader_mutex_lock(&pipeline->mutex);
+        while ((slot->state != PIPELINE_SLOT_EMPTY) && !pipeline->stop)
+            reader_cond_wait(&pipeline->changed, &pipeline->mutex);
+        stop = pipeline->stop;
+        reader_mutex_unlock(&pipeline->mutex);
+        if (stop)
+            break;
+        
+        if (slot->capacity < bytes)
+        {
+            free (slot->data);
+            slot->data = (ui1 *) malloc((size_t) bytes);
+            slot->capacity = (slot->data == NULL) ? 0 : bytes;
+        }
+        ok = (slot->data != NULL) && read_segment_data(pipeline->channel, segment, offset, bytes, slot->data);
+        
+        reader_mutex_lock(&pipeline->mutex);
+        slot->bytes = bytes;
+        slot->first_block = block;
+        slot->end_block = end_block;
+        slot->state = ok ? PIPELINE_SLOT_FULL : PIPELINE_SLOT_FAILED;
+        reader_cond_broadcast(&pipeline->changed);
+        reader_mutex_unlock(&pipeline->mutex);
+        if (!ok)
+            break;
+        
+        n_slot = (n_slot + 1) % PIPELINE_SLOTS;
+    }
+    
+    return READER_THREAD_RETURN_VALUE;
+}
+
+// Reads num_blocks blocks starting at first_block (channel block number) into decomp_data through a read pipeline.
+// Blocks are placed exactly as read_mef_ts_data() places them.  Returns 1 on success, 0 on error.
+static si4 read_blocks_pipelined(CHANNEL *channel, CHANNEL_BLOCK_INDEX *index, si8 first_block, si8 num_blocks, si4 times_specified,
+                                 si8 start_time, si8 end_time, si8 start_samp, si4 *decomp_data, si4 num_samps, si4 n_threads)
+{
+    READ_PIPELINE pipeline;
+    READER_THREAD reader;
+    PIPELINE_SLOT *slot;
+    DECODE_BLOCK_JOB *jobs;
+    RED_PROCESSING_STRUCT *rps;
+    VERIFIED_BLOCKS verified;
+    RED_BLOCK_HEADER *block_header;
+    si4 *temp_data_buf;
+    si8 i, n_jobs, jobs_capacity, failed_job, offset, sample_counter, block_start_time;
+    ui1 *cdp;
+    si4 n_slot, ok, done, state;
+    ui4 max_samps;
+    sf8 fs;
+    
+    max_samps = channel->metadata.time_series_section_2->maximum_block_samples;
+    fs = channel->metadata.time_series_section_2->sampling_frequency;
+    verified.channel = NULL;
+    
+    memset(&pipeline, 0, sizeof(READ_PIPELINE));
+    pipeline.channel = channel;
+    pipeline.index = index;
+    pipeline.first_block = first_block;
+    pipeline.num_blocks = num_blocks;
+    
+    rps = allocate_channel_decode_rps(channel, max_samps);
+    temp_data_buf = (si4 *) malloc(sizeof(si4) * (size_t) (max_samps + 1));
+    jobs_capacity = 64;
+    jobs = (DECODE_BLOCK_JOB *) malloc(sizeof(DECODE_BLOCK_JOB) * (size_t) jobs_capacity);
+    if ((rps == NULL) || (temp_data_buf == NULL) || (jobs == NULL))
+    {
+        printf("Error allocating memory, exiting...");
+        free (jobs);
+        free (temp_data_buf);
+        free_decode_rps(rps);
+        return 0;
+    }
+    
+    reader_mutex_init(&pipeline.mutex);
+    reader_cond_init(&pipeline.changed);
+    if (!reader_thread_create(&reader, pipeline_reader, &pipeline))
+    {
+        printf("Error starting read thread, exiting...");
+        reader_cond_destroy(&pipeline.changed);
+        reader_mutex_destroy(&pipeline.mutex);
+        free (jobs);
+        free (temp_data_buf);
+        free_decode_rps(rps);
+        return 0;
+    }
+    
+    ok = 1;
+    done = 0;
+    sample_counter = 0;
+    n_slot = 0;
+    while (ok && !done)
+    {
+        slot = &pipeline.slots[n_slot];
+        reader_mutex_lock(&pipeline.mutex);
+        while (slot->state == PIPELINE_SLOT_EMPTY)
+            reader_cond_wait(&pipeline.changed, &pipeline.mutex);
+        state = slot->state;
+        reader_mutex_unlock(&pipeline.mutex);
+        if (state == PIPELINE_SLOT_FAILED)
+        {
+            printf("Error reading file, exiting...");
+            ok = 0;
+            break;
+        }
+        
+        // middle blocks of the chunk are collected as jobs and decoded straight into the output before the slot is
+        // given back; the first and last blocks are decoded to a temporary buffer and clipped to the output
+        n_jobs = 0;
+        for (i = slot->first_block; (i < slot->end_block) && ok && !done; i++)
+        {
+            cdp = slot->data + (index->file_offset[first_block + i] - index->file_offset[first_block + slot->first_block]);
+            block_header = (RED_BLOCK_HEADER *) cdp;
+            
+            if (i == 0)
+            {
+                if (!channel_block_crc(channel, first_block + i, cdp, max_samps, slot->data, slot->bytes, &verified, NULL))
+                {
+                    printf("RED block %ld has 0 bytes, or CRC failed, data likely corrupt...", (long) (first_block + i));
+                    ok = 0;
+                    break;
+                }
+                decode_block(rps, cdp, temp_data_buf, NULL);
+                if (times_specified)
+                    offset = output_offset_for_time(rps->block_header->start_time, start_time, fs);
+                else
+                    offset = index->start_sample[first_block] - start_samp;
+                copy_block_clipped(decomp_data, num_samps, offset, temp_data_buf, rps->block_header->number_of_samples);
+                if (offset < num_samps)
+                    sample_counter = (offset + rps->block_header->number_of_samples < num_samps) ? offset + rps->block_header->number_of_samples : num_samps;
+                else
+                    sample_counter = offset;
+                if (num_blocks == 1)
+                    done = 1;
+                continue;
+            }
+            
+            if (i < num_blocks - 1)
+            {
+                if (!check_block_bounds(cdp, max_samps, slot->data, slot->bytes) || (block_header->block_bytes == 0))
+                {
+                    printf("RED block %ld has 0 bytes, or CRC failed, data likely corrupt...", (long) (first_block + i));
+                    ok = 0;
+                    break;
+                }
+                
+                // when reading by time, the first middle block that doesn't fit the range is used as the last block
+                offset = sample_counter;
+                if (times_specified)
+                {
+                    block_start_time = block_header->start_time;
+                    remove_recording_time_offset( &block_start_time );
+                    if ((block_start_time >= start_time) &&
+                        (block_start_time + ((block_header->number_of_samples / fs) * 1e6) < end_time))
+                        offset = (si8) ((((block_start_time - start_time) / 1000000.0) * fs) + 0.5);
+                    else
+                        offset = -1;
+                }
+                if (offset >= 0)
+                {
+                    if (n_jobs == jobs_capacity)
+                    {
+                        if (!grow_array((void **) &jobs, sizeof(DECODE_BLOCK_JOB) * (size_t) (jobs_capacity * 2)))
+                        {
+                            printf("Error allocating memory, exiting...");
+                            ok = 0;
+                            break;
+                        }
+                        jobs_capacity *= 2;
+                    }
+                    jobs[n_jobs].block_ptr = cdp;
+                    jobs[n_jobs].bytes_available = slot->bytes - (ui8) (cdp - slot->data);
+                    jobs[n_jobs].output_ptr = decomp_data + offset;
+                    jobs[n_jobs].number_of_samples = block_header->number_of_samples;
+                    jobs[n_jobs].channel = channel;
+                    jobs[n_jobs].block = first_block + i;
+                    n_jobs++;
+                    sample_counter += block_header->number_of_samples;
+                    continue;
+                }
+            }
+            
+            // last block; the middle blocks before it are decoded first, as they are in a one-shot read
+            failed_job = decode_block_jobs(jobs, n_jobs, max_samps, 0, n_threads);
+            n_jobs = 0;
+            if (failed_job >= 0)
+            {
+                printf("RED block has 0 bytes, or CRC failed, data likely corrupt...");
+                ok = 0;
+                break;
+            }
+            if (!channel_block_crc(channel, first_block + i, cdp, max_samps, slot->data, slot->bytes, &verified, NULL))
+            {
+                printf("RED block %ld has 0 bytes, or CRC failed, data likely corrupt...", (long) (first_block + i));
+                ok = 0;
+                break;
+            }
+            decode_block(rps, cdp, temp_data_buf, NULL);
+            if (times_specified)
+                offset = output_offset_for_time(rps->block_header->start_time, start_time, fs);
+            else
+                offset = sample_counter;
+            copy_block_clipped(decomp_data, num_samps, offset, temp_data_buf, rps->block_header->number_of_samples);
+            done = 1;
+        }
+        
+        if (ok && (n_jobs > 0) && (decode_block_jobs(jobs, n_jobs, max_samps, 0, n_threads) >= 0))
+        {
+            printf("RED block has 0 bytes, or CRC failed, data likely corrupt...");
+            ok = 0;
+        }
+        
+        reader_mutex_lock(&pipeline.mutex);
+        slot->state = PIPELINE_SLOT_EMPTY;
+        reader_cond_broadcast(&pipeline.changed);
+        reader_mutex_unlock(&pipeline.mutex);
+        n_slot = (n_slot + 1) % PIPELINE_SLOTS;
+    }
+    
+    // the reader may still be ahead of a read that ended early
+    reader_mutex_lock(&pipeline.mutex);
+    pipeline.stop = 1;
+    reader_cond_broadcast(&pipeline.changed);
+    reader_mutex_unlock(&pipeline.mutex);
+    reader_thread_join(reader);
+    
+    for (n_slot = 0; n_slot < PIPELINE_SLOTS; n_slot++)
+        free (pipeline.slots[n_slot].data);
+    reader_cond_destroy(&pipeline.changed);
+    reader_mutex_destroy(&pipeline.mutex);
+    free (jobs);
+    free (temp_data_buf);
+    free_decode_rps(rps);
+    
+    return ok;
+}
+
+/**************************  Streaming cursor  ****************************/
+
+// Cursors decode a range one block at a time, so memory use is fixed: a window of compressed blocks
+// (CURSOR_READ_WINDOW_BYTES, or one block if larger) and one decoded block.
+#define CURSOR_READ_WINDOW_BYTES    (1024 * 1024)
+
+struct READ_MEF_TS_CURSOR {
+    CHANNEL     *channel;
+    si4         read_channel;
+    CHANNEL_BLOCK_INDEX *index;
+    si4         times_specified;
+    si8         start_time;
+    si8         end_time;
+    si8         start_samp;
+    si8         end_samp;
+    si8         total_samps;            // number of samples the range produces
+    si8         position;               // next sample of the range to return
+    sf8         sampling_frequency;
+    ui4         max_samps;
+    si4         io_mode;
+    si8         next_block;             // next block to decode
+    si8         end_block;              // one past the last block that can contribute to the range
+    sf8         units_conversion_factor;
+    si4         *block_samples;         // last decoded block, not yet fully returned
+    si8         block_offset;           // position in the range of the decoded block's first sample
+    si8         block_count;            // number of the decoded block's samples to use
+    si4         block_pending;
+    ui1         *window;                // compressed blocks read from one segment
+    ui8         window_size;
+    si4         window_segment;
+    si8         window_file_offset;
+    ui8         window_bytes;
+    ui1         *block_copy;            // mapped blocks are copied here for decoding
+    RED_PROCESSING_STRUCT   *rps;
+    VERIFIED_BLOCKS         verified;       // channel NULL until the first block is checked
+};
+
+// position in the output of a block starting at block_time, rounded the same way as read_mef_ts_data()
+static si8 output_offset_for_time(si8 block_time, si8 start_time, sf8 sampling_frequency)
+{
+    if ((block_time - start_time) >= 0)
+        return (si8) ((((block_time - start_time) / 1000000.0) * sampling_frequency) + 0.5);
+    else
+        return (si8) ((((block_time - start_time) / 1000000.0) * sampling_frequency) - 0.5);
+}
+
+// position in the range of the first sample of a block
+static si8 cursor_block_offset(READ_MEF_TS_CURSOR *cursor, si8 block)
+{
+    si8 block_start_time;
+    
+    if (cursor->times_specified)
+    {
+        block_start_time = cursor->index->start_time[block];
+        remove_recording_time_offset( &block_start_time);
+        return output_offset_for_time(block_start_time, cursor->start_time, cursor->sampling_frequency);
+    }
+    
+    return cursor->index->start_sample[block] - cursor->start_samp;
+}
+
+static READ_MEF_TS_CURSOR *open_mef_ts_cursor(si1 *channel_path, si1 *password, si8 start_value, si8 end_value, si4 times_specified, CHANNEL *channel_passed_in)
+{
+    READ_MEF_TS_CURSOR *cursor;
+    CHANNEL *channel;
+    si4 read_channel;
+    si8 first_block;
+    
+    if (channel_passed_in == NULL)
+    {
+        read_channel = 1;
+        
+        // set up mef 3 library
+        (void) initialize_meflib();
+        MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
+        
+        channel = read_channel_with_cached_password(channel_path, password);
+        
+        if (channel == NULL)
+            return NULL;
+        if (channel->channel_type != TIME_SERIES_CHANNEL_TYPE) {
+            printf("Not a time series channel, exiting...");
+            free_read_channel(channel);
+            return NULL;
+        }
+    }
+    else
+    {
+        read_channel = 0;
+        channel = channel_passed_in;
+    }
+    
+    cursor = (READ_MEF_TS_CURSOR *) calloc((size_t) 1, sizeof(READ_MEF_TS_CURSOR));
+    cursor->channel = channel;
+    cursor->read_channel = read_channel;
+    cursor->times_specified = times_specified;
+    cursor->sampling_frequency = channel->metadata.time_series_section_2->sampling_frequency;
+    cursor->max_samps = channel->metadata.time_series_section_2->maximum_block_samples;
+    cursor->units_conversion_factor = channel->metadata.time_series_section_2->units_conversion_factor;
+    cursor->io_mode = read_mef_ts_data_io_mode;
+    cursor->index = get_channel_block_index(channel);
+    if (cursor->index == NULL)
+    {
+        printf("Could not index channel, exiting...");
+        close_mef_ts_cursor(cursor);
+        return NULL;
+    }
+    
+    // same range checks as read_mef_ts_data()
+    if (times_specified)
+    {
+        cursor->start_time = start_value;
+        cursor->end_time = end_value;
+        if (cursor->start_time >= cursor->end_time)
+        {
+            printf("Start time later than end time, exiting...");
+            close_mef_ts_cursor(cursor);
+            return NULL;
+        }
+        if (((cursor->start_time < channel->earliest_start_time) & (cursor->end_time < channel->earliest_start_time)) |
+            ((cursor->start_time > channel->latest_end_time) & (cursor->end_time > channel->latest_end_time))){
+            printf("Start and stop times are out of file.");
+            close_mef_ts_cursor(cursor);
+            return NULL;
+        }
+        cursor->total_samps = (si8) (((cursor->end_time - cursor->start_time) / 1000000.0) * cursor->sampling_frequency);
+        
+        // start with the last block starting at or before the start time
+        first_block = block_index_first_after_time(cursor->index, 0, cursor->index->number_of_blocks, cursor->start_time, MEF_TRUE) - 1;
+        cursor->end_block = block_index_first_after_time(cursor->index, 0, cursor->index->number_of_blocks, cursor->end_time, MEF_TRUE);
+    }
+    else
+    {
+        cursor->start_samp = start_value;
+        cursor->end_samp = end_value;
+        if (cursor->start_samp >= cursor->end_samp)
+        {
+            printf("Start sample larger than end sample, exiting...");
+            close_mef_ts_cursor(cursor);
+            return NULL;
+        }
+        if (((cursor->start_samp < 0) & (cursor->end_samp < 0)) |
+            ((cursor->start_samp > channel->metadata.time_series_section_2->number_of_samples) & (cursor->end_samp > channel->metadata.time_series_section_2->number_of_samples))){
+            printf("Start and stop samples are out of file. Returning None");
+            close_mef_ts_cursor(cursor);
+            return NULL;
+        }
+        if (cursor->end_samp > channel->metadata.time_series_section_2->number_of_samples)
+            cursor->end_samp = channel->metadata.time_series_section_2->number_of_samples;
+        if (cursor->start_samp < 0)
+            cursor->start_samp = 0;
+        cursor->total_samps = cursor->end_samp - cursor->start_samp;
+        
+        first_block = block_index_first_after_sample(cursor->index, cursor->start_samp) - 1;
+        cursor->end_block = block_index_first_after_sample(cursor->index, cursor->end_samp - 1);
+    }
+    if (first_block < 0)
+        first_block = 0;
+    cursor->next_block = first_block;
+    
+    cursor->window_size = RED_MAX_COMPRESSED_BYTES(cursor->max_samps, 1);
+    if (cursor->window_size < CURSOR_READ_WINDOW_BYTES)
+        cursor->window_size = CURSOR_READ_WINDOW_BYTES;
+    if (cursor->io_mode == READ_IO_MMAP)
+        cursor->block_copy = (ui1 *) malloc((size_t) RED_MAX_COMPRESSED_BYTES(cursor->max_samps, 1));
+    else
+        cursor->window = (ui1 *) malloc((size_t) cursor->window_size);
+    cursor->window_segment = -1;
+    cursor->block_samples = (si4 *) malloc(sizeof(si4) * (size_t) cursor->max_samps);
+    cursor->rps = allocate_channel_decode_rps(cursor->channel, cursor->max_samps);
+    
+    return cursor;
+}
+
+// opens a cursor over a time range; gaps in the data are returned as NaN, as with read_mef_ts_data_by_time()
+READ_MEF_TS_CURSOR *open_mef_ts_cursor_by_time(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, CHANNEL *channel_passed_in)
+{
+    return open_mef_ts_cursor(channel_path, password, start_time, end_time, 1, channel_passed_in);
+}
+
+// opens a cursor over a sample range, as with read_mef_ts_data_by_samp()
+READ_MEF_TS_CURSOR *open_mef_ts_cursor_by_samp(si1 *channel_path, si1 *password, si8 start_samp, si8 end_samp, CHANNEL *channel_passed_in)
+{
+    return open_mef_ts_cursor(channel_path, password, start_samp, end_samp, 0, channel_passed_in);
+}
+
+// Returns a pointer to the compressed block, reading the window forward when the block isn't in it already.  Sets
+// bytes_available to the number of bytes from the block to the end of the window (or mapped file).
+static ui1 *cursor_block_data(READ_MEF_TS_CURSOR *cursor, si8 block, ui8 *bytes_available)
+{
+    CHANNEL_BLOCK_INDEX *index;
+    si4 segment;
+    si8 offset, last, window_end;
+    ui1 *map;
+    ui8 map_bytes;
+    
+    index = cursor->index;
+    segment = index->segment[block];
+    offset = index->file_offset[block];
+    
+    if (cursor->io_mode == READ_IO_MMAP)
+    {
+        map = get_segment_map(cursor->channel, segment, &map_bytes);
+        if ((map == NULL) || (offset < 0) || ((ui8) offset >= map_bytes))
+            return NULL;
+        *bytes_available = map_bytes - (ui8) offset;
+        return map + offset;
+    }
+    
+    // fill the window with as many whole blocks of this segment as fit
+    if ((segment != cursor->window_segment) || (offset < cursor->window_file_offset) ||
+        (block_index_block_end_offset(index, cursor->channel, block) > cursor->window_file_offset + (si8) cursor->window_bytes))
+    {
+        last = block;
+        window_end = block_index_block_end_offset(index, cursor->channel, block);
+        while ((last + 1 < cursor->end_block) && (index->segment[last + 1] == segment) &&
+               (block_index_block_end_offset(index, cursor->channel, last + 1) - offset <= (si8) cursor->window_size))
+        {
+            last++;
+            window_end = block_index_block_end_offset(index, cursor->channel, last);
+        }
+        if ((window_end - offset > (si8) cursor->window_size) ||
+            !read_segment_data(cursor->channel, segment, offset, (ui8) (window_end - offset), cursor->window))
+            return NULL;
+        cursor->window_segment = segment;
+        cursor->window_file_offset = offset;
+        cursor->window_bytes = (ui8) (window_end - offset);
+    }
+    
+    *bytes_available = cursor->window_bytes - (ui8) (offset - cursor->window_file_offset);
+    return cursor->window + (offset - cursor->window_file_offset);
+}
+
+// decodes the next block into the cursor's block buffer
+static si4 cursor_decode_next_block(READ_MEF_TS_CURSOR *cursor)
+{
+    ui1 *block_ptr;
+    ui8 bytes_available;
+    si8 block, next_offset;
+    
+    block = cursor->next_block;
+    block_ptr = cursor_block_data(cursor, block, &bytes_available);
+    if ((block_ptr == NULL) || (((RED_BLOCK_HEADER *) block_ptr)->block_bytes == 0) ||
+        !channel_block_crc(cursor->channel, block, block_ptr, cursor->max_samps, block_ptr, bytes_available, &cursor->verified, NULL))
+    {
+        printf("RED block %ld has 0 bytes, or CRC failed, data likely corrupt...", (long) block);
+        return 0;
+    }
+    decode_block(cursor->rps, block_ptr, cursor->block_samples, cursor->block_copy);
+    
+    cursor->block_offset = cursor_block_offset(cursor, block);
+    cursor->block_count = cursor->rps->block_header->number_of_samples;
+    
+    // where blocks overlap (time stamp jitter), the later block's samples win, as they do in read_mef_ts_data()
+    if (block + 1 < cursor->end_block)
+    {
+        next_offset = cursor_block_offset(cursor, block + 1);
+        if ((next_offset >= cursor->block_offset) && (next_offset < cursor->block_offset + cursor->block_count))
+            cursor->block_count = next_offset - cursor->block_offset;
+    }
+    
+    cursor->block_pending = 1;
+    cursor->next_block++;
+    
+    return 1;
+}
+
+// Returns the next (up to) max_samples samples of the range in decomp_data, and the time of the first of them in
+// chunk_start_time (may be NULL).  Returns the number of samples, 0 at the end of the range, or -1 on error.
+// Fills the next chunk of the range, of up to max_samples samples, converting samples as they are placed when output is
+// not READ_OUTPUT_SI4.  See read_mef_ts_cursor_next().
+static si4 cursor_next(READ_MEF_TS_CURSOR *cursor, void *output, si4 output_format, si4 max_samples, si8 *chunk_start_time)
+{
+    si8 chunk_start, chunk_end, first, last;
+    si4 n_samps;
+    
+    if ((cursor == NULL) || (output == NULL) || (max_samples <= 0))
+        return -1;
+    
+    if (cursor->position >= cursor->total_samps)
+        return 0;
+    
+    n_samps = max_samples;
+    if (cursor->total_samps - cursor->position < n_samps)
+        n_samps = (si4) (cursor->total_samps - cursor->position);
+    chunk_start = cursor->position;
+    chunk_end = chunk_start + n_samps;
+    
+    if (chunk_start_time != NULL)
+    {
+        if (cursor->times_specified)
+            *chunk_start_time = cursor->start_time + (si8) (((chunk_start / cursor->sampling_frequency) * 1e6) + 0.5);
+        else
+            *chunk_start_time = uutc_for_sample_c(cursor->start_samp + chunk_start, cursor->channel);
+    }
+    
+    // fill with NAN's if specifying by time, so gaps are NaN
+    if (cursor->times_specified)
+        fill_output_nan(output, output_format, 0, (si8) n_samps);
+    
+    while (1)
+    {
+        if (cursor->block_pending)
+        {
+            // copy the part of the decoded block that falls in this chunk
+            first = (cursor->block_offset > chunk_start) ? cursor->block_offset : chunk_start;
+            last = cursor->block_offset + cursor->block_count;
+            if (last > chunk_end)
+                last = chunk_end;
+            if (last > first)
+                place_output_samples(output, output_format, first - chunk_start, cursor->block_samples + (first - cursor->block_offset),
+                                     last - first, cursor->units_conversion_factor);
+            
+            // rest of the block belongs to the next chunk
+            if (cursor->block_offset + cursor->block_count > chunk_end)
+                break;
+            cursor->block_pending = 0;
+        }
+        
+        if (cursor->next_block >= cursor->end_block)
+            break;
+        if (cursor_block_offset(cursor, cursor->next_block) >= chunk_end)
+            break;
+        if (!cursor_decode_next_block(cursor))
+            return -1;
+    }
+    
+    cursor->position = chunk_end;
+    
+    return n_samps;
+}
+
+si4 read_mef_ts_cursor_next(READ_MEF_TS_CURSOR *cursor, si4 *decomp_data, si4 max_samples, si8 *chunk_start_time)
+{
+    return cursor_next(cursor, decomp_data, READ_OUTPUT_SI4, max_samples, chunk_start_time);
+}
+
+// float variants: samples are multiplied by the channel's units conversion factor, RED_NAN becomes NaN
+si4 read_mef_ts_cursor_next_sf4(READ_MEF_TS_CURSOR *cursor, sf4 *data, si4 max_samples, si8 *chunk_start_time)
+{
+    return cursor_next(cursor, data, READ_OUTPUT_SF4, max_samples, chunk_start_time);
+}
+
+si4 read_mef_ts_cursor_next_sf8(READ_MEF_TS_CURSOR *cursor, sf8 *data, si4 max_samples, si8 *chunk_start_time)
+{
+    return cursor_next(cursor, data, READ_OUTPUT_SF8, max_samples, chunk_start_time);
+}
+
+void close_mef_ts_cursor(READ_MEF_TS_CURSOR *cursor)
+{
+    si4 i;
+    
+    if (cursor == NULL)
+        return;
+    
+    free (cursor->window);
+    free (cursor->block_copy);
+    free (cursor->block_samples);
+    free_decode_rps(cursor->rps);
+    
+    if (cursor->read_channel == 1)
+    {
+        for (i = 0; i < cursor->channel->number_of_segments; i++)
+        {
+            if (cursor->channel->segments[i].time_series_data_fps->fp != NULL)
+            {
+                fclose(cursor->channel->segments[i].time_series_data_fps->fp);
+                cursor->channel->segments[i].time_series_data_fps->fp = NULL;
+            }
+        }
+        free_read_channel(cursor->channel);
+    }
+    
+    free (cursor);
+}
+
+// One-shot float reads: a read with the output format set, so with the settings any read gets (threads, io mode,
+// block cache).  The output buffer is the caller's, so it isn't freed on error.
+static si4 read_mef_ts_data_float(si1 *channel_path, si1 *password, si8 start_value, si8 end_value, si4 times_specified,
+                                  void *output, si4 output_format, CHANNEL *channel_passed_in)
+{
+    READ_MEF_TS_DATA_OPTIONS options;
+    
+    initialize_read_mef_ts_data_options(&options);
+    options.free_decomp_data_on_error = MEF_FALSE;
+    options.output_format = output_format;
+    
+    return read_mef_ts_data_with_options(channel_path, password, start_value, end_value, times_specified, (si4 *) output, channel_passed_in, -1, &options);
+}
+
+si4 read_mef_ts_data_by_time_sf4(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, sf4 *data, CHANNEL *channel_passed_in)
+{
+    return read_mef_ts_data_float(channel_path, password, start_time, end_time, MEF_TRUE, data, READ_OUTPUT_SF4, channel_passed_in);
+}
+
+si4 read_mef_ts_data_by_samp_sf4(si1 *channel_path, si1 *password, si8 start_samp, si8 end_samp, sf4 *data, CHANNEL *channel_passed_in)
+{
+    return read_mef_ts_data_float(channel_path, password, start_samp, end_samp, MEF_FALSE, data, READ_OUTPUT_SF4, channel_passed_in);
+}
+
+si4 read_mef_ts_data_by_time_sf8(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, sf8 *data, CHANNEL *channel_passed_in)
+{
+    return read_mef_ts_data_float(channel_path, password, start_time, end_time, MEF_TRUE, data, READ_OUTPUT_SF8, channel_passed_in);
+}
+
+si4 read_mef_ts_data_by_samp_sf8(si1 *channel_path, si1 *password, si8 start_samp, si8 end_samp, sf8 *data, CHANNEL *channel_passed_in)
+{
+    return read_mef_ts_data_float(channel_path, password, start_samp, end_samp, MEF_FALSE, data, READ_OUTPUT_SF8, channel_passed_in);
+}
+
+/**************************  Resampled reads  ****************************/
+
+// Reads at a lower output rate go through a polyphase FIR resampler: the input rate is converted by an upsampling factor
+// L and downsampling factor M (output rate = sampling frequency * L / M), with a Kaiser windowed sinc low pass filter at
+// the upsampled rate.  Input comes from a cursor in chunks, so the full rate data is never held in memory; filter state
+// carries across blocks, chunks and segments.  An output is NaN if any input under the filter is (gaps, and the edges of
+// the recording).
+
+#define RESAMPLE_MAX_L              1024
+#define RESAMPLE_STOPBAND_DB        80.0
+#define RESAMPLE_PASSBAND_EDGE      0.40    // fraction of the output rate: pass band up to here, stop band from 0.5
+#define RESAMPLE_CHUNK_SAMPLES      65536
+
+typedef struct {
+    si4     L;
+    si4     M;
+    si4     T;                  // taps per phase
+    sf8     *phases;            // L x T taps, each phase reversed, so an output is a dot product with the history
+    sf8     *history;           // last T inputs, stored twice so the last T are always contiguous
+    ui1     *history_nan;
+    si4     write;
+    si4     nan_count;          // NaN inputs in the history
+    si8     inputs;             // inputs pushed so far
+    si8     next_n;             // input index * L (plus the filter delay) of the next output
+    sf8     *output;
+    si8     outputs;
+    si8     total_outputs;
+} RESAMPLER;
+
+// zeroth order modified Bessel function of the first kind, for the Kaiser window
+static sf8 bessel_i0(sf8 x)
+{
+    sf8 sum, term;
+    si4 k;
+    
+    sum = term = 1.0;
+    for (k = 1; k < 64; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-16)
+            break;
+    }
+    
+    return sum;
+}
+
+// finds L / M closest to output_rate / input_rate, with L at most RESAMPLE_MAX_L
+static void resample_ratio(sf8 input_rate, sf8 output_rate, si4 *L, si4 *M)
+{
+    sf8 ratio, error, best_error;
+    si4 l, m;
+    
+    ratio = output_rate / input_rate;
+    best_error = -1.0;
+    *L = *M = 1;
+    for (l = 1; l <= RESAMPLE_MAX_L; l++)
+    {
+        m = (si4) ((l / ratio) + 0.5);
+        if (m < l)
+            m = l;
+        error = fabs(((sf8) l / m) - ratio);
+        if ((best_error < 0.0) || (error < best_error))
+        {
+            best_error = error;
+            *L = l;
+            *M = m;
+        }
+        if (error <= ratio * 1e-12)
+            break;
+    }
+}
+
+static si4 initialize_resampler(RESAMPLER *resampler, sf8 input_rate, sf8 output_rate, sf8 *output, si8 total_outputs)
+{
+    sf8 *taps, fc, transition, beta, t, half, sum;
+    si4 L, M, T, N, n_eff, m, phase, j;
+    
+    memset(resampler, 0, sizeof(RESAMPLER));
+    resample_ratio(input_rate, output_rate, &L, &M);
+    
+    if (L == M)
+    {
+        // same rate, no filtering
+        T = 1;
+        N = n_eff = 1;
+        taps = (sf8 *) calloc((size_t) 1, sizeof(sf8));
+        taps[0] = 1.0;
+    }
+    else
+    {
+        // Kaiser estimate of the filter length for the stop band attenuation and transition width
+        fc = (0.5 * (RESAMPLE_PASSBAND_EDGE + 0.5) * output_rate) / (input_rate * L);
+        transition = ((0.5 - RESAMPLE_PASSBAND_EDGE) * output_rate) / (input_rate * L);
+        beta = 0.1102 * (RESAMPLE_STOPBAND_DB - 8.7);
+        N = (si4) ceil((RESAMPLE_STOPBAND_DB - 8.0) / (2.285 * 2.0 * M_PI * transition));
+        T = (N + L - 1) / L;
+        N = L * T;
+        n_eff = (N % 2) ? N : N - 1;    // odd length, so the delay is a whole number of samples
+        
+        taps = (sf8 *) calloc((size_t) N, sizeof(sf8));
+        half = (n_eff - 1) / 2.0;
+        sum = 0.0;
+        for (m = 0; m < n_eff; m++)
+        {
+            t = m - half;
+            taps[m] = (t == 0.0) ? (2.0 * fc) : (sin(2.0 * M_PI * fc * t) / (M_PI * t));
+            if (half > 0.0)
+                taps[m] *= bessel_i0(beta * sqrt(1.0 - ((t / half) * (t / half)))) / bessel_i0(beta);
+            sum += taps[m];
+        }
+        for (m = 0; m < n_eff; m++)
+            taps[m] *= L / sum;         // unit gain at DC, after zero stuffing
+    }
+    
+    resampler->L = L;
+    resampler->M = M;
+    resampler->T = T;
+    resampler->phases = (sf8 *) malloc(sizeof(sf8) * (size_t) (L * T));
+    for (phase = 0; phase < L; phase++)
+        for (j = 0; j < T; j++)
+            resampler->phases[(phase * T) + (T - 1 - j)] = taps[phase + (j * L)];
+    free (taps);
+    
+    // the history starts out as NaN, so outputs before T inputs have been seen are NaN
+    resampler->history = (sf8 *) calloc((size_t) (2 * T), sizeof(sf8));
+    resampler->history_nan = (ui1 *) malloc((size_t) T);
+    memset(resampler->history_nan, 1, (size_t) T);
+    resampler->nan_count = T;
+    
+    // output k is centered on input k * M / L, delayed by half the filter
+    resampler->next_n = (n_eff - 1) / 2;
+    resampler->output = output;
+    resampler->total_outputs = total_outputs;
+    
+    return (resampler->phases != NULL) && (resampler->history != NULL);
+}
+
+static void free_resampler(RESAMPLER *resampler)
+{
+    free (resampler->phases);
+    free (resampler->history);
+    free (resampler->history_nan);
+}
+
+// pushes input samples, writing every output whose last input has arrived
+static void resampler_push(RESAMPLER *resampler, sf8 *input, si8 n)
+{
+    sf8 *window, *taps, sum;
+    si8 i;
+    si4 T, w, j, is_nan;
+    
+    T = resampler->T;
+    for (i = 0; (i < n) && (resampler->outputs < resampler->total_outputs); i++)
+    {
+        w = resampler->write;
+        is_nan = isnan(input[i]) ? 1 : 0;
+        resampler->nan_count += is_nan - resampler->history_nan[w];
+        resampler->history_nan[w] = (ui1) is_nan;
+        resampler->history[w] = resampler->history[w + T] = is_nan ? 0.0 : input[i];
+        resampler->write = (w + 1 == T) ? 0 : w + 1;
+        window = resampler->history + w + 1;
+        
+        while ((resampler->outputs < resampler->total_outputs) && (resampler->next_n / resampler->L == resampler->inputs))
+        {
+            if (resampler->nan_count > 0)
+                sum = NAN;
+            else
+            {
+                taps = resampler->phases + ((resampler->next_n % resampler->L) * T);
+                sum = 0.0;
+                for (j = 0; j < T; j++)
+                    sum += taps[j] * window[j];
+            }
+            resampler->output[resampler->outputs++] = sum;
+            resampler->next_n += resampler->M;
+        }
+        resampler->inputs++;
+    }
+}
+
+// Reads [start_time, end_time) resampled to output_rate (at most the channel's sampling frequency), as sf8 in the
+// channel's units.  Returns the number of output samples, ((end_time - start_time) / 1e6) * output_rate, or 0 on error.
+si4 read_mef_ts_data_resampled_by_time(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, sf8 output_rate, sf8 *data, CHANNEL *channel_passed_in)
+{
+    READ_MEF_TS_CURSOR *cursor;
+    RESAMPLER resampler;
+    CHANNEL *channel;
+    sf8 *chunk, fs;
+    si8 total_outputs, pad_time, i;
+    si4 n, read_channel;
+    
+    if ((start_time >= end_time) || (output_rate <= 0.0))
+    {
+        printf("Invalid resampled read, exiting...");
+        return 0;
+    }
+    
+    // the channel is read here rather than by the cursor, as its sampling frequency sets the padding
+    if (channel_passed_in == NULL)
+    {
+        read_channel = 1;
+        
+        // set up mef 3 library
+        (void) initialize_meflib();
+        MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
+        
+        channel = read_channel_with_cached_password(channel_path, password);
+        
+        if (channel == NULL)
+            return 0;
+        if (channel->channel_type != TIME_SERIES_CHANNEL_TYPE) {
+            printf("Not a time series channel, exiting...");
+            free_read_channel(channel);
+            return 0;
+        }
+    }
+    else
+    {
+        read_channel = 0;
+        channel = channel_passed_in;
+    }
+    
+    fs = channel->metadata.time_series_section_2->sampling_frequency;
+    if (output_rate > fs)
+    {
+        printf("Output rate higher than sampling frequency, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        return 0;
+    }
+    
+    total_outputs = (si8) (((end_time - start_time) / 1000000.0) * output_rate);
+    if (!initialize_resampler(&resampler, fs, output_rate, data, total_outputs))
+    {
+        free_resampler(&resampler);
+        if (read_channel == 1)
+            free_read_channel(channel);
+        return 0;
+    }
+    
+    // the input is read over a range padded by half the filter length (plus a little) on each side, and output 0 is
+    // centered on the input at start_time
+    pad_time = (si8) ceil((((resampler.T / 2) + 2) / fs) * 1e6);
+    resampler.next_n += (si8) ((((pad_time / 1e6) * fs) * resampler.L) + 0.5);
+    
+    cursor = open_mef_ts_cursor(NULL, NULL, start_time - pad_time, end_time + pad_time, MEF_TRUE, channel);
+    if (cursor == NULL)
+    {
+        free_resampler(&resampler);
+        if (read_channel == 1)
+            free_read_channel(channel);
+        return 0;
+    }
+    
+    chunk = (sf8 *) malloc(sizeof(sf8) * RESAMPLE_CHUNK_SAMPLES);
+    n = 0;
+    while ((resampler.outputs < total_outputs) && ((n = cursor_next(cursor, chunk, READ_OUTPUT_SF8, RESAMPLE_CHUNK_SAMPLES, NULL)) > 0))
+        resampler_push(&resampler, chunk, (si8) n);
+    
+    // outputs the padded range didn't reach
+    for (i = resampler.outputs; i < total_outputs; i++)
+        data[i] = NAN;
+    
+    free (chunk);
+    close_mef_ts_cursor(cursor);
+    free_resampler(&resampler);
+    if (read_channel == 1)
+        free_read_channel(channel);
+    
+    return (n < 0) ? 0 : (si4) total_outputs;
+}
+
+/**************************  Sample conversion  ****************************/
+
+// Samples are converted as (sample * factor), computed in double precision (and rounded to float for sf4 output), with
+// RED_NAN mapped to NaN.  The SSE2 and AVX2 kernels give the same results as the scalar loop.
+
+#if defined(READER_X86) && defined(__GNUC__)
+#define READER_TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#define READER_TARGET_AVX2
+#endif
+
+// nonzero if the processor (and OS) support AVX2, checked once
+static si4 reader_cpu_has_avx2(void)
+{
+    static si4 has_avx2 = -1;
+    si4 has;
+    
+    has = reader_atomic_load(&has_avx2);
+    if (has < 0)
+    {
+#if defined(READER_X86) && defined(__GNUC__)
+        __builtin_cpu_init();
+        has = __builtin_cpu_supports("avx2") ? 1 : 0;
+#elif defined(READER_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        has = 0;
+        if (info[0] >= 7)
+        {
+            __cpuid(info, 1);
+            if ((info[2] & (1 << 27)) && ((_xgetbv(0) & 0x6) == 0x6))  // OSXSAVE, and the OS saves ymm state
+            {
+                __cpuidex(info, 7, 0);
+                has = (info[1] & (1 << 5)) ? 1 : 0;
+            }
+        }
+#else
+        has = 0;
+#endif
+        reader_atomic_store(&has_avx2, has);
+    }
+    
+    return has;
+}
+
+static void convert_samples_sf4_scalar(si4 *samples, sf4 *output, si8 n, sf8 factor)
+{
+    si8 i;
+    
+    for (i = 0; i < n; i++)
+        output[i] = (samples[i] == RED_NAN) ? NAN : (sf4) (samples[i] * factor);
+}
+
+static void convert_samples_sf8_scalar(si4 *samples, sf8 *output, si8 n, sf8 factor)
+{
+    si8 i;
+    
+    for (i = 0; i < n; i++)
+        output[i] = (samples[i] == RED_NAN) ? NAN : samples[i] * factor;
+}
+
+#ifdef READER_X86
+READER_TARGET_AVX2 static void convert_samples_sf4_avx2(si4 *samples, sf4 *output, si8 n, sf8 factor)
+{
+    __m256d scale;
+    __m128i red_nan, x;
+    __m128 y, nan_mask, nan_value;
+    si8 i;
+    
+    scale = _mm256_set1_pd(factor);
+    red_nan = _mm_set1_epi32(RED_NAN);
+    nan_value = _mm_set1_ps(NAN);
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        x = _mm_loadu_si128((__m128i *) (samples + i));
+        y = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_cvtepi32_pd(x), scale));
+        nan_mask = _mm_castsi128_ps(_mm_cmpeq_epi32(x, red_nan));
+        _mm_storeu_ps(output + i, _mm_blendv_ps(y, nan_value, nan_mask));
+    }
+    convert_samples_sf4_scalar(samples + i, output + i, n - i, factor);
+}
+
+READER_TARGET_AVX2 static void convert_samples_sf8_avx2(si4 *samples, sf8 *output, si8 n, sf8 factor)
+{
+    __m256d scale, y, nan_mask, nan_value;
+    __m128i red_nan, x;
+    si8 i;
+    
+    scale = _mm256_set1_pd(factor);
+    red_nan = _mm_set1_epi32(RED_NAN);
+    nan_value = _mm256_set1_pd(NAN);
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        x = _mm_loadu_si128((__m128i *) (samples + i));
+        y = _mm256_mul_pd(_mm256_cvtepi32_pd(x), scale);
+        nan_mask = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmpeq_epi32(x, red_nan)));
+        _mm256_storeu_pd(output + i, _mm256_blendv_pd(y, nan_value, nan_mask));
+    }
+    convert_samples_sf8_scalar(samples + i, output + i, n - i, factor);
+}
+
+static void convert_samples_sf4_sse2(si4 *samples, sf4 *output, si8 n, sf8 factor)
+{
+    __m128d scale;
+    __m128i red_nan, x;
+    __m128 y, nan_mask, nan_value;
+    si8 i;
+    
+    scale = _mm_set1_pd(factor);
+    red_nan = _mm_set1_epi32(RED_NAN);
+    nan_value = _mm_set1_ps(NAN);
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        x = _mm_loadu_si128((__m128i *) (samples + i));
+        y = _mm_movelh_ps(_mm_cvtpd_ps(_mm_mul_pd(_mm_cvtepi32_pd(x), scale)),
+                          _mm_cvtpd_ps(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(x, 8)), scale)));
+        nan_mask = _mm_castsi128_ps(_mm_cmpeq_epi32(x, red_nan));
+        _mm_storeu_ps(output + i, _mm_or_ps(_mm_and_ps(nan_mask, nan_value), _mm_andnot_ps(nan_mask, y)));
+    }
+    convert_samples_sf4_scalar(samples + i, output + i, n - i, factor);
+}
+
+static void convert_samples_sf8_sse2(si4 *samples, sf8 *output, si8 n, sf8 factor)
+{
+    __m128d scale, y, nan_mask, nan_value;
+    __m128i red_nan, x, eq;
+    si8 i;
+    
+    scale = _mm_set1_pd(factor);
+    red_nan = _mm_set1_epi32(RED_NAN);
+    nan_value = _mm_set1_pd(NAN);
+    for (i = 0; i + 2 <= n; i += 2)
+    {
+        x = _mm_loadl_epi64((__m128i *) (samples + i));
+        y = _mm_mul_pd(_mm_cvtepi32_pd(x), scale);
+        eq = _mm_cmpeq_epi32(x, red_nan);
+        nan_mask = _mm_castsi128_pd(_mm_unpacklo_epi32(eq, eq));
+        _mm_storeu_pd(output + i, _mm_or_pd(_mm_and_pd(nan_mask, nan_value), _mm_andnot_pd(nan_mask, y)));
+    }
+    convert_samples_sf8_scalar(samples + i, output + i, n - i, factor);
+}
+#endif
+
+// converts n samples to sf4 microvolts (or whatever the channel's units are), RED_NAN to NaN
+void convert_samples_sf4(si4 *samples, sf4 *output, si8 n, sf8 factor)
+{
+#ifdef READER_X86
+    if (reader_cpu_has_avx2())
+        convert_samples_sf4_avx2(samples, output, n, factor);
+    else
+        convert_samples_sf4_sse2(samples, output, n, factor);
+#else
+    convert_samples_sf4_scalar(samples, output, n, factor);
+#endif
+}
+
+void convert_samples_sf8(si4 *samples, sf8 *output, si8 n, sf8 factor)
+{
+#ifdef READER_X86
+    if (reader_cpu_has_avx2())
+        convert_samples_sf8_avx2(samples, output, n, factor);
+    else
+        convert_samples_sf8_sse2(samples, output, n, factor);
+#else
+    convert_samples_sf8_scalar(samples, output, n, factor);
+#endif
+}
+
+// places n samples at output[position], converting them for float output formats
+static void place_output_samples(void *output, si4 output_format, si8 position, si4 *samples, si8 n, sf8 factor)
+{
+    switch (output_format)
+    {
+        case READ_OUTPUT_SF4:
+            convert_samples_sf4(samples, (sf4 *) output + position, n, factor);
+            break;
+        case READ_OUTPUT_SF8:
+            convert_samples_sf8(samples, (sf8 *) output + position, n, factor);
+            break;
+        default:
+            memcpy((si4 *) output + position, samples, sizeof(si4) * (size_t) n);
+            break;
+    }
+}
+
+// sets n outputs from position on to RED_NAN, or NaN for float output formats
+static void fill_output_nan(void *output, si4 output_format, si8 position, si8 n)
+{
+    sf4 nan_sf4;
+    sf8 *output_sf8;
+    si8 i;
+    si4 nan_bits;
+    
+    switch (output_format)
+    {
+        case READ_OUTPUT_SF4:
+            nan_sf4 = NAN;
+            memcpy(&nan_bits, &nan_sf4, sizeof(si4));
+            memset_int((si4 *) ((sf4 *) output + position), nan_bits, (size_t) n);
+            break;
+        case READ_OUTPUT_SF8:
+            output_sf8 = (sf8 *) output + position;
+            for (i = 0; i < n; i++)
+                output_sf8[i] = NAN;
+            break;
+        default:
+            memset_int((si4 *) output + position, RED_NAN, (size_t) n);
+            break;
+    }
+}
+
+// Converts the first n samples of a read's output, decoded into it as si4, to the output format in place.  sf8 outputs
+// are twice the size of the samples, so they are converted from the end, half of what remains at a time: the outputs
+// of the upper half then lie past its samples, and don't reach the lower half, which is still to be converted.
+static void convert_output_in_place(void *output, si4 output_format, si8 n, sf8 factor)
+{
+    si8 start, end;
+    si4 first;
+    
+    switch (output_format)
+    {
+        case READ_OUTPUT_SF4:
+            convert_samples_sf4((si4 *) output, (sf4 *) output, n, factor);
+            break;
+        case READ_OUTPUT_SF8:
+            for (end = n; end > 1; end = start)
+            {
+                start = (end + 1) / 2;
+                convert_samples_sf8((si4 *) output + start, (sf8 *) output + start, end - start, factor);
+            }
+            if (n > 0)
+            {
+                first = *(si4 *) output;
+                convert_samples_sf8(&first, (sf8 *) output, 1, factor);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**************************  Envelope  ****************************/
+
+// adds the part of [block_start, block_end) inside each bin to that bin's covered time
+static void envelope_add_coverage(sf8 *covered, si4 n_bins, si8 start_time, sf8 bin_width, si8 block_start, si8 block_end)
+{
+    si8 bin, last_bin;
+    sf8 lo, hi;
+    
+    bin = (si8) ((block_start - start_time) / bin_width);
+    last_bin = (si8) ((block_end - 1 - start_time) / bin_width);
+    if (bin < 0)
+        bin = 0;
+    if (last_bin >= n_bins)
+        last_bin = n_bins - 1;
+    for (; bin <= last_bin; bin++)
+    {
+        lo = start_time + (bin * bin_width);
+        hi = lo + bin_width;
+        if (block_start > lo)
+            lo = (sf8) block_start;
+        if (block_end < hi)
+            hi = (sf8) block_end;
+        if (hi > lo)
+            covered[bin] += hi - lo;
+    }
+}
+
+static inline void envelope_update(si4 *bin_min, si4 *bin_max, si8 bin, si4 min_value, si4 max_value)
+{
+    if ((bin_min[bin] == RED_NAN) || (min_value < bin_min[bin]))
+        bin_min[bin] = min_value;
+    if ((bin_max[bin] == RED_NAN) || (max_value > bin_max[bin]))
+        bin_max[bin] = max_value;
+}
+
+// Computes the minimum and maximum of a channel over each of n_bins equal bins of [start_time, end_time), for drawing
+// zoomed-out views.  A block lying inside a single bin contributes the minimum and maximum stored in its time series
+// index entry, without being read; only blocks crossing a bin edge (bins narrower than a block) or an end of the range
+// are decoded.  bin_gap is set for bins partly or wholly outside the recorded data.  Bins holding no samples get RED_NAN
+// as minimum and maximum.  Returns n_bins, or 0 on error.
+si4 read_mef_ts_envelope_by_time(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, si4 n_bins, si4 *bin_min, si4 *bin_max, ui1 *bin_gap, CHANNEL *channel_passed_in)
+{
+    CHANNEL *channel;
+    CHANNEL_BLOCK_INDEX *index;
+    TIME_SERIES_INDEX *tsi;
+    RED_PROCESSING_STRUCT *rps;
+    VERIFIED_BLOCKS verified;
+    si4 *samples;
+    ui1 *block_data, *block_buffer, *block_copy, *map;
+    sf8 *covered;
+    si8 block, first_block, end_block, block_start, block_end, bin, last_bin, sample_time;
+    ui8 block_bytes, buffer_bytes, map_bytes;
+    sf8 fs, bin_width, sample_period;
+    si4 read_channel, segment, ok, io_mode;
+    ui4 max_samps, i;
+    
+    if ((n_bins <= 0) || (start_time >= end_time))
+    {
+        printf("Invalid envelope range, exiting...");
+        return 0;
+    }
+    
+    if (channel_passed_in == NULL)
+    {
+        read_channel = 1;
+        
+        // set up mef 3 library
+        (void) initialize_meflib();
+        MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
+        
+        channel = read_channel_with_cached_password(channel_path, password);
+        
+        if (channel == NULL)
+            return 0;
+        if (channel->channel_type != TIME_SERIES_CHANNEL_TYPE) {
+            printf("Not a time series channel, exiting...");
+            free_read_channel(channel);
+            return 0;
+        }
+    }
+    else
+    {
+        read_channel = 0;
+        channel = channel_passed_in;
+    }
+    
+    index = get_channel_block_index(channel);
+    if (index == NULL)
+    {
+        printf("Could not index channel, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        return 0;
+    }
+    
+    fs = channel->metadata.time_series_section_2->sampling_frequency;
+    max_samps = channel->metadata.time_series_section_2->maximum_block_samples;
+    io_mode = read_mef_ts_data_io_mode;
+    verified.channel = NULL;
+    bin_width = (end_time - start_time) / (sf8) n_bins;
+    sample_period = 1e6 / fs;
+    
+    memset_int(bin_min, RED_NAN, (size_t) n_bins);
+    memset_int(bin_max, RED_NAN, (size_t) n_bins);
+    covered = (sf8 *) calloc((size_t) n_bins, sizeof(sf8));
+    
+    // decoding state, set up when the first block needs decoding
+    rps = NULL;
+    samples = NULL;
+    block_buffer = block_copy = NULL;
+    buffer_bytes = 0;
+    ok = 1;
+    
+    // blocks starting before end_time, from the last one starting at or before start_time
+    first_block = block_index_first_after_time(index, 0, index->number_of_blocks, start_time, MEF_TRUE) - 1;
+    if (first_block < 0)
+        first_block = 0;
+    end_block = block_index_first_after_time(index, first_block, index->number_of_blocks, end_time - 1, MEF_TRUE);
+    
+    for (block = first_block; (block < end_block) && ok; block++)
+    {
+        segment = index->segment[block];
+        tsi = &channel->segments[segment].time_series_indices_fps->time_series_indices[block - index->segment_first_block[segment]];
+        block_start = index->start_time[block];
+        remove_recording_time_offset( &block_start );
+        block_end = block_start + (si8) ((tsi->number_of_samples * sample_period) + 0.5);
+        if ((block_end <= start_time) || (block_start >= end_time) || (tsi->number_of_samples == 0))
+            continue;
+        
+        envelope_add_coverage(covered, n_bins, start_time, bin_width, block_start, block_end);
+        
+        // block inside one bin: the index extrema are enough
+        bin = (si8) ((block_start - start_time) / bin_width);
+        last_bin = (si8) ((block_end - 1 - start_time) / bin_width);
+        if ((block_start >= start_time) && (block_end <= end_time) && (bin == last_bin))
+        {
+            envelope_update(bin_min, bin_max, bin, tsi->minimum_sample_value, tsi->maximum_sample_value);
+            continue;
+        }
+        
+        // otherwise decode it, and bin each sample
+        if (rps == NULL)
+        {
+            rps = allocate_channel_decode_rps(channel, max_samps);
+            samples = (si4 *) malloc(sizeof(si4) * (size_t) (max_samps + 1));
+            if (io_mode == READ_IO_MMAP)
+                block_copy = (ui1 *) malloc((size_t) RED_MAX_COMPRESSED_BYTES(max_samps, 1));
+        }
+        block_bytes = (ui8) (block_index_block_end_offset(index, channel, block) - index->file_offset[block]);
+        if (io_mode == READ_IO_MMAP)
+        {
+            map = get_segment_map(channel, segment, &map_bytes);
+            if ((map == NULL) || ((ui8) index->file_offset[block] + block_bytes > map_bytes))
+            {
+                printf("Error mapping file, exiting...");
+                ok = 0;
+                break;
+            }
+            block_data = map + index->file_offset[block];
+        }
+        else
+        {
+            if (block_bytes > buffer_bytes)
+            {
+                free (block_buffer);
+                block_buffer = (ui1 *) malloc((size_t) block_bytes);
+                buffer_bytes = block_bytes;
+            }
+            block_data = block_buffer;
+            if (!read_segment_data(channel, segment, index->file_offset[block], block_bytes, block_data))
+            {
+                printf("Error reading file, exiting...");
+                ok = 0;
+                break;
+            }
+        }
+        if (!channel_block_crc(channel, block, block_data, max_samps, block_data, block_bytes, &verified, NULL))
+        {
+            printf("RED block %ld has 0 bytes, or CRC failed, data likely corrupt...", (long) block);
+            ok = 0;
+            break;
+        }
+        decode_block(rps, block_data, samples, block_copy);
+        
+        for (i = 0; i < rps->block_header->number_of_samples; i++)
+        {
+            if (samples[i] == RED_NAN)
+                continue;
+            sample_time = block_start + (si8) ((i * sample_period) + 0.5);
+            if ((sample_time < start_time) || (sample_time >= end_time))
+                continue;
+            bin = (si8) ((sample_time - start_time) / bin_width);
+            if (bin >= n_bins)
+                bin = n_bins - 1;
+            envelope_update(bin_min, bin_max, bin, samples[i], samples[i]);
+        }
+    }
+    
+    // a bin is a gap if less of it is covered than its width, allowing a sample period for rounding of block times
+    if (ok && (bin_gap != NULL))
+    {
+        for (bin = 0; bin < n_bins; bin++)
+            bin_gap[bin] = ((covered[bin] <= 0.0) || (covered[bin] < bin_width - sample_period)) ? 1 : 0;
+    }
+    
+    free (covered);
+    free (samples);
+    free (block_buffer);
+    free (block_copy);
+    free_decode_rps(rps);
+    if (read_channel == 1)
+        free_read_channel(channel);
+    
+    return ok ? n_bins : 0;
+}
+
+/**************************  Windowed features  ****************************/
+
+// Features of fixed length windows stepping through a time range, computed from each block as it is decoded, so the
+// samples themselves are never written out.  The windows are split into tasks of consecutive windows, which worker
+// threads take in turn.  A task reads and decodes the blocks covering its windows and adds each block's samples to the
+// windows holding them.  Blocks straddling two tasks are decoded by both.
+
+#define FEATURE_TASK_BLOCKS     64          // blocks spanned by one task, roughly
+#define BLOCK_RUN_BYTES         (1 << 20)   // most compressed data read at once (see read_block_run())
+
+typedef struct {
+    si8     n;                  // valid samples
+    si4     shift;              // first valid sample, subtracted from the others for the mean and variance sums
+    si8     sum;
+    sf8     sum_squares;
+    sf8     line_length;
+    si8     zero_crossings;
+    si4     last;               // sample before the next one, if has_last
+    si1     has_last;           // cleared by a NaN or a discontinuity, so neither is bridged
+} FEATURE_ACCUMULATOR;
+
+typedef struct {
+    CHANNEL             *channel;
+    CHANNEL_BLOCK_INDEX *index;
+    si8                 start_time;
+    si8                 window_length;
+    si8                 window_step;
+    si8                 n_windows;
+    si8                 windows_per_task;
+    ui4                 features;
+    si4                 n_features;
+    sf8                 factor;
+    sf8                 *output;
+    si4                 io_mode;
+    si8                 next_task;
+    si8                 n_tasks;
+    si4                 failed;
+    READER_MUTEX        mutex;
+} FEATURE_READ;
+
+si8 mef_ts_feature_window_count(si8 start_time, si8 end_time, si8 window_length, si8 window_step)
+{
+    if ((window_length <= 0) || (window_step <= 0) || (end_time - start_time < window_length))
+        return 0;
+    
+    return ((end_time - start_time - window_length) / window_step) + 1;
+}
+
+static inline si8 feature_sample_time(si8 block_start, si8 i, sf8 sample_period)
+{
+    return block_start + (si8) ((i * sample_period) + 0.5);
+}
+
+// first sample of a block at or after time t, sample times rounded as in feature_sample_time()
+static si8 feature_first_sample_at(si8 t, si8 block_start, si8 n, sf8 sample_period)
+{
+    si8 i;
+    
+    i = (si8) ((t - block_start) / sample_period);
+    if (i < 0)
+        i = 0;
+    if (i > n)
+        i = n;
+    while ((i > 0) && (feature_sample_time(block_start, i - 1, sample_period) >= t))
+        i--;
+    while ((i < n) && (feature_sample_time(block_start, i, sample_period) < t))
+        i++;
+    
+    return i;
+}
+
+static void feature_accumulate(FEATURE_ACCUMULATOR *acc, si4 *samples, si8 n)
+{
+    si8 i, sum;
+    sf8 d, sum_squares, line_length;
+    si4 x, last, has_last;
+    
+    sum = acc->sum;
+    sum_squares = acc->sum_squares;
+    line_length = acc->line_length;
+    last = acc->last;
+    has_last = acc->has_last;
+    for (i = 0; i < n; i++)
+    {
+        x = samples[i];
+        if (x == RED_NAN)
+        {
+            has_last = 0;
+            continue;
+        }
+        if (acc->n++ == 0)
+            acc->shift = x;
+        d = (sf8) x - acc->shift;
+        sum += (si8) x - acc->shift;
+        sum_squares += d * d;
+        if (has_last)
+        {
+            line_length += fabs((sf8) x - last);
+            if ((x < 0) != (last < 0))
+                acc->zero_crossings++;
+        }
+        last = x;
+        has_last = 1;
+    }
+    acc->sum = sum;
+    acc->sum_squares = sum_squares;
+    acc->line_length = line_length;
+    acc->last = last;
+    acc->has_last = (si1) has_last;
+}
+
+// adds the samples of a decoded block to the windows of [first_window, end_window) they fall in
+static void feature_add_block(FEATURE_READ *fr, FEATURE_ACCUMULATOR *acc, si8 first_window, si8 end_window, si8 block_start,
+                              si4 *samples, si8 n, si4 discontinuity, sf8 sample_period)
+{
+    si8 w, w_end, window_start, block_end, i0, i1;
+    
+    block_end = feature_sample_time(block_start, n - 1, sample_period) + 1;
+    
+    // windows ending after the block starts and starting before it ends
+    w = block_start - fr->start_time - fr->window_length;
+    w = (w < 0) ? 0 : (w / fr->window_step) + 1;
+    if (w < first_window)
+        w = first_window;
+    w_end = ((block_end - fr->start_time) + fr->window_step - 1) / fr->window_step;
+    if (w_end > end_window)
+        w_end = end_window;
+    
+    for (; w < w_end; w++)
+    {
+        window_start = fr->start_time + (w * fr->window_step);
+        i0 = feature_first_sample_at(window_start, block_start, n, sample_period);
+        i1 = feature_first_sample_at(window_start + fr->window_length, block_start, n, sample_period);
+        if (i1 <= i0)
+            continue;
+        if (discontinuity)
+            acc[w - first_window].has_last = 0;
+        feature_accumulate(&acc[w - first_window], samples + i0, i1 - i0);
+    }
+}
+
+// Brings in the run of consecutive blocks of one segment from block on (before end_block, and at most
+// BLOCK_RUN_BYTES unless a single block is larger), from the segment's mapping or read into *buffer.  Sets *run_end to
+// the block after the run, and *run_bytes to its size.  Returns the run's data, or NULL on error.
+static ui1 *read_block_run(CHANNEL *channel, CHANNEL_BLOCK_INDEX *index, si8 block, si8 end_block, si4 io_mode, ui1 **buffer, ui8 *buffer_bytes,
+                           si8 *run_end, ui8 *run_bytes)
+{
+    ui1 *map;
+    ui8 map_bytes;
+    si8 run_offset;
+    si4 segment;
+    
+    segment = index->segment[block];
+    run_offset = index->file_offset[block];
+    for (*run_end = block + 1; *run_end < end_block; (*run_end)++)
+    {
+        if ((index->segment[*run_end] != segment) || (block_index_block_end_offset(index, channel, *run_end) - run_offset > BLOCK_RUN_BYTES))
+            break;
+    }
+    *run_bytes = (ui8) (block_index_block_end_offset(index, channel, *run_end - 1) - run_offset);
+    
+    if (io_mode == READ_IO_MMAP)
+    {
+        map = get_segment_map(channel, segment, &map_bytes);
+        if ((map == NULL) || ((ui8) run_offset + *run_bytes > map_bytes))
+        {
+            printf("Error mapping file, exiting...");
+            return NULL;
+        }
+        return map + run_offset;
+    }
+    
+    if (*run_bytes > *buffer_bytes)
+    {
+        free (*buffer);
+        *buffer = (ui1 *) malloc((size_t) *run_bytes);
+        *buffer_bytes = (*buffer == NULL) ? 0 : *run_bytes;
+        if (*buffer == NULL)
+            return NULL;
+    }
+    if (!read_segment_data(channel, segment, run_offset, *run_bytes, *buffer))
+    {
+        printf("Error reading file, exiting...");
+        return NULL;
+    }
+    
+    return *buffer;
+}
+
+// reads and decodes the blocks covering windows [first_window, end_window), adding them to acc
+static si4 feature_task(FEATURE_READ *fr, si8 first_window, si8 end_window, FEATURE_ACCUMULATOR *acc, RED_PROCESSING_STRUCT *rps,
+                        si4 *samples, ui1 *block_copy, ui1 **buffer, ui8 *buffer_bytes)
+{
+    CHANNEL *channel;
+    CHANNEL_BLOCK_INDEX *index;
+    VERIFIED_BLOCKS verified;
+    ui1 *data, *block_ptr;
+    si8 block, first_block, end_block, run_end, run_offset, span_start, span_end, block_start;
+    ui8 run_bytes;
+    sf8 sample_period;
+    ui4 max_samps;
+    
+    channel = fr->channel;
+    index = fr->index;
+    verified.channel = NULL;
+    max_samps = channel->metadata.time_series_section_2->maximum_block_samples;
+    sample_period = 1e6 / channel->metadata.time_series_section_2->sampling_frequency;
+    span_start = fr->start_time + (first_window * fr->window_step);
+    span_end = fr->start_time + ((end_window - 1) * fr->window_step) + fr->window_length;
+    
+    // blocks starting before the span ends, from the last one starting at or before it starts
+    first_block = block_index_first_after_time(index, 0, index->number_of_blocks, span_start, MEF_TRUE) - 1;
+    if (first_block < 0)
+        first_block = 0;
+    end_block = block_index_first_after_time(index, first_block, index->number_of_blocks, span_end - 1, MEF_TRUE);
+    
+    for (block = first_block; block < end_block; block = run_end)
+    {
+        data = read_block_run(channel, index, block, end_block, fr->io_mode, buffer, buffer_bytes, &run_end, &run_bytes);
+        if (data == NULL)
+            return 0;
+        
+        run_offset = index->file_offset[block];
+        for (; block < run_end; block++)
+        {
+            block_ptr = data + (index->file_offset[block] - run_offset);
+            if (!channel_block_crc(channel, block, block_ptr, max_samps, data, run_bytes, &verified, NULL))
+            {
+                printf("RED block %ld has 0 bytes, or CRC failed, data likely corrupt...", (long) block);
+                return 0;
+            }
+            decode_block(rps, block_ptr, samples, block_copy);
+            if (rps->block_header->number_of_samples == 0)
+                continue;
+            block_start = index->start_time[block];
+            remove_recording_time_offset( &block_start );
+            feature_add_block(fr, acc, first_window, end_window, block_start, samples, (si8) rps->block_header->number_of_samples,
+                              index->discontinuity[block], sample_period);
+        }
+    }
+    
+    return 1;
+}
+
+// writes a window's selected features, in bit order, scaled to the channel's units
+static void feature_finish(FEATURE_READ *fr, FEATURE_ACCUMULATOR *acc, sf8 *out)
+{
+    sf8 mean, variance, scale;
+    si4 f;
+    
+    mean = variance = NAN;
+    if (acc->n > 0)
+    {
+        mean = (sf8) acc->sum / acc->n;
+        variance = (acc->sum_squares / acc->n) - (mean * mean);
+        if (variance < 0.0)
+            variance = 0.0;
+        mean += acc->shift;
+    }
+    scale = fabs(fr->factor);
+    
+    f = 0;
+    if (fr->features & READ_FEATURE_LINE_LENGTH)
+        out[f++] = (acc->n > 0) ? acc->line_length * scale : NAN;
+    if (fr->features & READ_FEATURE_RMS)
+        out[f++] = sqrt(variance + (mean * mean)) * scale;
+    if (fr->features & READ_FEATURE_MEAN)
+        out[f++] = mean * fr->factor;
+    if (fr->features & READ_FEATURE_VARIANCE)
+        out[f++] = variance * fr->factor * fr->factor;
+    if (fr->features & READ_FEATURE_ZERO_CROSSINGS)
+        out[f++] = (acc->n > 0) ? (sf8) acc->zero_crossings : NAN;
+    if (fr->features & READ_FEATURE_COUNT)
+        out[f++] = (sf8) acc->n;
+}
+
+static READER_THREAD_RETURN feature_worker(void *arg)
+{
+    FEATURE_READ *fr;
+    FEATURE_ACCUMULATOR *acc;
+    RED_PROCESSING_STRUCT *rps;
+    si4 *samples;
+    ui1 *block_copy, *buffer;
+    ui8 buffer_bytes;
+    si8 task, first_window, end_window, w;
+    ui4 max_samps;
+    si4 ok;
+    
+    fr = (FEATURE_READ *) arg;
+    max_samps = fr->channel->metadata.time_series_section_2->maximum_block_samples;
+    
+    rps = allocate_channel_decode_rps(fr->channel, max_samps);
+    samples = (si4 *) malloc(sizeof(si4) * (size_t) (max_samps + 1));
+    block_copy = NULL;
+    if (fr->io_mode == READ_IO_MMAP)
+        block_copy = (ui1 *) malloc((size_t) RED_MAX_COMPRESSED_BYTES(max_samps, 1));
+    acc = (FEATURE_ACCUMULATOR *) malloc(sizeof(FEATURE_ACCUMULATOR) * (size_t) fr->windows_per_task);
+    buffer = NULL;
+    buffer_bytes = 0;
+    ok = (rps != NULL) && (samples != NULL) && (acc != NULL) && ((block_copy != NULL) || (fr->io_mode != READ_IO_MMAP));
+    
+    while (ok)
+    {
+        reader_mutex_lock(&fr->mutex);
+        task = fr->failed ? fr->n_tasks : fr->next_task++;
+        reader_mutex_unlock(&fr->mutex);
+        if (task >= fr->n_tasks)
+            break;
+        
+        first_window = task * fr->windows_per_task;
+        end_window = first_window + fr->windows_per_task;
+        if (end_window > fr->n_windows)
+            end_window = fr->n_windows;
+        
+        memset(acc, 0, sizeof(FEATURE_ACCUMULATOR) * (size_t) (end_window - first_window));
+        ok = feature_task(fr, first_window, end_window, acc, rps, samples, block_copy, &buffer, &buffer_bytes);
+        if (ok)
+        {
+            for (w = first_window; w < end_window; w++)
+                feature_finish(fr, &acc[w - first_window], fr->output + (w * fr->n_features));
+        }
+    }
+    
+    if (!ok)
+    {
+        reader_mutex_lock(&fr->mutex);
+        fr->failed = 1;
+        reader_mutex_unlock(&fr->mutex);
+    }
+    
+    free (buffer);
+    free (acc);
+    free (block_copy);
+    free (samples);
+    free_decode_rps(rps);
+    
+    return READER_THREAD_RETURN_VALUE;
+}
+
+// Computes features of windows window_length microseconds long, starting every window_step microseconds from start_time,
+// for the windows lying wholly in [start_time, end_time) (see mef_ts_feature_window_count()).  features is an OR of
+// READ_FEATURE_ flags; output receives, for each window in turn, the selected features in the order of their flags.
+// Features are in the channel's units and computed over the window's valid samples: NaN samples and gaps are left out,
+// and line length and zero crossings are only taken between consecutive samples of continuous data.  Windows with no
+// valid samples get NaN features (and a count of 0).  Blocks are read and decoded once per task of consecutive windows,
+// with tasks spread over the set_read_mef_ts_data_num_threads() threads.  Returns the number of windows, or 0 on error.
+si4 read_mef_ts_features_by_time(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, si8 window_length, si8 window_step,
+                                 ui4 features, sf8 *output, CHANNEL *channel_passed_in)
+{
+    FEATURE_READ fr;
+    CHANNEL *channel;
+    READER_THREAD *threads;
+    si4 *thread_started;
+    si8 n_windows, task_length;
+    si4 read_channel, n_threads, w, f;
+    sf8 fs;
+    
+    n_windows = mef_ts_feature_window_count(start_time, end_time, window_length, window_step);
+    features &= READ_FEATURE_ALL;
+    if ((n_windows <= 0) || (n_windows > 0x7FFFFFFF) || (features == 0))
+    {
+        printf("Invalid feature windows, exiting...");
+        return 0;
+    }
+    if (output == NULL)
+    {
+        printf("No feature buffer was passed to function, exiting...");
+        return 0;
+    }
+    
+    if (channel_passed_in == NULL)
+    {
+        read_channel = 1;
+        
+        // set up mef 3 library
+        (void) initialize_meflib();
+        MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
+        
+        channel = read_channel_with_cached_password(channel_path, password);
+        
+        if (channel == NULL)
+            return 0;
+        if (channel->channel_type != TIME_SERIES_CHANNEL_TYPE) {
+            printf("Not a time series channel, exiting...");
+            free_read_channel(channel);
+            return 0;
+        }
+    }
+    else
+    {
+        read_channel = 0;
+        channel = channel_passed_in;
+    }
+    
+    fr.index = get_channel_block_index(channel);
+    if (fr.index == NULL)
+    {
+        printf("Could not index channel, exiting...");
+        if (read_channel == 1)
+            free_read_channel(channel);
+        return 0;
+    }
+    
+    fs = channel->metadata.time_series_section_2->sampling_frequency;
+    fr.channel = channel;
+    fr.start_time = start_time;
+    fr.window_length = window_length;
+    fr.window_step = window_step;
+    fr.n_windows = n_windows;
+    fr.features = features;
+    fr.n_features = 0;
+    for (f = 0; f < 32; f++)
+        if (features & (1u << f))
+            fr.n_features++;
+    fr.factor = get_channel_units_conversion_factor(channel);
+    fr.output = output;
+    fr.io_mode = (read_mef_ts_data_io_mode == READ_IO_MMAP) ? READ_IO_MMAP : READ_IO_FREAD;
+    fr.next_task = 0;
+    fr.failed = 0;
+    reader_mutex_init(&fr.mutex);
+    
+    // tasks span about FEATURE_TASK_BLOCKS blocks, but there are several per thread when the range allows
+    n_threads = read_mef_ts_data_num_threads;
+    task_length = (si8) (FEATURE_TASK_BLOCKS * (channel->metadata.time_series_section_2->maximum_block_samples * 1e6 / fs));
+    fr.windows_per_task = task_length / window_step;
+    if (fr.windows_per_task > (n_windows + (4 * n_threads) - 1) / (4 * n_threads))
+        fr.windows_per_task = (n_windows + (4 * n_threads) - 1) / (4 * n_threads);
+    if (fr.windows_per_task < 1)
+        fr.windows_per_task = 1;
+    fr.n_tasks = (n_windows + fr.windows_per_task - 1) / fr.windows_per_task;
+    if (n_threads > fr.n_tasks)
+        n_threads = (si4) fr.n_tasks;
+    
+    threads = (READER_THREAD *) calloc((size_t) n_threads, sizeof(READER_THREAD));
+    thread_started = (si4 *) calloc((size_t) n_threads, sizeof(si4));
+    for (w = 1; w < n_threads; w++)
+        thread_started[w] = reader_thread_create(&threads[w], feature_worker, &fr);
+    feature_worker(&fr);
+    for (w = 1; w < n_threads; w++)
+        if (thread_started[w])
+            reader_thread_join(threads[w]);
+    
+    free (thread_started);
+    free (threads);
+    reader_mutex_destroy(&fr.mutex);
+    if (read_channel == 1)
+        free_read_channel(channel);
+    
+    return fr.failed ? 0 : (si4) n_windows;
+}
+
+/**************************  Pyramid sidecar  ****************************/
+
+// Level 0 bins are filled by decoding the channel in tasks of PYRAMID_TASK_BINS bins of one continuous range, which
+// worker threads take in turn (tasks own their bins, so no locking is needed).  Each level above is then built from the
+// one below.
+
+#define PYRAMID_TASK_BINS       4096
+
+typedef struct {
+    si8     range;
+    si8     start_sample;       // channel sample numbers, start_sample on a bin boundary
+    si8     end_sample;
+} PYRAMID_TASK;
+
+typedef struct {
+    CHANNEL             *channel;
+    CHANNEL_BLOCK_INDEX *index;
+    CONTINUOUS_RANGES   *ranges;
+    PYRAMID_BIN         *bins;          // level 0
+    si8                 *first_bin;
+    PYRAMID_TASK        *tasks;
+    si8                 n_tasks;
+    si8                 next_task;
+    si4                 io_mode;
+    si4                 failed;
+    READER_MUTEX        mutex;
+} PYRAMID_BUILD;
+
+static si8 pyramid_range_bins(si8 range_samples, si4 level)
+{
+    si8 bin_samples;
+    
+    bin_samples = (si8) MEF_PYRAMID_BASE_BIN_SAMPLES << level;
+    
+    return (range_samples + bin_samples - 1) / bin_samples;
+}
+
+static void pyramid_merge_bin(PYRAMID_BIN *bin, PYRAMID_BIN *other)
+{
+    if (other->count == 0)
+        return;
+    if (bin->count == 0)
+    {
+        *bin = *other;
+        return;
+    }
+    if (other->minimum < bin->minimum)
+        bin->minimum = other->minimum;
+    if (other->maximum > bin->maximum)
+        bin->maximum = other->maximum;
+    bin->mean = ((bin->mean * bin->count) + (other->mean * other->count)) / ((sf8) bin->count + other->count);
+    bin->count += other->count;
+}
+
+// adds samples [i0, i1) of a decoded block starting at channel sample block_start to the level 0 bins of a range
+static void pyramid_add_samples(PYRAMID_BIN *range_bins, si8 range_start, si8 block_start, si4 *samples, si8 i0, si8 i1)
+{
+    PYRAMID_BIN *bin;
+    si8 i, bin_end, sum;
+    si4 x, minimum, maximum;
+    ui4 count;
+    
+    while (i0 < i1)
+    {
+        bin = range_bins + ((block_start + i0 - range_start) / MEF_PYRAMID_BASE_BIN_SAMPLES);
+        bin_end = range_start + (((block_start + i0 - range_start) / MEF_PYRAMID_BASE_BIN_SAMPLES) + 1) * MEF_PYRAMID_BASE_BIN_SAMPLES - block_start;
+        if (bin_end > i1)
+            bin_end = i1;
+        
+        sum = 0;
+        count = 0;
+        minimum = maximum = 0;
+        for (i = i0; i < bin_end; i++)
+        {
+            x = samples[i];
+            if (x == RED_NAN)
+                continue;
+            if ((count == 0) || (x < minimum))
+                minimum = x;
+            if ((count == 0) || (x > maximum))
+                maximum = x;
+            sum += x;
+            count++;
+        }
+        i0 = bin_end;
+        if (count == 0)
+            continue;
+        
+        // mean holds the sum until the task is done
+        if ((bin->count == 0) || (minimum < bin->minimum))
+            bin->minimum = minimum;
+        if ((bin->count == 0) || (maximum > bin->maximum))
+            bin->maximum = maximum;
+        bin->mean += (sf8) sum;
+        bin->count += count;
+    }
+}
+
+static si4 pyramid_task(PYRAMID_BUILD *pb, PYRAMID_TASK *task, RED_PROCESSING_STRUCT *rps, si4 *samples, ui1 *block_copy, ui1 **buffer, ui8 *buffer_bytes)
+{
+    CHANNEL *channel;
+    CHANNEL_BLOCK_INDEX *index;
+    PYRAMID_BIN *range_bins, *bin, *end_bin;
+    VERIFIED_BLOCKS verified;
+    ui1 *data, *block_ptr;
+    si8 block, first_block, end_block, run_end, run_offset, range_start, i0, i1, n;
+    ui8 run_bytes;
+    ui4 max_samps;
+    
+    channel = pb->channel;
+    index = pb->index;
+    verified.channel = NULL;
+    max_samps = channel->metadata.time_series_section_2->maximum_block_samples;
+    range_start = pb->ranges->start_sample[task->range];
+    range_bins = pb->bins + pb->first_bin[task->range];
+    
+    bin = range_bins + ((task->start_sample - range_start) / MEF_PYRAMID_BASE_BIN_SAMPLES);
+    end_bin = range_bins + pyramid_range_bins(task->end_sample - range_start, 0);
+    memset(bin, 0, sizeof(PYRAMID_BIN) * (size_t) (end_bin - bin));
+    
+    first_block = block_index_first_after_sample(index, task->start_sample) - 1;
+    if (first_block < 0)
+        first_block = 0;
+    end_block = block_index_first_after_sample(index, task->end_sample - 1);
+    
+    for (block = first_block; block < end_block; block = run_end)
+    {
+        data = read_block_run(channel, index, block, end_block, pb->io_mode, buffer, buffer_bytes, &run_end, &run_bytes);
+        if (data == NULL)
+            return 0;
+        
+        run_offset = index->file_offset[block];
+        for (; block < run_end; block++)
+        {
+            block_ptr = data + (index->file_offset[block] - run_offset);
+            if (!channel_block_crc(channel, block, block_ptr, max_samps, data, run_bytes, &verified, NULL))
+            {
+                printf("RED block %ld has 0 bytes, or CRC failed, data likely corrupt...", (long) block);
+                return 0;
+            }
+            decode_block(rps, block_ptr, samples, block_copy);
+            
+            n = (si8) rps->block_header->number_of_samples;
+            i0 = task->start_sample - index->start_sample[block];
+            i1 = task->end_sample - index->start_sample[block];
+            if (i0 < 0)
+                i0 = 0;
+            if (i1 > n)
+                i1 = n;
+            pyramid_add_samples(range_bins, range_start, index->start_sample[block], samples, i0, i1);
+        }
+    }
+    
+    for (; bin < end_bin; bin++)
+    {
+        if (bin->count > 0)
+            bin->mean /= bin->count;
+        else
+            bin->minimum = bin->maximum = RED_NAN;
+    }
+    
+    return 1;
+}
+
+static READER_THREAD_RETURN pyramid_worker(void *arg)
+{
+    PYRAMID_BUILD *pb;
+    RED_PROCESSING_STRUCT *rps;
+    si4 *samples;
+    ui1 *block_copy, *buffer;
+    ui8 buffer_bytes;
+    si8 task;
+    ui4 max_samps;
+    si4 ok;
+    
+    pb = (PYRAMID_BUILD *) arg;
+    max_samps = pb->channel->metadata.time_series_section_2->maximum_block_samples;
+    
+    rps = allocate_channel_decode_rps(pb->channel, max_samps);
+    samples = (si4 *) malloc(sizeof(si4) * (size_t) (max_samps + 1));
+    block_copy = NULL;
+    if (pb->io_mode == READ_IO_MMAP)
+        block_copy = (ui1 *) malloc((size_t) RED_MAX_COMPRESSED_BYTES(max_samps, 1));
+    buffer = NULL;
+    buffer_bytes = 0;
+    ok = (rps != NULL) && (samples != NULL) && ((block_copy != NULL) || (pb->io_mode != READ_IO_MMAP));
+    
+    while (ok)
+    {
+        reader_mutex_lock(&pb->mutex);
+        task = pb->failed ? pb->n_tasks : pb->next_task++;
+        reader_mutex_unlock(&pb->mutex);
+        if (task >= pb->n_tasks)
+            break;
+        
+        ok = pyramid_task(pb, &pb->tasks[task], rps, samples, block_copy, &buffer, &buffer_bytes);
+    }
+    
+    if (!ok)
+    {
+        reader_mutex_lock(&pb->mutex);
+        pb->failed = 1;
+        reader_mutex_unlock(&pb->mutex);
+    }
+    
+    free (buffer);
+    free (block_copy);
+    free (samples);
+    free_decode_rps(rps);
+    
+    return READER_THREAD_RETURN_VALUE;
+}
+
+// Maps a pyramid sidecar, if it is valid for this version and its arrays lie within it.  Returns NULL otherwise.
+static MEF_PYRAMID *map_pyramid(si1 *file_name)
+{
+    MEF_PYRAMID *pyramid;
+    PYRAMID_HEADER *header;
+    si8 n_ranges, offset, bytes, level, i;
+    si4 valid;
+    
+    pyramid = (MEF_PYRAMID *) calloc((size_t) 1, sizeof(MEF_PYRAMID));
+    if ((pyramid == NULL) || !map_segment(&pyramid->map, file_name))
+    {
+        free (pyramid);
+        return NULL;
+    }
+    
+    header = (PYRAMID_HEADER *) pyramid->map.data;
+    valid = (pyramid->map.bytes >= sizeof(PYRAMID_HEADER)) && (memcmp(header->magic, PYRAMID_MAGIC, sizeof(PYRAMID_MAGIC)) == 0) &&
+            (header->version == MEF_PYRAMID_VERSION) && (header->header_bytes == sizeof(PYRAMID_HEADER)) &&
+            (header->file_bytes == (si8) pyramid->map.bytes) && (header->base_bin_samples == MEF_PYRAMID_BASE_BIN_SAMPLES) &&
+            (header->number_of_levels >= 1) && (header->number_of_levels <= MEF_PYRAMID_MAX_LEVELS) &&
+            (header->number_of_ranges >= 0) && (header->number_of_ranges < header->file_bytes);
+    n_ranges = valid ? header->number_of_ranges : 0;
+    
+    // every array lies within the file
+    for (i = 0; valid && (i < 4); i++)
+    {
+        offset = header->range_arrays_offset[i];
+        if ((offset < (si8) sizeof(PYRAMID_HEADER)) || (offset + (n_ranges * (si8) sizeof(si8)) > header->file_bytes))
+            valid = 0;
+    }
+    for (level = 0; valid && (level < header->number_of_levels); level++)
+    {
+        offset = header->level_first_bin_offset[level];
+        if ((offset < (si8) sizeof(PYRAMID_HEADER)) || (offset + ((n_ranges + 1) * (si8) sizeof(si8)) > header->file_bytes))
+        {
+            valid = 0;
+            break;
+        }
+        pyramid->first_bin[level] = (si8 *) (pyramid->map.data + offset);
+        
+        // each range's bins follow the previous range's, so bins + first_bin[level][r] + k stays within the level
+        if (pyramid->first_bin[level][0] != 0)
+            valid = 0;
+        for (i = 0; valid && (i < n_ranges); i++)
+            if (pyramid->first_bin[level][i + 1] < pyramid->first_bin[level][i])
+                valid = 0;
+        if (!valid)
+            break;
+        offset = header->level_bins_offset[level];
+        bytes = pyramid->first_bin[level][n_ranges] * (si8) sizeof(PYRAMID_BIN);
+        if ((offset < (si8) sizeof(PYRAMID_HEADER)) || (bytes < 0) || (offset + bytes > header->file_bytes))
+            valid = 0;
+        pyramid->bins[level] = (PYRAMID_BIN *) (pyramid->map.data + offset);
+    }
+    
+    if (!valid)
+    {
+        unmap_segment(&pyramid->map);
+        free (pyramid);
+        return NULL;
+    }
+    
+    pyramid->header = header;
+    pyramid->range_start_time = (si8 *) (pyramid->map.data + header->range_arrays_offset[0]);
+    pyramid->range_end_time = (si8 *) (pyramid->map.data + header->range_arrays_offset[1]);
+    pyramid->range_start_sample = (si8 *) (pyramid->map.data + header->range_arrays_offset[2]);
+    pyramid->range_end_sample = (si8 *) (pyramid->map.data + header->range_arrays_offset[3]);
+    
+    return pyramid;
+}
+
+MEF_PYRAMID *open_mef_pyramid(si1 *channel_path)
+{
+    si1 file_name[MEF_FULL_FILE_NAME_BYTES];
+    
+    channel_sidecar_file_name(channel_path, MEF_PYRAMID_EXTENSION, file_name);
+    
+    return map_pyramid(file_name);
+}
+
+void close_mef_pyramid(MEF_PYRAMID *pyramid)
+{
+    if (pyramid == NULL)
+        return;
+    
+    unmap_segment(&pyramid->map);
+    free (pyramid);
+}
+
+// Returns how many level 0 bins at the start of each range of an existing pyramid are still valid for the channel's
+// ranges (in reused, which has an entry per range of the channel), assuming data is only ever appended: every range but
+// the last must be unchanged, and the last may only have grown.  Returns 1 if the pyramid is entirely up to date, 0
+// otherwise.
+static si4 reusable_pyramid_bins(MEF_PYRAMID *old, CONTINUOUS_RANGES *ranges, sf8 sampling_frequency, si8 *reused)
+{
+    si8 n_old, r, last;
+    
+    memset(reused, 0, sizeof(si8) * (size_t) ranges->number_of_ranges);
+    if (old == NULL)
+        return 0;
+    
+    n_old = old->header->number_of_ranges;
+    if ((n_old == 0) || (n_old > ranges->number_of_ranges) || (old->header->sampling_frequency != sampling_frequency))
+        return 0;
+    for (r = 0; r < n_old - 1; r++)
+    {
+        if ((old->range_start_time[r] != ranges->start_time[r]) || (old->range_end_time[r] != ranges->end_time[r]) ||
+            (old->range_start_sample[r] != ranges->start_sample[r]) || (old->range_end_sample[r] != ranges->end_sample[r]))
+            return 0;
+    }
+    last = n_old - 1;
+    if ((old->range_start_time[last] != ranges->start_time[last]) || (old->range_start_sample[last] != ranges->start_sample[last]) ||
+        (old->range_end_sample[last] > ranges->end_sample[last]))
+        return 0;
+    
+    for (r = 0; r < last; r++)
+        reused[r] = old->first_bin[0][r + 1] - old->first_bin[0][r];
+    reused[last] = (old->range_end_sample[last] - old->range_start_sample[last]) / MEF_PYRAMID_BASE_BIN_SAMPLES;
+    
+    return (n_old == ranges->number_of_ranges) && (old->range_end_sample[last] == ranges->end_sample[last]) &&
+           (old->range_end_time[last] == ranges->end_time[last]);
+}
+
+// Reads a channel and writes its pyramid sidecar (replacing any existing one only once the new one is complete).  Bins
+// of an existing pyramid that the channel's data has only been appended to are kept, and only the rest of the channel
+// is decoded; an up to date pyramid is left as it is.  Returns 1, or 0 on error.
+si4 write_mef_channel_pyramid(si1 *channel_path, si1 *password)
+{
+    PYRAMID_BUILD pb;
+    PYRAMID_HEADER header;
+    MEF_PYRAMID *old;
+    CHANNEL *channel;
+    CHANNEL_BLOCK_INDEX *index;
+    CONTINUOUS_RANGES *ranges;
+    PYRAMID_BIN *level_bins[MEF_PYRAMID_MAX_LEVELS], *bin;
+    si8 *first_bin[MEF_PYRAMID_MAX_LEVELS], *reused;
+    READER_THREAD *threads;
+    si4 *thread_started;
+    si1 file_name[MEF_FULL_FILE_NAME_BYTES], temp_file_name[MEF_FULL_FILE_NAME_BYTES];
+    si8 n_ranges, n_bins, max_range_samples, offset, r, k, level, n_levels, sample;
+    si4 ok, up_to_date, n_threads, w;
+    FILE *fp;
+    
+    // set up mef 3 library
+    (void) initialize_meflib();
+    MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
+    
+    channel = read_channel_with_cached_password(channel_path, password);
+    if (channel == NULL)
+        return 0;
+    if (channel->channel_type != TIME_SERIES_CHANNEL_TYPE) {
+        printf("Not a time series channel, exiting...");
+        free_read_channel(channel);
+        return 0;
+    }
+    
+    index = build_channel_block_index(channel);
+    ranges = (index != NULL) ? build_continuous_ranges(channel, index) : NULL;
+    if ((ranges == NULL) || (ranges->number_of_ranges == 0))
+    {
+        printf("Could not index channel, exiting...");
+        free_continuous_ranges(ranges);
+        free_channel_block_index(index);
+        free_read_channel(channel);
+        return 0;
+    }
+    n_ranges = ranges->number_of_ranges;
+    
+    // levels up to the first where every range fits in one bin
+    max_range_samples = 0;
+    for (r = 0; r < n_ranges; r++)
+        if (ranges->end_sample[r] - ranges->start_sample[r] > max_range_samples)
+            max_range_samples = ranges->end_sample[r] - ranges->start_sample[r];
+    n_levels = 1;
+    while ((n_levels < MEF_PYRAMID_MAX_LEVELS) && (pyramid_range_bins(max_range_samples, (si4) n_levels - 1) > 1))
+        n_levels++;
+    
+    ok = 1;
+    for (level = 0; level < n_levels; level++)
+    {
+        first_bin[level] = (si8 *) malloc(sizeof(si8) * (size_t) (n_ranges + 1));
+        ok = ok && (first_bin[level] != NULL);
+        if (first_bin[level] == NULL)
+            continue;
+        first_bin[level][0] = 0;
+        for (r = 0; r < n_ranges; r++)
+            first_bin[level][r + 1] = first_bin[level][r] + pyramid_range_bins(ranges->end_sample[r] - ranges->start_sample[r], (si4) level);
+        level_bins[level] = (PYRAMID_BIN *) calloc((size_t) first_bin[level][n_ranges] + 1, sizeof(PYRAMID_BIN));
+        ok = ok && (level_bins[level] != NULL);
+    }
+    reused = (si8 *) malloc(sizeof(si8) * (size_t) n_ranges);
+    pb.tasks = NULL;
+    pb.n_tasks = 0;
+    ok = ok && (reused != NULL);
+    
+    // keep what an existing pyramid has of the data, and decode the rest
+    channel_sidecar_file_name(channel_path, MEF_PYRAMID_EXTENSION, file_name);
+    up_to_date = 0;
+    if (ok)
+    {
+        old = map_pyramid(file_name);
+        up_to_date = reusable_pyramid_bins(old, ranges, index->sampling_frequency, reused);
+        for (r = 0; (r < n_ranges) && !up_to_date; r++)
+            if (reused[r] > 0)
+                memcpy(level_bins[0] + first_bin[0][r], old->bins[0] + old->first_bin[0][r], sizeof(PYRAMID_BIN) * (size_t) reused[r]);
+        close_mef_pyramid(old);
+        
+        n_bins = 0;
+        for (r = 0; r < n_ranges; r++)
+            n_bins += (first_bin[0][r + 1] - first_bin[0][r] - reused[r] + PYRAMID_TASK_BINS - 1) / PYRAMID_TASK_BINS;
+        pb.tasks = (PYRAMID_TASK *) malloc(sizeof(PYRAMID_TASK) * (size_t) (n_bins + 1));
+        ok = (pb.tasks != NULL);
+        for (r = 0; ok && (r < n_ranges) && !up_to_date; r++)
+        {
+            for (sample = ranges->start_sample[r] + (reused[r] * MEF_PYRAMID_BASE_BIN_SAMPLES); sample < ranges->end_sample[r];
+                 sample += PYRAMID_TASK_BINS * MEF_PYRAMID_BASE_BIN_SAMPLES)
+            {
+                pb.tasks[pb.n_tasks].range = r;
+                pb.tasks[pb.n_tasks].start_sample = sample;
+                pb.tasks[pb.n_tasks].end_sample = sample + (PYRAMID_TASK_BINS * MEF_PYRAMID_BASE_BIN_SAMPLES);
+                if (pb.tasks[pb.n_tasks].end_sample > ranges->end_sample[r])
+                    pb.tasks[pb.n_tasks].end_sample = ranges->end_sample[r];
+                pb.n_tasks++;
+            }
+        }
+    }
+    
+    if (ok && !up_to_date && (pb.n_tasks > 0))
+    {
+        pb.channel = channel;
+        pb.index = index;
+        pb.ranges = ranges;
+        pb.bins = level_bins[0];
+        pb.first_bin = first_bin[0];
+        pb.next_task = 0;
+        pb.io_mode = (read_mef_ts_data_io_mode == READ_IO_MMAP) ? READ_IO_MMAP : READ_IO_FREAD;
+        pb.failed = 0;
+        reader_mutex_init(&pb.mutex);
+        
+        n_threads = read_mef_ts_data_num_threads;
+        if (n_threads > pb.n_tasks)
+            n_threads = (si4) pb.n_tasks;
+        threads = (READER_THREAD *) calloc((size_t) n_threads, sizeof(READER_THREAD));
+        thread_started = (si4 *) calloc((size_t) n_threads, sizeof(si4));
+        for (w = 1; w < n_threads; w++)
+            thread_started[w] = reader_thread_create(&threads[w], pyramid_worker, &pb);
+        pyramid_worker(&pb);
+        for (w = 1; w < n_threads; w++)
+            if (thread_started[w])
+                reader_thread_join(threads[w]);
+        free (thread_started);
+        free (threads);
+        reader_mutex_destroy(&pb.mutex);
+        ok = !pb.failed;
+    }
+    
+    // each level above from the one below, within each range
+    for (level = 1; ok && !up_to_date && (level < n_levels); level++)
+    {
+        for (r = 0; r < n_ranges; r++)
+        {
+            for (k = 0; k < first_bin[level][r + 1] - first_bin[level][r]; k++)
+            {
+                bin = level_bins[level] + first_bin[level][r] + k;
+                bin->minimum = bin->maximum = RED_NAN;
+                bin->mean = NAN;
+                pyramid_merge_bin(bin, level_bins[level - 1] + first_bin[level - 1][r] + (2 * k));
+                if ((2 * k) + 1 < first_bin[level - 1][r + 1] - first_bin[level - 1][r])
+                    pyramid_merge_bin(bin, level_bins[level - 1] + first_bin[level - 1][r] + (2 * k) + 1);
+            }
+        }
+    }
+    
+    if (ok && !up_to_date)
+    {
+        memset(&header, 0, sizeof(PYRAMID_HEADER));
+        memcpy(header.magic, PYRAMID_MAGIC, sizeof(PYRAMID_MAGIC));
+        header.version = MEF_PYRAMID_VERSION;
+        header.header_bytes = sizeof(PYRAMID_HEADER);
+        header.number_of_samples = index->end_sample;
+        header.number_of_ranges = n_ranges;
+        header.sampling_frequency = index->sampling_frequency;
+        header.base_bin_samples = MEF_PYRAMID_BASE_BIN_SAMPLES;
+        header.number_of_levels = (ui4) n_levels;
+        
+        offset = sidecar_array_bytes(sizeof(PYRAMID_HEADER));
+        for (r = 0; r < 4; r++)
+        {
+            header.range_arrays_offset[r] = offset;
+            offset += sidecar_array_bytes(sizeof(si8) * (size_t) n_ranges);
+        }
+        for (level = 0; level < n_levels; level++)
+        {
+            header.level_first_bin_offset[level] = offset;
+            offset += sidecar_array_bytes(sizeof(si8) * (size_t) (n_ranges + 1));
+            header.level_bins_offset[level] = offset;
+            offset += sidecar_array_bytes(sizeof(PYRAMID_BIN) * (size_t) first_bin[level][n_ranges]);
+        }
+        header.file_bytes = offset;
+        
+        // written under a temporary name, and renamed into place when complete
+        MEF_snprintf(temp_file_name, MEF_FULL_FILE_NAME_BYTES, "%s.tmp", file_name);
+        fp = fopen(temp_file_name, "wb");
+        if (fp == NULL)
+        {
+            printf("Could not create %s, exiting...", temp_file_name);
+            ok = 0;
+        }
+        else
+        {
+            ok = write_sidecar_array(fp, &header, sizeof(PYRAMID_HEADER));
+            ok = ok && write_sidecar_array(fp, ranges->start_time, sizeof(si8) * (size_t) n_ranges);
+            ok = ok && write_sidecar_array(fp, ranges->end_time, sizeof(si8) * (size_t) n_ranges);
+            ok = ok && write_sidecar_array(fp, ranges->start_sample, sizeof(si8) * (size_t) n_ranges);
+            ok = ok && write_sidecar_array(fp, ranges->end_sample, sizeof(si8) * (size_t) n_ranges);
+            for (level = 0; ok && (level < n_levels); level++)
+            {
+                ok = write_sidecar_array(fp, first_bin[level], sizeof(si8) * (size_t) (n_ranges + 1));
+                ok = ok && write_sidecar_array(fp, level_bins[level], sizeof(PYRAMID_BIN) * (size_t) first_bin[level][n_ranges]);
+            }
+            if (fclose(fp) != 0)
+                ok = 0;
+            
+            if (ok)
+            {
+#ifdef _WIN32
+                remove(file_name);
+#endif
+                ok = (rename(temp_file_name, file_name) == 0);
+            }
+            if (!ok)
+            {
+                printf("Error writing %s, exiting...", file_name);
+                remove(temp_file_name);
+            }
+        }
+    }
+    
+    for (level = 0; level < n_levels; level++)
+    {
+        if (first_bin[level] != NULL)
+            free (level_bins[level]);
+        free (first_bin[level]);
+    }
+    free (pb.tasks);
+    free (reused);
+    free_continuous_ranges(ranges);
+    free_channel_block_index(index);
+    free_read_channel(channel);
+    
+    return ok;
+}
+
+// Returns the pyramid level read_mef_pyramid_by_time() uses for n_bins over [start_time, end_time): the coarsest whose
+// bins are no longer than the output bins, or level 0 if even its bins are longer.  Returns -1 on error.
+si4 get_mef_pyramid_level(MEF_PYRAMID *pyramid, si8 start_time, si8 end_time, si4 n_bins)
+{
+    sf8 bin_width, sample_period;
+    si4 level;
+    
+    if ((pyramid == NULL) || (n_bins <= 0) || (start_time >= end_time))
+        return -1;
+    
+    bin_width = (end_time - start_time) / (sf8) n_bins;
+    sample_period = 1e6 / pyramid->header->sampling_frequency;
+    level = 0;
+    while ((level + 1 < (si4) pyramid->header->number_of_levels) &&
+           (((sf8) ((si8) MEF_PYRAMID_BASE_BIN_SAMPLES << (level + 1)) * sample_period) <= bin_width))
+        level++;
+    
+    return level;
+}
+
+// Computes the minimum, maximum and mean of a channel over each of n_bins equal bins of [start_time, end_time) from its
+// pyramid, using the level given by get_mef_pyramid_level().  Each output bin takes every pyramid bin overlapping it, so
+// extrema are never missed.  bin_mean may be NULL.  Bins holding no samples get RED_NAN as minimum and maximum, and NaN as
+// mean.  Returns n_bins, or 0 on error.
+si4 read_mef_pyramid_by_time(MEF_PYRAMID *pyramid, si8 start_time, si8 end_time, si4 n_bins, si4 *bin_min, si4 *bin_max, sf8 *bin_mean)
+{
+    PYRAMID_BIN *bins, *bin;
+    sf8 *counts, *sums, bin_width, level_bin_duration, range_start, range_end, t0, t1;
+    si8 r, k, end_k, n_range_bins, out, last_out;
+    si4 level;
+    
+    level = get_mef_pyramid_level(pyramid, start_time, end_time, n_bins);
+    if (level < 0)
+    {
+        printf("Invalid pyramid range, exiting...");
+        return 0;
+    }
+    
+    bin_width = (end_time - start_time) / (sf8) n_bins;
+    level_bin_duration = (sf8) ((si8) MEF_PYRAMID_BASE_BIN_SAMPLES << level) * (1e6 / pyramid->header->sampling_frequency);
+    bins = pyramid->bins[level];
+    
+    memset_int(bin_min, RED_NAN, (size_t) n_bins);
+    memset_int(bin_max, RED_NAN, (size_t) n_bins);
+    counts = (sf8 *) calloc((size_t) n_bins, sizeof(sf8));
+    sums = (sf8 *) calloc((size_t) n_bins, sizeof(sf8));
+    if ((counts == NULL) || (sums == NULL))
+    {
+        free (counts);
+        free (sums);
+        return 0;
+    }
+    
+    for (r = 0; r < pyramid->header->number_of_ranges; r++)
+    {
+        range_start = (sf8) pyramid->range_start_time[r];
+        range_end = (sf8) pyramid->range_end_time[r];
+        if ((range_end <= start_time) || (range_start >= end_time))
+            continue;
+        
+        // the range's bins overlapping [start_time, end_time)
+        n_range_bins = pyramid->first_bin[level][r + 1] - pyramid->first_bin[level][r];
+        k = (start_time > range_start) ? (si8) ((start_time - range_start) / level_bin_duration) : 0;
+        end_k = (si8) ceil((((end_time < range_end) ? end_time : range_end) - range_start) / level_bin_duration);
+        if (end_k > n_range_bins)
+            end_k = n_range_bins;
+        
+        for (; k < end_k; k++)
+        {
+            bin = bins + pyramid->first_bin[level][r] + k;
+            if (bin->count == 0)
+                continue;
+            t0 = range_start + (k * level_bin_duration);
+            t1 = t0 + level_bin_duration;
+            if (t1 > range_end)
+                t1 = range_end;
+            out = (t0 > start_time) ? (si8) ((t0 - start_time) / bin_width) : 0;
+            last_out = (si8) ceil((t1 - start_time) / bin_width) - 1;
+            if (last_out >= n_bins)
+                last_out = n_bins - 1;
+            for (; out <= last_out; out++)
+            {
+                envelope_update(bin_min, bin_max, out, bin->minimum, bin->maximum);
+                sums[out] += bin->mean * bin->count;
+                counts[out] += bin->count;
+            }
+        }
+    }
+    
+    if (bin_mean != NULL)
+    {
+        for (out = 0; out < n_bins; out++)
+            bin_mean[out] = (counts[out] > 0.0) ? sums[out] / counts[out] : NAN;
+    }
+    
+    free (counts);
+    free (sums);
+    
+    return n_bins;
+}
+
+/**************************  Integrity verification  ****************************/
+
+// Every block of the channels is checked, in jobs of consecutive blocks of one segment (about VERIFY_CHUNK_BYTES of
+// data each), which worker threads take in file order.  Each job's data is read with one call, and the OS is asked to
+// read ahead the job the workers will reach next, so the files are streamed.  A segment's data file is closed when its
+// last job is done, unless it was already open, so whole sessions don't run out of file handles.
+
+#define VERIFY_CHUNK_BYTES      (8 << 20)
+
+typedef struct {
+    si4     channel;
+    si4     segment;
+    si8     slot;               // entry of the channel's segment in VERIFY_RUN.jobs_left
+    si8     first_block;        // channel block numbers
+    si8     end_block;
+    si8     offset;
+    ui8     bytes;
+} VERIFY_JOB;
+
+typedef struct {
+    CHANNEL                 **channels;
+    CHANNEL_BLOCK_INDEX     **indices;
+    si4                     n_channels;
+    MEF_VERIFY_OPTIONS      *options;
+    VERIFY_JOB              *jobs;
+    si8                     n_jobs;
+    si8                     next_job;
+    si8                     *jobs_left;         // per channel segment: jobs not yet done, -1 if its file was open already
+    si8                     lookahead;
+    ui4                     max_samps;
+    MEF_VERIFY_PROGRESS     progress;
+    sf8                     start_time;
+    sf8                     last_report;
+    si4                     failed;
+    READER_MUTEX            mutex;              // also serializes the callbacks
+} VERIFY_RUN;
+
+void initialize_mef_verify_options(MEF_VERIFY_OPTIONS *options)
+{
+    memset(options, 0, sizeof(MEF_VERIFY_OPTIONS));
+    options->progress_interval = 1.0;
+    options->decode = MEF_TRUE;
+}
+
+static void report_bad_block(VERIFY_RUN *vr, VERIFY_JOB *job, si8 block, si4 error)
+{
+    CHANNEL_BLOCK_INDEX *index;
+    MEF_VERIFY_ERROR report;
+    
+    index = vr->indices[job->channel];
+    report.channel = vr->channels[job->channel];
+    report.channel_number = job->channel;
+    report.segment = job->segment;
+    report.block = block - index->segment_first_block[job->segment];
+    report.start_time = index->start_time[block];
+    remove_recording_time_offset( &report.start_time );
+    report.file_offset = index->file_offset[block];
+    report.block_bytes = block_index_block_end_offset(index, report.channel, block) - index->file_offset[block];
+    report.error = error;
+    
+    reader_mutex_lock(&vr->mutex);
+    vr->progress.bad_blocks++;
+    if (vr->options->error_function != NULL)
+        vr->options->error_function(vr->options->user_data, &report);
+    reader_mutex_unlock(&vr->mutex);
+}
+
+// checks one block whose data is block_ptr (block_bytes long, by the index); returns 0 or a VERIFY_BLOCK_ error
+static si4 verify_block(VERIFY_RUN *vr, VERIFY_JOB *job, si8 block, ui1 *block_ptr, si8 block_bytes, RED_PROCESSING_STRUCT *rps, si4 *samples)
+{
+    CHANNEL *channel;
+    TIME_SERIES_INDEX *tsi;
+    RED_BLOCK_HEADER *block_header;
+    ui4 max_samps;
+    
+    channel = vr->channels[job->channel];
+    max_samps = channel->metadata.time_series_section_2->maximum_block_samples;
+    tsi = &channel->segments[job->segment].time_series_indices_fps->time_series_indices[block - vr->indices[job->channel]->segment_first_block[job->segment]];
+    if ((block_bytes <= 0) || (tsi->number_of_samples == 0))
+        return VERIFY_BLOCK_ZERO_LENGTH;
+    
+    block_header = (RED_BLOCK_HEADER *) block_ptr;
+    if ((block_bytes >= RED_BLOCK_HEADER_BYTES) && (block_header->block_bytes == 0))
+        return VERIFY_BLOCK_ZERO_LENGTH;
+    if (!check_block_bounds(block_ptr, max_samps, block_ptr, (ui8) block_bytes))
+        return VERIFY_BLOCK_BAD_BOUNDS;
+    if (!check_block_crc(block_ptr, max_samps, block_ptr, (ui8) block_bytes))
+        return VERIFY_BLOCK_BAD_CRC;
+    
+    if (vr->options->decode)
+    {
+        if ((block_header->number_of_samples > max_samps) || (block_header->number_of_samples != tsi->number_of_samples))
+            return VERIFY_BLOCK_BAD_DECODE;
+        decode_block(rps, block_ptr, samples, NULL);
+    }
+    
+    return 0;
+}
+
+static READER_THREAD_RETURN verify_worker(void *arg)
+{
+    VERIFY_RUN *vr;
+    VERIFY_JOB *job, *ahead;
+    CHANNEL *channel;
+    CHANNEL_BLOCK_INDEX *index;
+    RED_PROCESSING_STRUCT *rps;
+    si4 *samples;
+    ui1 *buffer, *block_ptr;
+    ui8 buffer_bytes;
+    si8 j, block, block_bytes, n_blocks;
+    si4 error, read_ok, file_done;
+    sf8 now;
+    
+    vr = (VERIFY_RUN *) arg;
+    
+    rps = NULL;
+    samples = NULL;
+    if (vr->options->decode)
+    {
+        rps = allocate_decode_rps(vr->max_samps);
+        samples = (si4 *) malloc(sizeof(si4) * (size_t) (vr->max_samps + 1));
+    }
+    buffer = NULL;
+    buffer_bytes = 0;
+    if (vr->options->decode && ((rps == NULL) || (samples == NULL)))
+    {
+        reader_mutex_lock(&vr->mutex);
+        vr->failed = 1;
+        reader_mutex_unlock(&vr->mutex);
+    }
+    
+    while (1)
+    {
+        reader_mutex_lock(&vr->mutex);
+        j = vr->failed ? vr->n_jobs : vr->next_job++;
+        if ((j < vr->n_jobs) && (j + vr->lookahead < vr->n_jobs))
+        {
+            ahead = &vr->jobs[j + vr->lookahead];
+            advise_segment_data(vr->channels[ahead->channel], ahead->segment, ahead->offset, ahead->bytes);
+        }
+        reader_mutex_unlock(&vr->mutex);
+        if (j >= vr->n_jobs)
+            break;
+        
+        job = &vr->jobs[j];
+        channel = vr->channels[job->channel];
+        index = vr->indices[job->channel];
+        
+        // the whole job at once; if that fails, block by block to find the unreadable ones
+        if (job->bytes > buffer_bytes)
+        {
+            free (buffer);
+            buffer = (ui1 *) malloc((size_t) job->bytes);
+            buffer_bytes = (buffer == NULL) ? 0 : job->bytes;
+        }
+        read_ok = (buffer != NULL) && ((job->bytes == 0) || read_segment_data(channel, job->segment, job->offset, job->bytes, buffer));
+        
+        for (block = job->first_block; block < job->end_block; block++)
+        {
+            block_bytes = block_index_block_end_offset(index, channel, block) - index->file_offset[block];
+            block_ptr = (buffer == NULL) ? NULL : buffer + (index->file_offset[block] - job->offset);
+            if ((block_bytes > 0) && ((index->file_offset[block] < job->offset) || (index->file_offset[block] + block_bytes > job->offset + (si8) job->bytes)))
+                error = VERIFY_BLOCK_BAD_BOUNDS;    // index offsets out of order
+            else if (!read_ok && (block_bytes > 0) && ((block_ptr == NULL) || !read_segment_data(channel, job->segment, index->file_offset[block], (ui8) block_bytes, block_ptr)))
+                error = VERIFY_BLOCK_READ_ERROR;
+            else
+            {
+                if (rps != NULL)
+                    rps->password_data = channel_password_data(channel);
+                error = verify_block(vr, job, block, block_ptr, block_bytes, rps, samples);
+            }
+            if (error)
+                report_bad_block(vr, job, block, error);
+        }
+        
+        n_blocks = job->end_block - job->first_block;
+        reader_mutex_lock(&vr->mutex);
+        vr->progress.blocks_checked += n_blocks;
+        vr->progress.bytes_checked += job->bytes;
+        file_done = (vr->jobs_left[job->slot] > 0) && (--vr->jobs_left[job->slot] == 0);
+        if (file_done)
+        {
+            reader_mutex_lock(&reader_channel_states_mutex);
+            if (channel->segments[job->segment].time_series_data_fps->fp != NULL)
+                fclose(channel->segments[job->segment].time_series_data_fps->fp);
+            channel->segments[job->segment].time_series_data_fps->fp = NULL;
+            reader_mutex_unlock(&reader_channel_states_mutex);
+        }
+        now = reader_clock();
+        if ((vr->options->progress_function != NULL) && (now - vr->last_report >= vr->options->progress_interval))
+        {
+            vr->last_report = now;
+            vr->progress.seconds = now - vr->start_time;
+            vr->progress.bytes_per_second = (vr->progress.seconds > 0.0) ? vr->progress.bytes_checked / vr->progress.seconds : 0.0;
+            vr->options->progress_function(vr->options->user_data, &vr->progress);
+        }
+        reader_mutex_unlock(&vr->mutex);
+    }
+    
+    free (buffer);
+    free (samples);
+    free_decode_rps(rps);
+    
+    return READER_THREAD_RETURN_VALUE;
+}
+
+// Checks every block of the given channels with a pool of worker threads.  Returns the number of bad blocks, or -1 if
+// a channel could not be indexed.
+static si8 verify_channels(CHANNEL **channels, si4 n_channels, MEF_VERIFY_OPTIONS *options, MEF_VERIFY_PROGRESS *result)
+{
+    VERIFY_RUN vr;
+    MEF_VERIFY_OPTIONS default_options;
+    CHANNEL_BLOCK_INDEX *index;
+    READER_THREAD *threads;
+    si4 *thread_started;
+    si8 n_slots, slot, block, end_block, run_end, n_jobs;
+    si4 ch, segment, n_threads, w;
+    
+    if (options == NULL)
+    {
+        initialize_mef_verify_options(&default_options);
+        options = &default_options;
+    }
+    
+    memset(&vr, 0, sizeof(VERIFY_RUN));
+    vr.channels = channels;
+    vr.n_channels = n_channels;
+    vr.options = options;
+    vr.start_time = vr.last_report = reader_clock();
+    vr.progress.channels_total = n_channels;
+    
+    // indices are built up front, so workers only read them
+    vr.indices = (CHANNEL_BLOCK_INDEX **) calloc((size_t) n_channels, sizeof(CHANNEL_BLOCK_INDEX *));
+    n_slots = n_jobs = 0;
+    for (ch = 0; ch < n_channels; ch++)
+    {
+        index = vr.indices[ch] = get_channel_block_index(channels[ch]);
+        if (index == NULL)
+        {
+            printf("Could not index channel %d, exiting...", ch);
+            free (vr.indices);
+            return -1;
+        }
+        if (channels[ch]->metadata.time_series_section_2->maximum_block_samples > vr.max_samps)
+            vr.max_samps = channels[ch]->metadata.time_series_section_2->maximum_block_samples;
+        n_slots += index->number_of_segments;
+        n_jobs += index->number_of_blocks;
+        vr.progress.blocks_total += index->number_of_blocks;
+        for (segment = 0; segment < index->number_of_segments; segment++)
+            if (index->segment_first_block[segment + 1] > index->segment_first_block[segment])
+                vr.progress.bytes_total += (ui8) (block_index_block_end_offset(index, channels[ch], index->segment_first_block[segment + 1] - 1) -
+                                                  index->file_offset[index->segment_first_block[segment]]);
+    }
+    vr.jobs = (VERIFY_JOB *) malloc(sizeof(VERIFY_JOB) * (size_t) (n_jobs + 1));
+    vr.jobs_left = (si8 *) calloc((size_t) (n_slots + 1), sizeof(si8));
+    if ((vr.jobs == NULL) || (vr.jobs_left == NULL))
+    {
+        free (vr.jobs);
+        free (vr.jobs_left);
+        free (vr.indices);
+        return -1;
+    }
+    
+    // jobs in file order: runs of blocks of one segment
+    slot = 0;
+    for (ch = 0; ch < n_channels; ch++)
+    {
+        index = vr.indices[ch];
+        for (segment = 0; segment < index->number_of_segments; segment++, slot++)
+        {
+            end_block = index->segment_first_block[segment + 1];
+            for (block = index->segment_first_block[segment]; block < end_block; block = run_end)
+            {
+                for (run_end = block + 1; run_end < end_block; run_end++)
+                    if (block_index_block_end_offset(index, channels[ch], run_end) - index->file_offset[block] > VERIFY_CHUNK_BYTES)
+                        break;
+                vr.jobs[vr.n_jobs].channel = ch;
+                vr.jobs[vr.n_jobs].segment = segment;
+                vr.jobs[vr.n_jobs].slot = slot;
+                vr.jobs[vr.n_jobs].first_block = block;
+                vr.jobs[vr.n_jobs].end_block = run_end;
+                vr.jobs[vr.n_jobs].offset = index->file_offset[block];
+                vr.jobs[vr.n_jobs].bytes = (ui8) (block_index_block_end_offset(index, channels[ch], run_end - 1) - index->file_offset[block]);
+                if ((si8) vr.jobs[vr.n_jobs].bytes < 0)
+                    vr.jobs[vr.n_jobs].bytes = 0;
+                vr.n_jobs++;
+                vr.jobs_left[slot]++;
+            }
+            if (channels[ch]->segments[segment].time_series_data_fps->fp != NULL)
+                vr.jobs_left[slot] = -1;
+        }
+    }
+    
+    n_threads = (options->num_threads > 0) ? options->num_threads : read_mef_ts_data_num_threads;
+    if (n_threads > vr.n_jobs)
+        n_threads = (si4) vr.n_jobs;
+    if (n_threads < 1)
+        n_threads = 1;
+    vr.lookahead = n_threads;
+    reader_mutex_init(&vr.mutex);
+    
+    threads = (READER_THREAD *) calloc((size_t) n_threads, sizeof(READER_THREAD));
+    thread_started = (si4 *) calloc((size_t) n_threads, sizeof(si4));
+    for (w = 1; w < n_threads; w++)
+        thread_started[w] = reader_thread_create(&threads[w], verify_worker, &vr);
+    verify_worker(&vr);
+    for (w = 1; w < n_threads; w++)
+        if (thread_started[w])
+            reader_thread_join(threads[w]);
+    free (thread_started);
+    free (threads);
+    
+    vr.progress.channels_checked = n_channels;
+    vr.progress.seconds = reader_clock() - vr.start_time;
+    vr.progress.bytes_per_second = (vr.progress.seconds > 0.0) ? vr.progress.bytes_checked / vr.progress.seconds : 0.0;
+    if (options->progress_function != NULL)
+        options->progress_function(options->user_data, &vr.progress);
+    if (result != NULL)
+        *result = vr.progress;
+    reader_mutex_destroy(&vr.mutex);
+    
+    free (vr.jobs);
+    free (vr.jobs_left);
+    free (vr.indices);
+    
+    return vr.failed ? -1 : vr.progress.bad_blocks;
+}
+
+// Checks every block of a channel: that it has data, that its header's size fits, its CRC, and (with options->decode)
+// that it decodes to the number of samples its index entry gives.  Every bad block is passed to
+// options->error_function, and options->progress_function is called every options->progress_interval seconds and once
+// at the end; callbacks come from the worker threads, one at a time.  options may be NULL for the defaults.  If result
+// is not NULL it receives the final counts.  Returns the number of bad blocks, or -1 on error.
+si8 verify_mef_channel(si1 *channel_path, si1 *password, MEF_VERIFY_OPTIONS *options, MEF_VERIFY_PROGRESS *result, CHANNEL *channel_passed_in)
+{
+    CHANNEL *channel;
+    si8 n_bad;
+    
+    if (channel_passed_in == NULL)
+    {
+        // set up mef 3 library
+        (void) initialize_meflib();
+        MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
+        
+        channel = read_channel_with_cached_password(channel_path, password);
+        
+        if (channel == NULL)
+            return -1;
+        if (channel->channel_type != TIME_SERIES_CHANNEL_TYPE) {
+            printf("Not a time series channel, exiting...");
+            free_read_channel(channel);
+            return -1;
+        }
+    }
+    else
+        channel = channel_passed_in;
+    
+    n_bad = verify_channels(&channel, 1, options, result);
+    
+    if (channel_passed_in == NULL)
+        free_read_channel(channel);
+    
+    return n_bad;
+}
+
+// Same as verify_mef_channel(), for every time series channel of an already read SESSION, with one pool of workers
+// shared by all of them.  MEF_VERIFY_ERROR.channel_number is the channel's index in the session.
+si8 verify_mef_session(SESSION *session, MEF_VERIFY_OPTIONS *options, MEF_VERIFY_PROGRESS *result)
+{
+    CHANNEL **channels;
+    si8 n_bad;
+    si4 i;
+    
+    if ((session == NULL) || (session->number_of_time_series_channels <= 0))
+        return -1;
+    
+    channels = (CHANNEL **) malloc(sizeof(CHANNEL *) * (size_t) session->number_of_time_series_channels);
+    for (i = 0; i < session->number_of_time_series_channels; i++)
+        channels[i] = &session->time_series_channels[i];
+    
+    n_bad = verify_channels(channels, session->number_of_time_series_channels, options, result);
+    
+    free (channels);
+    
+    return n_bad;
+}
+
+/**************************  Encrypted channels  ****************************/
+
+// Reading a channel derives its password data from the password (validating it against the universal header and
+// expanding the level 1 and 2 AES keys).  That is done once per channel path and password: the first read's password
+// data is kept here and handed to read_MEF_channel() by later reads.  Channels holding cached password data count as
+// users, so clear_mef_password_cache() frees an entry only once nothing refers to it.
+typedef struct PASSWORD_CACHE_ENTRY PASSWORD_CACHE_ENTRY;
+struct PASSWORD_CACHE_ENTRY {
+    si1                     *channel_path;
+    si1                     *password;
+    PASSWORD_DATA           *password_data;
+    si4                     users;
+    si4                     cleared;        // dropped from the cache, freed when the last user is done
+    PASSWORD_CACHE_ENTRY    *next;
+};
+
+static PASSWORD_CACHE_ENTRY *password_cache = NULL;
+static READER_MUTEX password_cache_mutex = READER_MUTEX_INITIALIZER;
+
+static si4 hardware_aes_enabled = 1;
+
+static void free_password_cache_entry(PASSWORD_CACHE_ENTRY *entry)
+{
+    if (entry->password_data != NULL)
+        memset(entry->password_data, 0, sizeof(PASSWORD_DATA));
+    memset(entry->password, 0, strlen(entry->password));
+    free (entry->password_data);
+    free (entry->password);
+    free (entry->channel_path);
+    free (entry);
+}
+
+// the entry holding password_data, or NULL if it isn't cached (call with password_cache_mutex held)
+static PASSWORD_CACHE_ENTRY *find_cached_password_data(PASSWORD_DATA *password_data)
+{
+    PASSWORD_CACHE_ENTRY *entry;
+    
+    for (entry = password_cache; entry != NULL; entry = entry->next)
+        if (entry->password_data == password_data)
+            return entry;
+    
+    return NULL;
+}
+
+// Reads a channel as read_MEF_channel() does, reusing the password data of an earlier read of the same channel path
+// with the same password.  Free the channel with free_read_channel(), or call release_read_channel_password() before
+// free_channel().
+static CHANNEL *read_channel_with_cached_password(si1 *channel_path, si1 *password)
+{
+    PASSWORD_CACHE_ENTRY *entry;
+    PASSWORD_DATA *password_data;
+    CHANNEL *channel;
+    si1 *key;
+    
+    key = (password == NULL) ? "" : password;
+    
+    reader_mutex_lock(&password_cache_mutex);
+    for (entry = password_cache; entry != NULL; entry = entry->next)
+        if ((strcmp(entry->channel_path, channel_path) == 0) && (strcmp(entry->password, key) == 0))
+            break;
+    if (entry != NULL)
+        entry->users++;
+    reader_mutex_unlock(&password_cache_mutex);
+    
+    channel = read_MEF_channel(NULL, channel_path, TIME_SERIES_CHANNEL_TYPE, password, (entry == NULL) ? NULL : entry->password_data, MEF_FALSE, MEF_FALSE);
+    
+    if (entry != NULL)
+    {
+        if ((channel == NULL) || (channel->number_of_segments <= 0))
+        {
+            reader_mutex_lock(&password_cache_mutex);
+            entry->users--;
+            reader_mutex_unlock(&password_cache_mutex);
+        }
+        return channel;
+    }
+    
+    if ((channel == NULL) || (channel->number_of_segments <= 0) || (channel->segments[0].metadata_fps->password_data == NULL))
+        return channel;
+    password_data = channel->segments[0].metadata_fps->password_data;
+    
+    // the channel's password data becomes the cached copy, unless another thread cached one first
+    reader_mutex_lock(&password_cache_mutex);
+    for (entry = password_cache; entry != NULL; entry = entry->next)
+        if ((strcmp(entry->channel_path, channel_path) == 0) && (strcmp(entry->password, key) == 0))
+            break;
+    if (entry == NULL)
+    {
+        entry = (PASSWORD_CACHE_ENTRY *) calloc((size_t) 1, sizeof(PASSWORD_CACHE_ENTRY));
+        if (entry != NULL)
+        {
+            entry->channel_path = (si1 *) malloc(strlen(channel_path) + 1);
+            entry->password = (si1 *) malloc(strlen(key) + 1);
+            if ((entry->channel_path == NULL) || (entry->password == NULL))
+            {
+                free (entry->channel_path);
+                free (entry->password);
+                free (entry);
+            }
+            else
+            {
+                strcpy(entry->channel_path, channel_path);
+                strcpy(entry->password, key);
+                entry->password_data = password_data;
+                entry->users = 1;
+                entry->next = password_cache;
+                password_cache = entry;
+            }
+        }
+    }
+    reader_mutex_unlock(&password_cache_mutex);
+    
+    return channel;
+}
+
+// Before free_channel() on a channel read with read_channel_with_cached_password(): sets whether free_channel() frees
+// the channel's password data, which it must not do if the data is cached.
+static void release_read_channel_password(CHANNEL *channel)
+{
+    PASSWORD_CACHE_ENTRY *entry, **link;
+    FILE_PROCESSING_STRUCT *fps;
+    
+    if (channel->number_of_segments <= 0)
+        return;
+    fps = channel->segments[0].metadata_fps;
+    
+    reader_mutex_lock(&password_cache_mutex);
+    entry = find_cached_password_data(fps->password_data);
+    fps->directives.free_password_data = (entry == NULL) ? MEF_TRUE : MEF_FALSE;
+    if ((entry != NULL) && (--entry->users == 0) && entry->cleared)
+    {
+        for (link = &password_cache; *link != entry; link = &(*link)->next);
+        *link = entry->next;
+        free_password_cache_entry(entry);
+    }
+    reader_mutex_unlock(&password_cache_mutex);
+}
+
+// Drops all cached password data, so the next read of each channel derives it again from its password.  Entries still
+// used by open channels (cursors, multi-channel reads in progress) are freed when those are done with them.
+void clear_mef_password_cache(void)
+{
+    PASSWORD_CACHE_ENTRY *entry, **link;
+    
+    reader_mutex_lock(&password_cache_mutex);
+    link = &password_cache;
+    while ((entry = *link) != NULL)
+    {
+        if (entry->users > 0)
+        {
+            entry->cleared = 1;
+            link = &entry->next;
+            continue;
+        }
+        *link = entry->next;
+        free_password_cache_entry(entry);
+    }
+    reader_mutex_unlock(&password_cache_mutex);
+}
+
+// the password data a channel's blocks are decrypted with, NULL if there is none
+static PASSWORD_DATA *channel_password_data(CHANNEL *channel)
+{
+    if ((channel == NULL) || (channel->number_of_segments <= 0) || (channel->segments[0].metadata_fps == NULL))
+        return NULL;
+    
+    return channel->segments[0].metadata_fps->password_data;
+}
+
+void set_read_mef_ts_data_hardware_aes(si4 enabled)
+{
+    reader_atomic_store(&hardware_aes_enabled, enabled);
+}
+
+// the expanded key an encrypted block is decrypted with, NULL if the block isn't encrypted or the password doesn't
+// give access to it
+static ui1 *block_encryption_key(RED_PROCESSING_STRUCT *rps)
+{
+    PASSWORD_DATA *password_data;
+    
+    password_data = rps->password_data;
+    if (password_data == NULL)
+        return NULL;
+    if (rps->block_header->flags & RED_LEVEL_1_ENCRYPTION_MASK)
+        return (password_data->access_level >= LEVEL_1_ACCESS) ? (ui1 *) password_data->level_1_encryption_key : NULL;
+    if (rps->block_header->flags & RED_LEVEL_2_ENCRYPTION_MASK)
+        return (password_data->access_level >= LEVEL_2_ACCESS) ? (ui1 *) password_data->level_2_encryption_key : NULL;
+    
+    return NULL;
+}
+
+// decrypts the encrypted part of a block in place with meflib's AES, as RED_decode() would, and marks it as no longer
+// encrypted
+static void decrypt_red_block_software(ui1 *block, ui1 *key)
+{
+    RED_BLOCK_HEADER *block_header;
+    ui1 *data;
+    si8 i, n;
+    
+    block_header = (RED_BLOCK_HEADER *) block;
+    n = (si8) ((block_header->block_bytes - RED_ENCRYPTION_START_OFFSET) / ENCRYPTION_BLOCK_BYTES);
+    data = block + RED_ENCRYPTION_START_OFFSET;
+    for (i = 0; i < n; i++, data += ENCRYPTION_BLOCK_BYTES)
+        AES_decrypt(data, data, NULL, key);
+    block_header->flags &= ~(RED_LEVEL_1_ENCRYPTION_MASK | RED_LEVEL_2_ENCRYPTION_MASK);
+}
+
+// AES-NI decryption is only built for x86; elsewhere encrypted blocks are always left to meflib's own decryption
+#ifdef READER_X86
+
+// -1: not yet checked, 0: meflib's software AES, 1: AES-NI; see decode_block_hardware_aes().  Set once, under
+// hardware_aes_mutex, by the first decode of an encrypted block; read without the lock.
+static si4 hardware_aes_state = -1;
+static READER_MUTEX hardware_aes_mutex = READER_MUTEX_INITIALIZER;
+
+#ifdef __GNUC__
+#define READER_TARGET_AES   __attribute__((target("aes,sse2")))
+#else
+#define READER_TARGET_AES
+#endif
+
+// nonzero if the processor has the AES instructions, checked once
+static si4 reader_cpu_has_aes(void)
+{
+    static si4 has_aes = -1;
+    si4 has;
+    
+    has = reader_atomic_load(&has_aes);
+    if (has < 0)
+    {
+#if defined(__GNUC__)
+        __builtin_cpu_init();
+        has = __builtin_cpu_supports("aes") ? 1 : 0;
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        has = (info[2] & (1 << 25)) ? 1 : 0;
+#else
+        has = 0;
+#endif
+        reader_atomic_store(&has_aes, has);
+    }
+    
+    return has;
+}
+
+// AES-128 decryption of n 16 byte blocks in place (ECB, as meflib encrypts), with meflib's expanded (encryption) key.
+// The decryption round keys are the encryption ones in reverse, passed through InvMixColumns; four blocks are decrypted
+// at a time to keep the AES unit busy.
+READER_TARGET_AES static void aes_decrypt_blocks_aesni(ui1 *data, si8 n, ui1 *expanded_key)
+{
+    __m128i keys[11], b0, b1, b2, b3;
+    si8 i;
+    si4 r;
+    
+    keys[0] = _mm_loadu_si128((__m128i *) (expanded_key + 160));
+    for (r = 1; r < 10; r++)
+        keys[r] = _mm_aesimc_si128(_mm_loadu_si128((__m128i *) (expanded_key + (16 * (10 - r)))));
+    keys[10] = _mm_loadu_si128((__m128i *) expanded_key);
+    
+    for (i = 0; i + 4 <= n; i += 4, data += 64)
+    {
+        b0 = _mm_xor_si128(_mm_loadu_si128((__m128i *) data), keys[0]);
+        b1 = _mm_xor_si128(_mm_loadu_si128((__m128i *) (data + 16)), keys[0]);
+        b2 = _mm_xor_si128(_mm_loadu_si128((__m128i *) (data + 32)), keys[0]);
+        b3 = _mm_xor_si128(_mm_loadu_si128((__m128i *) (data + 48)), keys[0]);
+        for (r = 1; r < 10; r++)
+        {
+            b0 = _mm_aesdec_si128(b0, keys[r]);
+            b1 = _mm_aesdec_si128(b1, keys[r]);
+            b2 = _mm_aesdec_si128(b2, keys[r]);
+            b3 = _mm_aesdec_si128(b3, keys[r]);
+        }
+        _mm_storeu_si128((__m128i *) data, _mm_aesdeclast_si128(b0, keys[10]));
+        _mm_storeu_si128((__m128i *) (data + 16), _mm_aesdeclast_si128(b1, keys[10]));
+        _mm_storeu_si128((__m128i *) (data + 32), _mm_aesdeclast_si128(b2, keys[10]));
+        _mm_storeu_si128((__m128i *) (data + 48), _mm_aesdeclast_si128(b3, keys[10]));
+    }
+    for (; i < n; i++, data += 16)
+    {
+        b0 = _mm_xor_si128(_mm_loadu_si128((__m128i *) data), keys[0]);
+        for (r = 1; r < 10; r++)
+            b0 = _mm_aesdec_si128(b0, keys[r]);
+        _mm_storeu_si128((__m128i *) data, _mm_aesdeclast_si128(b0, keys[10]));
+    }
+}
+
+// decrypts the encrypted part of a block in place, as RED_decode() would, and marks it as no longer encrypted
+static void decrypt_red_block(ui1 *block, ui1 *key)
+{
+    RED_BLOCK_HEADER *block_header;
+    
+    block_header = (RED_BLOCK_HEADER *) block;
+    aes_decrypt_blocks_aesni(block + RED_ENCRYPTION_START_OFFSET, (si8) ((block_header->block_bytes - RED_ENCRYPTION_START_OFFSET) / ENCRYPTION_BLOCK_BYTES), key);
+    block_header->flags &= ~(RED_LEVEL_1_ENCRYPTION_MASK | RED_LEVEL_2_ENCRYPTION_MASK);
+}
+
+// The check of decode_block_hardware_aes(), called with hardware_aes_mutex held: decodes a copy of the block decrypted
+// with AES-NI, then the block itself with meflib's AES, and compares the samples.  Sets and returns hardware_aes_state,
+// or returns -1, without decoding, if it couldn't allocate the copies.
+static si4 check_hardware_aes(RED_PROCESSING_STRUCT *rps, ui1 *key)
+{
+    RED_PROCESSING_STRUCT check_rps;
+    RED_BLOCK_HEADER *block_header;
+    ui1 *check_block;
+    si4 *check_samples;
+    si4 state;
+    
+    block_header = rps->block_header;
+    check_block = (ui1 *) malloc((size_t) block_header->block_bytes);
+    check_samples = (si4 *) malloc(sizeof(si4) * ((size_t) block_header->number_of_samples + 1));
+    if ((check_block == NULL) || (check_samples == NULL))
+    {
+        free (check_block);
+        free (check_samples);
+        return -1;
+    }
+    memcpy(check_block, rps->compressed_data, (size_t) block_header->block_bytes);
+    decrypt_red_block(check_block, key);
+    check_rps = *rps;
+    check_rps.compressed_data = check_block;
+    check_rps.block_header = (RED_BLOCK_HEADER *) check_block;
+    check_rps.decompressed_ptr = check_rps.decompressed_data = check_samples;
+    RED_decode(&check_rps);
+    
+    RED_decode(rps);
+    state = (memcmp(check_samples, rps->decompressed_data, sizeof(si4) * (size_t) block_header->number_of_samples) == 0) ? 1 : 0;
+    if (state == 0)
+        printf("AES-NI decryption differs from meflib's, using meflib's...");
+    reader_atomic_store(&hardware_aes_state, state);
+    
+    free (check_block);
+    free (check_samples);
+    
+    return state;
+}
+
+// Decodes an encrypted block (set up in rps as decode_block() does), decrypting it with AES-NI where that is available
+// and decoding the decrypted block with decode_red_block().  The first time, the block is decoded both ways and AES-NI is
+// only used from then on if the samples agree, so a mismatch with meflib's layout of the encrypted bytes can only
+// cost speed.  The check is made once, by the first thread to get there; others decoding meanwhile wait for its result.
+// Returns 0, without decoding, if the block should be left to RED_decode().
+static si4 decode_block_hardware_aes(RED_PROCESSING_STRUCT *rps)
+{
+    RED_BLOCK_HEADER *block_header;
+    ui1 *key;
+    si4 state;
+    
+    if (!reader_atomic_load(&hardware_aes_enabled) || !reader_cpu_has_aes())
+        return 0;
+    state = reader_atomic_load(&hardware_aes_state);
+    if (state == 0)
+        return 0;
+    key = block_encryption_key(rps);
+    block_header = rps->block_header;
+    if ((key == NULL) || (block_header->block_bytes < RED_ENCRYPTION_START_OFFSET))
+        return 0;
+    
+    if (state < 0)
+    {
+        reader_mutex_lock(&hardware_aes_mutex);
+        state = reader_atomic_load(&hardware_aes_state);
+        if (state < 0)
+        {
+            state = check_hardware_aes(rps, key);
+            reader_mutex_unlock(&hardware_aes_mutex);
+            return (state >= 0);    // the block is decoded, unless the check couldn't be made
+        }
+        reader_mutex_unlock(&hardware_aes_mutex);
+        if (state == 0)
+            return 0;
+    }
+    
+    decrypt_red_block(rps->compressed_data, key);
+    decode_red_block(rps);
+    
+    return 1;
+}
+
+#else
+
+static si4 decode_block_hardware_aes(RED_PROCESSING_STRUCT *rps)
+{
+    return 0;
+}
+
+#endif  // READER_X86
+
+/**************************  RED decoding  ****************************/
+
+// This module's decoder of RED blocks, which gives the samples RED_decode() gives: the difference bytes are range
+// decoded with the block's symbol counts, the samples rebuilt from the differences and keysamples, then multiplied back
+// by the block's scale factor and retrended if the block was compressed lossily.  Range decoding is serial; the runs of
+// differences between keysamples are summed, and the samples of scaled blocks multiplied back, with SSE2 or, where the
+// processor supports it, AVX2 code, picked at run time.  The scalar versions are the reference the others agree with.
+
+#define RED_DECODE_BOTTOM_VALUE     ((ui4) 0x00800000)
+#define RED_DECODE_EXTRA_BITS       7
+#define RED_DECODE_KEYSAMPLE_FLAG   0x80        // difference byte (-128) marking a keysample, whose si4 value follows
+
+#define RED_BLOCK_KIND_LOSSLESS     0
+#define RED_BLOCK_KIND_TRANSFORMED  1           // scaled or detrended
+#define RED_BLOCK_KINDS             2
+
+static si4 module_red_decode_enabled = 1;
+
+// per kind of block: -1 not yet checked, 0 RED_decode(), 1 this module's decoder; see decode_red_block().  Set once
+// for each kind, under red_decode_mutex, by the first decode of a block of that kind; read without the lock.
+static si4 red_decode_state[RED_BLOCK_KINDS] = { -1, -1 };
+static READER_MUTEX red_decode_mutex = READER_MUTEX_INITIALIZER;
+
+void set_read_mef_ts_data_red_decode(si4 enabled)
+{
+    reader_atomic_store(&module_red_decode_enabled, enabled);
+}
+
+static si4 red_block_kind(RED_BLOCK_HEADER *block_header)
+{
+    if ((block_header->scale_factor > (sf4) 1.0) || (block_header->detrend_slope != (sf4) 0.0) || (block_header->detrend_intercept != (sf4) 0.0))
+        return RED_BLOCK_KIND_TRANSFORMED;
+    
+    return RED_BLOCK_KIND_LOSSLESS;
+}
+
+// Range decodes n difference bytes from a block (Schindler's coder, as meflib encodes it: a header byte, then the
+// coded bytes).  Bytes past the end of the block are read as zeros, so a corrupt block can't make it read further.
+static void red_range_decode(RED_BLOCK_HEADER *block_header, ui1 *differences, si8 n)
+{
+    ui4 cnts[256], cum_cnts[257], total, low, range, help, cc, tmp;
+    ui1 *in, *in_end, buffer;
+    si4 i, lo, hi, mid;
+    si8 k;
+    
+    cum_cnts[0] = 0;
+    for (i = 0; i < 256; i++)
+    {
+        cnts[i] = block_header->statistics[i];
+        cum_cnts[i + 1] = cum_cnts[i] + cnts[i];
+    }
+    total = cum_cnts[256];
+    if (total == 0)
+    {
+        memset(differences, 0, (size_t) n);
+        return;
+    }
+    
+    in = (ui1 *) block_header + RED_BLOCK_HEADER_BYTES + 1;     // past the header byte
+    in_end = (ui1 *) block_header + block_header->block_bytes;
+    buffer = (in < in_end) ? *in++ : 0;
+    low = (ui4) buffer >> (8 - RED_DECODE_EXTRA_BITS);
+    range = (ui4) 1 << RED_DECODE_EXTRA_BITS;
+    for (k = 0; k < n; k++)
+    {
+        while (range <= RED_DECODE_BOTTOM_VALUE)
+        {
+            low = (low << 8) | (((ui4) buffer << RED_DECODE_EXTRA_BITS) & 0xFF);
+            buffer = (in < in_end) ? *in++ : 0;
+            low |= (ui4) buffer >> (8 - RED_DECODE_EXTRA_BITS);
+            range <<= 8;
+        }
+        help = range / total;
+        cc = low / help;
+        if (cc >= total)
+            cc = total - 1;
+        
+        // the symbol is the last whose cumulative count is <= cc (symbols that never occur share theirs with the next)
+        lo = 0;
+        hi = 255;
+        while (lo < hi)
+        {
+            mid = (lo + hi + 1) >> 1;
+            if (cum_cnts[mid] <= cc)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        tmp = help * cum_cnts[lo];
+        low -= tmp;
+        range = ((cum_cnts[lo] + cnts[lo]) < total) ? help * cnts[lo] : range - tmp;
+        differences[k] = (ui1) lo;
+    }
+}
+
+// Sums a run of n differences onto value, writing each sample, and returns the last.  Sums wrap as the vector
+// versions' do.
+static si4 red_sum_differences_scalar(si1 *differences, si8 n, si4 *samples, si4 value)
+{
+    ui4 sum;
+    si8 i;
+    
+    sum = (ui4) value;
+    for (i = 0; i < n; i++)
+    {
+        sum += (ui4) (si4) differences[i];
+        samples[i] = (si4) sum;
+    }
+    
+    return (si4) sum;
+}
+
+// Multiplies n samples by a block's scale factor, rounding halves away from zero.
+static void red_unscale_scalar(si4 *samples, si8 n, sf8 scale_factor)
+{
+    sf8 value;
+    si8 i;
+    
+    for (i = 0; i < n; i++)
+    {
+        value = (sf8) samples[i] * scale_factor;
+        samples[i] = (si4) ((value >= 0.0) ? value + 0.5 : value - 0.5);
+    }
+}
+
+#ifdef READER_X86
+READER_TARGET_AVX2 static si4 red_sum_differences_avx2(si1 *differences, si8 n, si4 *samples, si4 value)
+{
+    __m256i carry, last, x;
+    si8 i;
+    
+    carry = _mm256_set1_epi32(value);
+    last = _mm256_set1_epi32(7);
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        // prefix sums of 8 differences: within each 128 bit lane, then the low lane's total added to the high lane
+        x = _mm256_cvtepi8_epi32(_mm_loadl_epi64((__m128i *) (differences + i)));
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+        x = _mm256_add_epi32(x, _mm256_permute2x128_si256(_mm256_shuffle_epi32(x, 0xFF), x, 0x08));
+        x = _mm256_add_epi32(x, carry);
+        _mm256_storeu_si256((__m256i *) (samples + i), x);
+        carry = _mm256_permutevar8x32_epi32(x, last);
+    }
+    
+    return red_sum_differences_scalar(differences + i, n - i, samples + i, _mm_cvtsi128_si32(_mm256_castsi256_si128(carry)));
+}
+
+READER_TARGET_AVX2 static void red_unscale_avx2(si4 *samples, si8 n, sf8 scale_factor)
+{
+    __m256d scale, half, sign, value;
+    si8 i;
+    
+    scale = _mm256_set1_pd(scale_factor);
+    half = _mm256_set1_pd(0.5);
+    sign = _mm256_set1_pd(-0.0);
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        value = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((__m128i *) (samples + i))), scale);
+        value = _mm256_add_pd(value, _mm256_or_pd(_mm256_and_pd(value, sign), half));
+        _mm_storeu_si128((__m128i *) (samples + i), _mm256_cvttpd_epi32(value));
+    }
+    red_unscale_scalar(samples + i, n - i, scale_factor);
+}
+
+// prefix sums of four differences (sign extended to 32 bits) onto carry, which is left holding the last
+static __m128i red_sum_four_sse2(__m128i x, __m128i *carry)
+{
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+    x = _mm_add_epi32(x, *carry);
+    *carry = _mm_shuffle_epi32(x, 0xFF);
+    
+    return x;
+}
+
+static si4 red_sum_differences_sse2(si1 *differences, si8 n, si4 *samples, si4 value)
+{
+    __m128i carry, bytes, lo, hi;
+    si8 i;
+    
+    carry = _mm_set1_epi32(value);
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        // sign extension: each byte paired with itself, then shifted arithmetically back down
+        bytes = _mm_loadu_si128((__m128i *) (differences + i));
+        lo = _mm_unpacklo_epi8(bytes, bytes);
+        hi = _mm_unpackhi_epi8(bytes, bytes);
+        _mm_storeu_si128((__m128i *) (samples + i), red_sum_four_sse2(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 24), &carry));
+        _mm_storeu_si128((__m128i *) (samples + i + 4), red_sum_four_sse2(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 24), &carry));
+        _mm_storeu_si128((__m128i *) (samples + i + 8), red_sum_four_sse2(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 24), &carry));
+        _mm_storeu_si128((__m128i *) (samples + i + 12), red_sum_four_sse2(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 24), &carry));
+    }
+    
+    return red_sum_differences_scalar(differences + i, n - i, samples + i, _mm_cvtsi128_si32(carry));
+}
+
+static void red_unscale_sse2(si4 *samples, si8 n, sf8 scale_factor)
+{
+    __m128d scale, half, sign, lo, hi;
+    __m128i x;
+    si8 i;
+    
+    scale = _mm_set1_pd(scale_factor);
+    half = _mm_set1_pd(0.5);
+    sign = _mm_set1_pd(-0.0);
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        x = _mm_loadu_si128((__m128i *) (samples + i));
+        lo = _mm_mul_pd(_mm_cvtepi32_pd(x), scale);
+        hi = _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(x, 8)), scale);
+        lo = _mm_add_pd(lo, _mm_or_pd(_mm_and_pd(lo, sign), half));
+        hi = _mm_add_pd(hi, _mm_or_pd(_mm_and_pd(hi, sign), half));
+        _mm_storeu_si128((__m128i *) (samples + i), _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi)));
+    }
+    red_unscale_scalar(samples + i, n - i, scale_factor);
+}
+#endif
+
+static si4 red_sum_differences(si1 *differences, si8 n, si4 *samples, si4 value)
+{
+#ifdef READER_X86
+    if (reader_cpu_has_avx2())
+        return red_sum_differences_avx2(differences, n, samples, value);
+    return red_sum_differences_sse2(differences, n, samples, value);
+#else
+    return red_sum_differences_scalar(differences, n, samples, value);
+#endif
+}
+
+static void red_unscale(si4 *samples, si8 n, sf8 scale_factor)
+{
+#ifdef READER_X86
+    if (reader_cpu_has_avx2())
+        red_unscale_avx2(samples, n, scale_factor);
+    else
+        red_unscale_sse2(samples, n, scale_factor);
+#else
+    red_unscale_scalar(samples, n, scale_factor);
+#endif
+}
+
+// Adds back a block's trend line (intercept at its first sample), rounding halves away from zero.  The line is
+// accumulated sample by sample, so this stays scalar.
+static void red_retrend(si4 *samples, si8 n, sf8 slope, sf8 intercept)
+{
+    sf8 mx_plus_b, value;
+    si8 i;
+    
+    mx_plus_b = intercept;
+    for (i = 0; i < n; i++)
+    {
+        value = (sf8) samples[i] + mx_plus_b;
+        samples[i] = (si4) ((value >= 0.0) ? value + 0.5 : value - 0.5);
+        mx_plus_b += slope;
+    }
+}
+
+// Rebuilds n samples from n_differences difference bytes: a keysample flag is followed by the sample itself, any other
+// byte is the difference from the previous sample.  Runs between keysamples are found with memchr() and summed as a
+// whole.  If the differences run out (a corrupt block), the rest of the samples repeat the last one.
+static void red_reconstruct(si1 *differences, si8 n_differences, si4 *samples, si8 n)
+{
+    si1 *p, *end, *flag;
+    si4 value;
+    si8 i, run;
+    
+    p = differences;
+    end = differences + n_differences;
+    value = 0;
+    i = 0;
+    while ((i < n) && (p < end))
+    {
+        if ((ui1) *p == RED_DECODE_KEYSAMPLE_FLAG)
+        {
+            if (end - p < 1 + (si8) sizeof(si4))
+                break;
+            memcpy(&value, p + 1, sizeof(si4));
+            samples[i++] = value;
+            p += 1 + sizeof(si4);
+            continue;
+        }
+        flag = (si1 *) memchr(p, RED_DECODE_KEYSAMPLE_FLAG, (size_t) (end - p));
+        run = ((flag != NULL) ? flag : end) - p;
+        if (run > n - i)
+            run = n - i;
+        value = red_sum_differences(p, run, samples + i, value);
+        p += run;
+        i += run;
+    }
+    for (; i < n; i++)
+        samples[i] = value;
+}
+
+// Decodes an unencrypted block, set up in rps as decode_block() does, with this module's decoder.  Like RED_decode(),
+// it removes the recording time offset from the header start time.
+static void red_decode_unencrypted(RED_PROCESSING_STRUCT *rps)
+{
+    RED_BLOCK_HEADER *block_header;
+    si8 n_differences;
+    
+    block_header = rps->block_header;
+    n_differences = (si8) block_header->difference_bytes;
+    if (n_differences > (si8) RED_MAX_DIFFERENCE_BYTES(block_header->number_of_samples))
+        n_differences = (si8) RED_MAX_DIFFERENCE_BYTES(block_header->number_of_samples);
+    
+    red_range_decode(block_header, (ui1 *) rps->difference_buffer, n_differences);
+    red_reconstruct(rps->difference_buffer, n_differences, rps->decompressed_ptr, (si8) block_header->number_of_samples);
+    if (block_header->scale_factor > (sf4) 1.0)
+        red_unscale(rps->decompressed_ptr, (si8) block_header->number_of_samples, (sf8) block_header->scale_factor);
+    if ((block_header->detrend_slope != (sf4) 0.0) || (block_header->detrend_intercept != (sf4) 0.0))
+        red_retrend(rps->decompressed_ptr, (si8) block_header->number_of_samples, (sf8) block_header->detrend_slope, (sf8) block_header->detrend_intercept);
+    
+    remove_recording_time_offset(&block_header->start_time);
+}
+
+// The check of decode_red_block(), called with red_decode_mutex held: decodes a copy of the block with this module's
+// decoder, then the block itself with RED_decode(), and compares the samples and header start times.  Sets and returns
+// the state of the block's kind, or returns -1, without decoding, if it couldn't allocate the copies.
+static si4 check_red_decode(RED_PROCESSING_STRUCT *rps, si4 kind)
+{
+    RED_PROCESSING_STRUCT check_rps;
+    RED_BLOCK_HEADER *block_header;
+    ui1 *check_block;
+    si4 *check_samples;
+    si4 state;
+    
+    block_header = rps->block_header;
+    check_block = (ui1 *) malloc((size_t) block_header->block_bytes);
+    check_samples = (si4 *) malloc(sizeof(si4) * ((size_t) block_header->number_of_samples + 1));
+    if ((check_block == NULL) || (check_samples == NULL))
+    {
+        free (check_block);
+        free (check_samples);
+        return -1;
+    }
+    memcpy(check_block, rps->compressed_data, (size_t) block_header->block_bytes);
+    check_rps = *rps;
+    check_rps.compressed_data = check_block;
+    check_rps.block_header = (RED_BLOCK_HEADER *) check_block;
+    check_rps.decompressed_ptr = check_rps.decompressed_data = check_samples;
+    red_decode_unencrypted(&check_rps);
+    
+    RED_decode(rps);
+    state = ((memcmp(check_samples, rps->decompressed_ptr, sizeof(si4) * (size_t) block_header->number_of_samples) == 0) &&
+             (check_rps.block_header->start_time == block_header->start_time)) ? 1 : 0;
+    if (state == 0)
+        printf("RED decoding differs from meflib's, using meflib's...");
+    reader_atomic_store(&red_decode_state[kind], state);
+    
+    free (check_block);
+    free (check_samples);
+    
+    return state;
+}
+
+// Decodes a block (set up in rps as decode_block() does) with this module's decoder, or with RED_decode() if that is
+// turned off, or the block is still encrypted.  The first block of each kind (lossless, or scaled or detrended) is
+// decoded both ways, and this module's decoder is only used for the kind from then on if the results agree, so a
+// difference from meflib's decoding can only cost speed.  As with AES-NI, the check is made once, by the first thread
+// to get there; others decoding meanwhile wait for its result.
+static void decode_red_block(RED_PROCESSING_STRUCT *rps)
+{
+    si4 kind, state;
+    
+    if (!reader_atomic_load(&module_red_decode_enabled) || (rps->block_header->flags & (RED_LEVEL_1_ENCRYPTION_MASK | RED_LEVEL_2_ENCRYPTION_MASK)))
+    {
+        RED_decode(rps);
+        return;
+    }
+    kind = red_block_kind(rps->block_header);
+    state = reader_atomic_load(&red_decode_state[kind]);
+    if (state < 0)
+    {
+        reader_mutex_lock(&red_decode_mutex);
+        state = reader_atomic_load(&red_decode_state[kind]);
+        if (state < 0)
+        {
+            state = check_red_decode(rps, kind);
+            reader_mutex_unlock(&red_decode_mutex);
+            if (state < 0)      // the check couldn't be made
+                RED_decode(rps);
+            return;
+        }
+        reader_mutex_unlock(&red_decode_mutex);
+    }
+    
+    if (state == 0)
+        RED_decode(rps);
+    else
+        red_decode_unencrypted(rps);
+}
+
+// This module's decoder on its own, without the check against RED_decode() reads make: decodes the block at
+// rps->compressed_data into rps->decompressed_ptr as RED_decode() does.  An encrypted block is first decrypted in
+// place with meflib's AES.  Returns 0, without decoding, if rps->password_data doesn't give access to it.
+si4 red_decode_block(RED_PROCESSING_STRUCT *rps)
+{
+    ui1 *key;
+    
+    rps->block_header = (RED_BLOCK_HEADER *) rps->compressed_data;
+    if (rps->block_header->flags & (RED_LEVEL_1_ENCRYPTION_MASK | RED_LEVEL_2_ENCRYPTION_MASK))
+    {
+        key = block_encryption_key(rps);
+        if ((key == NULL) || (rps->block_header->block_bytes < RED_ENCRYPTION_START_OFFSET))
+            return 0;
+        decrypt_red_block_software(rps->compressed_data, key);
+    }
+    red_decode_unencrypted(rps);
+    
+    return 1;
+}
+
+/**************************  Read statistics  ****************************/
+
+void initialize_read_mef_ts_stats(READ_MEF_TS_STATS *stats)
+{
+    memset(stats, 0, sizeof(READ_MEF_TS_STATS));
+}
+
+const si1 *read_mef_ts_stage_name(si4 stage)
+{
+    switch (stage)
+    {
+        case READ_STAGE_OPEN:
+            return "open";
+        case READ_STAGE_INDEX:
+            return "index";
+        case READ_STAGE_IO:
+            return "io";
+        case READ_STAGE_DECODE:
+            return "decode";
+        case READ_STAGE_READ:
+            return "read";
+    }
+    
+    return "unknown";
+}
+
+// monotonic clock, in seconds from an arbitrary start
+static sf8 reader_clock(void)
+{
+#ifndef _WIN32
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return (sf8) now.tv_sec + ((sf8) now.tv_nsec * 1.0e-9);
+#else
+    static LARGE_INTEGER frequency = {0};
+    LARGE_INTEGER now;
+    
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    
+    return (sf8) now.QuadPart / (sf8) frequency.QuadPart;
+#endif
+}
+
+// adds the time since start to stage, passes the span to the trace callback, and returns the time the stage ended
+static sf8 end_read_stage(READ_MEF_TS_STATS *stats, si4 stage, sf8 start)
+{
+    sf8 end;
+    
+    end = reader_clock();
+    stats->stage_seconds[stage] += end - start;
+    if (stats->trace != NULL)
+        (*stats->trace)(stats->trace_user_data, stage, start, end);
+    
+    return end;
+}
+
+static void add_decode_times(READ_MEF_TS_STATS *stats, DECODE_TIMES *times)
+{
+    stats->blocks_decoded += times->blocks_decoded;
+    stats->blocks_crc_checked += times->blocks_crc_checked;
+    stats->crc_seconds += times->crc_seconds;
+    stats->decode_seconds += times->decode_seconds;
+}
+
+/**************************  Block CRC  ****************************/
+
+// Block CRCs are computed with slicing-by-16 tables here rather than byte at a time.  The tables are built once, on
+// first use, for meflib's CRC (CRC_POLYNOMIAL, reflected, starting from CRC_START_VALUE), and checked against
+// CRC_calculate() on a fixed buffer before they are used; if they differ, or on big endian hosts, CRC_validate() is
+// used instead.
+
+#define CRC_CHECK_BYTES     1031    // not a multiple of 16, so the byte at a time tail is checked too
+
+static si4 read_mef_ts_data_crc_policy = READ_CRC_ALWAYS;
+
+static ui4 block_crc_tables[16][256];
+static si4 block_crc_tables_state = 0;     // 0 not built yet, 1 in use, -1 CRC_validate() is used
+static READER_MUTEX block_crc_mutex = READER_MUTEX_INITIALIZER;
+
+// Sets whether block CRCs are checked every time a block is read (READ_CRC_ALWAYS, the default), only the first time
+// each block of a channel is read (READ_CRC_ONCE, until release_channel_reader_state()), or never (READ_CRC_SKIP).
+void set_read_mef_ts_data_crc_policy(si4 crc_policy)
+{
+    if ((crc_policy != READ_CRC_ONCE) && (crc_policy != READ_CRC_SKIP))
+        crc_policy = READ_CRC_ALWAYS;
+    
+    read_mef_ts_data_crc_policy = crc_policy;
+}
+
+si4 get_read_mef_ts_data_crc_policy(void)
+{
+    return read_mef_ts_data_crc_policy;
+}
+
+static ui4 block_crc_update(ui4 crc, ui1 *data, si8 bytes)
+{
+    ui4 w0, w1, w2, w3;
+    
+    while (bytes >= 16)
+    {
+        memcpy(&w0, data, 4);
+        memcpy(&w1, data + 4, 4);
+        memcpy(&w2, data + 8, 4);
+        memcpy(&w3, data + 12, 4);
+        w0 ^= crc;
+        crc = block_crc_tables[15][w0 & 0xff] ^ block_crc_tables[14][(w0 >> 8) & 0xff] ^
+              block_crc_tables[13][(w0 >> 16) & 0xff] ^ block_crc_tables[12][w0 >> 24] ^
+              block_crc_tables[11][w1 & 0xff] ^ block_crc_tables[10][(w1 >> 8) & 0xff] ^
+              block_crc_tables[9][(w1 >> 16) & 0xff] ^ block_crc_tables[8][w1 >> 24] ^
+              block_crc_tables[7][w2 & 0xff] ^ block_crc_tables[6][(w2 >> 8) & 0xff] ^
+              block_crc_tables[5][(w2 >> 16) & 0xff] ^ block_crc_tables[4][w2 >> 24] ^
+              block_crc_tables[3][w3 & 0xff] ^ block_crc_tables[2][(w3 >> 8) & 0xff] ^
+              block_crc_tables[1][(w3 >> 16) & 0xff] ^ block_crc_tables[0][w3 >> 24];
+        data += 16;
+        bytes -= 16;
+    }
+    while (bytes-- > 0)
+        crc = block_crc_tables[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    
+    return crc;
+}
+
+
+// builds the tables for a (reflected) polynomial
+static void build_block_crc_tables(ui4 polynomial)
+{
+    ui4 c;
+    si4 i, j;
+    
+    for (i = 0; i < 256; i++)
+    {
+        c = (ui4) i;
+        for (j = 0; j < 8; j++)
+            c = (c & 1) ? ((c >> 1) ^ polynomial) : (c >> 1);
+        block_crc_tables[0][i] = c;
+    }
+    for (i = 0; i < 256; i++)
+        for (j = 1; j < 16; j++)
+            block_crc_tables[j][i] = (block_crc_tables[j - 1][i] >> 8) ^ block_crc_tables[0][block_crc_tables[j - 1][i] & 0xff];
+}
+
+// builds the CRC tables on first use (once, under block_crc_mutex), returns nonzero if they can be used
+static si4 block_crc_tables_ready(void)
+{
+    ui1 check[CRC_CHECK_BYTES];
+    ui4 one, random;
+    si4 state, i;
+    
+    state = (si4) reader_atomic_load(&block_crc_tables_state);
+    if (state != 0)
+        return (state > 0);
+    
+    reader_mutex_lock(&block_crc_mutex);
+    state = block_crc_tables_state;
+    if (state == 0)
+    {
+        // the tables read the data a word at a time, little endian
+        one = 1;
+        state = -1;
+        if (*((ui1 *) &one) == 1)
+        {
+            build_block_crc_tables(CRC_POLYNOMIAL);
+            
+            // the tables must give meflib's CRC exactly, whatever its start value or final step
+            random = 1;
+            for (i = 0; i < CRC_CHECK_BYTES; i++)
+            {
+                random = (random * 1103515245) + 12345;
+                check[i] = (ui1) (random >> 16);
+            }
+            if (block_crc_update(CRC_START_VALUE, check, CRC_CHECK_BYTES) == CRC_calculate(check, CRC_CHECK_BYTES))
+                state = 1;
+            else
+                printf("Table CRC differs from meflib's, using meflib's...");
+        }
+        reader_atomic_store(&block_crc_tables_state, state);
+    }
+    reader_mutex_unlock(&block_crc_mutex);
+    
+    return (state > 0);
+}
+
+// CRC of a block (from just past its CRC field), as CRC_calculate() computes it
+ui4 calculate_block_crc(ui1 *data, si8 bytes)
+{
+    if (!block_crc_tables_ready())
+        return CRC_calculate(data, bytes);
+    
+    return block_crc_update(CRC_START_VALUE, data, bytes);
+}
+
+// looks up a channel's verified block bitmap (READ_CRC_ONCE) for verified, creating it if needed (sized for the
+// channel's block index, and at least block + 1 bits); verified->bits is NULL if it couldn't be created
+static void find_verified_blocks(CHANNEL *channel, si8 block, VERIFIED_BLOCKS *verified)
+{
+    READER_CHANNEL_STATE *state;
+    si8 n_bits;
+    
+    verified->channel = channel;
+    verified->bits = NULL;
+    verified->n_bits = 0;
+    
+    reader_mutex_lock(&reader_channel_states_mutex);
+    state = find_reader_channel_state(channel, 1);
+    if (state != NULL)
+    {
+        if (state->verified_blocks == NULL)
+        {
+            n_bits = (state->block_index != NULL) ? state->block_index->number_of_blocks : 0;
+            if (n_bits <= block)
+                n_bits = block + 1;
+            state->verified_blocks = (ui1 *) calloc((size_t) ((n_bits + 7) >> 3), sizeof(ui1));
+            state->number_of_verified_bits = (state->verified_blocks == NULL) ? 0 : n_bits;
+        }
+        verified->bits = state->verified_blocks;
+        verified->n_bits = state->number_of_verified_bits;
+    }
+    reader_mutex_unlock(&reader_channel_states_mutex);
+}
+
+/**************************  Other helper functions  ****************************/
+
+si8 sample_for_uutc_c(si8 uutc, CHANNEL *channel)
+{
+    ui8 sample;
+    sf8 native_samp_freq;
+    ui8 prev_sample_number;
+    si8 prev_time;
+    si8 next_sample_number;
+    si8 k;
+    CHANNEL_BLOCK_INDEX *index;
+    
+    index = get_channel_block_index(channel);
+    if (index == NULL)
+    {
+        printf("Could not index channel, exiting...");
+        return -1;
+    }
+    native_samp_freq = channel->metadata.time_series_section_2->sampling_frequency;
+    
+    // find the first block starting after uutc; sample is interpolated from the block before it
+    k = block_index_first_after_time(index, 0, index->number_of_blocks, uutc, MEF_FALSE);
+    if (k == 0)
+    {
+        prev_sample_number = channel->segments[0].metadata_fps->metadata.time_series_section_2->start_sample;
+        prev_time = channel->segments[0].time_series_indices_fps->time_series_indices[0].start_time;
+    }
+    else
+    {
+        prev_sample_number = index->start_sample[k - 1];
+        prev_time = index->start_time[k - 1];
+    }
+    
+    // if we go all the way to the end of the last segment, don't go past its end
+    if (k < index->number_of_blocks)
+        next_sample_number = index->start_sample[k];
+    else
+        next_sample_number = index->end_sample;
+    
+    sample = prev_sample_number + (ui8) (((((sf8) (uutc - prev_time)) / 1000000.0) * native_samp_freq) + 0.5);
+    if (sample > (ui8) next_sample_number)
+        sample = next_sample_number;  // prevent it from going too far
+    
+    return(sample);
+}
+
+si8 uutc_for_sample_c(si8 sample, CHANNEL *channel)
+{
+    ui8 uutc;
+    sf8 native_samp_freq;
+    ui8 prev_sample_number; 
+    si8 prev_time;
+    si8 k;
+    CHANNEL_BLOCK_INDEX *index;
+    
+    index = get_channel_block_index(channel);
+    if (index == NULL)
+    {
+        printf("Could not index channel, exiting...");
+        return UUTC_NO_ENTRY;
+    }
+    native_samp_freq = channel->metadata.time_series_section_2->sampling_frequency;
+    
+    // find the first block starting after sample; time is interpolated from the block before it
+    k = block_index_first_after_sample(index, sample);
+    if (k == 0)
+    {
+        prev_sample_number = channel->segments[0].metadata_fps->metadata.time_series_section_2->start_sample;
+        prev_time = channel->segments[0].time_series_indices_fps->time_series_indices[0].start_time;
+    }
+    else
+    {
+        prev_sample_number = index->start_sample[k - 1];
+        prev_time = index->start_time[k - 1];
+    }
+    
+    uutc = prev_time + (ui8) ((((sf8) (sample - prev_sample_number) / native_samp_freq) * 1000000.0) + 0.5);
+    
+    return(uutc);
+}
+
+#ifdef READER_X86
+READER_TARGET_AVX2 static void memset_int_avx2(si4 *ptr, si4 value, size_t num)
+{
+    __m256i v;
+    size_t i;
+    
+    v = _mm256_set1_epi32(value);
+    for (i = 0; i + 8 <= num; i += 8)
+        _mm256_storeu_si256((__m256i *) (ptr + i), v);
+    for (; i < num; i++)
+        ptr[i] = value;
+}
+
+static void memset_int_sse2(si4 *ptr, si4 value, size_t num)
+{
+    __m128i v;
+    size_t i;
+    
+    v = _mm_set1_epi32(value);
+    for (i = 0; i + 4 <= num; i += 4)
+        _mm_storeu_si128((__m128i *) (ptr + i), v);
+    for (; i < num; i++)
+        ptr[i] = value;
+}
+#endif
+
+// sets num si4's to value (used for NaN filling), with wide stores where the processor has them
+void memset_int(si4 *ptr, si4 value, size_t num)
+{
+#ifndef READER_X86
+    size_t i;
+#endif
+    
+    if (num < 1)
+        return;
+    
+#ifdef READER_X86
+    if (reader_cpu_has_avx2())
+        memset_int_avx2(ptr, value, num);
+    else
+        memset_int_sse2(ptr, value, num);
+#else
+    for (i = 0; i < num; i++)
+        ptr[i] = value;
+#endif
+}
+
+// returns a segment's open .tdat file, opening it if needed.  Opening is locked, so threads sharing a channel don't
+// both open the file.
+static FILE *segment_data_fp(CHANNEL *channel, si4 segment)
+{
+    FILE *fp;
+    
+    reader_mutex_lock(&reader_channel_states_mutex);
+    if (channel->segments[segment].time_series_data_fps->fp == NULL)
+        channel->segments[segment].time_series_data_fps->fp = fopen(channel->segments[segment].time_series_data_fps->full_file_name, "rb");
+    fp = channel->segments[segment].time_series_data_fps->fp;
+    reader_mutex_unlock(&reader_channel_states_mutex);
+    
+    return fp;
+}
+
+// reads bytes from a segment's .tdat file at offset into buffer, opening the file if needed.  Returns 1 on success.
+si4 read_segment_data(CHANNEL *channel, si4 segment, si8 offset, ui8 bytes, ui1 *buffer)
+{
+    FILE *fp;
+    ui8 n_read;
+#ifndef _WIN32
+    ssize_t n;
+#endif
+    
+    fp = segment_data_fp(channel, segment);
+    if (fp == NULL)
+        return 0;
+    
+#ifndef _WIN32
+    // pread() doesn't move the file position, so concurrent reads of the same file are safe
+    n_read = 0;
+    while (n_read < bytes)
+    {
+        n = pread(fileno(fp), buffer + n_read, (size_t) (bytes - n_read), (off_t) (offset + n_read));
+        if (n <= 0)
+            break;
+        n_read += (ui8) n;
+    }
+#else
+    reader_mutex_lock(&reader_channel_states_mutex);
+    _fseeki64(fp, offset, SEEK_SET);
+    n_read = fread(buffer, sizeof(si1), (size_t) bytes, fp);
+    reader_mutex_unlock(&reader_channel_states_mutex);
+#endif
+    
+    return (n_read == bytes);
+}
+
+// tells the OS a range of a segment's .tdat file will be read soon, so it can start reading it in the background
+void advise_segment_data(CHANNEL *channel, si4 segment, si8 offset, ui8 bytes)
+{
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    FILE *fp;
+    
+    fp = segment_data_fp(channel, segment);
+    if (fp != NULL)
+        posix_fadvise(fileno(fp), (off_t) offset, (off_t) bytes, POSIX_FADV_WILLNEED);
+#endif
+}
+
+si4 check_block_crc(ui1* block_hdr_ptr, ui4 max_samps, ui1* total_data_ptr, ui8 total_data_bytes)
+{
+    si1 CRC_valid;
+    RED_BLOCK_HEADER* block_header;
+    
+    if (!check_block_bounds(block_hdr_ptr, max_samps, total_data_ptr, total_data_bytes))
+        return 0;
+    
+    block_header = (RED_BLOCK_HEADER*) block_hdr_ptr;
+    
+    // at this point we know we have enough data to actually run the CRC calculation, so do it
+    CRC_valid = (calculate_block_crc((ui1*) block_header + CRC_BYTES, block_header->block_bytes - CRC_BYTES) == block_header->block_CRC) ? MEF_TRUE : MEF_FALSE;
+    
+    // return output of CRC heck
+    if (CRC_valid == MEF_TRUE)
+        return 1;
+    else
+        return 0;
+}
+
+// Checks a block's bounds and, depending on the CRC policy, its CRC.  block is the block's channel block number, used to
+// remember verified blocks with READ_CRC_ONCE.  channel may be NULL, in which case the CRC is always checked.
+si4 check_channel_block_crc(CHANNEL *channel, si8 block, ui1* block_hdr_ptr, ui4 max_samps, ui1* total_data_ptr, ui8 total_data_bytes)
+{
+    return channel_block_crc(channel, block, block_hdr_ptr, max_samps, total_data_ptr, total_data_bytes, NULL, NULL);
+}
+
+// check_channel_block_crc(), with the channel's verified bitmap from verified (looked up on first use, see
+// VERIFIED_BLOCKS; NULL to look it up for this block only), and setting *computed (if not NULL) to whether the CRC was
+// calculated
+static si4 channel_block_crc(CHANNEL *channel, si8 block, ui1* block_hdr_ptr, ui4 max_samps, ui1* total_data_ptr, ui8 total_data_bytes,
+                             VERIFIED_BLOCKS *verified, si4 *computed)
+{
+    VERIFIED_BLOCKS local_verified;
+    si4 policy;
+    ui1 bit;
+    
+    policy = (channel == NULL) ? READ_CRC_ALWAYS : read_mef_ts_data_crc_policy;
+    
+    if (computed != NULL)
+        *computed = 0;
+    if (policy == READ_CRC_SKIP)
+        return check_block_bounds(block_hdr_ptr, max_samps, total_data_ptr, total_data_bytes);
+    
+    // blocks past the bitmap (appended since it was created) are checked every time
+    bit = 0;
+    if ((policy == READ_CRC_ONCE) && (block >= 0))
+    {
+        if (verified == NULL)
+        {
+            local_verified.channel = NULL;
+            verified = &local_verified;
+        }
+        if (verified->channel != channel)
+            find_verified_blocks(channel, block, verified);
+        if (block < verified->n_bits)
+        {
+            bit = (ui1) (1 << (block & 7));
+            if (reader_atomic_load_byte(&verified->bits[block >> 3]) & bit)
+                return check_block_bounds(block_hdr_ptr, max_samps, total_data_ptr, total_data_bytes);
+        }
+    }
+    
+    if (computed != NULL)
+        *computed = 1;
+    if (!check_block_crc(block_hdr_ptr, max_samps, total_data_ptr, total_data_bytes))
+        return 0;
+    
+    if (bit)
+        (void) reader_atomic_or_byte(&verified->bits[block >> 3], bit);
+    
+    return 1;
+}
+
+// Checks that the block header, and the block it describes, lie within the data buffer, and that the block holds at most
+// max_samps samples.  Cheap, only reads the header; done under every CRC policy.
+si4 check_block_bounds(ui1* block_hdr_ptr, ui4 max_samps, ui1* total_data_ptr, ui8 total_data_bytes)
+{
+    ui8 offset_into_data, remaining_buf_size;
+    RED_BLOCK_HEADER* block_header;
+    
+    offset_into_data = block_hdr_ptr - total_data_ptr;
+    remaining_buf_size = total_data_bytes - offset_into_data;
+    
+    // check if remaining buffer at least contains the RED block header
+    if (remaining_buf_size < RED_BLOCK_HEADER_BYTES)
+        return 0;
+    
+    block_header = (RED_BLOCK_HEADER*) block_hdr_ptr;
+    
+    // check if entire block, based on size specified in header, can possibly fit in the remaining buffer
+    if (block_header->block_bytes > remaining_buf_size)
+        return 0;
+    
+    // check if size specified in header is absurdly large
+    if (block_header->block_bytes > RED_MAX_COMPRESSED_BYTES(max_samps, 1))
+        return 0;
+    
+    // sample buffers are sized for max_samps, so a block claiming more would be decoded past their end
+    if (block_header->number_of_samples > max_samps)
+        return 0;
+    
+    return 1;
+}
+
+si4 get_number_of_processors(void)
+{
+    si4 n_procs;
+    
+#ifndef _WIN32
+    n_procs = (si4) sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    SYSTEM_INFO sys_info;
+    
+    GetSystemInfo(&sys_info);
+    n_procs = (si4) sys_info.dwNumberOfProcessors;
+#endif
+    if (n_procs < 1)
+        n_procs = 1;
+    
+    return n_procs;
+}
+
+/**************************  Channel block index  ****************************/
+
+// Builds the flattened index of every block in the channel.  This is the only place the per-segment index arrays are
+// walked in full; all other lookups binary search this (or compute directly, for regular channels).
+CHANNEL_BLOCK_INDEX *build_channel_block_index(CHANNEL *channel)
+{
+    CHANNEL_BLOCK_INDEX *index;
+    TIME_SERIES_METADATA_SECTION_2 *seg_md;
+    TIME_SERIES_INDEX *tsi;
+    si8 i, j, k, n_blocks, seg_blocks;
+    si4 n_segments;
+    
+    if ((channel == NULL) || (channel->number_of_segments <= 0))
+        return NULL;
+    
+    n_segments = (si4) channel->number_of_segments;
+    n_blocks = 0;
+    for (i = 0; i < n_segments; i++)
+        n_blocks += channel->segments[i].metadata_fps->metadata.time_series_section_2->number_of_blocks;
+    
+    index = (CHANNEL_BLOCK_INDEX *) calloc((size_t) 1, sizeof(CHANNEL_BLOCK_INDEX));
+    if (index == NULL)
+    {
+        printf("Error allocating memory, exiting...");
+        return NULL;
+    }
+    index->number_of_blocks = n_blocks;
+    index->number_of_segments = n_segments;
+    index->start_sample = (si8 *) malloc(sizeof(si8) * (size_t) (n_blocks + 1));
+    index->start_time = (si8 *) malloc(sizeof(si8) * (size_t) (n_blocks + 1));
+    index->file_offset = (si8 *) malloc(sizeof(si8) * (size_t) (n_blocks + 1));
+    index->segment = (si4 *) malloc(sizeof(si4) * (size_t) (n_blocks + 1));
+    index->discontinuity = (ui1 *) malloc(sizeof(ui1) * (size_t) (n_blocks + 1));
+    index->segment_first_block = (si8 *) malloc(sizeof(si8) * (size_t) (n_segments + 1));
+    index->segment_start_time = (si8 *) malloc(sizeof(si8) * (size_t) n_segments);
+    index->segment_end_time = (si8 *) malloc(sizeof(si8) * (size_t) n_segments);
+    index->segment_start_sample = (si8 *) malloc(sizeof(si8) * (size_t) n_segments);
+    index->segment_end_sample = (si8 *) malloc(sizeof(si8) * (size_t) n_segments);
+    if ((index->start_sample == NULL) || (index->start_time == NULL) || (index->file_offset == NULL) || (index->segment == NULL) ||
+        (index->discontinuity == NULL) || (index->segment_first_block == NULL) || (index->segment_start_time == NULL) ||
+        (index->segment_end_time == NULL) || (index->segment_start_sample == NULL) || (index->segment_end_sample == NULL))
+    {
+        printf("Error allocating memory, exiting...");
+        free_channel_block_index(index);
+        return NULL;
+    }
+    index->sampling_frequency = channel->metadata.time_series_section_2->sampling_frequency;
+    index->segments = channel->segments;
+    index->channel_number_of_segments = channel->number_of_segments;
+    index->channel_number_of_samples = channel->metadata.time_series_section_2->number_of_samples;
+    
+    k = 0;
+    for (i = 0; i < n_segments; i++)
+    {
+        seg_md = channel->segments[i].metadata_fps->metadata.time_series_section_2;
+        tsi = channel->segments[i].time_series_indices_fps->time_series_indices;
+        seg_blocks = seg_md->number_of_blocks;
+        
+        index->segment_first_block[i] = k;
+        index->segment_start_time[i] = channel->segments[i].time_series_data_fps->universal_header->start_time;
+        index->segment_end_time[i] = channel->segments[i].time_series_data_fps->universal_header->end_time;
+        remove_recording_time_offset( &index->segment_start_time[i]);
+        remove_recording_time_offset( &index->segment_end_time[i]);
+        index->segment_start_sample[i] = seg_md->start_sample;
+        index->segment_end_sample[i] = seg_md->start_sample + seg_md->number_of_samples;
+        
+        for (j = 0; j < seg_blocks; j++, k++)
+        {
+            index->start_sample[k] = seg_md->start_sample + tsi[j].start_sample;
+            index->start_time[k] = tsi[j].start_time;
+            index->file_offset[k] = tsi[j].file_offset;
+            index->segment[k] = (si4) i;
+            index->discontinuity[k] = (tsi[j].RED_block_flags & RED_DISCONTINUITY_MASK) ? 1 : 0;
+        }
+    }
+    index->segment_first_block[n_segments] = k;
+    index->end_sample = index->segment_end_sample[n_segments - 1];
+    
+    // A channel is regular when every block holds the same number of samples (the last may be short) and there are no
+    // discontinuities after the first block.  Sample lookups can then be computed instead of searched.
+    index->regular = MEF_FALSE;
+    if (n_blocks > 1)
+    {
+        index->block_samples = (ui4) (index->start_sample[1] - index->start_sample[0]);
+        index->regular = (index->block_samples > 0) ? MEF_TRUE : MEF_FALSE;
+        check_block_index_regular(index, 1);
+    }
+    
+    return index;
+}
+
+// clears index->regular if a block from first_block on breaks the regular layout
+static void check_block_index_regular(CHANNEL_BLOCK_INDEX *index, si8 first_block)
+{
+    si8 k;
+    
+    for (k = first_block; (k < index->number_of_blocks) && index->regular; k++)
+    {
+        if ((index->discontinuity[k]) || (index->start_sample[k] != index->start_sample[0] + (k * (si8) index->block_samples)))
+            index->regular = MEF_FALSE;
+    }
+}
+
+// reallocates an array, leaving it as it was if that fails (returns 0)
+static si4 grow_array(void **array, size_t bytes)
+{
+    void *grown;
+    
+    grown = realloc(*array, bytes);
+    if (grown == NULL)
+        return 0;
+    *array = grown;
+    
+    return 1;
+}
+
+// Extends a block index built for a channel to the blocks appended to the channel since: those added to what was its
+// last segment, and those of segments added after it.  Returns 0 if the index could not be grown.
+static si4 extend_channel_block_index(CHANNEL_BLOCK_INDEX *index, CHANNEL *channel)
+{
+    TIME_SERIES_METADATA_SECTION_2 *seg_md;
+    TIME_SERIES_INDEX *tsi;
+    si8 i, j, k, n_blocks, old_blocks;
+    si4 n_segments, last;
+    
+    last = index->number_of_segments - 1;
+    n_segments = (si4) channel->number_of_segments;
+    n_blocks = index->segment_first_block[last];
+    for (i = last; i < n_segments; i++)
+        n_blocks += channel->segments[i].metadata_fps->metadata.time_series_section_2->number_of_blocks;
+    if ((n_segments < index->number_of_segments) || (n_blocks < index->number_of_blocks))
+        return 0;
+    
+    if (!grow_array((void **) &index->start_sample, sizeof(si8) * (size_t) (n_blocks + 1)) ||
+        !grow_array((void **) &index->start_time, sizeof(si8) * (size_t) (n_blocks + 1)) ||
+        !grow_array((void **) &index->file_offset, sizeof(si8) * (size_t) (n_blocks + 1)) ||
+        !grow_array((void **) &index->segment, sizeof(si4) * (size_t) (n_blocks + 1)) ||
+        !grow_array((void **) &index->discontinuity, sizeof(ui1) * (size_t) (n_blocks + 1)) ||
+        !grow_array((void **) &index->segment_first_block, sizeof(si8) * (size_t) (n_segments + 1)) ||
+        !grow_array((void **) &index->segment_start_time, sizeof(si8) * (size_t) n_segments) ||
+        !grow_array((void **) &index->segment_end_time, sizeof(si8) * (size_t) n_segments) ||
+        !grow_array((void **) &index->segment_start_sample, sizeof(si8) * (size_t) n_segments) ||
+        !grow_array((void **) &index->segment_end_sample, sizeof(si8) * (size_t) n_segments))
+        return 0;
+    
+    // the old last segment's new blocks, then the new segments, as build_channel_block_index() fills them in
+    old_blocks = index->number_of_blocks;
+    k = old_blocks;
+    for (i = last; i < n_segments; i++)
+    {
+        seg_md = channel->segments[i].metadata_fps->metadata.time_series_section_2;
+        tsi = channel->segments[i].time_series_indices_fps->time_series_indices;
+        
+        index->segment_first_block[i] = (i == last) ? index->segment_first_block[last] : k;
+        index->segment_start_time[i] = channel->segments[i].time_series_data_fps->universal_header->start_time;
+        index->segment_end_time[i] = channel->segments[i].time_series_data_fps->universal_header->end_time;
+        remove_recording_time_offset( &index->segment_start_time[i]);
+        remove_recording_time_offset( &index->segment_end_time[i]);
+        index->segment_start_sample[i] = seg_md->start_sample;
+        index->segment_end_sample[i] = seg_md->start_sample + seg_md->number_of_samples;
+        
+        for (j = k - index->segment_first_block[i]; j < seg_md->number_of_blocks; j++, k++)
+        {
+            index->start_sample[k] = seg_md->start_sample + tsi[j].start_sample;
+            index->start_time[k] = tsi[j].start_time;
+            index->file_offset[k] = tsi[j].file_offset;
+            index->segment[k] = (si4) i;
+            index->discontinuity[k] = (tsi[j].RED_block_flags & RED_DISCONTINUITY_MASK) ? 1 : 0;
+        }
+    }
+    index->segment_first_block[n_segments] = k;
+    index->number_of_blocks = n_blocks;
+    index->number_of_segments = n_segments;
+    index->end_sample = index->segment_end_sample[n_segments - 1];
+    index->segments = channel->segments;
+    index->channel_number_of_segments = channel->number_of_segments;
+    index->channel_number_of_samples = channel->metadata.time_series_section_2->number_of_samples;
+    
+    // only the new blocks need checking, unless there were too few blocks before to tell
+    if (old_blocks <= 1)
+    {
+        index->regular = MEF_FALSE;
+        if (n_blocks > 1)
+        {
+            index->block_samples = (ui4) (index->start_sample[1] - index->start_sample[0]);
+            index->regular = (index->block_samples > 0) ? MEF_TRUE : MEF_FALSE;
+            check_block_index_regular(index, 1);
+        }
+    }
+    else
+        check_block_index_regular(index, old_blocks);
+    
+    return 1;
+}
+
+void free_channel_block_index(CHANNEL_BLOCK_INDEX *index)
+{
+    if (index == NULL)
+        return;
+    
+    free (index->start_sample);
+    free (index->start_time);
+    free (index->file_offset);
+    free (index->segment);
+    free (index->discontinuity);
+    free (index->segment_first_block);
+    free (index->segment_start_time);
+    free (index->segment_end_time);
+    free (index->segment_start_sample);
+    free (index->segment_end_sample);
+    free (index);
+}
+
+// returns nonzero if the channel no longer looks like the one the index was built from
+static si4 block_index_is_stale(CHANNEL_BLOCK_INDEX *index, CHANNEL *channel)
+{
+    if (index->segments != channel->segments)
+        return 1;
+    if (index->channel_number_of_segments != channel->number_of_segments)
+        return 1;
+    if (index->channel_number_of_samples != channel->metadata.time_series_section_2->number_of_samples)
+        return 1;
+    
+    return 0;
+}
+
+// returns the module's state for a channel, creating it if create is set (caller holds reader_channel_states_mutex)
+static READER_CHANNEL_STATE *find_reader_channel_state(CHANNEL *channel, si4 create)
+{
+    READER_CHANNEL_STATE *state;
+    
+    for (state = reader_channel_states; state != NULL; state = state->next)
+        if (state->channel == channel)
+            return state;
+    
+    if (!create)
+        return NULL;
+    
+    state = (READER_CHANNEL_STATE *) calloc((size_t) 1, sizeof(READER_CHANNEL_STATE));
+    if (state == NULL)
+        return NULL;
+    state->channel = channel;
+    state->next = reader_channel_states;
+    reader_channel_states = state;
+    
+    return state;
+}
+
+// Returns the block index of a channel, building it on first use.  The index is kept until
+// release_channel_reader_state() is called for the channel, and rebuilt if the channel's segments change.
+CHANNEL_BLOCK_INDEX *get_channel_block_index(CHANNEL *channel)
+{
+    READER_CHANNEL_STATE *state;
+    CHANNEL_BLOCK_INDEX *index;
+    
+    if (channel == NULL)
+        return NULL;
+    
+    reader_mutex_lock(&reader_channel_states_mutex);
+    state = find_reader_channel_state(channel, MEF_TRUE);
+    if (state == NULL)
+    {
+        reader_mutex_unlock(&reader_channel_states_mutex);
+        printf("Error allocating memory, exiting...");
+        return NULL;
+    }
+    if ((state->block_index != NULL) && block_index_is_stale(state->block_index, channel))
+    {
+        free_channel_block_index(state->block_index);
+        state->block_index = NULL;
+        free_continuous_ranges(state->continuous_ranges);
+        state->continuous_ranges = NULL;
+    }
+    if (state->block_index == NULL)
+        state->block_index = build_channel_block_index(channel);
+    index = state->block_index;
+    reader_mutex_unlock(&reader_channel_states_mutex);
+    
+    return index;
+}
+
+// Frees everything this module has cached for a channel.  Call this before free_channel() on a channel that was
+// passed to the read functions, as a new channel allocated at the same address would otherwise find the old state.
+void release_channel_reader_state(CHANNEL *channel)
+{
+    READER_CHANNEL_STATE **link, *state;
+    
+    reader_mutex_lock(&reader_channel_states_mutex);
+    for (link = &reader_channel_states; *link != NULL; link = &(*link)->next)
+    {
+        if ((*link)->channel == channel)
+        {
+            state = *link;
+            *link = state->next;
+            free_channel_block_index(state->block_index);
+            free_continuous_ranges(state->continuous_ranges);
+            free_segment_maps(state);
+            free (state->verified_blocks);
+            free (state);
+            invalidate_read_mef_ts_data_block_cache(channel);
+            break;
+        }
+    }
+    reader_mutex_unlock(&reader_channel_states_mutex);
+}
+
+// continuous ranges of a channel, built from its block index on first use (valid until release_channel_reader_state())
+CONTINUOUS_RANGES *get_channel_continuous_ranges(CHANNEL *channel)
+{
+    READER_CHANNEL_STATE *state;
+    CONTINUOUS_RANGES *ranges;
+    
+    if (get_channel_block_index(channel) == NULL)
+        return NULL;
+    
+    reader_mutex_lock(&reader_channel_states_mutex);
+    state = find_reader_channel_state(channel, MEF_TRUE);
+    if ((state != NULL) && (state->continuous_ranges == NULL) && (state->block_index != NULL))
+        state->continuous_ranges = build_continuous_ranges(channel, state->block_index);
+    ranges = (state != NULL) ? state->continuous_ranges : NULL;
+    reader_mutex_unlock(&reader_channel_states_mutex);
+    
+    return ranges;
+}
+
+// A range starts at the first block and at every block flagged as a discontinuity.  Its end time is that of its last
+// block, computed as find_start_and_end_times_of_continuous_ranges() always has.
+CONTINUOUS_RANGES *build_continuous_ranges(CHANNEL *channel, CHANNEL_BLOCK_INDEX *index)
+{
+    CONTINUOUS_RANGES *ranges;
+    si8 k, n_ranges, r, block_start_time;
+    si4 segment;
+    ui4 number_of_samples;
+    
+    n_ranges = 0;
+    for (k = 0; k < index->number_of_blocks; k++)
+        if (index->discontinuity[k] || (k == 0))
+            n_ranges++;
+    
+    ranges = (CONTINUOUS_RANGES *) calloc((size_t) 1, sizeof(CONTINUOUS_RANGES));
+    if (ranges == NULL)
+        return NULL;
+    ranges->start_time = (si8 *) malloc(sizeof(si8) * (size_t) (n_ranges + 1));
+    ranges->end_time = (si8 *) malloc(sizeof(si8) * (size_t) (n_ranges + 1));
+    ranges->start_sample = (si8 *) malloc(sizeof(si8) * (size_t) (n_ranges + 1));
+    ranges->end_sample = (si8 *) malloc(sizeof(si8) * (size_t) (n_ranges + 1));
+    ranges->time_before = (si8 *) malloc(sizeof(si8) * (size_t) (n_ranges + 1));
+    if ((ranges->start_time == NULL) || (ranges->end_time == NULL) || (ranges->start_sample == NULL) ||
+        (ranges->end_sample == NULL) || (ranges->time_before == NULL))
+    {
+        free_continuous_ranges(ranges);
+        return NULL;
+    }
+    
+    r = -1;
+    for (k = 0; k < index->number_of_blocks; k++)
+    {
+        block_start_time = index->start_time[k];
+        remove_recording_time_offset( &block_start_time);
+        segment = index->segment[k];
+        number_of_samples = channel->segments[segment].time_series_indices_fps->time_series_indices[k - index->segment_first_block[segment]].number_of_samples;
+        
+        if (index->discontinuity[k] || (k == 0))
+        {
+            r++;
+            ranges->start_time[r] = block_start_time;
+            ranges->start_sample[r] = index->start_sample[k];
+        }
+        ranges->end_time[r] = block_start_time + ((number_of_samples / channel->metadata.time_series_section_2->sampling_frequency) * 1e6);
+        ranges->end_sample[r] = index->start_sample[k] + number_of_samples;
+    }
+    ranges->number_of_ranges = n_ranges;
+    
+    ranges->time_before[0] = 0;
+    for (r = 0; r < n_ranges; r++)
+        ranges->time_before[r + 1] = ranges->time_before[r] + (ranges->end_time[r] - ranges->start_time[r]);
+    
+    return ranges;
+}
+
+// Extends continuous ranges built from a block index to the index's blocks from first_block on (blocks appended to the
+// channel since, see extend_channel_block_index()).  Returns 0 if the ranges could not be grown.
+static si4 extend_continuous_ranges(CONTINUOUS_RANGES *ranges, CHANNEL *channel, CHANNEL_BLOCK_INDEX *index, si8 first_block)
+{
+    si8 k, n_ranges, r, first_range, block_start_time;
+    si4 segment;
+    ui4 number_of_samples;
+    
+    n_ranges = ranges->number_of_ranges;
+    for (k = first_block; k < index->number_of_blocks; k++)
+        if (index->discontinuity[k] || (k == 0))
+            n_ranges++;
+    
+    if (!grow_array((void **) &ranges->start_time, sizeof(si8) * (size_t) (n_ranges + 1)) ||
+        !grow_array((void **) &ranges->end_time, sizeof(si8) * (size_t) (n_ranges + 1)) ||
+        !grow_array((void **) &ranges->start_sample, sizeof(si8) * (size_t) (n_ranges + 1)) ||
+        !grow_array((void **) &ranges->end_sample, sizeof(si8) * (size_t) (n_ranges + 1)) ||
+        !grow_array((void **) &ranges->time_before, sizeof(si8) * (size_t) (n_ranges + 1)))
+        return 0;
+    
+    // the last range grows until a new block starts another
+    r = ranges->number_of_ranges - 1;
+    first_range = (r < 0) ? 0 : r;
+    for (k = first_block; k < index->number_of_blocks; k++)
+    {
+        block_start_time = index->start_time[k];
+        remove_recording_time_offset( &block_start_time);
+        segment = index->segment[k];
+        number_of_samples = channel->segments[segment].time_series_indices_fps->time_series_indices[k - index->segment_first_block[segment]].number_of_samples;
+        
+        if (index->discontinuity[k] || (k == 0))
+        {
+            r++;
+            ranges->start_time[r] = block_start_time;
+            ranges->start_sample[r] = index->start_sample[k];
+        }
+        ranges->end_time[r] = block_start_time + ((number_of_samples / channel->metadata.time_series_section_2->sampling_frequency) * 1e6);
+        ranges->end_sample[r] = index->start_sample[k] + number_of_samples;
+    }
+    ranges->number_of_ranges = n_ranges;
+    
+    ranges->time_before[0] = 0;
+    for (r = first_range; r < n_ranges; r++)
+        ranges->time_before[r + 1] = ranges->time_before[r] + (ranges->end_time[r] - ranges->start_time[r]);
+    
+    return 1;
+}
+
+void free_continuous_ranges(CONTINUOUS_RANGES *ranges)
+{
+    if (ranges == NULL)
+        return;
+    
+    free (ranges->start_time);
+    free (ranges->end_time);
+    free (ranges->start_sample);
+    free (ranges->end_sample);
+    free (ranges->time_before);
+    free (ranges);
+}
+
+// first range ending after uutc (number_of_ranges if none)
+static si8 continuous_ranges_first_ending_after(CONTINUOUS_RANGES *ranges, si8 uutc)
+{
+    si8 lo, hi, mid;
+    
+    lo = 0;
+    hi = ranges->number_of_ranges;
+    while (lo < hi)
+    {
+        mid = lo + ((hi - lo) >> 1);
+        if (ranges->end_time[mid] > uutc)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    
+    return lo;
+}
+
+// first range starting at or after uutc (number_of_ranges if none)
+static si8 continuous_ranges_first_starting_at_or_after(CONTINUOUS_RANGES *ranges, si8 uutc)
+{
+    si8 lo, hi, mid;
+    
+    lo = 0;
+    hi = ranges->number_of_ranges;
+    while (lo < hi)
+    {
+        mid = lo + ((hi - lo) >> 1);
+        if (ranges->start_time[mid] >= uutc)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    
+    return lo;
+}
+
+// Returns the number of ranges overlapping [start_time, end_time), and the first of them in first_range.
+si8 continuous_ranges_overlapping(CONTINUOUS_RANGES *ranges, si8 start_time, si8 end_time, si8 *first_range)
+{
+    si8 first, end;
+    
+    first = continuous_ranges_first_ending_after(ranges, start_time);
+    end = continuous_ranges_first_starting_at_or_after(ranges, end_time);
+    if (first_range != NULL)
+        *first_range = first;
+    
+    return (end > first) ? (end - first) : 0;
+}
+
+// Returns the range holding the first data at or after uutc, and that time in data_time (uutc itself if it is within a
+// range, otherwise the start of the next range).  Returns -1 if there is no data after uutc.
+si8 continuous_ranges_next_data(CONTINUOUS_RANGES *ranges, si8 uutc, si8 *data_time)
+{
+    si8 r;
+    
+    r = continuous_ranges_first_ending_after(ranges, uutc);
+    if (r >= ranges->number_of_ranges)
+        return -1;
+    
+    if (data_time != NULL)
+        *data_time = (ranges->start_time[r] > uutc) ? ranges->start_time[r] : uutc;
+    
+    return r;
+}
+
+// Returns the time (in microseconds) within [start_time, end_time) covered by data.
+si8 continuous_ranges_coverage(CONTINUOUS_RANGES *ranges, si8 start_time, si8 end_time)
+{
+    si8 first, n, last, coverage;
+    
+    n = continuous_ranges_overlapping(ranges, start_time, end_time, &first);
+    if (n == 0)
+        return 0;
+    last = first + n - 1;
+    
+    // whole ranges, less the parts of the end ones outside the window
+    coverage = ranges->time_before[last + 1] - ranges->time_before[first];
+    if (ranges->start_time[first] < start_time)
+        coverage -= start_time - ranges->start_time[first];
+    if (ranges->end_time[last] > end_time)
+        coverage -= ranges->end_time[last] - end_time;
+    
+    return coverage;
+}
+
+static inline si8 block_index_time(CHANNEL_BLOCK_INDEX *index, si8 block, si4 remove_offset)
+{
+    si8 block_start_time;
+    
+    block_start_time = index->start_time[block];
+    if (remove_offset)
+        remove_recording_time_offset( &block_start_time);
+    
+    return block_start_time;
+}
+
+// Returns the first block in [lo, hi) whose start time is later than uutc, or hi if there is none.
+// If remove_offset is set, block times have the recording time offset removed before being compared.
+si8 block_index_first_after_time(CHANNEL_BLOCK_INDEX *index, si8 lo, si8 hi, si8 uutc, si4 remove_offset)
+{
+    si8 mid, guess;
+    sf8 block_duration;
+    
+    if (lo >= hi)
+        return hi;
+    
+    // regular channel: blocks are evenly spaced in time, so work out where the answer should be and check it
+    if (index->regular)
+    {
+        block_duration = (index->block_samples / index->sampling_frequency) * 1e6;
+        if (uutc < block_index_time(index, lo, remove_offset))
+            return lo;
+        guess = lo + (si8) ((uutc - block_index_time(index, lo, remove_offset)) / block_duration) + 1;
+        if (guess > hi)
+            guess = hi;
+        if ((block_index_time(index, guess - 1, remove_offset) <= uutc) &&
+            ((guess == hi) || (block_index_time(index, guess, remove_offset) > uutc)))
+            return guess;
+    }
+    
+    while (lo < hi)
+    {
+        mid = lo + ((hi - lo) >> 1);
+        if (block_index_time(index, mid, remove_offset) > uutc)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    
+    return lo;
+}
+
+// Returns the first block whose (channel) start sample is larger than sample, or number_of_blocks if there is none.
+si8 block_index_first_after_sample(CHANNEL_BLOCK_INDEX *index, si8 sample)
+{
+    si8 lo, hi, mid;
+    
+    lo = 0;
+    hi = index->number_of_blocks;
+    if (hi == 0)
+        return 0;
+    
+    // regular channel: block k starts at sample start_sample[0] + (k * block_samples)
+    if (index->regular)
+    {
+        if (sample < index->start_sample[0])
+            return 0;
+        mid = ((sample - index->start_sample[0]) / (si8) index->block_samples) + 1;
+        return (mid < hi) ? mid : hi;
+    }
+    
+    while (lo < hi)
+    {
+        mid = lo + ((hi - lo) >> 1);
+        if (index->start_sample[mid] > sample)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    
+    return lo;
+}
+
+// returns the .tdat file offset just past the end of a block
+si8 block_index_block_end_offset(CHANNEL_BLOCK_INDEX *index, CHANNEL *channel, si8 block)
+{
+    if ((block + 1 < index->number_of_blocks) && (index->segment[block + 1] == index->segment[block]))
+        return index->file_offset[block + 1];
+    
+    return channel->segments[index->segment[block]].time_series_data_fps->file_length;
+}
+
+// returns the first segment whose end time is at or after uutc, or -1
+si4 block_index_first_segment_ending_at_or_after(CHANNEL_BLOCK_INDEX *index, si8 uutc)
+{
+    si4 lo, hi, mid;
+    
+    lo = 0;
+    hi = index->number_of_segments;
+    while (lo < hi)
+    {
+        mid = lo + ((hi - lo) >> 1);
+        if (index->segment_end_time[mid] >= uutc)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    
+    return (lo < index->number_of_segments) ? lo : -1;
+}
+
+// returns the last segment whose start time is at or before uutc, or -1
+si4 block_index_last_segment_starting_at_or_before(CHANNEL_BLOCK_INDEX *index, si8 uutc)
+{
+    si4 lo, hi, mid;
+    
+    lo = 0;
+    hi = index->number_of_segments;
+    while (lo < hi)
+    {
+        mid = lo + ((hi - lo) >> 1);
+        if (index->segment_start_time[mid] > uutc)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    
+    return lo - 1;
+}
+
+// Returns the last segment containing sample, or -1.  A sample on the boundary between two segments belongs to both,
+// and the later one is returned.
+si4 block_index_segment_for_sample(CHANNEL_BLOCK_INDEX *index, si8 sample)
+{
+    si4 lo, hi, mid;
+    
+    lo = 0;
+    hi = index->number_of_segments;
+    while (lo < hi)
+    {
+        mid = lo + ((hi - lo) >> 1);
+        if (index->segment_start_sample[mid] > sample)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    lo--;
+    
+    if ((lo >= 0) && (sample <= index->segment_end_sample[lo]))
+        return lo;
+    
+    return -1;
+}
+
+/**************************  Mapped segment files  ****************************/
+
+static void unmap_segment(SEGMENT_MAP *map)
+{
+    if (map->data == NULL)
+        return;
+    
+#ifndef _WIN32
+    munmap(map->data, (size_t) map->bytes);
+#else
+    UnmapViewOfFile(map->data);
+    CloseHandle(map->mapping_handle);
+    CloseHandle(map->file_handle);
+#endif
+    map->data = NULL;
+    map->bytes = 0;
+}
+
+// unmaps all of a channel's segment files (caller holds reader_channel_states_mutex, or owns the state)
+static void free_segment_maps(READER_CHANNEL_STATE *state)
+{
+    si8 i;
+    
+    if (state->segment_maps == NULL)
+        return;
+    
+    for (i = 0; i < state->number_of_segment_maps; i++)
+        unmap_segment(&state->segment_maps[i]);
+    free (state->segment_maps);
+    state->segment_maps = NULL;
+    state->number_of_segment_maps = 0;
+}
+
+static si4 map_segment(SEGMENT_MAP *map, si1 *file_name)
+{
+#ifndef _WIN32
+    si4 fd;
+    struct stat sb;
+    void *data;
+    
+    fd = open(file_name, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if ((fstat(fd, &sb) != 0) || (sb.st_size <= 0))
+    {
+        close(fd);
+        return 0;
+    }
+    data = mmap(NULL, (size_t) sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // the mapping stays valid
+    if (data == MAP_FAILED)
+        return 0;
+    
+    map->data = (ui1 *) data;
+    map->bytes = (ui8) sb.st_size;
+    
+    if (read_mef_ts_data_access_pattern == READ_ACCESS_SEQUENTIAL)
+        madvise(data, (size_t) sb.st_size, MADV_SEQUENTIAL);
+    else if (read_mef_ts_data_access_pattern == READ_ACCESS_RANDOM)
+        madvise(data, (size_t) sb.st_size, MADV_RANDOM);
+#else
+    LARGE_INTEGER file_size;
+    
+    map->file_handle = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                                   (read_mef_ts_data_access_pattern == READ_ACCESS_SEQUENTIAL) ? FILE_FLAG_SEQUENTIAL_SCAN :
+                                   (read_mef_ts_data_access_pattern == READ_ACCESS_RANDOM) ? FILE_FLAG_RANDOM_ACCESS : FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file_handle == INVALID_HANDLE_VALUE)
+        return 0;
+    if (!GetFileSizeEx(map->file_handle, &file_size) || (file_size.QuadPart <= 0))
+    {
+        CloseHandle(map->file_handle);
+        return 0;
+    }
+    map->mapping_handle = CreateFileMappingA(map->file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (map->mapping_handle == NULL)
+    {
+        CloseHandle(map->file_handle);
+        return 0;
+    }
+    map->data = (ui1 *) MapViewOfFile(map->mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if (map->data == NULL)
+    {
+        CloseHandle(map->mapping_handle);
+        CloseHandle(map->file_handle);
+        return 0;
+    }
+    map->bytes = (ui8) file_size.QuadPart;
+#endif
+    
+    return 1;
+}
+
+// Returns a read-only mapping of a segment's .tdat file, mapping it on first use.  Mappings are kept until
+// release_channel_reader_state() is called for the channel.
+ui1 *get_segment_map(CHANNEL *channel, si4 segment, ui8 *bytes)
+{
+    si4 mapped;
+    
+    return map_channel_segment(channel, segment, bytes, &mapped);
+}
+
+// get_segment_map(), also setting mapped to whether the file was mapped by this call
+static ui1 *map_channel_segment(CHANNEL *channel, si4 segment, ui8 *bytes, si4 *mapped)
+{
+    READER_CHANNEL_STATE *state;
+    SEGMENT_MAP *map;
+    ui1 *data;
+    
+    reader_mutex_lock(&reader_channel_states_mutex);
+    state = find_reader_channel_state(channel, MEF_TRUE);
+    if ((state != NULL) && (state->number_of_segment_maps != channel->number_of_segments))
+    {
+        free_segment_maps(state);
+        state->segment_maps = (SEGMENT_MAP *) calloc((size_t) channel->number_of_segments, sizeof(SEGMENT_MAP));
+        state->number_of_segment_maps = (state->segment_maps != NULL) ? channel->number_of_segments : 0;
+    }
+    *mapped = 0;
+    if ((state == NULL) || (state->segment_maps == NULL))
+    {
+        reader_mutex_unlock(&reader_channel_states_mutex);
+        *bytes = 0;
+        return NULL;
+    }
+    map = &state->segment_maps[segment];
+    if (map->data == NULL)
+        *mapped = map_segment(map, channel->segments[segment].time_series_data_fps->full_file_name);
+    data = map->data;
+    *bytes = map->bytes;
+    reader_mutex_unlock(&reader_channel_states_mutex);
+    
+    return data;
+}
+
+// tells the OS the given range of a mapping is about to be read, so it can start bringing it in
+void advise_segment_map(ui1 *data, ui8 bytes)
+{
+#ifndef _WIN32
+    static si8 page_size = 0;
+    ui1 *start;
+    
+    if (page_size == 0)
+        page_size = sysconf(_SC_PAGESIZE);
+    
+    // madvise() needs a page aligned start
+    start = (ui1 *) ((uintptr_t) data & ~((uintptr_t) page_size - 1));
+    madvise(start, (size_t) ((data + bytes) - start), MADV_WILLNEED);
+#endif
+}
+
+/**************************  Parallel block decode  ****************************/
+
+// creates a RED processing struct set up for decompression, with a difference buffer sized for max_samps
+RED_PROCESSING_STRUCT *allocate_decode_rps(ui4 max_samps)
+{
+    RED_PROCESSING_STRUCT *rps;
+    
+    rps = (RED_PROCESSING_STRUCT *) calloc((size_t) 1, sizeof(RED_PROCESSING_STRUCT));
+    if (rps == NULL)
+        return NULL;
+    rps->compression.mode = RED_DECOMPRESSION;
+    rps->difference_buffer = (si1 *) e_calloc((size_t) RED_MAX_DIFFERENCE_BYTES(max_samps) + 1, sizeof(ui1), __FUNCTION__, __LINE__, USE_GLOBAL_BEHAVIOR);
+    if (rps->difference_buffer == NULL)
+    {
+        free (rps);
+        return NULL;
+    }
+    
+    return rps;
+}
+
+// the same, with the channel's password data, for decoding its encrypted blocks
+static RED_PROCESSING_STRUCT *allocate_channel_decode_rps(CHANNEL *channel, ui4 max_samps)
+{
+    RED_PROCESSING_STRUCT *rps;
+    
+    rps = allocate_decode_rps(max_samps);
+    if (rps != NULL)
+        rps->password_data = channel_password_data(channel);
+    
+    return rps;
+}
+
+void free_decode_rps(RED_PROCESSING_STRUCT *rps)
+{
+    if (rps == NULL)
+        return;
+    
+    free (rps->difference_buffer);
+    free (rps);
+}
+
+// Decodes one block into output, with this module's decoder where it agrees with RED_decode() (see decode_red_block()).
+// Decoding modifies the block (the header start time, and the data of encrypted blocks), so if block_copy is given the
+// block is copied there first and decoded from the copy.
+void decode_block(RED_PROCESSING_STRUCT *rps, ui1 *block_ptr, si4 *output, ui1 *block_copy)
+{
+    if (block_copy != NULL)
+    {
+        memcpy(block_copy, block_ptr, (size_t) ((RED_BLOCK_HEADER *) block_ptr)->block_bytes);
+        block_ptr = block_copy;
+    }
+    
+    rps->compressed_data = block_ptr;
+    rps->block_header = (RED_BLOCK_HEADER *) rps->compressed_data;
+    rps->decompressed_ptr = rps->decompressed_data = output;
+    if ((rps->block_header->flags & (RED_LEVEL_1_ENCRYPTION_MASK | RED_LEVEL_2_ENCRYPTION_MASK)) && decode_block_hardware_aes(rps))
+        return;
+    decode_red_block(rps);
+}
+
+// Checks a block (see check_channel_block_crc(); verified is the caller's VERIFIED_BLOCKS) and decodes it into output.
+// Returns 0, without decoding, if the check fails.  If times isn't NULL, the blocks checked and decoded, and the time
+// taken by each, are added to it.
+static si4 check_and_decode_block(CHANNEL *channel, si8 block, RED_PROCESSING_STRUCT *rps, ui1 *block_ptr, ui4 max_samps, ui1 *total_data_ptr,
+                                  ui8 total_data_bytes, si4 *output, ui1 *block_copy, VERIFIED_BLOCKS *verified, DECODE_TIMES *times)
+{
+    si4 computed, valid;
+    sf8 start, crc_end;
+    
+    // jobs of one decode can come from different channels
+    if (channel != NULL)
+        rps->password_data = channel_password_data(channel);
+    
+    if (times == NULL)
+    {
+        if (!channel_block_crc(channel, block, block_ptr, max_samps, total_data_ptr, total_data_bytes, verified, NULL))
+            return 0;
+        decode_block(rps, block_ptr, output, block_copy);
+        return 1;
+    }
+    
+    start = reader_clock();
+    valid = channel_block_crc(channel, block, block_ptr, max_samps, total_data_ptr, total_data_bytes, verified, &computed);
+    crc_end = reader_clock();
+    if (computed)
+    {
+        times->blocks_crc_checked++;
+        times->crc_seconds += crc_end - start;
+    }
+    if (!valid)
+        return 0;
+    
+    decode_block(rps, block_ptr, output, block_copy);
+    times->blocks_decoded++;
+    times->decode_seconds += reader_clock() - crc_end;
+    
+    return 1;
+}
+
+static void add_worker_times(DECODE_TIMES *total, DECODE_TIMES *times)
+{
+    total->blocks_decoded += times->blocks_decoded;
+    total->blocks_crc_checked += times->blocks_crc_checked;
+    total->crc_seconds += times->crc_seconds;
+    total->decode_seconds += times->decode_seconds;
+}
+
+// steps to the block following cdp, moving on to the next span at the end of the current one
+static ui1 *next_block_ptr(COMPRESSED_SPAN *spans, si4 n_spans, si4 *span, ui1 *cdp)
+{
+    cdp += ((RED_BLOCK_HEADER *) cdp)->block_bytes;
+    if ((cdp >= spans[*span].data + spans[*span].bytes) && (*span + 1 < n_spans))
+    {
+        (*span)++;
+        cdp = spans[*span].data;
+    }
+    
+    return cdp;
+}
+
+static READER_THREAD_RETURN decode_worker(void *arg)
+{
+    DECODE_WORKER *worker;
+    RED_PROCESSING_STRUCT *rps;
+    VERIFIED_BLOCKS verified;
+    ui1 *block_copy;
+    si8 j;
+    
+    worker = (DECODE_WORKER *) arg;
+    verified.channel = NULL;
+    
+    // each worker has its own processing struct and difference buffer
+    rps = (worker->rps != NULL) ? worker->rps : allocate_decode_rps(worker->max_samps);
+    
+    block_copy = NULL;
+    if (worker->copy_blocks)
+        block_copy = (worker->block_copy != NULL) ? worker->block_copy : (ui1 *) malloc((size_t) RED_MAX_COMPRESSED_BYTES(worker->max_samps, 1));
+    
+    // a worker that can't get its buffers fails its first job
+    if ((rps == NULL) || (worker->copy_blocks && (block_copy == NULL)))
+        worker->failed_job = worker->first_job;
+    
+    for (j = worker->first_job; (j < worker->end_job) && (worker->failed_job < 0); j++)
+    {
+        if (!check_and_decode_block(worker->jobs[j].channel, worker->jobs[j].block, rps, worker->jobs[j].block_ptr, worker->max_samps,
+                                    worker->jobs[j].block_ptr, worker->jobs[j].bytes_available, worker->jobs[j].output_ptr, block_copy,
+                                    &verified, worker->timed ? &worker->times : NULL))
+        {
+            worker->failed_job = j;
+            break;
+        }
+    }
+    
+    if (block_copy != worker->block_copy)
+        free (block_copy);
+    if (rps != worker->rps)
+        free_decode_rps(rps);
+    
+    return READER_THREAD_RETURN_VALUE;
+}
+
+// Decodes the jobs, in order, on up to n_threads threads.  Returns -1 on success, otherwise the index of the first job
+// whose block failed its CRC check.  If copy_blocks is set, each block is copied before decoding, so the compressed
+// data is left untouched (for mapped files).
+//
+// Jobs are split into contiguous runs, one per thread.  A split is only made where no earlier job writes past the
+// start of a later one, so overlapping blocks (which can happen when placing blocks by time) are always decoded by the
+// same worker in their original order, and the result matches a serial decode exactly.
+si8 decode_block_jobs(DECODE_BLOCK_JOB *jobs, si8 n_jobs, ui4 max_samps, si4 copy_blocks, si4 n_threads)
+{
+    return decode_block_jobs_with_buffers(jobs, n_jobs, max_samps, copy_blocks, n_threads, NULL, NULL);
+}
+
+// Same as decode_block_jobs(), with a processing struct (and, if copy_blocks is set, a block copy buffer) for the
+// jobs decoded on the calling thread, so a serial decode allocates nothing.  Either may be NULL.
+si8 decode_block_jobs_with_buffers(DECODE_BLOCK_JOB *jobs, si8 n_jobs, ui4 max_samps, si4 copy_blocks, si4 n_threads,
+                                   RED_PROCESSING_STRUCT *rps, ui1 *block_copy)
+{
+    return decode_block_jobs_timed(jobs, n_jobs, max_samps, copy_blocks, n_threads, rps, block_copy, NULL);
+}
+
+// decode_block_jobs_with_buffers(), adding the work done by every worker to times, if it isn't NULL
+static si8 decode_block_jobs_timed(DECODE_BLOCK_JOB *jobs, si8 n_jobs, ui4 max_samps, si4 copy_blocks, si4 n_threads,
+                                   RED_PROCESSING_STRUCT *rps, ui1 *block_copy, DECODE_TIMES *times)
+{
+    DECODE_WORKER serial_worker;
+    DECODE_WORKER *workers;
+    READER_THREAD *threads;
+    si4 *thread_started;
+    si4 **suffix_min_start;
+    si4 *max_end;
+    si8 j, target, failed_job;
+    si4 n_workers, w;
+    
+    if (n_jobs <= 0)
+        return -1;
+    
+    // not worth starting a thread for only a handful of blocks
+    if (n_threads > n_jobs / DECODE_MIN_BLOCKS_PER_THREAD)
+        n_threads = (si4) (n_jobs / DECODE_MIN_BLOCKS_PER_THREAD);
+    if (n_threads < 1)
+        n_threads = 1;
+    
+    // serial case, decode everything on the calling thread
+    if (n_threads == 1)
+    {
+        serial_worker.jobs = jobs;
+        serial_worker.first_job = 0;
+        serial_worker.end_job = n_jobs;
+        serial_worker.max_samps = max_samps;
+        serial_worker.copy_blocks = copy_blocks;
+        serial_worker.failed_job = -1;
+        serial_worker.rps = rps;
+        serial_worker.block_copy = block_copy;
+        serial_worker.timed = (times != NULL);
+        memset(&serial_worker.times, 0, sizeof(DECODE_TIMES));
+        decode_worker(&serial_worker);
+        if (times != NULL)
+            add_worker_times(times, &serial_worker.times);
+        return serial_worker.failed_job;
+    }
+    
+    workers = (DECODE_WORKER *) calloc((size_t) n_threads, sizeof(DECODE_WORKER));
+    
+    // lowest output position written by any job at or after j
+    suffix_min_start = (si4 **) malloc(sizeof(si4 *) * (size_t) n_jobs);
+    suffix_min_start[n_jobs - 1] = jobs[n_jobs - 1].output_ptr;
+    for (j = n_jobs - 2; j >= 0; j--)
+        suffix_min_start[j] = (jobs[j].output_ptr < suffix_min_start[j + 1]) ? jobs[j].output_ptr : suffix_min_start[j + 1];
+    
+    // split jobs into runs
+    n_workers = 0;
+    max_end = NULL;
+    workers[0].first_job = 0;
+    target = n_jobs / n_threads;
+    for (j = 0; j < n_jobs; j++)
+    {
+        if ((max_end == NULL) || (jobs[j].output_ptr + jobs[j].number_of_samples > max_end))
+            max_end = jobs[j].output_ptr + jobs[j].number_of_samples;
+        
+        if ((n_workers < n_threads - 1) && (j + 1 < n_jobs) && ((j + 1 - workers[n_workers].first_job) >= target) &&
+            (max_end <= suffix_min_start[j + 1]))
+        {
+            workers[n_workers].end_job = j + 1;
+            n_workers++;
+            workers[n_workers].first_job = j + 1;
+        }
+    }
+    workers[n_workers].end_job = n_jobs;
+    n_workers++;
+    free (suffix_min_start);
+    
+    threads = (READER_THREAD *) calloc((size_t) n_workers, sizeof(READER_THREAD));
+    thread_started = (si4 *) calloc((size_t) n_workers, sizeof(si4));
+    
+    for (w = 0; w < n_workers; w++)
+    {
+        workers[w].jobs = jobs;
+        workers[w].max_samps = max_samps;
+        workers[w].copy_blocks = copy_blocks;
+        workers[w].failed_job = -1;
+        workers[w].timed = (times != NULL);
+    }
+    workers[0].rps = rps;
+    workers[0].block_copy = block_copy;
+    
+    // the calling thread takes the first run itself
+    for (w = 1; w < n_workers; w++)
+        thread_started[w] = reader_thread_create(&threads[w], decode_worker, &workers[w]);
+    decode_worker(&workers[0]);
+    for (w = 1; w < n_workers; w++)
+    {
+        if (thread_started[w])
+            reader_thread_join(threads[w]);
+        else
+            decode_worker(&workers[w]);  // couldn't start the thread, do it here
+    }
+    
+    failed_job = -1;
+    for (w = 0; w < n_workers; w++)
+    {
+        if (workers[w].failed_job >= 0)
+        {
+            failed_job = workers[w].failed_job;
+            break;
+        }
+    }
+    if (times != NULL)
+    {
+        for (w = 0; w < n_workers; w++)
+            add_worker_times(times, &workers[w].times);
+    }
+    
+    free (thread_started);
+    free (threads);
+    free (workers);
+    
+    return failed_job;
 }
 
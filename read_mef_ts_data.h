@@ -21,23 +21,349 @@
 
 #include "meflib.h"
 
+// Flattened index of every block in a channel, in channel order, built once per channel (see get_channel_block_index()).
+typedef struct {
+    si8     number_of_blocks;
+    si4     number_of_segments;
+    si8     *start_sample;          // channel sample number of the first sample of each block
+    si8     *start_time;            // start time of each block, as stored in the index files
+    si8     *file_offset;           // offset of each block in its segment's .tdat file
+    si4     *segment;               // segment each block belongs to
+    ui1     *discontinuity;         // nonzero if the block starts a discontinuity
+    si8     *segment_first_block;   // first block of each segment (number_of_segments + 1 entries)
+    si8     *segment_start_time;    // segment bounds, times have the recording time offset removed
+    si8     *segment_end_time;
+    si8     *segment_start_sample;
+    si8     *segment_end_sample;
+    si8     end_sample;             // one past the last sample of the channel
+    si1     regular;                // all blocks hold block_samples samples (the last may be short), no discontinuities
+    ui4     block_samples;
+    sf8     sampling_frequency;
+    SEGMENT *segments;              // what the index was built from, to detect a changed CHANNEL
+    si8     channel_number_of_segments;
+    si8     channel_number_of_samples;
+} CHANNEL_BLOCK_INDEX;
+
+// Continuous ranges of a channel (runs of blocks without a discontinuity), in time order, built once per channel (see
+// get_channel_continuous_ranges()).
+typedef struct {
+    si8     number_of_ranges;
+    si8     *start_time;            // recording time offset removed
+    si8     *end_time;              // start time of the range's last block plus that block's duration
+    si8     *start_sample;          // channel sample numbers, end_sample is one past the range's last sample
+    si8     *end_sample;
+    si8     *time_before;           // total duration of the ranges before each one (number_of_ranges + 1 entries)
+} CONTINUOUS_RANGES;
+
 si4 read_mef_ts_data_by_time(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, si4 *decomp_data, CHANNEL *channel_passed_in);
 si4 read_mef_ts_data_by_time_with_limit(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, si4 *decomp_data, CHANNEL *channel_passed_in, si4 sample_limit);
 si4 read_mef_ts_data_by_samp(si1 *channel_path, si1 *password, si8 start_samp, si8 end_samp, si4 *decomp_data, CHANNEL *channel_passed_in);
 si4 find_start_and_end_times_of_continuous_ranges(si1 *channel_path, si1 *password, si8 **start_continuous_input, si8 **end_continuous_input, CHANNEL *channel_passed_in);
 
+// continuous range queries, each a binary search of the channel's cached ranges.  Windows are [start_time, end_time).
+CONTINUOUS_RANGES *get_channel_continuous_ranges(CHANNEL *channel);
+si8 continuous_ranges_overlapping(CONTINUOUS_RANGES *ranges, si8 start_time, si8 end_time, si8 *first_range);
+si8 continuous_ranges_next_data(CONTINUOUS_RANGES *ranges, si8 uutc, si8 *data_time);
+si8 continuous_ranges_coverage(CONTINUOUS_RANGES *ranges, si8 start_time, si8 end_time);
+
+// parallel decode: number of threads used to decode the blocks of a single read.
+// 1 (the default) decodes serially, 0 uses one thread per online processor.
+void set_read_mef_ts_data_num_threads(si4 num_threads);
+si4 get_read_mef_ts_data_num_threads(void);
+
+// multi-channel reads: same time range from many channels, into one channels x samples buffer
+#define CHANNEL_MAJOR_LAYOUT        0   // decomp_data[channel * samples_per_channel + sample]
+#define SAMPLE_INTERLEAVED_LAYOUT   1   // decomp_data[sample * n_channels + channel]
+
+si4 read_mef_channels_data_by_time(si1 **channel_paths, si1 *password, CHANNEL **channels_passed_in, si4 n_channels, si8 start_time, si8 end_time, si4 *decomp_data, si8 samples_per_channel, si4 layout, si4 *samples_returned);
+si4 read_mef_session_data_by_time(SESSION *session, si4 *channel_indices, si4 n_channels, si8 start_time, si8 end_time, si4 *decomp_data, si8 samples_per_channel, si4 layout, si4 *samples_returned);
+
+// epoch reads: many time windows of one channel into one epochs x samples buffer, each block read and decoded once
+si4 read_mef_ts_epochs_by_time(si1 *channel_path, si1 *password, si8 *start_times, si8 *end_times, si4 n_epochs, si4 *decomp_data, si8 samples_per_epoch, si4 *samples_returned, CHANNEL *channel_passed_in);
+
+// how compressed data is brought in: read into a buffer (default), decoded from memory mapped segment files, or read in
+// chunks on a separate thread while earlier chunks are decoded
+#define READ_IO_DEFAULT     0   // per-call options only: use the set_read_mef_ts_data_io_mode() setting
+#define READ_IO_FREAD       1
+#define READ_IO_MMAP        2
+#define READ_IO_PIPELINED   3
+void set_read_mef_ts_data_io_mode(si4 io_mode);
+si4 get_read_mef_ts_data_io_mode(void);
+
+// access pattern hint for mapped segment files
+#define READ_ACCESS_NORMAL      0
+#define READ_ACCESS_SEQUENTIAL  1   // long scans, aggressive read-ahead
+#define READ_ACCESS_RANDOM      2   // short reads scattered over the channel, no read-ahead
+void set_read_mef_ts_data_access_pattern(si4 access_pattern);
+
+// per-bin min/max of a time range from the block index, decoding only blocks that cross bin edges
+si4 read_mef_ts_envelope_by_time(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, si4 n_bins, si4 *bin_min, si4 *bin_max, ui1 *bin_gap, CHANNEL *channel_passed_in);
+
+// features of fixed windows, computed while decoding; output holds, per window, the selected features in flag order
+#define READ_FEATURE_LINE_LENGTH        0x01
+#define READ_FEATURE_RMS                0x02
+#define READ_FEATURE_MEAN               0x04
+#define READ_FEATURE_VARIANCE           0x08
+#define READ_FEATURE_ZERO_CROSSINGS     0x10
+#define READ_FEATURE_COUNT              0x20    // valid (non-NaN) samples in the window
+#define READ_FEATURE_ALL                0x3F
+si8 mef_ts_feature_window_count(si8 start_time, si8 end_time, si8 window_length, si8 window_step);
+si4 read_mef_ts_features_by_time(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, si8 window_length, si8 window_step,
+                                 ui4 features, sf8 *output, CHANNEL *channel_passed_in);
+
+// block CRC checking: every time a block is read (default), the first time each block of a channel is read, or never
+#define READ_CRC_ALWAYS     0
+#define READ_CRC_ONCE       1
+#define READ_CRC_SKIP       2
+void set_read_mef_ts_data_crc_policy(si4 crc_policy);
+si4 get_read_mef_ts_data_crc_policy(void);
+
+// decoded block cache, used by reads of a CHANNEL passed in by the caller (disabled by default)
+void set_read_mef_ts_data_block_cache_size(ui8 max_bytes);
+void invalidate_read_mef_ts_data_block_cache(CHANNEL *channel);
+void get_read_mef_ts_data_block_cache_stats(ui8 *hits, ui8 *misses, ui8 *bytes_used, si8 *number_of_blocks);
+void reset_read_mef_ts_data_block_cache_stats(void);
+
+// streaming cursor: returns a range in chunks, with memory use independent of the length of the range
+typedef struct READ_MEF_TS_CURSOR READ_MEF_TS_CURSOR;
+READ_MEF_TS_CURSOR *open_mef_ts_cursor_by_time(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, CHANNEL *channel_passed_in);
+READ_MEF_TS_CURSOR *open_mef_ts_cursor_by_samp(si1 *channel_path, si1 *password, si8 start_samp, si8 end_samp, CHANNEL *channel_passed_in);
+si4 read_mef_ts_cursor_next(READ_MEF_TS_CURSOR *cursor, si4 *decomp_data, si4 max_samples, si8 *chunk_start_time);
+void close_mef_ts_cursor(READ_MEF_TS_CURSOR *cursor);
+
+// float output: samples are multiplied by the channel's units conversion factor, and RED_NAN (gaps, and missing
+// samples) becomes NaN.  Same ranges and return values as the si4 functions; the one-shot functions are
+// read_mef_ts_data_with_options() reads with output_format set, so take the same threads, io modes and block cache.
+#define READ_OUTPUT_SI4     0
+#define READ_OUTPUT_SF4     1
+#define READ_OUTPUT_SF8     2
+si4 read_mef_ts_data_by_time_sf4(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, sf4 *data, CHANNEL *channel_passed_in);
+si4 read_mef_ts_data_by_samp_sf4(si1 *channel_path, si1 *password, si8 start_samp, si8 end_samp, sf4 *data, CHANNEL *channel_passed_in);
+si4 read_mef_ts_data_by_time_sf8(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, sf8 *data, CHANNEL *channel_passed_in);
+si4 read_mef_ts_data_by_samp_sf8(si1 *channel_path, si1 *password, si8 start_samp, si8 end_samp, sf8 *data, CHANNEL *channel_passed_in);
+si4 read_mef_ts_cursor_next_sf4(READ_MEF_TS_CURSOR *cursor, sf4 *data, si4 max_samples, si8 *chunk_start_time);
+si4 read_mef_ts_cursor_next_sf8(READ_MEF_TS_CURSOR *cursor, sf8 *data, si4 max_samples, si8 *chunk_start_time);
+
+// resampled read: [start_time, end_time) at output_rate (<= sampling frequency), anti-alias filtered, as sf8 in the
+// channel's units
+si4 read_mef_ts_data_resampled_by_time(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, sf8 output_rate, sf8 *data, CHANNEL *channel_passed_in);
+
+void convert_samples_sf4(si4 *samples, sf4 *output, si8 n, sf8 factor);
+void convert_samples_sf8(si4 *samples, sf8 *output, si8 n, sf8 factor);
+
 CHANNEL *get_channel_struct(si1 *channel_path, si1 *password);
 sf8 get_channel_sampling_frequency(CHANNEL *channel);
 sf8 get_channel_units_conversion_factor(CHANNEL *channel);
 
+// read planning: what a read of a range would return and read, worked out from the block index without decoding
+typedef struct {
+    si8     number_of_samples;              // samples the read returns, the size of the buffer it needs
+    si8     number_of_recorded_samples;     // recorded samples in the range (by time, fewer than number_of_samples across gaps)
+    ui8     compressed_bytes;               // compressed data the read reads
+    si8     number_of_blocks;               // blocks decoded
+    si4     number_of_segments;             // segments touched
+    si1     has_gaps;                       // MEF_TRUE if the range spans a discontinuity, or extends past the recording
+    si8     first_block;                    // channel block numbers of the first and last blocks read
+    si8     last_block;
+} READ_MEF_TS_PLAN;
+si4 plan_mef_ts_read_by_time(si1 *channel_path, si1 *password, si8 start_time, si8 end_time, READ_MEF_TS_PLAN *plan, CHANNEL *channel_passed_in);
+si4 plan_mef_ts_read_by_samp(si1 *channel_path, si1 *password, si8 start_samp, si8 end_samp, READ_MEF_TS_PLAN *plan, CHANNEL *channel_passed_in);
+si4 plan_mef_ts_read(si1 *channel_path, si1 *password, si8 start_value, si8 end_value, si4 times_specified, READ_MEF_TS_PLAN *plan, CHANNEL *channel_passed_in);
+
+// Reader context: buffers for reads of one CHANNEL (compressed data, decode scratch), sized from the channel's largest
+// block and kept between reads, growing only when a read needs more.  Pass it in READ_MEF_TS_DATA_OPTIONS.  A context
+// may only be used by one read at a time.
+typedef struct READ_MEF_TS_CONTEXT READ_MEF_TS_CONTEXT;
+READ_MEF_TS_CONTEXT *create_read_mef_ts_context(CHANNEL *channel);
+void free_read_mef_ts_context(READ_MEF_TS_CONTEXT *context);
+
+// Lazy channels: opening reads only the bounds of each segment (two small header reads), not its metadata and index
+// files.  A range is read through a CHANNEL covering just the segments it touches (loaded on first use), which can be
+// passed to any function taking channel_passed_in; it stays valid until the next call on the lazy channel.  Loaded
+// segments outside that CHANNEL can be evicted, least recently used first.  Use a lazy channel from one thread at a time.
+typedef struct {
+    si8     start_time;             // recording time offset removed
+    si8     end_time;
+    si8     start_sample;           // channel sample numbers, end_sample is one past the segment's last sample
+    si8     end_sample;
+    si8     number_of_blocks;
+} LAZY_SEGMENT_BOUNDS;
+typedef struct LAZY_MEF_CHANNEL LAZY_MEF_CHANNEL;
+LAZY_MEF_CHANNEL *open_lazy_mef_channel(si1 *channel_path, si1 *password);
+void close_lazy_mef_channel(LAZY_MEF_CHANNEL *lazy);
+si8 get_lazy_mef_channel_bounds(LAZY_MEF_CHANNEL *lazy, LAZY_SEGMENT_BOUNDS **bounds);
+CHANNEL *get_lazy_mef_channel_range(LAZY_MEF_CHANNEL *lazy, si8 start_value, si8 end_value, si4 times_specified);
+si4 read_lazy_mef_ts_data_by_time(LAZY_MEF_CHANNEL *lazy, si8 start_time, si8 end_time, si4 *decomp_data);
+si4 read_lazy_mef_ts_data_by_samp(LAZY_MEF_CHANNEL *lazy, si8 start_samp, si8 end_samp, si4 *decomp_data);
+si8 evict_lazy_mef_channel_segments(LAZY_MEF_CHANNEL *lazy, si8 max_loaded_segments);
+CHANNEL_BLOCK_INDEX *get_lazy_mef_channel_block_index(LAZY_MEF_CHANNEL *lazy);
+CONTINUOUS_RANGES *get_lazy_mef_channel_continuous_ranges(LAZY_MEF_CHANNEL *lazy);
+
+// Index sidecar: one file per channel (<channel name>.ridx, in the channel directory) holding the flattened block index,
+// every segment's bounds and time series indices, sampling information and the continuous ranges, laid out to be used
+// in place from a read-only mapping.  open_lazy_mef_channel() uses a fresh sidecar instead of reading segment headers,
+// and fills in segments from it instead of reading their files.  A sidecar older than any segment file, or written for a
+// different set of segments or another version, is ignored.
+#define MEF_INDEX_SIDECAR_EXTENSION     "ridx"
+#define MEF_INDEX_SIDECAR_VERSION       1
+si4 write_mef_channel_index_sidecar(si1 *channel_path, si1 *password);
+si4 mef_channel_index_sidecar_is_fresh(si1 *channel_path);
+
+// Tail following, for recordings still being written: refresh_mef_channel() adds what has been appended to the files of
+// a CHANNEL since it was read (new index entries of its last segment, new segments), reading only that, and
+// read_mef_ts_data_since() returns the samples from a cursor (a sample number it advances) to the end of the channel.
+// A refresh reallocates the channel's segments array, the last segment's index entries, and the block index, continuous
+// ranges and mappings this module keeps for the channel, and may free the block index.  Nothing may use the channel
+// while it is refreshed (no read on another thread, and no cursor left open over it), and pointers taken from it before
+// a refresh (segments, index entries, CHANNEL_BLOCK_INDEX and CONTINUOUS_RANGES) are invalid after it.  Applications
+// reading a channel from several threads must hold off readers themselves, e.g. with a reader/writer lock taken for
+// writing around refresh_mef_channel().
+si8 refresh_mef_channel(CHANNEL *channel, si1 *password);
+si4 read_mef_ts_data_since(CHANNEL *channel, si8 *next_sample, si4 *decomp_data, si4 max_samples);
+
+// Pyramid sidecar: one file per channel (<channel name>.rpyr, in the channel directory) holding the minimum, maximum and
+// mean of bins of MEF_PYRAMID_BASE_BIN_SAMPLES samples, and of bins twice as long at each level above, with no bin
+// crossing a continuous range boundary.  write_mef_channel_pyramid() decodes only what was appended since the existing
+// pyramid was written, and read_mef_pyramid_by_time() summarizes a time range into n_bins from the coarsest level fine
+// enough for them.
+#define MEF_PYRAMID_EXTENSION           "rpyr"
+#define MEF_PYRAMID_VERSION             1
+#define MEF_PYRAMID_BASE_BIN_SAMPLES    64
+#define MEF_PYRAMID_MAX_LEVELS          24
+typedef struct MEF_PYRAMID MEF_PYRAMID;
+si4 write_mef_channel_pyramid(si1 *channel_path, si1 *password);
+MEF_PYRAMID *open_mef_pyramid(si1 *channel_path);
+void close_mef_pyramid(MEF_PYRAMID *pyramid);
+si4 get_mef_pyramid_level(MEF_PYRAMID *pyramid, si8 start_time, si8 end_time, si4 n_bins);
+si4 read_mef_pyramid_by_time(MEF_PYRAMID *pyramid, si8 start_time, si8 end_time, si4 n_bins, si4 *bin_min, si4 *bin_max, sf8 *bin_mean);
+
+// Integrity verification: every block of a channel, or of all time series channels of a session, is read and checked
+// by a pool of worker threads, and every bad block reported, rather than stopping at the first.
+#define VERIFY_BLOCK_ZERO_LENGTH    1   // the index or the block header gives the block no bytes or samples
+#define VERIFY_BLOCK_BAD_BOUNDS     2   // the size in the block header is absurd or runs past the block's data
+#define VERIFY_BLOCK_BAD_CRC        3
+#define VERIFY_BLOCK_BAD_DECODE     4   // the block header's sample count is too large, or differs from the index
+#define VERIFY_BLOCK_READ_ERROR     5   // the block's data could not be read
+typedef struct {
+    CHANNEL *channel;
+    si4     channel_number;                 // position of the channel in the call (0 for a single channel)
+    si4     segment;
+    si8     block;                          // block number within the segment
+    si8     start_time;                     // from the index, recording time offset removed
+    si8     file_offset;                    // in the segment's .tdat file
+    si8     block_bytes;                    // from the index
+    si4     error;                          // VERIFY_BLOCK_ code
+} MEF_VERIFY_ERROR;
+typedef struct {
+    si8     channels_checked;
+    si8     channels_total;
+    si8     blocks_checked;
+    si8     blocks_total;
+    ui8     bytes_checked;
+    ui8     bytes_total;
+    si8     bad_blocks;
+    sf8     seconds;                        // since the start of the verification
+    sf8     bytes_per_second;
+} MEF_VERIFY_PROGRESS;
+typedef void (*MEF_VERIFY_ERROR_FUNCTION)(void *user_data, MEF_VERIFY_ERROR *error);
+typedef void (*MEF_VERIFY_PROGRESS_FUNCTION)(void *user_data, MEF_VERIFY_PROGRESS *progress);
+typedef struct {
+    MEF_VERIFY_ERROR_FUNCTION       error_function;         // called for each bad block, NULL (default) for none
+    MEF_VERIFY_PROGRESS_FUNCTION    progress_function;      // called every progress_interval seconds and at the end
+    void    *user_data;
+    sf8     progress_interval;              // seconds, 1.0 by default
+    si4     num_threads;                    // 0 (default) uses the set_read_mef_ts_data_num_threads() setting
+    si1     decode;                         // MEF_TRUE (default) decodes every block, MEF_FALSE only checks bounds and CRCs
+} MEF_VERIFY_OPTIONS;
+void initialize_mef_verify_options(MEF_VERIFY_OPTIONS *options);
+si8 verify_mef_channel(si1 *channel_path, si1 *password, MEF_VERIFY_OPTIONS *options, MEF_VERIFY_PROGRESS *result, CHANNEL *channel_passed_in);
+si8 verify_mef_session(SESSION *session, MEF_VERIFY_OPTIONS *options, MEF_VERIFY_PROGRESS *result);
+
+// Encrypted channels: the password data reads derive from a password (the access level and expanded AES keys) is cached
+// per channel path and password, so later reads of the channel skip deriving it; clear the cache after a password
+// change.  Encrypted blocks are decrypted with AES-NI where the processor has it, unless disabled here.
+void clear_mef_password_cache(void);
+void set_read_mef_ts_data_hardware_aes(si4 enabled);
+
+// RED blocks are decoded by this module's own decoder (vectorized where the processor allows), which is checked against
+// meflib's RED_decode() on the first block of each kind a process decodes and only used if the two agree; disabled
+// here, every block goes to RED_decode().  red_decode_block() is the module's decoder alone, without that check, for
+// comparing the two: it decodes rps->compressed_data into rps->decompressed_ptr as RED_decode() does, decrypting an
+// encrypted block first, and returns 0 if rps->password_data doesn't give access to it.
+void set_read_mef_ts_data_red_decode(si4 enabled);
+si4 red_decode_block(RED_PROCESSING_STRUCT *rps);
+
+// Per-call statistics, passed in READ_MEF_TS_DATA_OPTIONS.  Reads add to the counts and times, so one struct can total
+// many reads; zero it with initialize_read_mef_ts_stats().  Stage times are wall times; the CRC and decode times are
+// summed over decode threads.  Block and byte counts cover reads that read compressed data themselves (not those
+// served by the block cache or the pipelined io mode, which only report stage times).
+#define READ_STAGE_OPEN     0   // reading the CHANNEL, when a path is given
+#define READ_STAGE_INDEX    1   // finding the blocks of the range
+#define READ_STAGE_IO       2   // reading (or mapping) the compressed data
+#define READ_STAGE_DECODE   3   // CRC checks and decoding
+#define READ_STAGE_READ     4   // the whole call
+#define READ_STAGE_COUNT    5
+typedef void (*READ_MEF_TS_TRACE_FUNCTION)(void *user_data, si4 stage, sf8 start_seconds, sf8 end_seconds);
+typedef struct {
+    si8     reads;
+    ui8     bytes_read;                     // compressed bytes read, or used from mapped files
+    si8     blocks_decoded;
+    si8     blocks_crc_checked;             // blocks whose CRC was calculated (see set_read_mef_ts_data_crc_policy())
+    si8     segments_touched;
+    si8     files_opened;                   // segment data files opened by the reads
+    sf8     stage_seconds[READ_STAGE_COUNT];
+    sf8     crc_seconds;
+    sf8     decode_seconds;
+    READ_MEF_TS_TRACE_FUNCTION  trace;      // if set, called as each stage ends, with monotonic clock times in seconds
+    void    *trace_user_data;
+} READ_MEF_TS_STATS;
+void initialize_read_mef_ts_stats(READ_MEF_TS_STATS *stats);
+const si1 *read_mef_ts_stage_name(si4 stage);
+
+// per-call options for read_mef_ts_data_with_options()
+typedef struct {
+    si4     num_threads;                    // threads used to decode blocks, 0 uses set_read_mef_ts_data_num_threads() setting
+    si1     free_decomp_data_on_error;      // MEF_TRUE (default) frees decomp_data when the read fails
+    si4     io_mode;                        // READ_IO_DEFAULT, READ_IO_FREAD, READ_IO_MMAP or READ_IO_PIPELINED
+    si1     use_block_cache;                // MEF_TRUE (default) uses the block cache, when it is enabled
+    READ_MEF_TS_CONTEXT *context;           // buffers to reuse for reads of context's channel, NULL (default) allocates per read
+    READ_MEF_TS_STATS   *stats;             // statistics to add to, NULL (default) for none
+    si4     output_format;                  // READ_OUTPUT_SI4 (default), or READ_OUTPUT_SF4 or READ_OUTPUT_SF8 with decomp_data
+                                            // pointing to an sf4 or sf8 buffer (cast to si4 *), as the float output functions
+} READ_MEF_TS_DATA_OPTIONS;
+
 // base function, should not be called by user directly
 si4 read_mef_ts_data(si1 *channel_path, si1 *password, si8 start_value, si8 end_value, si4 times_specified, si4 *decomp_data, CHANNEL *channel_passed_in, si4 sample_limit);
+si4 read_mef_ts_data_with_options(si1 *channel_path, si1 *password, si8 start_value, si8 end_value, si4 times_specified, si4 *decomp_data, CHANNEL *channel_passed_in, si4 sample_limit, READ_MEF_TS_DATA_OPTIONS *options);
+void initialize_read_mef_ts_data_options(READ_MEF_TS_DATA_OPTIONS *options);
 
 // helper functions
 si8 sample_for_uutc_c(si8 uutc, CHANNEL *channel);
 si8 uutc_for_sample_c(si8 sample, CHANNEL *channel);
 void memset_int(si4 *ptr, si4 value, size_t num);
 si4 check_block_crc(ui1* block_hdr_ptr, ui4 max_samps, ui1* total_data_ptr, ui8 total_data_bytes);
+si4 check_block_bounds(ui1* block_hdr_ptr, ui4 max_samps, ui1* total_data_ptr, ui8 total_data_bytes);
+si4 check_channel_block_crc(CHANNEL *channel, si8 block, ui1* block_hdr_ptr, ui4 max_samps, ui1* total_data_ptr, ui8 total_data_bytes);
+ui4 calculate_block_crc(ui1 *data, si8 bytes);
+si4 read_segment_data(CHANNEL *channel, si4 segment, si8 offset, ui8 bytes, ui1 *buffer);
+void advise_segment_data(CHANNEL *channel, si4 segment, si8 offset, ui8 bytes);
+si4 get_number_of_processors(void);
+RED_PROCESSING_STRUCT *allocate_decode_rps(ui4 max_samps);
+void free_decode_rps(RED_PROCESSING_STRUCT *rps);
+
+// channel block index
+CHANNEL_BLOCK_INDEX *get_channel_block_index(CHANNEL *channel);
+CHANNEL_BLOCK_INDEX *build_channel_block_index(CHANNEL *channel);
+void free_channel_block_index(CHANNEL_BLOCK_INDEX *index);
+CONTINUOUS_RANGES *build_continuous_ranges(CHANNEL *channel, CHANNEL_BLOCK_INDEX *index);
+void free_continuous_ranges(CONTINUOUS_RANGES *ranges);
+void release_channel_reader_state(CHANNEL *channel);
+si8 block_index_first_after_time(CHANNEL_BLOCK_INDEX *index, si8 lo, si8 hi, si8 uutc, si4 remove_offset);
+si8 block_index_first_after_sample(CHANNEL_BLOCK_INDEX *index, si8 sample);
+si8 block_index_block_end_offset(CHANNEL_BLOCK_INDEX *index, CHANNEL *channel, si8 block);
+si4 block_index_first_segment_ending_at_or_after(CHANNEL_BLOCK_INDEX *index, si8 uutc);
+si4 block_index_last_segment_starting_at_or_before(CHANNEL_BLOCK_INDEX *index, si8 uutc);
+si4 block_index_segment_for_sample(CHANNEL_BLOCK_INDEX *index, si8 sample);
 
 // helper types
 typedef struct CONTINUOUS_RANGE_NODE CONTINUOUS_RANGE_NODE;
@@ -47,3 +373,19 @@ struct CONTINUOUS_RANGE_NODE {
     si8 end_time;
     CONTINUOUS_RANGE_NODE *next;
 };
+
+// one block of a read: where its RED block starts in the compressed buffer, and where its samples go
+typedef struct {
+    ui1     *block_ptr;
+    ui8     bytes_available;    // compressed bytes from block_ptr to the end of its buffer (or mapped span)
+    si4     *output_ptr;
+    ui4     number_of_samples;
+    CHANNEL *channel;           // with block, the block's identity for the CRC policy (NULL: always verify)
+    si8     block;              // channel block number
+} DECODE_BLOCK_JOB;
+
+si8 decode_block_jobs(DECODE_BLOCK_JOB *jobs, si8 n_jobs, ui4 max_samps, si4 copy_blocks, si4 n_threads);
+si8 decode_block_jobs_with_buffers(DECODE_BLOCK_JOB *jobs, si8 n_jobs, ui4 max_samps, si4 copy_blocks, si4 n_threads, RED_PROCESSING_STRUCT *rps, ui1 *block_copy);
+void decode_block(RED_PROCESSING_STRUCT *rps, ui1 *block_ptr, si4 *output, ui1 *block_copy);
+ui1 *get_segment_map(CHANNEL *channel, si4 segment, ui8 *bytes);
+void advise_segment_map(ui1 *data, ui8 bytes);
@@ -0,0 +1,511 @@
+// Multiscale Electrophysiology Format (MEF) version 3.0
+// Copyright 2022, Mayo Foundation, Rochester MN. All rights reserved.
+
+// Usage and modification of this source code is governed by the Apache 2.0 license.
+// You may not use this file except in compliance with this License.
+// A copy of the Apache 2.0 License may be obtained at http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under this License is distributed on an "as is" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either expressed or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Thanks to all who acknowledge the Mayo Systems Electrophysiology Laboratory, Rochester, MN
+// in academic publications of their work facilitated by this software.
+
+// Synthetic channel writer shared by bench_read.c and test_read_features.c (see synthetic_channel.h).
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "synthetic_channel.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <sys/types.h>
+#else
+#include <direct.h>
+#endif
+
+extern MEF_GLOBALS *MEF_globals;
+
+// small deterministic generator, so runs are repeatable
+ui4 synthetic_random(ui8 *state)
+{
+    *state = (*state * 6364136223846793005ULL) + 1442695040888963407ULL;
+    return (ui4) (*state >> 33);
+}
+
+static void make_directory(si1 *path)
+{
+#ifndef _WIN32
+    mkdir(path, 0755);
+#else
+    _mkdir(path);
+#endif
+}
+
+void initialize_synthetic_channel(SYNTHETIC_CHANNEL *synth)
+{
+    memset(synth, 0, sizeof(SYNTHETIC_CHANNEL));
+    MEF_strncpy(synth->dir, "mef_synthetic", MEF_FULL_FILE_NAME_BYTES);
+    MEF_strncpy(synth->name, "synthetic", MEF_BASE_FILE_NAME_BYTES);
+    synth->rate = 1000.0;
+    synth->block_samples = 1000;
+    synth->seconds = 600.0;
+    synth->gap_ms = 500.0;
+    synth->start_time = SYNTHETIC_START_TIME;
+    synth->signal = SYNTHETIC_SIGNAL_MIXED;
+}
+
+void synthetic_channel_path(SYNTHETIC_CHANNEL *synth, si1 *path)
+{
+    MEF_snprintf(path, MEF_FULL_FILE_NAME_BYTES, "%s/%s.%s/%s.%s", synth->dir, synth->name, SESSION_DIRECTORY_TYPE_STRING,
+                 synth->name, TIME_SERIES_CHANNEL_DIRECTORY_TYPE_STRING);
+}
+
+void synthetic_segment_name(SYNTHETIC_CHANNEL *synth, si4 segment, si1 *name)
+{
+    MEF_snprintf(name, MEF_BASE_FILE_NAME_BYTES, "%s-%06d", synth->name, segment);
+}
+
+// A block of the channel's signal.  Mixed signals are a function of the sample number (and the noise of the order
+// blocks are generated in), tones of time, so that they stay in phase across gaps.
+static void synthesize_block(SYNTHETIC_CHANNEL *synth, si4 *samples, si4 n, si8 first_sample, si8 start_time, ui8 *random_state)
+{
+    si4 i;
+    sf8 t;
+
+    for (i = 0; i < n; i++)
+    {
+        switch (synth->signal)
+        {
+            case SYNTHETIC_SIGNAL_DC:
+                samples[i] = (si4) synth->amplitude;
+                break;
+            case SYNTHETIC_SIGNAL_TONE:
+                t = ((sf8) (start_time - synth->start_time) / 1e6) + ((sf8) i / synth->rate);
+                samples[i] = (si4) floor((synth->amplitude * sin(2.0 * M_PI * synth->frequency * t)) + 0.5);
+                break;
+            default:
+                t = (sf8) (first_sample + i) / synth->rate;
+                samples[i] = (si4) ((8000.0 * sin(2.0 * M_PI * 7.0 * t)) + (2000.0 * sin(2.0 * M_PI * 61.0 * t)) +
+                                    (sf8) ((si4) (synthetic_random(random_state) & 0x3FF) - 512));
+                break;
+        }
+    }
+}
+
+// Decodes a block just written with meflib's RED_decode() and with the reader's own decoder (red_decode_block()), each
+// from its own copy of the block, and compares the samples and header start times.  Prints the difference, returns 0
+// if there is one.
+static si4 check_block_decode(RED_PROCESSING_STRUCT *rps, si4 segment, si8 block, ui1 *block_copy, si4 *meflib_samples, si4 *module_samples)
+{
+    RED_PROCESSING_STRUCT decode_rps;
+    si8 meflib_start_time;
+    ui4 i, n;
+
+    n = rps->block_header->number_of_samples;
+    decode_rps = *rps;
+    decode_rps.compression.mode = RED_DECOMPRESSION;
+    decode_rps.compressed_data = block_copy;
+    decode_rps.block_header = (RED_BLOCK_HEADER *) block_copy;
+
+    memcpy(block_copy, rps->compressed_data, (size_t) rps->block_header->block_bytes);
+    decode_rps.decompressed_ptr = decode_rps.decompressed_data = meflib_samples;
+    RED_decode(&decode_rps);
+    meflib_start_time = decode_rps.block_header->start_time;
+
+    memcpy(block_copy, rps->compressed_data, (size_t) rps->block_header->block_bytes);
+    decode_rps.decompressed_ptr = decode_rps.decompressed_data = module_samples;
+    if (!red_decode_block(&decode_rps))
+    {
+        printf("Segment %d block %lld: the reader's decoder could not decrypt it\n", segment, (long long) block);
+        return 0;
+    }
+
+    if (decode_rps.block_header->start_time != meflib_start_time)
+    {
+        printf("Segment %d block %lld: decoded start time is %lld, RED_decode() gives %lld\n", segment, (long long) block,
+               (long long) decode_rps.block_header->start_time, (long long) meflib_start_time);
+        return 0;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (module_samples[i] != meflib_samples[i])
+        {
+            printf("Segment %d block %lld: decoded sample %u is %d, RED_decode() gives %d\n", segment, (long long) block, i,
+                   module_samples[i], meflib_samples[i]);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Writes the next segment: its metadata, data and index files.  Unless decode_mismatches is NULL, each block is also
+// decoded both ways, and blocks that decode differently with the reader's decoder are counted in it.
+static si4 write_segment(SYNTHETIC_CHANNEL *synth, si1 *channel_path, si4 *decode_mismatches)
+{
+    FILE_PROCESSING_STRUCT *proto_fps, *metadata_fps, *data_fps, *index_fps;
+    RED_PROCESSING_STRUCT *rps;
+    TIME_SERIES_METADATA_SECTION_2 *tmd2;
+    TIME_SERIES_INDEX *tsi;
+    UNIVERSAL_HEADER *uh;
+    si1 segment_name[MEF_BASE_FILE_NAME_BYTES], segment_path[MEF_FULL_FILE_NAME_BYTES];
+    si4 *samples, *meflib_samples, *module_samples;
+    ui1 *block_copy;
+    si8 n_samples, n_blocks, block, block_time, file_offset, contiguous_blocks, contiguous_bytes, contiguous_samples, offset;
+    si4 segment, n, gap;
+    sf8 block_duration;
+
+    segment = synth->segments_written;
+    offset = synth->recording_time_offset;
+    n_samples = (si8) (synth->seconds * synth->rate);
+    n_blocks = (n_samples + synth->block_samples - 1) / synth->block_samples;
+    block_duration = ((sf8) synth->block_samples / synth->rate) * 1e6;
+
+    synthetic_segment_name(synth, segment, segment_name);
+    MEF_snprintf(segment_path, MEF_FULL_FILE_NAME_BYTES, "%s/%s.%s", channel_path, segment_name, SEGMENT_DIRECTORY_TYPE_STRING);
+    make_directory(segment_path);
+
+    meflib_samples = module_samples = NULL;
+    block_copy = NULL;
+    if (decode_mismatches != NULL)
+    {
+        meflib_samples = (si4 *) malloc(sizeof(si4) * (size_t) synth->block_samples);
+        module_samples = (si4 *) malloc(sizeof(si4) * (size_t) synth->block_samples);
+        block_copy = (ui1 *) malloc((size_t) RED_MAX_COMPRESSED_BYTES(synth->block_samples, 1));
+        if ((meflib_samples == NULL) || (module_samples == NULL) || (block_copy == NULL))
+        {
+            printf("Could not allocate the block decoding check buffers\n");
+            free (meflib_samples);
+            free (module_samples);
+            free (block_copy);
+            return 0;
+        }
+    }
+
+    // universal header and password data shared by the segment's files; times are written with the offset applied
+    proto_fps = allocate_file_processing_struct(UNIVERSAL_HEADER_BYTES, NO_FILE_TYPE_CODE, NULL, NULL, 0);
+    initialize_universal_header(proto_fps, MEF_TRUE, MEF_FALSE, MEF_TRUE);
+    uh = proto_fps->universal_header;
+    MEF_strncpy(uh->channel_name, synth->name, MEF_BASE_FILE_NAME_BYTES);
+    MEF_strncpy(uh->session_name, synth->name, MEF_BASE_FILE_NAME_BYTES);
+    uh->segment_number = segment;
+    uh->start_time = synth->next_start_time - offset;
+    proto_fps->password_data = process_password_data(NULL, synth->encrypt ? SYNTHETIC_PASSWORD : NULL, synth->encrypt ? SYNTHETIC_PASSWORD_2 : NULL, uh);
+
+    // metadata, rewritten at the end with the block statistics
+    metadata_fps = allocate_file_processing_struct(METADATA_FILE_BYTES, TIME_SERIES_METADATA_FILE_TYPE_CODE, NULL, proto_fps, UNIVERSAL_HEADER_BYTES);
+    MEF_snprintf(metadata_fps->full_file_name, MEF_FULL_FILE_NAME_BYTES, "%s/%s.%s", segment_path, segment_name, TIME_SERIES_METADATA_FILE_TYPE_STRING);
+    initialize_metadata(metadata_fps);
+    generate_UUID(metadata_fps->universal_header->file_UUID);
+    metadata_fps->universal_header->number_of_entries = 1;
+    metadata_fps->universal_header->maximum_entry_size = METADATA_FILE_BYTES;
+    metadata_fps->metadata.section_1->section_2_encryption = synth->encrypt ? LEVEL_1_ENCRYPTION : NO_ENCRYPTION;
+    metadata_fps->metadata.section_1->section_3_encryption = synth->encrypt ? LEVEL_2_ENCRYPTION : NO_ENCRYPTION;
+    tmd2 = metadata_fps->metadata.time_series_section_2;
+    tmd2->sampling_frequency = synth->rate;
+    tmd2->units_conversion_factor = 1.0;
+    MEF_strncpy(tmd2->units_description, "microvolts", TIME_SERIES_METADATA_UNITS_DESCRIPTION_BYTES);
+    tmd2->start_sample = synth->next_start_sample;
+    tmd2->acquisition_channel_number = 1;
+    tmd2->block_interval = (si8) (block_duration + 0.5);
+    metadata_fps->metadata.section_3->recording_time_offset = offset;
+
+    index_fps = allocate_file_processing_struct(UNIVERSAL_HEADER_BYTES + (n_blocks * TIME_SERIES_INDEX_BYTES), TIME_SERIES_INDICES_FILE_TYPE_CODE, NULL, metadata_fps, UNIVERSAL_HEADER_BYTES);
+    MEF_snprintf(index_fps->full_file_name, MEF_FULL_FILE_NAME_BYTES, "%s/%s.%s", segment_path, segment_name, TIME_SERIES_INDICES_FILE_TYPE_STRING);
+    generate_UUID(index_fps->universal_header->file_UUID);
+    index_fps->universal_header->number_of_entries = n_blocks;
+    index_fps->universal_header->maximum_entry_size = TIME_SERIES_INDEX_BYTES;
+
+    // the data file's header is written first, and again once its body CRC is known
+    data_fps = allocate_file_processing_struct(UNIVERSAL_HEADER_BYTES + RED_MAX_COMPRESSED_BYTES(synth->block_samples, 1), TIME_SERIES_DATA_FILE_TYPE_CODE, NULL, metadata_fps, UNIVERSAL_HEADER_BYTES);
+    MEF_snprintf(data_fps->full_file_name, MEF_FULL_FILE_NAME_BYTES, "%s/%s.%s", segment_path, segment_name, TIME_SERIES_DATA_FILE_TYPE_STRING);
+    generate_UUID(data_fps->universal_header->file_UUID);
+    data_fps->universal_header->number_of_entries = n_blocks;
+    data_fps->universal_header->maximum_entry_size = synth->block_samples;
+    data_fps->universal_header->body_CRC = CRC_START_VALUE;
+    data_fps->directives.io_bytes = UNIVERSAL_HEADER_BYTES;
+    data_fps->directives.close_file = MEF_FALSE;
+    write_MEF_file(data_fps);
+
+    rps = RED_allocate_processing_struct(synth->block_samples, 0, 0, RED_MAX_DIFFERENCE_BYTES(synth->block_samples), 0, 0, metadata_fps->password_data);
+    rps->compression.mode = RED_COMPRESSION;
+    rps->directives.return_block_extrema = MEF_TRUE;
+    rps->directives.encryption_level = synth->encrypt ? LEVEL_1_ENCRYPTION : NO_ENCRYPTION;
+    rps->compressed_data = data_fps->RED_blocks;
+    rps->block_header = (RED_BLOCK_HEADER *) rps->compressed_data;
+    samples = (si4 *) malloc(sizeof(si4) * (size_t) synth->block_samples);
+
+    file_offset = UNIVERSAL_HEADER_BYTES;
+    block_time = synth->next_start_time;
+    contiguous_blocks = contiguous_bytes = contiguous_samples = 0;
+    tmd2->maximum_native_sample_value = -1e300;
+    tmd2->minimum_native_sample_value = 1e300;
+    for (block = 0; block < n_blocks; block++)
+    {
+        n = (si4) (((n_samples - (block * synth->block_samples)) < synth->block_samples) ? (n_samples - (block * synth->block_samples)) : synth->block_samples);
+        gap = (synth->gap_every > 0) && (block > 0) && ((block % synth->gap_every) == 0);
+        if (gap)
+            block_time += (si8) (synth->gap_ms * 1000.0);
+        synthesize_block(synth, samples, n, synth->next_start_sample + (block * synth->block_samples), block_time, &synth->random_state);
+
+        // every segment starts a new contiguous range, as do blocks after a gap
+        rps->original_data = rps->original_ptr = samples;
+        rps->block_header->number_of_samples = n;
+        rps->block_header->start_time = block_time - offset;
+        rps->directives.discontinuity = ((block == 0) || gap) ? MEF_TRUE : MEF_FALSE;
+        RED_encode(rps);
+        e_fwrite(rps->compressed_data, sizeof(ui1), (size_t) rps->block_header->block_bytes, data_fps->fp, data_fps->full_file_name, __FUNCTION__, __LINE__, EXIT_ON_FAIL);
+        data_fps->universal_header->body_CRC = CRC_update(rps->compressed_data, rps->block_header->block_bytes, data_fps->universal_header->body_CRC);
+        if ((decode_mismatches != NULL) && !check_block_decode(rps, segment, block, block_copy, meflib_samples, module_samples))
+            (*decode_mismatches)++;
+
+        tsi = index_fps->time_series_indices + block;
+        tsi->file_offset = file_offset;
+        tsi->start_time = block_time - offset;
+        tsi->start_sample = block * synth->block_samples;
+        tsi->number_of_samples = n;
+        tsi->block_bytes = rps->block_header->block_bytes;
+        tsi->maximum_sample_value = rps->maximum_sample_value;
+        tsi->minimum_sample_value = rps->minimum_sample_value;
+        tsi->RED_block_flags = rps->block_header->flags;
+        file_offset += rps->block_header->block_bytes;
+
+        // block statistics for the metadata
+        if (rps->block_header->flags & RED_DISCONTINUITY_MASK)
+        {
+            tmd2->number_of_discontinuities++;
+            contiguous_blocks = contiguous_bytes = contiguous_samples = 0;
+        }
+        contiguous_blocks++;
+        contiguous_bytes += rps->block_header->block_bytes;
+        contiguous_samples += n;
+        if (contiguous_blocks > tmd2->maximum_contiguous_blocks)
+            tmd2->maximum_contiguous_blocks = contiguous_blocks;
+        if (contiguous_bytes > tmd2->maximum_contiguous_block_bytes)
+            tmd2->maximum_contiguous_block_bytes = contiguous_bytes;
+        if (contiguous_samples > tmd2->maximum_contiguous_samples)
+            tmd2->maximum_contiguous_samples = contiguous_samples;
+        if ((si8) rps->block_header->block_bytes > tmd2->maximum_block_bytes)
+            tmd2->maximum_block_bytes = rps->block_header->block_bytes;
+        if ((ui4) n > tmd2->maximum_block_samples)
+            tmd2->maximum_block_samples = n;
+        if (rps->block_header->difference_bytes > tmd2->maximum_difference_bytes)
+            tmd2->maximum_difference_bytes = rps->block_header->difference_bytes;
+        if ((sf8) rps->maximum_sample_value > tmd2->maximum_native_sample_value)
+            tmd2->maximum_native_sample_value = rps->maximum_sample_value;
+        if ((sf8) rps->minimum_sample_value < tmd2->minimum_native_sample_value)
+            tmd2->minimum_native_sample_value = rps->minimum_sample_value;
+
+        block_time += (si8) ((((sf8) n / synth->rate) * 1e6) + 0.5);
+    }
+    tmd2->number_of_samples = n_samples;
+    tmd2->number_of_blocks = n_blocks;
+    tmd2->recording_duration = block_time - synth->next_start_time;
+
+    // every file of the segment covers the same time range
+    metadata_fps->universal_header->end_time = index_fps->universal_header->end_time = data_fps->universal_header->end_time = block_time - offset;
+
+    data_fps->universal_header->header_CRC = CRC_calculate(data_fps->raw_data + CRC_BYTES, UNIVERSAL_HEADER_BYTES - CRC_BYTES);
+    e_fseek(data_fps->fp, 0, SEEK_SET, data_fps->full_file_name, __FUNCTION__, __LINE__, EXIT_ON_FAIL);
+    e_fwrite(data_fps->universal_header, sizeof(ui1), UNIVERSAL_HEADER_BYTES, data_fps->fp, data_fps->full_file_name, __FUNCTION__, __LINE__, EXIT_ON_FAIL);
+    fclose(data_fps->fp);
+    data_fps->fp = NULL;
+
+    write_MEF_file(index_fps);
+    write_MEF_file(metadata_fps);
+
+    synth->segments_written++;
+    synth->next_start_time = block_time + (si8) (synth->gap_ms * 1000.0);
+    synth->next_start_sample += n_samples;
+
+    free (samples);
+    free (meflib_samples);
+    free (module_samples);
+    free (block_copy);
+    rps->compressed_data = NULL;   // belongs to data_fps
+    RED_free_processing_struct(rps);
+    free_file_processing_struct(data_fps);
+    free_file_processing_struct(index_fps);
+    free_file_processing_struct(metadata_fps);
+    free_file_processing_struct(proto_fps);
+
+    return 1;
+}
+
+// Writes the next segment of a channel written with write_synthetic_channel().  Returns 0 on failure.
+si4 append_synthetic_segment(SYNTHETIC_CHANNEL *synth, si4 *decode_mismatches)
+{
+    si1 path[MEF_FULL_FILE_NAME_BYTES];
+    si8 recording_time_offset;
+    si4 behavior_on_fail, written;
+
+    // block times are encoded as given, and a failed write is fatal; the caller's settings are restored after
+    (void) initialize_meflib();
+    behavior_on_fail = MEF_globals->behavior_on_fail;
+    recording_time_offset = MEF_globals->recording_time_offset;
+    MEF_globals->behavior_on_fail = EXIT_ON_FAIL;
+    MEF_globals->recording_time_offset = 0;
+
+    synthetic_channel_path(synth, path);
+    written = write_segment(synth, path, decode_mismatches);
+
+    MEF_globals->behavior_on_fail = behavior_on_fail;
+    MEF_globals->recording_time_offset = recording_time_offset;
+
+    return written;
+}
+
+// Writes a new channel of the given number of segments, in directories created as needed (an existing channel of the
+// same name is overwritten segment by segment, not removed).  Returns 0 on failure.
+si4 write_synthetic_channel(SYNTHETIC_CHANNEL *synth, si4 segments, si4 *decode_mismatches)
+{
+    si1 path[MEF_FULL_FILE_NAME_BYTES];
+    si4 segment;
+
+    make_directory(synth->dir);
+    MEF_snprintf(path, MEF_FULL_FILE_NAME_BYTES, "%s/%s.%s", synth->dir, synth->name, SESSION_DIRECTORY_TYPE_STRING);
+    make_directory(path);
+    synthetic_channel_path(synth, path);
+    make_directory(path);
+
+    synth->segments_written = 0;
+    synth->next_start_time = synth->start_time;
+    synth->next_start_sample = 0;
+    synth->random_state = SYNTHETIC_RANDOM_SEED;
+    for (segment = 0; segment < segments; segment++)
+        if (!append_synthetic_segment(synth, decode_mismatches))
+            return 0;
+
+    return 1;
+}
+
+// Regenerates the samples and block times of the first segments segments of a channel (synthesize_block() is
+// deterministic), laid out as write_segment() lays them out.  Block times have the recording time offset removed.
+si4 build_synthetic_truth(SYNTHETIC_CHANNEL *synth, si4 segments, SYNTHETIC_TRUTH *truth)
+{
+    si8 n_samples, n_blocks, block, block_time, start_time, start_sample, k;
+    ui8 random_state;
+    si4 segment, n, gap;
+
+    n_samples = (si8) (synth->seconds * synth->rate);
+    n_blocks = (n_samples + synth->block_samples - 1) / synth->block_samples;
+    truth->rate = synth->rate;
+    truth->number_of_samples = n_samples * segments;
+    truth->number_of_blocks = n_blocks * segments;
+    truth->samples = (si4 *) malloc(sizeof(si4) * (size_t) truth->number_of_samples);
+    truth->block_start_time = (si8 *) malloc(sizeof(si8) * (size_t) truth->number_of_blocks);
+    truth->block_start_sample = (si8 *) malloc(sizeof(si8) * (size_t) truth->number_of_blocks);
+    truth->block_samples = (si4 *) malloc(sizeof(si4) * (size_t) truth->number_of_blocks);
+    if ((truth->samples == NULL) || (truth->block_start_time == NULL) || (truth->block_start_sample == NULL) || (truth->block_samples == NULL))
+    {
+        free_synthetic_truth(truth);
+        return 0;
+    }
+
+    start_time = synth->start_time;
+    start_sample = 0;
+    random_state = SYNTHETIC_RANDOM_SEED;
+    k = 0;
+    for (segment = 0; segment < segments; segment++)
+    {
+        block_time = start_time;
+        for (block = 0; block < n_blocks; block++, k++)
+        {
+            n = (si4) (((n_samples - (block * synth->block_samples)) < synth->block_samples) ? (n_samples - (block * synth->block_samples)) : synth->block_samples);
+            gap = (synth->gap_every > 0) && (block > 0) && ((block % synth->gap_every) == 0);
+            if (gap)
+                block_time += (si8) (synth->gap_ms * 1000.0);
+            truth->block_start_time[k] = block_time;
+            truth->block_start_sample[k] = start_sample + (block * synth->block_samples);
+            truth->block_samples[k] = n;
+            synthesize_block(synth, truth->samples + truth->block_start_sample[k], n, truth->block_start_sample[k], block_time, &random_state);
+            block_time += (si8) ((((sf8) n / synth->rate) * 1e6) + 0.5);
+        }
+        start_time = block_time + (si8) (synth->gap_ms * 1000.0);
+        start_sample += n_samples;
+    }
+
+    return 1;
+}
+
+void free_synthetic_truth(SYNTHETIC_TRUTH *truth)
+{
+    free (truth->samples);
+    free (truth->block_start_time);
+    free (truth->block_start_sample);
+    free (truth->block_samples);
+    truth->samples = NULL;
+    truth->block_start_time = truth->block_start_sample = NULL;
+    truth->block_samples = NULL;
+}
+
+// Checks the n samples a read of [start, end) returned against what it should return: the channel's samples from start
+// when reading by sample, and when reading by time each block's samples from the output position of its start time
+// (rounded as the reader rounds it), with RED_NAN where no block lands.  Prints the first difference, returns 0 if any.
+si4 check_synthetic_read(SYNTHETIC_TRUTH *truth, si8 start, si8 end, si4 by_time, si4 *buffer, si4 n)
+{
+    si4 *expected;
+    si8 n_expected, first, last, offset, lo, hi, mid, k, i;
+    si4 ok;
+
+    expected = NULL;
+    first = 0;
+    if (by_time)
+    {
+        n_expected = (si8) (((end - start) / 1000000.0) * truth->rate);
+        expected = (si4 *) malloc(sizeof(si4) * (size_t) (n_expected + 1));
+        for (i = 0; i < n_expected; i++)
+            expected[i] = RED_NAN;
+
+        // from the last block starting at or before the window, to the last block starting within it
+        lo = 0;
+        hi = truth->number_of_blocks;
+        while (lo < hi)
+        {
+            mid = (lo + hi) / 2;
+            if (truth->block_start_time[mid] <= start)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        for (k = (lo > 0) ? lo - 1 : 0; (k < truth->number_of_blocks) && (truth->block_start_time[k] < end); k++)
+        {
+            if (truth->block_start_time[k] >= start)
+                offset = (si8) ((((truth->block_start_time[k] - start) / 1000000.0) * truth->rate) + 0.5);
+            else
+                offset = (si8) ((((truth->block_start_time[k] - start) / 1000000.0) * truth->rate) - 0.5);
+            for (i = 0; i < truth->block_samples[k]; i++)
+                if ((offset + i >= 0) && (offset + i < n_expected))
+                    expected[offset + i] = truth->samples[truth->block_start_sample[k] + i];
+        }
+    }
+    else
+    {
+        first = (start < 0) ? 0 : start;
+        last = (end > truth->number_of_samples) ? truth->number_of_samples : end;
+        n_expected = (last > first) ? last - first : 0;
+    }
+
+    ok = (n == n_expected);
+    if (!ok)
+        printf("Read of [%lld, %lld) %s returned %d samples, expected %lld\n", (long long) start, (long long) end,
+               by_time ? "by time" : "by sample", n, (long long) n_expected);
+    for (i = 0; ok && (i < n_expected); i++)
+    {
+        if (buffer[i] != (by_time ? expected[i] : truth->samples[first + i]))
+        {
+            printf("Read of [%lld, %lld) %s: sample %lld is %d, expected %d\n", (long long) start, (long long) end,
+                   by_time ? "by time" : "by sample", (long long) i, buffer[i], by_time ? expected[i] : truth->samples[first + i]);
+            ok = 0;
+        }
+    }
+    free (expected);
+
+    return ok;
+}
@@ -0,0 +1,78 @@
+// Multiscale Electrophysiology Format (MEF) version 3.0
+// Copyright 2022, Mayo Foundation, Rochester MN. All rights reserved.
+
+// Usage and modification of this source code is governed by the Apache 2.0 license.
+// You may not use this file except in compliance with this License.
+// A copy of the Apache 2.0 License may be obtained at http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under this License is distributed on an "as is" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either expressed or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Thanks to all who acknowledge the Mayo Systems Electrophysiology Laboratory, Rochester, MN
+// in academic publications of their work facilitated by this software.
+
+#ifndef SYNTHETIC_CHANNEL_IN
+#define SYNTHETIC_CHANNEL_IN
+
+#include "read_mef_ts_data.h"
+
+// Synthetic MEF 3.0 channels, written with meflib, for bench_read.c and test_read_features.c.  Every segment holds the
+// same number of samples in blocks of block_samples, optionally with a gap after every gap_every blocks, and segments
+// are separated by a gap of the same length.  The samples are deterministic, so what was written can be regenerated
+// (build_synthetic_truth()) and compared with what a read returns.
+
+#define SYNTHETIC_PASSWORD          "synthetic"             // level 1
+#define SYNTHETIC_PASSWORD_2        "synthetic_level_2"
+#define SYNTHETIC_START_TIME        1577836800000000        // 1 January 2020
+#define SYNTHETIC_RANDOM_SEED       12345
+
+#define SYNTHETIC_SIGNAL_MIXED      0   // sines at 7 and 61 Hz and noise, in the range of 16 bit acquisition
+#define SYNTHETIC_SIGNAL_DC         1   // amplitude, constant
+#define SYNTHETIC_SIGNAL_TONE       2   // a sine of amplitude at frequency, rounded to integers
+
+typedef struct {
+    si1     dir[MEF_FULL_FILE_NAME_BYTES];      // the session directory is created in dir
+    si1     name[MEF_BASE_FILE_NAME_BYTES];     // of the session and the channel
+    sf8     rate;
+    si4     block_samples;
+    sf8     seconds;                            // recording length of each segment
+    si4     gap_every;                          // a gap after every gap_every blocks, 0 for none
+    sf8     gap_ms;
+    si4     encrypt;                            // level 1 and 2 passwords above
+    si8     start_time;                         // of the first sample, recording time offset removed
+    si8     recording_time_offset;              // times are written with this offset applied, and it in section 3
+    si4     signal;                             // SYNTHETIC_SIGNAL_ code
+    sf8     amplitude;
+    sf8     frequency;
+    // where the next segment written starts
+    si4     segments_written;
+    si8     next_start_time;
+    si8     next_start_sample;
+    ui8     random_state;
+} SYNTHETIC_CHANNEL;
+
+// what a synthetic channel holds: every sample, and where each block starts (recording time offset removed)
+typedef struct {
+    sf8     rate;
+    si4     *samples;
+    si8     number_of_samples;
+    si8     *block_start_time;
+    si8     *block_start_sample;
+    si4     *block_samples;
+    si8     number_of_blocks;
+} SYNTHETIC_TRUTH;
+
+void initialize_synthetic_channel(SYNTHETIC_CHANNEL *synth);
+void synthetic_channel_path(SYNTHETIC_CHANNEL *synth, si1 *path);
+void synthetic_segment_name(SYNTHETIC_CHANNEL *synth, si4 segment, si1 *name);
+si4 write_synthetic_channel(SYNTHETIC_CHANNEL *synth, si4 segments, si4 *decode_mismatches);
+si4 append_synthetic_segment(SYNTHETIC_CHANNEL *synth, si4 *decode_mismatches);
+si4 build_synthetic_truth(SYNTHETIC_CHANNEL *synth, si4 segments, SYNTHETIC_TRUTH *truth);
+void free_synthetic_truth(SYNTHETIC_TRUTH *truth);
+si4 check_synthetic_read(SYNTHETIC_TRUTH *truth, si8 start, si8 end, si4 by_time, si4 *buffer, si4 n);
+ui4 synthetic_random(ui8 *state);
+
+#endif   // SYNTHETIC_CHANNEL_IN
@@ -0,0 +1,966 @@
+// Multiscale Electrophysiology Format (MEF) version 3.0
+// Copyright 2022, Mayo Foundation, Rochester MN. All rights reserved.
+
+// Usage and modification of this source code is governed by the Apache 2.0 license.
+// You may not use this file except in compliance with this License.
+// A copy of the Apache 2.0 License may be obtained at http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under this License is distributed on an "as is" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either expressed or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Thanks to all who acknowledge the Mayo Systems Electrophysiology Laboratory, Rochester, MN
+// in academic publications of their work facilitated by this software.
+
+// Checks of the module's read paths against synthetic channels (see synthetic_channel.h), whose samples are known:
+// lazy and fully opened channels, index sidecar staleness, tail following, epoch reads, envelopes, resampled reads,
+// pyramids, integrity verification, and reads of a channel with a recording time offset.  Each test writes its own
+// channel under the directory given (mef_test by default), and the program exits with status 1 if any check fails.
+//
+// Build with synthetic_channel.c, meflib.c and mefrec.c, for example:
+//     cc -O2 test_read_features.c synthetic_channel.c read_mef_ts_data.c meflib.c mefrec.c -lpthread -lm -o test_read_features
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "synthetic_channel.h"
+
+#ifndef _WIN32
+#include <utime.h>
+#else
+#include <sys/utime.h>
+#endif
+
+extern MEF_GLOBALS *MEF_globals;
+
+static si1 test_dir[MEF_FULL_FILE_NAME_BYTES];
+static ui8 random_state = 42;
+
+/**************************  Helpers  ****************************/
+
+// a synthetic channel of the test directory, with the defaults of synthetic_channel.c otherwise
+static void test_synthetic_channel(SYNTHETIC_CHANNEL *synth, si1 *name, sf8 rate, si4 block_samples, sf8 seconds, si4 gap_every)
+{
+    initialize_synthetic_channel(synth);
+    MEF_strncpy(synth->dir, test_dir, MEF_FULL_FILE_NAME_BYTES);
+    MEF_strncpy(synth->name, name, MEF_BASE_FILE_NAME_BYTES);
+    synth->rate = rate;
+    synth->block_samples = block_samples;
+    synth->seconds = seconds;
+    synth->gap_every = gap_every;
+    synth->gap_ms = 250.0;
+}
+
+// Writes the channel, with each block decoded both ways as it is written, regenerates what it holds and reads it.
+// Returns NULL on failure.
+static CHANNEL *write_test_channel(SYNTHETIC_CHANNEL *synth, si4 segments, SYNTHETIC_TRUTH *truth, si1 *path)
+{
+    CHANNEL *channel;
+    si4 decode_mismatches;
+
+    decode_mismatches = 0;
+    memset(truth, 0, sizeof(SYNTHETIC_TRUTH));
+    synthetic_channel_path(synth, path);
+    if (!write_synthetic_channel(synth, segments, &decode_mismatches) || (decode_mismatches > 0))
+    {
+        printf("Could not write channel %s (%d blocks decoded differently)\n", path, decode_mismatches);
+        return NULL;
+    }
+    if (!build_synthetic_truth(synth, segments, truth))
+    {
+        printf("Could not allocate the expected samples\n");
+        return NULL;
+    }
+    channel = read_MEF_channel(NULL, path, TIME_SERIES_CHANNEL_TYPE, NULL, NULL, MEF_FALSE, MEF_FALSE);
+    if ((channel == NULL) || (channel->channel_type != TIME_SERIES_CHANNEL_TYPE))
+    {
+        printf("Could not read channel %s\n", path);
+        free_synthetic_truth(truth);
+        return NULL;
+    }
+
+    return channel;
+}
+
+static void close_test_channel(CHANNEL *channel, SYNTHETIC_TRUTH *truth)
+{
+    release_channel_reader_state(channel);
+    free_channel(channel, MEF_TRUE);
+    free_synthetic_truth(truth);
+}
+
+// a value in [lo, hi)
+static si8 random_between(si8 lo, si8 hi)
+{
+    return lo + (si8) (((sf8) synthetic_random(&random_state) / 4294967296.0) * (sf8) (hi - lo));
+}
+
+static void print_result(si4 failures)
+{
+    if (failures == 0)
+        printf("Passed.\n");
+    else
+        printf("FAILED, %d checks.\n", failures);
+}
+
+// Reads n_windows random windows by time (and by sample, if by_sample) both through the fully opened channel and the
+// lazy one, which must return the same samples, and checks them against the truth.  Channel times are truth times
+// plus time_shift.  Returns the number of failed checks.
+static si4 compare_lazy_and_full(CHANNEL *channel, LAZY_MEF_CHANNEL *lazy, SYNTHETIC_TRUTH *truth, si8 time_shift, si4 n_windows, si4 by_sample)
+{
+    si4 *full_buf, *lazy_buf;
+    si8 start, end, max_window;
+    si4 i, n_full, n_lazy, failures;
+
+    max_window = (si8) (20.0 * truth->rate);
+    full_buf = (si4 *) malloc(sizeof(si4) * (size_t) (max_window + 1));
+    lazy_buf = (si4 *) malloc(sizeof(si4) * (size_t) (max_window + 1));
+    failures = 0;
+
+    for (i = 0; i < n_windows; i++)
+    {
+        start = random_between(channel->earliest_start_time, channel->latest_end_time - 20000000);
+        end = start + random_between(1000000, 20000000);
+        n_full = read_mef_ts_data_by_time(NULL, NULL, start, end, full_buf, channel);
+        n_lazy = read_lazy_mef_ts_data_by_time(lazy, start, end, lazy_buf);
+        if ((n_full != n_lazy) || ((n_full > 0) && memcmp(full_buf, lazy_buf, sizeof(si4) * (size_t) n_full)))
+        {
+            printf("Read of [%lld, %lld) by time: lazy channel returned %d samples, full channel %d, or they differ\n",
+                   (long long) start, (long long) end, n_lazy, n_full);
+            failures++;
+        }
+        else if (!check_synthetic_read(truth, start - time_shift, end - time_shift, 1, full_buf, n_full))
+            failures++;
+
+        if (!by_sample)
+            continue;
+        start = random_between(0, truth->number_of_samples - max_window);
+        end = start + random_between(1, max_window);
+        n_full = read_mef_ts_data_by_samp(NULL, NULL, start, end, full_buf, channel);
+        n_lazy = read_lazy_mef_ts_data_by_samp(lazy, start, end, lazy_buf);
+        if ((n_full != n_lazy) || ((n_full > 0) && memcmp(full_buf, lazy_buf, sizeof(si4) * (size_t) n_full)))
+        {
+            printf("Read of [%lld, %lld) by sample: lazy channel returned %d samples, full channel %d, or they differ\n",
+                   (long long) start, (long long) end, n_lazy, n_full);
+            failures++;
+        }
+        else if (!check_synthetic_read(truth, start, end, 0, full_buf, n_full))
+            failures++;
+    }
+
+    free (full_buf);
+    free (lazy_buf);
+
+    return failures;
+}
+
+// checks the lazy channel's segment bounds against the channel's segments
+static si4 check_lazy_bounds(LAZY_MEF_CHANNEL *lazy, CHANNEL *channel)
+{
+    LAZY_SEGMENT_BOUNDS *bounds;
+    TIME_SERIES_METADATA_SECTION_2 *seg_md;
+    si8 n_segments, s, start_time;
+    si4 failures;
+
+    failures = 0;
+    n_segments = get_lazy_mef_channel_bounds(lazy, &bounds);
+    if (n_segments != channel->number_of_segments)
+    {
+        printf("Lazy channel has %lld segments, expected %lld\n", (long long) n_segments, (long long) channel->number_of_segments);
+        return 1;
+    }
+    for (s = 0; s < n_segments; s++)
+    {
+        seg_md = channel->segments[s].metadata_fps->metadata.time_series_section_2;
+        start_time = channel->segments[s].time_series_indices_fps->time_series_indices[0].start_time;
+        remove_recording_time_offset(&start_time);
+        if ((bounds[s].start_time != start_time) || (bounds[s].start_sample != seg_md->start_sample) ||
+            (bounds[s].end_sample != seg_md->start_sample + seg_md->number_of_samples) || (bounds[s].number_of_blocks != seg_md->number_of_blocks))
+        {
+            printf("Lazy segment %lld bounds: start time %lld, samples [%lld, %lld), %lld blocks; expected %lld, [%lld, %lld), %lld blocks\n",
+                   (long long) s, (long long) bounds[s].start_time, (long long) bounds[s].start_sample, (long long) bounds[s].end_sample,
+                   (long long) bounds[s].number_of_blocks, (long long) start_time, (long long) seg_md->start_sample,
+                   (long long) (seg_md->start_sample + seg_md->number_of_samples), (long long) seg_md->number_of_blocks);
+            failures++;
+        }
+    }
+    if ((bounds[0].start_time != channel->earliest_start_time) || (bounds[n_segments - 1].end_time != channel->latest_end_time))
+    {
+        printf("Lazy channel spans [%lld, %lld), the full channel [%lld, %lld)\n", (long long) bounds[0].start_time,
+               (long long) bounds[n_segments - 1].end_time, (long long) channel->earliest_start_time, (long long) channel->latest_end_time);
+        failures++;
+    }
+
+    return failures;
+}
+
+// sets the modification time of a segment's data file
+static si4 set_segment_modified(SYNTHETIC_CHANNEL *synth, si1 *channel_path, si4 segment, time_t modified)
+{
+    struct utimbuf times;
+    si1 segment_name[MEF_BASE_FILE_NAME_BYTES], file_name[MEF_FULL_FILE_NAME_BYTES];
+
+    synthetic_segment_name(synth, segment, segment_name);
+    MEF_snprintf(file_name, MEF_FULL_FILE_NAME_BYTES, "%s/%s.%s/%s.%s", channel_path, segment_name, SEGMENT_DIRECTORY_TYPE_STRING,
+                 segment_name, TIME_SERIES_DATA_FILE_TYPE_STRING);
+    times.actime = times.modtime = modified;
+
+    return utime(file_name, &times) == 0;
+}
+
+/**************************  Tests  ****************************/
+
+// lazy channels return what the fully opened channel returns, by time and by sample, and have its segment bounds
+static si4 test_lazy_reads(void)
+{
+    SYNTHETIC_CHANNEL synth;
+    SYNTHETIC_TRUTH truth;
+    CHANNEL *channel;
+    LAZY_MEF_CHANNEL *lazy;
+    si1 path[MEF_FULL_FILE_NAME_BYTES];
+    si4 failures;
+
+    test_synthetic_channel(&synth, "lazy", 256.0, 500, 120.0, 7);
+    if ((channel = write_test_channel(&synth, 3, &truth, path)) == NULL)
+        return 1;
+    lazy = open_lazy_mef_channel(path, NULL);
+    if (lazy == NULL)
+    {
+        printf("Could not open lazy channel %s\n", path);
+        close_test_channel(channel, &truth);
+        return 1;
+    }
+
+    failures = check_lazy_bounds(lazy, channel);
+    failures += compare_lazy_and_full(channel, lazy, &truth, 0, 200, 1);
+
+    close_lazy_mef_channel(lazy);
+    close_test_channel(channel, &truth);
+
+    return failures;
+}
+
+// an index sidecar is used while fresh, and ignored once a segment file is newer or segments are added
+static si4 test_sidecar(void)
+{
+    SYNTHETIC_CHANNEL synth;
+    SYNTHETIC_TRUTH truth;
+    CHANNEL *channel;
+    LAZY_MEF_CHANNEL *lazy;
+    si1 path[MEF_FULL_FILE_NAME_BYTES];
+    si4 failures, step;
+    time_t now;
+
+    test_synthetic_channel(&synth, "sidecar", 1000.0, 1000, 30.0, 0);
+    if ((channel = write_test_channel(&synth, 2, &truth, path)) == NULL)
+        return 1;
+    failures = 0;
+    now = time(NULL);
+
+    // step 0: fresh sidecar; 1: a segment file modified after it; 2: the segment file older again; 3: a segment added;
+    // 4: the sidecar rewritten
+    for (step = 0; step < 5; step++)
+    {
+        switch (step)
+        {
+            case 0:
+                if (!write_mef_channel_index_sidecar(path, NULL))
+                {
+                    printf("Could not write the index sidecar of %s\n", path);
+                    failures++;
+                }
+                break;
+            case 1:
+                if (!set_segment_modified(&synth, path, 0, now + 60))
+                    failures++;
+                break;
+            case 2:
+                if (!set_segment_modified(&synth, path, 0, now - 60))
+                    failures++;
+                break;
+            case 3:
+                close_test_channel(channel, &truth);
+                if (!append_synthetic_segment(&synth, NULL) || !build_synthetic_truth(&synth, 3, &truth))
+                {
+                    printf("Could not add a segment to %s\n", path);
+                    return failures + 1;
+                }
+                channel = read_MEF_channel(NULL, path, TIME_SERIES_CHANNEL_TYPE, NULL, NULL, MEF_FALSE, MEF_FALSE);
+                if (channel == NULL)
+                {
+                    printf("Could not read channel %s\n", path);
+                    free_synthetic_truth(&truth);
+                    return failures + 1;
+                }
+                break;
+            case 4:
+                if (!write_mef_channel_index_sidecar(path, NULL))
+                {
+                    printf("Could not rewrite the index sidecar of %s\n", path);
+                    failures++;
+                }
+                break;
+        }
+
+        // the sidecar is fresh at steps 0, 2 and 4, and a lazy channel uses it exactly when it is
+        if ((mef_channel_index_sidecar_is_fresh(path) != 0) != ((step % 2) == 0))
+        {
+            printf("Step %d: the index sidecar is %s, expected %s\n", step, (step % 2) ? "fresh" : "stale", (step % 2) ? "stale" : "fresh");
+            failures++;
+        }
+        lazy = open_lazy_mef_channel(path, NULL);
+        if (lazy == NULL)
+        {
+            printf("Step %d: could not open lazy channel %s\n", step, path);
+            failures++;
+            continue;
+        }
+        if ((get_lazy_mef_channel_block_index(lazy) != NULL) != ((step % 2) == 0))
+        {
+            printf("Step %d: the lazy channel %s the index sidecar\n", step, (step % 2) ? "used" : "did not use");
+            failures++;
+        }
+        failures += check_lazy_bounds(lazy, channel);
+        failures += compare_lazy_and_full(channel, lazy, &truth, 0, 50, 1);
+        close_lazy_mef_channel(lazy);
+    }
+
+    close_test_channel(channel, &truth);
+
+    return failures;
+}
+
+// refresh_mef_channel() picks up an appended segment, and read_mef_ts_data_since() returns each sample once
+static si4 test_refresh(void)
+{
+    SYNTHETIC_CHANNEL synth;
+    SYNTHETIC_TRUTH truth;
+    CHANNEL *channel;
+    si1 path[MEF_FULL_FILE_NAME_BYTES];
+    si4 *samp_buf;
+    si8 next_sample, appended, segment_samples;
+    si4 failures, n;
+
+    test_synthetic_channel(&synth, "refresh", 1000.0, 1000, 30.0, 0);
+    if ((channel = write_test_channel(&synth, 2, &truth, path)) == NULL)
+        return 1;
+    failures = 0;
+    segment_samples = (si8) (synth.seconds * synth.rate);
+    samp_buf = (si4 *) malloc(sizeof(si4) * (size_t) (4 * segment_samples));     // room for the gaps of reads by time
+
+    // everything recorded so far
+    next_sample = 0;
+    n = read_mef_ts_data_since(channel, &next_sample, samp_buf, (si4) (3 * segment_samples));
+    if ((n != 2 * segment_samples) || (next_sample != 2 * segment_samples) || !check_synthetic_read(&truth, 0, n, 0, samp_buf, n))
+    {
+        printf("Reading since sample 0 returned %d samples, expected %lld\n", n, (long long) (2 * segment_samples));
+        failures++;
+    }
+    if (read_mef_ts_data_since(channel, &next_sample, samp_buf, (si4) (3 * segment_samples)) != 0)
+    {
+        printf("Reading past the end returned samples\n");
+        failures++;
+    }
+
+    // a segment appended while the channel is open
+    free_synthetic_truth(&truth);
+    if (!append_synthetic_segment(&synth, NULL) || !build_synthetic_truth(&synth, 3, &truth))
+    {
+        printf("Could not add a segment to %s\n", path);
+        free (samp_buf);
+        release_channel_reader_state(channel);
+        free_channel(channel, MEF_TRUE);
+        return failures + 1;
+    }
+    appended = refresh_mef_channel(channel, NULL);
+    if ((appended != segment_samples) || (channel->number_of_segments != 3))
+    {
+        printf("Refresh appended %lld samples and has %lld segments, expected %lld and 3\n", (long long) appended,
+               (long long) channel->number_of_segments, (long long) segment_samples);
+        failures++;
+    }
+
+    // the new samples, then nothing
+    n = read_mef_ts_data_since(channel, &next_sample, samp_buf, (si4) (3 * segment_samples));
+    if ((n != segment_samples) || (next_sample != 3 * segment_samples) ||
+        !check_synthetic_read(&truth, 2 * segment_samples, 3 * segment_samples, 0, samp_buf, n))
+    {
+        printf("Reading since the refresh returned %d samples, expected %lld\n", n, (long long) segment_samples);
+        failures++;
+    }
+    if (read_mef_ts_data_since(channel, &next_sample, samp_buf, (si4) (3 * segment_samples)) != 0)
+    {
+        printf("Reading past the end after the refresh returned samples\n");
+        failures++;
+    }
+
+    // and reads by time reach the new segment
+    n = read_mef_ts_data_by_time(NULL, NULL, truth.block_start_time[0], truth.block_start_time[truth.number_of_blocks - 1] + 1000000, samp_buf, channel);
+    if (!check_synthetic_read(&truth, truth.block_start_time[0], truth.block_start_time[truth.number_of_blocks - 1] + 1000000, 1, samp_buf, n))
+        failures++;
+
+    free (samp_buf);
+    close_test_channel(channel, &truth);
+
+    return failures;
+}
+
+// every epoch of read_mef_ts_epochs_by_time() holds what read_mef_ts_data_by_time() returns for its window
+static si4 test_epochs(void)
+{
+    SYNTHETIC_CHANNEL synth;
+    SYNTHETIC_TRUTH truth;
+    CHANNEL *channel;
+    si1 path[MEF_FULL_FILE_NAME_BYTES];
+    si8 start_times[50], end_times[50], samples_per_epoch, i;
+    si4 samples_returned[50], *epoch_buf, *samp_buf, *epoch;
+    si4 failures, n_epochs, n_with_data, n_read, e, n;
+
+    test_synthetic_channel(&synth, "epochs", 256.0, 500, 120.0, 7);
+    if ((channel = write_test_channel(&synth, 2, &truth, path)) == NULL)
+        return 1;
+    failures = 0;
+    n_epochs = 50;
+    samples_per_epoch = (si8) (5.0 * synth.rate) + 1;
+    epoch_buf = (si4 *) malloc(sizeof(si4) * (size_t) (n_epochs * samples_per_epoch));
+    samp_buf = (si4 *) malloc(sizeof(si4) * (size_t) samples_per_epoch);
+
+    // random windows, overlapping and in any order, and one before the recording
+    for (e = 0; e < n_epochs - 1; e++)
+    {
+        start_times[e] = random_between(channel->earliest_start_time, channel->latest_end_time - 5000000);
+        end_times[e] = start_times[e] + random_between(100000, 5000000);
+    }
+    start_times[e] = channel->earliest_start_time - 10000000;
+    end_times[e] = channel->earliest_start_time - 5000000;
+
+    n_read = read_mef_ts_epochs_by_time(NULL, NULL, start_times, end_times, n_epochs, epoch_buf, samples_per_epoch, samples_returned, channel);
+    n_with_data = 0;
+    for (e = 0; e < n_epochs; e++)
+    {
+        epoch = epoch_buf + (e * samples_per_epoch);
+        if (samples_returned[e] > 0)
+            n_with_data++;
+        n = (e < n_epochs - 1) ? read_mef_ts_data_by_time(NULL, NULL, start_times[e], end_times[e], samp_buf, channel) : 0;
+        if ((n != samples_returned[e]) || ((n > 0) && memcmp(epoch, samp_buf, sizeof(si4) * (size_t) n)))
+        {
+            printf("Epoch %d [%lld, %lld): %d samples, a read by time returns %d, or they differ\n", e, (long long) start_times[e],
+                   (long long) end_times[e], samples_returned[e], n);
+            failures++;
+            continue;
+        }
+        for (i = n; i < samples_per_epoch; i++)
+        {
+            if (epoch[i] != RED_NAN)
+            {
+                printf("Epoch %d: sample %lld past its end is %d, not NaN\n", e, (long long) i, epoch[i]);
+                failures++;
+                break;
+            }
+        }
+    }
+    if (n_read != n_with_data)
+    {
+        printf("%d epochs returned data, expected %d\n", n_read, n_with_data);
+        failures++;
+    }
+
+    free (epoch_buf);
+    free (samp_buf);
+    close_test_channel(channel, &truth);
+
+    return failures;
+}
+
+// Envelopes match the extrema of the samples a plain read returns, binned by sample time as the envelope bins them,
+// with bins narrower and wider than blocks; bins not wholly covered by blocks are marked as gaps.
+static si4 test_envelope(void)
+{
+    SYNTHETIC_CHANNEL synth;
+    SYNTHETIC_TRUTH truth;
+    CHANNEL *channel;
+    si1 path[MEF_FULL_FILE_NAME_BYTES];
+    si4 *bin_min, *bin_max, *expected_min, *expected_max, *samp_buf;
+    ui1 *bin_gap, *expected_gap;
+    sf8 *covered, bin_width, period, lo, hi;
+    si8 start, end, block_start, block_end, sample_time, bin, last_bin, k;
+    si4 failures, w, n_bins, n, i;
+    static const si4 bins_per_window[4] = {7, 100, 1000, 5000};
+
+    test_synthetic_channel(&synth, "envelope", 256.0, 500, 120.0, 7);
+    if ((channel = write_test_channel(&synth, 2, &truth, path)) == NULL)
+        return 1;
+    failures = 0;
+    period = 1e6 / synth.rate;
+    bin_min = (si4 *) malloc(sizeof(si4) * 5000);
+    bin_max = (si4 *) malloc(sizeof(si4) * 5000);
+    expected_min = (si4 *) malloc(sizeof(si4) * 5000);
+    expected_max = (si4 *) malloc(sizeof(si4) * 5000);
+    bin_gap = (ui1 *) malloc(5000);
+    expected_gap = (ui1 *) malloc(5000);
+    covered = (sf8 *) malloc(sizeof(sf8) * 5000);
+    samp_buf = (si4 *) malloc(sizeof(si4) * (size_t) synth.block_samples);
+
+    for (w = 0; w < 40; w++)
+    {
+        n_bins = bins_per_window[w % 4];
+        start = random_between(channel->earliest_start_time - 1000000, channel->latest_end_time - 1000000);
+        end = start + random_between(1000000, 100000000);
+        if (read_mef_ts_envelope_by_time(NULL, NULL, start, end, n_bins, bin_min, bin_max, bin_gap, channel) != n_bins)
+        {
+            printf("Envelope of [%lld, %lld) in %d bins failed\n", (long long) start, (long long) end, n_bins);
+            failures++;
+            continue;
+        }
+
+        // every block overlapping the window, read by sample, each sample binned by its time
+        bin_width = (end - start) / (sf8) n_bins;
+        for (bin = 0; bin < n_bins; bin++)
+        {
+            expected_min[bin] = expected_max[bin] = RED_NAN;
+            covered[bin] = 0.0;
+        }
+        for (k = 0; k < truth.number_of_blocks; k++)
+        {
+            block_start = truth.block_start_time[k];
+            block_end = block_start + (si8) ((truth.block_samples[k] * period) + 0.5);
+            if ((block_end <= start) || (block_start >= end))
+                continue;
+            n = read_mef_ts_data_by_samp(NULL, NULL, truth.block_start_sample[k], truth.block_start_sample[k] + truth.block_samples[k], samp_buf, channel);
+            if (n != truth.block_samples[k])
+            {
+                printf("Read of block %lld returned %d samples\n", (long long) k, n);
+                failures++;
+                continue;
+            }
+            for (i = 0; i < n; i++)
+            {
+                sample_time = block_start + (si8) ((i * period) + 0.5);
+                if ((sample_time < start) || (sample_time >= end))
+                    continue;
+                bin = (si8) ((sample_time - start) / bin_width);
+                if (bin >= n_bins)
+                    bin = n_bins - 1;
+                if ((expected_min[bin] == RED_NAN) || (samp_buf[i] < expected_min[bin]))
+                    expected_min[bin] = samp_buf[i];
+                if ((expected_max[bin] == RED_NAN) || (samp_buf[i] > expected_max[bin]))
+                    expected_max[bin] = samp_buf[i];
+            }
+            bin = (si8) ((block_start - start) / bin_width);
+            last_bin = (si8) ((block_end - 1 - start) / bin_width);
+            for (bin = (bin < 0) ? 0 : bin; (bin <= last_bin) && (bin < n_bins); bin++)
+            {
+                lo = start + (bin * bin_width);
+                hi = lo + bin_width;
+                if (block_start > lo)
+                    lo = (sf8) block_start;
+                if (block_end < hi)
+                    hi = (sf8) block_end;
+                if (hi > lo)
+                    covered[bin] += hi - lo;
+            }
+        }
+        for (bin = 0; bin < n_bins; bin++)
+        {
+            expected_gap[bin] = ((covered[bin] <= 0.0) || (covered[bin] < bin_width - period)) ? 1 : 0;
+            if ((bin_min[bin] != expected_min[bin]) || (bin_max[bin] != expected_max[bin]) || (bin_gap[bin] != expected_gap[bin]))
+            {
+                printf("Envelope of [%lld, %lld) in %d bins: bin %lld is [%d, %d] gap %d, expected [%d, %d] gap %d\n", (long long) start,
+                       (long long) end, n_bins, (long long) bin, bin_min[bin], bin_max[bin], bin_gap[bin], expected_min[bin],
+                       expected_max[bin], expected_gap[bin]);
+                failures++;
+                break;
+            }
+        }
+    }
+
+    free (bin_min);
+    free (bin_max);
+    free (expected_min);
+    free (expected_max);
+    free (bin_gap);
+    free (expected_gap);
+    free (covered);
+    free (samp_buf);
+    close_test_channel(channel, &truth);
+
+    return failures;
+}
+
+// resampled reads of a constant and of a tone match the signal at each output time, within the filter's pass band
+// ripple and the rounding of the samples; outputs whose filter reaches past the recording are NaN
+static si4 test_resampler(void)
+{
+    SYNTHETIC_CHANNEL synth;
+    SYNTHETIC_TRUTH truth;
+    CHANNEL *channel;
+    si1 path[MEF_FULL_FILE_NAME_BYTES];
+    sf8 *data, expected, tolerance, t;
+    si8 start, end, k;
+    si4 failures, signal, r, n, n_expected;
+    static const sf8 output_rates[3] = {250.0, 300.0, 1000.0};
+
+    failures = 0;
+    for (signal = SYNTHETIC_SIGNAL_DC; signal <= SYNTHETIC_SIGNAL_TONE; signal++)
+    {
+        test_synthetic_channel(&synth, (signal == SYNTHETIC_SIGNAL_DC) ? "dc" : "tone", 1000.0, 1000, 60.0, 0);
+        synth.signal = signal;
+        synth.amplitude = (signal == SYNTHETIC_SIGNAL_DC) ? 1234.0 : 2000.0;
+        synth.frequency = 10.0;
+        if ((channel = write_test_channel(&synth, 1, &truth, path)) == NULL)
+            return failures + 1;
+        tolerance = (1e-3 * synth.amplitude) + 1.0;
+        data = (sf8 *) malloc(sizeof(sf8) * 10000);
+
+        for (r = 0; r < 3; r++)
+        {
+            // ten seconds from the middle of the recording, starting on a sample
+            start = synth.start_time + 20000000;
+            end = start + 10000000;
+            n_expected = (si4) (((end - start) / 1e6) * output_rates[r]);
+            n = read_mef_ts_data_resampled_by_time(NULL, NULL, start, end, output_rates[r], data, channel);
+            if (n != n_expected)
+            {
+                printf("Resampled read at %.0f Hz returned %d samples, expected %d\n", output_rates[r], n, n_expected);
+                failures++;
+                continue;
+            }
+            for (k = 0; k < n; k++)
+            {
+                t = ((start - synth.start_time) / 1e6) + (k / output_rates[r]);
+                expected = (signal == SYNTHETIC_SIGNAL_DC) ? synth.amplitude : synth.amplitude * sin(2.0 * M_PI * synth.frequency * t);
+                if (isnan(data[k]) || (fabs(data[k] - expected) > tolerance))
+                {
+                    printf("%s resampled at %.0f Hz: output %lld is %f, expected %f\n", synth.name, output_rates[r], (long long) k, data[k], expected);
+                    failures++;
+                    break;
+                }
+            }
+
+            // at the start of the recording, the first outputs have no input before them
+            n = read_mef_ts_data_resampled_by_time(NULL, NULL, synth.start_time, synth.start_time + 1000000, output_rates[r], data, channel);
+            if ((output_rates[r] < synth.rate) && ((n <= 0) || !isnan(data[0])))
+            {
+                printf("%s resampled at %.0f Hz from the start of the recording: output 0 is %f, not NaN\n", synth.name, output_rates[r],
+                       (n > 0) ? data[0] : 0.0);
+                failures++;
+            }
+        }
+
+        free (data);
+        close_test_channel(channel, &truth);
+    }
+
+    return failures;
+}
+
+// Pyramid reads match minima, maxima and means computed from the samples: each pyramid bin (base_bin_samples << level
+// samples of a continuous range) summarized by brute force, and spread over the output bins it overlaps as
+// read_mef_pyramid_by_time() spreads them.
+static si4 test_pyramid(void)
+{
+    SYNTHETIC_CHANNEL synth;
+    SYNTHETIC_TRUTH truth;
+    CHANNEL *channel;
+    MEF_PYRAMID *pyramid;
+    si1 path[MEF_FULL_FILE_NAME_BYTES];
+    si4 *bin_min, *bin_max, *expected_min, *expected_max, level, failures, w, n_bins, value, bin_minimum, bin_maximum;
+    sf8 *bin_mean, *sums, *counts, bin_width, level_bin_duration, range_start, range_end, t0, t1, expected_mean;
+    si8 start, end, bin_samples, k, end_k, r_first, r_end, first_sample, last_sample, s, out, last_out, count;
+    sf8 sum;
+    static const si4 bins_per_window[3] = {10, 100, 1000};
+
+    test_synthetic_channel(&synth, "pyramid", 1000.0, 1000, 120.0, 10);
+    if ((channel = write_test_channel(&synth, 2, &truth, path)) == NULL)
+        return 1;
+    if (!write_mef_channel_pyramid(path, NULL) || ((pyramid = open_mef_pyramid(path)) == NULL))
+    {
+        printf("Could not write and open the pyramid of %s\n", path);
+        close_test_channel(channel, &truth);
+        return 1;
+    }
+    failures = 0;
+    bin_min = (si4 *) malloc(sizeof(si4) * 1000);
+    bin_max = (si4 *) malloc(sizeof(si4) * 1000);
+    bin_mean = (sf8 *) malloc(sizeof(sf8) * 1000);
+    expected_min = (si4 *) malloc(sizeof(si4) * 1000);
+    expected_max = (si4 *) malloc(sizeof(si4) * 1000);
+    sums = (sf8 *) malloc(sizeof(sf8) * 1000);
+    counts = (sf8 *) malloc(sizeof(sf8) * 1000);
+
+    for (w = 0; w < 30; w++)
+    {
+        n_bins = bins_per_window[w % 3];
+        start = random_between(channel->earliest_start_time - 1000000, channel->latest_end_time - 1000000);
+        end = start + random_between(1000000, 250000000);
+        if (read_mef_pyramid_by_time(pyramid, start, end, n_bins, bin_min, bin_max, bin_mean) != n_bins)
+        {
+            printf("Pyramid read of [%lld, %lld) in %d bins failed\n", (long long) start, (long long) end, n_bins);
+            failures++;
+            continue;
+        }
+
+        level = get_mef_pyramid_level(pyramid, start, end, n_bins);
+        bin_width = (end - start) / (sf8) n_bins;
+        bin_samples = (si8) MEF_PYRAMID_BASE_BIN_SAMPLES << level;
+        level_bin_duration = (sf8) bin_samples * (1e6 / synth.rate);
+        for (out = 0; out < n_bins; out++)
+        {
+            expected_min[out] = expected_max[out] = RED_NAN;
+            sums[out] = counts[out] = 0.0;
+        }
+
+        // continuous ranges of the truth: runs of blocks each starting where the one before ends
+        for (r_first = 0; r_first < truth.number_of_blocks; r_first = r_end)
+        {
+            for (r_end = r_first + 1; r_end < truth.number_of_blocks; r_end++)
+                if (truth.block_start_time[r_end] != truth.block_start_time[r_end - 1] + (si8) (((truth.block_samples[r_end - 1] / synth.rate) * 1e6) + 0.5))
+                    break;
+            range_start = (sf8) truth.block_start_time[r_first];
+            range_end = (sf8) (truth.block_start_time[r_end - 1] + (si8) ((truth.block_samples[r_end - 1] / synth.rate) * 1e6));
+            if ((range_end <= start) || (range_start >= end))
+                continue;
+            first_sample = truth.block_start_sample[r_first];
+            last_sample = truth.block_start_sample[r_end - 1] + truth.block_samples[r_end - 1];
+
+            k = (start > range_start) ? (si8) ((start - range_start) / level_bin_duration) : 0;
+            end_k = (si8) ceil((((end < range_end) ? end : range_end) - range_start) / level_bin_duration);
+            for (; (k < end_k) && (first_sample + (k * bin_samples) < last_sample); k++)
+            {
+                // the pyramid bin, from the samples
+                sum = 0.0;
+                count = 0;
+                bin_minimum = bin_maximum = RED_NAN;
+                for (s = first_sample + (k * bin_samples); (s < first_sample + ((k + 1) * bin_samples)) && (s < last_sample); s++)
+                {
+                    value = truth.samples[s];
+                    if ((bin_minimum == RED_NAN) || (value < bin_minimum))
+                        bin_minimum = value;
+                    if ((bin_maximum == RED_NAN) || (value > bin_maximum))
+                        bin_maximum = value;
+                    sum += value;
+                    count++;
+                }
+
+                // the output bins it overlaps
+                t0 = range_start + (k * level_bin_duration);
+                t1 = t0 + level_bin_duration;
+                if (t1 > range_end)
+                    t1 = range_end;
+                out = (t0 > start) ? (si8) ((t0 - start) / bin_width) : 0;
+                last_out = (si8) ceil((t1 - start) / bin_width) - 1;
+                if (last_out >= n_bins)
+                    last_out = n_bins - 1;
+                for (; out <= last_out; out++)
+                {
+                    if ((expected_min[out] == RED_NAN) || (bin_minimum < expected_min[out]))
+                        expected_min[out] = bin_minimum;
+                    if ((expected_max[out] == RED_NAN) || (bin_maximum > expected_max[out]))
+                        expected_max[out] = bin_maximum;
+                    sums[out] += sum;
+                    counts[out] += count;
+                }
+            }
+        }
+
+        for (out = 0; out < n_bins; out++)
+        {
+            expected_mean = (counts[out] > 0.0) ? sums[out] / counts[out] : NAN;
+            if ((bin_min[out] != expected_min[out]) || (bin_max[out] != expected_max[out]) || (isnan(bin_mean[out]) != isnan(expected_mean)) ||
+                (!isnan(expected_mean) && (fabs(bin_mean[out] - expected_mean) > 1e-6 * (1.0 + fabs(expected_mean)))))
+            {
+                printf("Pyramid read of [%lld, %lld) in %d bins (level %d): bin %lld is [%d, %d] mean %f, expected [%d, %d] mean %f\n",
+                       (long long) start, (long long) end, n_bins, level, (long long) out, bin_min[out], bin_max[out], bin_mean[out],
+                       expected_min[out], expected_max[out], expected_mean);
+                failures++;
+                break;
+            }
+        }
+    }
+
+    free (bin_min);
+    free (bin_max);
+    free (bin_mean);
+    free (expected_min);
+    free (expected_max);
+    free (sums);
+    free (counts);
+    close_mef_pyramid(pyramid);
+    close_test_channel(channel, &truth);
+
+    return failures;
+}
+
+// what verify_mef_channel() reported
+typedef struct {
+    si4     n_errors;
+    MEF_VERIFY_ERROR    first;
+} VERIFY_REPORTS;
+
+static void verify_error(void *user_data, MEF_VERIFY_ERROR *error)
+{
+    VERIFY_REPORTS *reports;
+
+    reports = (VERIFY_REPORTS *) user_data;
+    if (reports->n_errors++ == 0)
+        reports->first = *error;
+}
+
+// verify_mef_channel() passes a good channel, and reports a block with a byte of its data changed as a CRC failure
+static si4 test_verify(void)
+{
+    SYNTHETIC_CHANNEL synth;
+    SYNTHETIC_TRUTH truth;
+    CHANNEL *channel;
+    MEF_VERIFY_OPTIONS options;
+    MEF_VERIFY_PROGRESS result;
+    VERIFY_REPORTS reports;
+    TIME_SERIES_INDEX *tsi;
+    FILE *fp;
+    si1 path[MEF_FULL_FILE_NAME_BYTES], segment_name[MEF_BASE_FILE_NAME_BYTES], file_name[MEF_FULL_FILE_NAME_BYTES];
+    si8 bad_blocks;
+    si4 failures, byte, pass;
+
+    test_synthetic_channel(&synth, "verify", 1000.0, 1000, 30.0, 0);
+    if ((channel = write_test_channel(&synth, 2, &truth, path)) == NULL)
+        return 1;
+    failures = 0;
+    tsi = channel->segments[1].time_series_indices_fps->time_series_indices + 7;
+    initialize_mef_verify_options(&options);
+    options.error_function = verify_error;
+    options.user_data = &reports;
+
+    for (pass = 0; pass < 2; pass++)
+    {
+        // second pass: one byte of the data of segment 1, block 7 inverted
+        if (pass == 1)
+        {
+            synthetic_segment_name(&synth, 1, segment_name);
+            MEF_snprintf(file_name, MEF_FULL_FILE_NAME_BYTES, "%s/%s.%s/%s.%s", path, segment_name, SEGMENT_DIRECTORY_TYPE_STRING,
+                         segment_name, TIME_SERIES_DATA_FILE_TYPE_STRING);
+            fp = fopen(file_name, "r+b");
+            if (fp == NULL)
+            {
+                printf("Could not open %s\n", file_name);
+                failures++;
+                break;
+            }
+            fseek(fp, tsi->file_offset + RED_BLOCK_HEADER_BYTES + 10, SEEK_SET);
+            byte = fgetc(fp);
+            fseek(fp, tsi->file_offset + RED_BLOCK_HEADER_BYTES + 10, SEEK_SET);
+            fputc(byte ^ 0xFF, fp);
+            fclose(fp);
+        }
+
+        memset(&reports, 0, sizeof(reports));
+        bad_blocks = verify_mef_channel(path, NULL, &options, &result, NULL);
+        if ((bad_blocks != pass) || (reports.n_errors != pass) || (result.bad_blocks != pass) || (result.blocks_checked != truth.number_of_blocks))
+        {
+            printf("Verification %d: %lld bad blocks, %d reported, %lld of %lld blocks checked; expected %d bad\n", pass, (long long) bad_blocks,
+                   reports.n_errors, (long long) result.blocks_checked, (long long) truth.number_of_blocks, pass);
+            failures++;
+        }
+        else if ((pass == 1) && ((reports.first.segment != 1) || (reports.first.block != 7) || (reports.first.error != VERIFY_BLOCK_BAD_CRC) ||
+                                 (reports.first.file_offset != tsi->file_offset)))
+        {
+            printf("Verification reported segment %d block %lld at offset %lld, error %d; expected segment 1 block 7 at %lld, error %d\n",
+                   reports.first.segment, (long long) reports.first.block, (long long) reports.first.file_offset, reports.first.error,
+                   (long long) tsi->file_offset, VERIFY_BLOCK_BAD_CRC);
+            failures++;
+        }
+    }
+
+    close_test_channel(channel, &truth);
+
+    return failures;
+}
+
+// A channel written with a recording time offset: the lazy channel's times and reads by time are the full channel's,
+// and both return the samples written.  Reads by sample aren't checked, as sample times of such channels aren't
+// consistent between the module's index and meflib's conversions.  Run last, as reading the channel sets meflib's
+// recording time offset for the process.
+static si4 test_recording_time_offset(void)
+{
+    SYNTHETIC_CHANNEL synth;
+    SYNTHETIC_TRUTH truth;
+    CHANNEL *channel;
+    LAZY_MEF_CHANNEL *lazy;
+    si1 path[MEF_FULL_FILE_NAME_BYTES];
+    si4 failures;
+
+    test_synthetic_channel(&synth, "offset", 256.0, 500, 120.0, 7);
+    synth.recording_time_offset = synth.start_time - 86400000000;     // stored times a day after the epoch
+    if ((channel = write_test_channel(&synth, 2, &truth, path)) == NULL)
+        return 1;
+    lazy = open_lazy_mef_channel(path, NULL);
+    if (lazy == NULL)
+    {
+        printf("Could not open lazy channel %s\n", path);
+        close_test_channel(channel, &truth);
+        return 1;
+    }
+
+    failures = check_lazy_bounds(lazy, channel);
+    failures += compare_lazy_and_full(channel, lazy, &truth, channel->earliest_start_time - truth.block_start_time[0], 200, 0);
+
+    close_lazy_mef_channel(lazy);
+    close_test_channel(channel, &truth);
+
+    return failures;
+}
+
+/**************************  Main  ****************************/
+
+int main(int argc, char **argv)
+{
+    si4 failures, total;
+
+    MEF_strncpy(test_dir, (argc > 1) ? argv[1] : "mef_test", MEF_FULL_FILE_NAME_BYTES);
+    (void) initialize_meflib();
+    MEF_globals->behavior_on_fail = RETURN_ON_FAIL;
+    total = 0;
+
+    printf("***** Test 1, lazy channel reads against full channel reads. *****\n");
+    total += (failures = test_lazy_reads());
+    print_result(failures);
+
+    printf("***** Test 2, index sidecar freshness. *****\n");
+    total += (failures = test_sidecar());
+    print_result(failures);
+
+    printf("***** Test 3, refresh and reading since a sample. *****\n");
+    total += (failures = test_refresh());
+    print_result(failures);
+
+    printf("***** Test 4, epoch reads against reads by time. *****\n");
+    total += (failures = test_epochs());
+    print_result(failures);
+
+    printf("***** Test 5, envelopes against plain reads. *****\n");
+    total += (failures = test_envelope());
+    print_result(failures);
+
+    printf("***** Test 6, resampled reads of a constant and a tone. *****\n");
+    total += (failures = test_resampler());
+    print_result(failures);
+
+    printf("***** Test 7, pyramid reads against brute force. *****\n");
+    total += (failures = test_pyramid());
+    print_result(failures);
+
+    printf("***** Test 8, verification of a corrupted block. *****\n");
+    total += (failures = test_verify());
+    print_result(failures);
+
+    printf("***** Test 9, reads of a channel with a recording time offset. *****\n");
+    total += (failures = test_recording_time_offset());
+    print_result(failures);
+
+    printf("All done, %d checks failed.\n", total);
+
+    return (total > 0) ? 1 : 0;
+}